@@ -0,0 +1,11 @@
+@echo off
+echo Building capture_tool (64-bit, C++17)...
+
+REM Set up the environment for MSVC (you may need to adjust the path)
+call "C:\Program Files\Microsoft Visual Studio\2022\Community\VC\Auxiliary\Build\vcvars64.bat"
+
+REM Compile the program for Release (Optimized for Speed and Size)
+cl.exe /EHsc /std:c++17 /O2 /GL /MD /D NDEBUG capture_tool.cpp /Fecapture_tool.exe /link /LTCG /OPT:REF /OPT:ICF
+
+echo Build completed successfully!
+pause
@@ -0,0 +1,6 @@
+#!/bin/sh
+# Builds capture_tool on Linux (g++ or clang++, C++17).
+set -e
+cd "$(dirname "$0")"
+${CXX:-g++} -std=c++17 -O2 -pthread -DNDEBUG capture_tool.cpp -o capture_tool
+echo "Build completed successfully!"
@@ -0,0 +1,3958 @@
+// Command-line utilities for captures written by Printer_Relay_Logger and its service.
+// Portable (Windows and Linux); see build_capture_tool.bat / build_capture_tool.sh.
+
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <filesystem>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <queue>
+#include <chrono>
+#include <ctime>
+#include <random>
+#include <map>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+#include "../Common/capture_format.h"
+#include "../Common/capture_reader.h"
+#include "../Common/capture_files.h"
+#include "../Common/pcapng_writer.h"
+#include "../Common/job_catalog.h"
+#include "../Common/crc32c.h"
+#include "../Common/escpos_parser.h"
+#include "../Common/byte_filter.h"
+#include "../Common/bit_unpack.h"
+#include "../Common/receipt_decoder.h"
+#include "../Common/receipt_tiles.h"
+#include "../Common/width_detect.h"
+#include "../Common/receipt_pipeline.h"
+#include "../Common/png_writer.h"
+#include "../Common/receipt_thumbnails.h"
+#include "../Common/receipt_tail.h"
+#include "../Common/job_text_index.h"
+#include "../Common/receipt_split.h"
+#include "../Common/receipt_diff.h"
+#include "../Common/job_hash_index.h"
+
+namespace fs = std::filesystem;
+
+
+// --- Helpers ---
+
+std::string ReplaceExtension(const std::string& path, const std::string& extension) {
+    return fs::path(path).replace_extension(extension).string();
+}
+
+// '*' matches any run of characters, '?' any one character
+bool MatchesWildcard(const std::string& name, const std::string& pattern) {
+    size_t n = 0, p = 0, star = std::string::npos, resume = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++n;
+            ++p;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            resume = n;
+        } else if (star != std::string::npos) {
+            p = star + 1;
+            n = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
+}
+
+// Expands directories to the captures they contain (oldest first) and wildcards in the file
+// name ("printer_data/data_*.bin", for shells that do not expand them) to the matching
+// files by name; other files are kept as given
+std::vector<fs::path> ExpandCaptureInputs(const std::vector<std::string>& inputs) {
+    std::vector<fs::path> paths;
+    for (const std::string& input : inputs) {
+        std::error_code ec;
+        fs::path path(input);
+        std::string name = path.filename().string();
+        if (fs::is_directory(input, ec)) {
+            for (const CaptureFileInfo& info : ListCaptureFiles(input)) paths.push_back(info.path);
+        } else if (name.find_first_of("*?") != std::string::npos) {
+            fs::path dir = path.parent_path().empty() ? fs::path(".") : path.parent_path();
+            std::vector<fs::path> matches;
+            for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+                if (it->is_regular_file(ec) && MatchesWildcard(it->path().filename().string(), name)) matches.push_back(it->path());
+            }
+            std::sort(matches.begin(), matches.end());
+            paths.insert(paths.end(), matches.begin(), matches.end());
+        } else {
+            paths.emplace_back(input);
+        }
+    }
+    return paths;
+}
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool ParseUnsigned(const std::string& text, uint64_t& value) {
+    if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos) return false;
+    try {
+        value = std::stoull(text);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// "YYYY-MM-DD", "YYYY-MM-DD HH:MM[:SS]" (local time, 'T' also accepted) or "@<unix seconds>"
+bool ParseTimeArgument(const std::string& text, uint64_t& unix_us) {
+    if (!text.empty() && text[0] == '@') {
+        uint64_t seconds = 0;
+        if (!ParseUnsigned(text.substr(1), seconds)) return false;
+        unix_us = seconds * 1000000ull;
+        return true;
+    }
+    std::tm tm = {};
+    int year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+    char sep = ' ';
+    int fields = std::sscanf(text.c_str(), "%4d-%2d-%2d%c%2d:%2d:%2d", &year, &month, &day, &sep, &hour, &minute, &second);
+    if (fields != 3 && fields < 6) return false;
+    if (fields > 3 && sep != ' ' && sep != 'T') return false;
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = second;
+    tm.tm_isdst = -1;
+    std::time_t t = std::mktime(&tm);
+    if (t == (std::time_t)-1) return false;
+    unix_us = (uint64_t)t * 1000000ull;
+    return true;
+}
+
+std::string FormatLocalTime(uint64_t unix_us) {
+    std::time_t t = (std::time_t)(unix_us / 1000000ull);
+    std::tm tm = {};
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    char ms[8];
+    std::snprintf(ms, sizeof(ms), ".%03u", (unsigned)(unix_us / 1000 % 1000));
+    return std::string(buf) + ms;
+}
+
+
+// One capture feeding the pcapng export. Raw .bin captures have no timing or upstream
+// endpoint, so their data is emitted at the filename timestamp towards the --printer endpoint.
+struct PcapngSource {
+    fs::path path;
+    bool framed = false;
+    uint64_t start_us = 0;
+    std::string client;
+    std::string upstream;
+
+    CaptureFile capture;
+    CaptureFile::FrameCursor cursor;
+    size_t raw_offset = 0;
+    PcapngWriter::Flow flow;
+    CaptureFrameKind kind = CaptureFrameKind::ClientToPrinter;
+    ByteSpan payload;
+    uint64_t next_time_us = 0;
+
+    // Reads the header only, so thousands of inputs can be ordered without being mapped at once
+    bool Probe(std::string& error) {
+        std::ifstream probe(path, std::ios::binary);
+        if (!probe) {
+            error = "cannot open";
+            return false;
+        }
+        uint8_t raw[CAPTURE_FILE_HEADER_SIZE] = {};
+        probe.read(reinterpret_cast<char*>(raw), sizeof(raw));
+        CaptureFileHeader header;
+        framed = DecodeCaptureFileHeader(raw, (size_t)probe.gcount(), header);
+        uint64_t name_time = 0;
+        ParseCaptureFilename(path.filename().string(), name_time, client);
+        start_us = framed ? header.start_unix_us : name_time;
+        return true;
+    }
+
+    bool Open(std::string& error) {
+        if (!capture.Open(path, error)) return false;
+        if (framed) {
+            client = capture.client().empty() ? client : capture.client();
+            upstream = capture.upstream();
+        }
+        return true;
+    }
+
+    // Points payload at the next data chunk in the mapping
+    bool Advance() {
+        if (!framed) {
+            ByteSpan file = capture.file();
+            payload = file.subspan(raw_offset, PCAPNG_MAX_SEGMENT);
+            raw_offset += payload.size;
+            kind = CaptureFrameKind::ClientToPrinter;
+            next_time_us = start_us;
+            return !payload.empty();
+        }
+        CaptureFrame frame;
+        while (capture.NextFrame(cursor, frame, payload)) {
+            if (frame.kind == CaptureFrameKind::Meta) continue;
+            kind = frame.kind;
+            next_time_us = start_us + frame.time_us;
+            return true;
+        }
+        return false;
+    }
+};
+
+
+// --- Verification ---
+
+enum class CaptureVerifyStatus {
+    Ok,
+    NoReference, // Nothing to compare against (raw capture without catalog entry, or pre-checksum capture)
+    Truncated,
+    Mismatch,
+    Error
+};
+
+const char* CaptureVerifyStatusName(CaptureVerifyStatus status) {
+    switch (status) {
+        case CaptureVerifyStatus::Ok: return "OK";
+        case CaptureVerifyStatus::NoReference: return "UNCHECKED";
+        case CaptureVerifyStatus::Truncated: return "TRUNCATED";
+        case CaptureVerifyStatus::Mismatch: return "MISMATCH";
+        case CaptureVerifyStatus::Error: return "ERROR";
+    }
+    return "?";
+}
+
+struct CaptureVerifyResult {
+    CaptureVerifyStatus status = CaptureVerifyStatus::Ok;
+    std::string detail;
+    uint64_t bytes = 0; // File size, for throughput
+};
+
+std::string HexByte(uint8_t value) {
+    char text[3];
+    std::snprintf(text, sizeof(text), "%02x", value);
+    return text;
+}
+
+std::string HexCrc(uint32_t crc) {
+    char buf[9];
+    std::snprintf(buf, sizeof(buf), "%08x", crc);
+    return buf;
+}
+
+// Checks the checksum frames of a framed capture, and the client -> printer stream against
+// the job record when one is given
+CaptureVerifyResult VerifyCapture(CaptureFile& capture, const JobRecord* job) {
+    CaptureVerifyResult result;
+    result.bytes = capture.file().size;
+    auto fail = [&result](CaptureVerifyStatus status, const std::string& detail) {
+        // Keep the first problem, but a mismatch outranks everything else
+        if (result.status == CaptureVerifyStatus::Ok ||
+            (status == CaptureVerifyStatus::Mismatch && result.status != CaptureVerifyStatus::Mismatch)) {
+            result.status = status;
+            result.detail = detail;
+        }
+    };
+
+    uint32_t crc[2] = { 0, 0 };
+    uint64_t bytes[2] = { 0, 0 };
+    bool final_seen[2] = { false, false };
+    uint64_t last_good[2] = { 0, 0 }; // Bytes covered by the last matching checksum
+    uint64_t checkpoints = 0;
+    if (capture.framed()) {
+        capture.ForEachFrame([&](const CaptureFrame& frame, ByteSpan payload) {
+            if (frame.kind == CaptureFrameKind::ClientToPrinter || frame.kind == CaptureFrameKind::PrinterToClient) {
+                int d = (int)frame.kind;
+                crc[d] = Crc32cUpdate(crc[d], payload.data, payload.size);
+                bytes[d] += payload.size;
+                return true;
+            }
+            CaptureChecksum checksum;
+            if (frame.kind != CaptureFrameKind::Meta || !ParseChecksumMeta(payload.data, payload.size, checksum) ||
+                (int)checksum.direction > 1) {
+                return true;
+            }
+            int d = (int)checksum.direction;
+            ++checkpoints;
+            if (checksum.bytes != bytes[d] || checksum.crc != crc[d]) {
+                fail(CaptureVerifyStatus::Mismatch, std::string(d == 0 ? "client->printer" : "printer->client") +
+                     " data differs between bytes " + std::to_string(last_good[d]) + " and " + std::to_string(checksum.bytes) +
+                     " (recorded " + HexCrc(checksum.crc) + ", computed " + HexCrc(crc[d]) + ")");
+            } else if (result.status != CaptureVerifyStatus::Mismatch) {
+                last_good[d] = checksum.bytes;
+            }
+            final_seen[d] = final_seen[d] || checksum.final;
+            return true;
+        });
+        if (capture.truncated()) {
+            fail(CaptureVerifyStatus::Truncated, "last frame incomplete");
+        } else if (checkpoints > 0 && !(final_seen[0] && final_seen[1])) {
+            fail(CaptureVerifyStatus::Truncated, "no final checksum; the session was not closed cleanly");
+        } else if (checkpoints == 0 && !job) {
+            fail(CaptureVerifyStatus::NoReference, "no checksum frames");
+        }
+    } else {
+        for (const ByteSpan& segment : capture.client_stream().segments) {
+            crc[0] = Crc32cUpdate(crc[0], segment.data, segment.size);
+            bytes[0] += segment.size;
+        }
+    }
+
+    if (job && (job->flags & JOB_FLAG_CHECKSUMS) && job->outcome != JobOutcome::CaptureError) {
+        if (bytes[0] < job->bytes_to_printer) {
+            fail(CaptureVerifyStatus::Truncated, "holds " + std::to_string(bytes[0]) + " of " +
+                 std::to_string(job->bytes_to_printer) + " bytes sent to the printer (job " + std::to_string(job->job_id) + ")");
+        } else if (bytes[0] != job->bytes_to_printer || crc[0] != job->crc_to_printer) {
+            fail(CaptureVerifyStatus::Mismatch, "differs from what job " + std::to_string(job->job_id) + " sent to the printer (" +
+                 HexCrc(crc[0]) + " vs " + HexCrc(job->crc_to_printer) + ")");
+        }
+    } else if (!capture.framed()) {
+        fail(CaptureVerifyStatus::NoReference, job ? "job record has no usable checksum" : "no job catalog entry");
+    }
+    if (result.status == CaptureVerifyStatus::Ok) {
+        result.detail = "client->printer " + std::to_string(bytes[0]) + " bytes, crc32c " + HexCrc(crc[0]);
+        if (capture.framed()) result.detail += ", " + std::to_string(checkpoints) + " checksum frames";
+        if (job) result.detail += ", matches job " + std::to_string(job->job_id);
+    }
+    return result;
+}
+
+// verify <capture|dir>... [--threads n]: checks captures in parallel
+int CmdVerify(const std::vector<std::string>& args) {
+    std::vector<std::string> inputs;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool quiet = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        uint64_t n = 0;
+        if (args[i] == "--threads" && i + 1 < args.size() && ParseUnsigned(args[i + 1], n) && n > 0) {
+            threads = (unsigned)n;
+            ++i;
+        } else if (args[i] == "--quiet") {
+            quiet = true;
+        } else {
+            inputs.push_back(args[i]);
+        }
+    }
+    if (inputs.empty()) {
+        std::cerr << "Usage: capture_tool verify <capture|dir>... [--threads n] [--quiet]" << std::endl;
+        return 2;
+    }
+    std::vector<fs::path> paths = ExpandCaptureInputs(inputs);
+
+    // Job records by capture, from the catalog next to each capture
+    std::map<fs::path, std::map<std::string, JobRecord>> jobs_by_dir;
+    for (const fs::path& path : paths) {
+        fs::path dir = path.parent_path();
+        if (jobs_by_dir.count(dir)) continue;
+        auto& jobs = jobs_by_dir[dir];
+        JobCatalog catalog;
+        std::string error;
+        if (!catalog.Open(dir.empty() ? fs::path(".") : dir, error)) continue;
+        for (uint64_t row = 0; row < catalog.rows(); ++row) {
+            JobRecord job = catalog.record(row);
+            if (!job.capture.empty()) jobs[job.capture] = std::move(job);
+        }
+    }
+
+    std::vector<CaptureVerifyResult> results(paths.size());
+    std::atomic<size_t> next{ 0 };
+    auto start = std::chrono::steady_clock::now();
+    auto worker = [&]() {
+        for (size_t i = next++; i < paths.size(); i = next++) {
+            CaptureFile capture;
+            std::string error;
+            if (!capture.Open(paths[i], error)) {
+                results[i].status = CaptureVerifyStatus::Error;
+                results[i].detail = error;
+                continue;
+            }
+            const auto& jobs = jobs_by_dir[paths[i].parent_path()];
+            auto job = jobs.find(paths[i].filename().string());
+            results[i] = VerifyCapture(capture, job == jobs.end() ? nullptr : &job->second);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < std::min<size_t>(threads, paths.size()); ++t) pool.emplace_back(worker);
+    worker();
+    for (std::thread& t : pool) t.join();
+    double elapsed = SecondsSince(start);
+
+    size_t counts[5] = {};
+    uint64_t total_bytes = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        const CaptureVerifyResult& r = results[i];
+        counts[(int)r.status]++;
+        total_bytes += r.bytes;
+        if (!quiet || r.status == CaptureVerifyStatus::Truncated || r.status == CaptureVerifyStatus::Mismatch ||
+            r.status == CaptureVerifyStatus::Error) {
+            std::cout << CaptureVerifyStatusName(r.status) << "  " << paths[i].string() << ": " << r.detail << std::endl;
+        }
+    }
+    std::cout << paths.size() << " captures: " << counts[0] << " ok, " << counts[1] << " unchecked, " << counts[2] << " truncated, "
+              << counts[3] << " mismatched, " << counts[4] << " unreadable. "
+              << (total_bytes / 1e6) << " MB in " << elapsed << " s (" << (elapsed > 0 ? total_bytes / 1e6 / elapsed : 0.0)
+              << " MB/s, " << std::min<size_t>(threads, std::max<size_t>(paths.size(), 1)) << " threads, crc32c " << Crc32cImplementation() << ")" << std::endl;
+    return counts[2] + counts[3] + counts[4] > 0 ? 1 : 0;
+}
+
+// info <capture>: prints the header, session endpoints and per-direction totals
+int CmdInfo(const std::vector<std::string>& args) {
+    if (args.size() != 1) {
+        std::cerr << "Usage: capture_tool info <capture>" << std::endl;
+        return 2;
+    }
+    CaptureFile capture;
+    std::string error;
+    if (!capture.Open(args[0], error)) {
+        std::cerr << "[ERROR] " << args[0] << ": " << error << std::endl;
+        return 1;
+    }
+
+    std::cout << "File:            " << args[0] << std::endl;
+    if (!capture.framed()) {
+        std::cout << "Format:          raw" << std::endl;
+        std::cout << "Client->Printer: " << capture.client_stream().size << " bytes" << std::endl;
+        return 0;
+    }
+
+    uint64_t frames[3] = { 0, 0, 0 };
+    uint64_t bytes[3] = { 0, 0, 0 };
+    uint64_t last_time_us = 0;
+    capture.ForEachFrame([&](const CaptureFrame& frame, ByteSpan payload) {
+        size_t kind = (size_t)frame.kind;
+        if (kind <= 2) {
+            frames[kind]++;
+            bytes[kind] += payload.size;
+        }
+        last_time_us = frame.time_us;
+        return true;
+    });
+
+    std::cout << "Format:          framed v" << capture.framed_header().version << std::endl;
+    std::cout << "Start (unix us): " << capture.framed_header().start_unix_us << std::endl;
+    std::cout << "Client:          " << (capture.client().empty() ? "?" : capture.client()) << std::endl;
+    std::cout << "Upstream:        " << (capture.upstream().empty() ? "?" : capture.upstream()) << std::endl;
+    std::cout << "Duration:        " << (last_time_us / 1000.0) << " ms" << std::endl;
+    std::cout << "Client->Printer: " << frames[0] << " chunks, " << bytes[0] << " bytes" << std::endl;
+    std::cout << "Printer->Client: " << frames[1] << " chunks, " << bytes[1] << " bytes" << std::endl;
+    if (capture.truncated()) {
+        std::cout << "WARNING: capture is truncated (last frame incomplete)." << std::endl;
+    }
+    CaptureVerifyResult verify = VerifyCapture(capture, nullptr);
+    std::cout << "Checksums:       " << CaptureVerifyStatusName(verify.status) << " (" << verify.detail << ")" << std::endl;
+    return 0;
+}
+
+// to-raw <capture.cap> [output.bin]: extracts the client -> printer stream in the layout
+// the viewers expect
+int CmdToRaw(const std::vector<std::string>& args) {
+    if (args.empty() || args.size() > 2) {
+        std::cerr << "Usage: capture_tool to-raw <capture.cap> [output.bin]" << std::endl;
+        return 2;
+    }
+    std::string output = args.size() == 2 ? args[1] : ReplaceExtension(args[0], RAW_CAPTURE_EXTENSION);
+
+    CaptureFile capture;
+    std::string error;
+    if (!capture.Open(args[0], error)) {
+        std::cerr << "[ERROR] " << args[0] << ": " << error << std::endl;
+        return 1;
+    }
+    if (!capture.framed()) {
+        std::cerr << "[ERROR] " << args[0] << " is already a raw capture." << std::endl;
+        return 1;
+    }
+    std::ofstream out(output, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        std::cerr << "[ERROR] Cannot create " << output << std::endl;
+        return 1;
+    }
+
+    for (const ByteSpan& segment : capture.client_stream().segments) {
+        out.write(reinterpret_cast<const char*>(segment.data), (std::streamsize)segment.size);
+    }
+    if (!out) {
+        std::cerr << "[ERROR] Error writing " << output << std::endl;
+        return 1;
+    }
+    if (capture.truncated()) {
+        std::cerr << "[WARN] " << args[0] << " is truncated; converted the complete frames only." << std::endl;
+    }
+    std::cout << "Wrote " << capture.client_stream().size << " bytes to " << output << std::endl;
+    return 0;
+}
+
+// to-pcapng <capture|dir>... -o <out.pcapng> [--printer ip:port]: merges captures into one
+// pcapng file ordered by time. Only captures that overlap in time are open at once and
+// each holds a single chunk in memory.
+int CmdToPcapng(const std::vector<std::string>& args) {
+    std::vector<std::string> inputs;
+    std::string output;
+    std::string printer = "10.0.0.2:9100";
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "-o" && i + 1 < args.size()) {
+            output = args[++i];
+        } else if (args[i] == "--printer" && i + 1 < args.size()) {
+            printer = args[++i];
+        } else {
+            inputs.push_back(args[i]);
+        }
+    }
+    if (inputs.empty() || output.empty()) {
+        std::cerr << "Usage: capture_tool to-pcapng <capture|dir>... -o <out.pcapng> [--printer ip:port]" << std::endl;
+        return 2;
+    }
+    PcapngEndpoint default_printer;
+    if (!ParseEndpoint(printer, default_printer)) {
+        std::cerr << "[ERROR] Invalid --printer endpoint: " << printer << std::endl;
+        return 2;
+    }
+
+    std::vector<std::unique_ptr<PcapngSource>> sources;
+    for (const fs::path& path : ExpandCaptureInputs(inputs)) {
+        auto source = std::make_unique<PcapngSource>();
+        source->path = path;
+        std::string error;
+        if (!source->Probe(error)) {
+            std::cerr << "[WARN] Skipping " << path.string() << ": " << error << std::endl;
+            continue;
+        }
+        sources.push_back(std::move(source));
+    }
+    std::stable_sort(sources.begin(), sources.end(), [](const auto& a, const auto& b) { return a->start_us < b->start_us; });
+
+    PcapngWriter writer;
+    if (!writer.Open(output)) {
+        std::cerr << "[ERROR] Cannot create " << output << std::endl;
+        return 1;
+    }
+
+    auto later = [](const PcapngSource* a, const PcapngSource* b) { return a->next_time_us > b->next_time_us; };
+    std::priority_queue<PcapngSource*, std::vector<PcapngSource*>, decltype(later)> active(later);
+    auto start = std::chrono::steady_clock::now();
+    uint64_t payload_bytes = 0;
+    size_t next_source = 0;
+    size_t flows = 0;
+
+    auto finish = [&](PcapngSource* source) {
+        writer.EndFlow(source->flow, source->next_time_us);
+        if (source->capture.truncated()) {
+            std::cerr << "[WARN] " << source->path.string() << " is truncated." << std::endl;
+        }
+        source->capture = CaptureFile(); // Unmap
+    };
+
+    while (true) {
+        // Start every capture that begins before the earliest pending chunk
+        while (next_source < sources.size() &&
+               (active.empty() || sources[next_source]->start_us <= active.top()->next_time_us)) {
+            PcapngSource* source = sources[next_source++].get();
+            std::string error;
+            if (!source->Open(error)) {
+                std::cerr << "[WARN] Skipping " << source->path.string() << ": " << error << std::endl;
+                continue;
+            }
+            bool has_data = source->Advance();
+            PcapngEndpoint client_ep, upstream_ep;
+            if (!ParseEndpoint(source->client, client_ep)) client_ep = DefaultEndpoint(1, 0);
+            if (!ParseEndpoint(source->upstream, upstream_ep)) upstream_ep = default_printer;
+            source->flow = writer.BeginFlow(client_ep, upstream_ep, source->start_us);
+            flows++;
+            if (has_data) {
+                active.push(source);
+            } else {
+                source->next_time_us = source->start_us;
+                finish(source);
+            }
+        }
+        if (active.empty()) break;
+
+        PcapngSource* source = active.top();
+        active.pop();
+        if (!writer.WriteData(source->flow, source->kind == CaptureFrameKind::ClientToPrinter, source->next_time_us,
+                              source->payload.data, source->payload.size)) {
+            break; // Reported below
+        }
+        payload_bytes += source->payload.size;
+        if (source->Advance()) {
+            active.push(source);
+        } else {
+            finish(source);
+        }
+    }
+
+    if (!writer.Close()) {
+        std::cerr << "[ERROR] Error writing " << output << std::endl;
+        return 1;
+    }
+    double seconds = SecondsSince(start);
+    std::cout << "Wrote " << writer.packets_written() << " packets (" << flows << " flows, " << payload_bytes
+              << " payload bytes) to " << output << " in " << seconds << " s";
+    if (seconds > 0) std::cout << " (" << (payload_bytes / 1048576.0 / seconds) << " MB/s)";
+    std::cout << std::endl;
+    return 0;
+}
+
+
+void PrintJobHeader() {
+    std::printf("%8s  %-23s  %9s  %-21s  %-21s  %12s  %10s  %-20s  %s\n",
+                "ID", "Start", "Dur (ms)", "Client", "Printer", "To printer", "From", "Outcome", "Capture");
+}
+
+void PrintJob(const JobRecord& job) {
+    double duration_ms = job.end_unix_us > job.start_unix_us ? (job.end_unix_us - job.start_unix_us) / 1000.0 : 0.0;
+    std::printf("%8llu  %-23s  %9.1f  %-21s  %-21s  %12llu  %10llu  %-20s  %s\n",
+                (unsigned long long)job.job_id, FormatLocalTime(job.start_unix_us).c_str(), duration_ms,
+                job.client.c_str(), job.upstream.c_str(), (unsigned long long)job.bytes_to_printer,
+                (unsigned long long)job.bytes_from_printer, JobOutcomeName(job.outcome),
+                job.capture.empty() ? "-" : job.capture.c_str());
+}
+
+// jobs [filters]: queries the job catalog the relay keeps in printer_data
+int CmdJobs(const std::vector<std::string>& args) {
+    const char* usage =
+        "Usage: capture_tool jobs [--dir <printer_data>] [--from <time>] [--to <time>] [--client <ip[:port]>]\n"
+        "                         [--printer <ip[:port]>] [--min-bytes <n>] [--max-bytes <n>] [--outcome <name>]\n"
+        "                         [--limit <n>] [--reindex]\n"
+        "  <time> is YYYY-MM-DD[ HH:MM[:SS]] (local time) or @<unix seconds>; --to is exclusive.\n"
+        "  Outcomes: completed, reset, capture-error, relay-error, interrupted, upstream-unavailable";
+    fs::path dir = "printer_data";
+    JobQuery query;
+    bool reindex = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        bool has_value = i + 1 < args.size();
+        bool ok = true;
+        if (arg == "--reindex") {
+            reindex = true;
+        } else if (!has_value) {
+            ok = false;
+        } else if (arg == "--dir") {
+            dir = args[++i];
+        } else if (arg == "--from") {
+            ok = ParseTimeArgument(args[++i], query.from_unix_us);
+        } else if (arg == "--to") {
+            ok = ParseTimeArgument(args[++i], query.to_unix_us);
+        } else if (arg == "--client") {
+            SplitEndpointQuery(args[++i], query.client_host, query.client_port);
+        } else if (arg == "--printer") {
+            SplitEndpointQuery(args[++i], query.printer_host, query.printer_port);
+        } else if (arg == "--min-bytes") {
+            ok = ParseUnsigned(args[++i], query.min_bytes);
+        } else if (arg == "--max-bytes") {
+            ok = ParseUnsigned(args[++i], query.max_bytes);
+        } else if (arg == "--outcome") {
+            JobOutcome outcome = JobOutcome::Completed;
+            ok = ParseJobOutcome(args[++i], outcome);
+            query.outcome = (int)outcome;
+        } else if (arg == "--limit") {
+            uint64_t limit = 0;
+            ok = ParseUnsigned(args[++i], limit);
+            query.limit = (size_t)limit;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "[ERROR] Invalid argument: " << arg << (i < args.size() && args[i] != arg ? " " + args[i] : "") << std::endl;
+            std::cerr << usage << std::endl;
+            return 2;
+        }
+    }
+
+    JobCatalog catalog;
+    std::string error;
+    if (!catalog.Open(dir, error)) {
+        std::cerr << "[ERROR] " << (dir / JOB_CATALOG_FILENAME).string() << ": " << error << std::endl;
+        return 1;
+    }
+    // The relay only appends; indexes are caught up here once enough new rows accumulated
+    if (!catalog.UpdateIndexes(reindex ? 1 : JOB_INDEX_MAX_TAIL, error)) {
+        std::cerr << "[WARN] Could not update the catalog indexes (" << error << "); scanning unindexed rows." << std::endl;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    JobQueryStats stats;
+    std::vector<JobRecord> jobs = catalog.Query(query, &stats);
+    double elapsed = SecondsSince(start);
+
+    PrintJobHeader();
+    for (const JobRecord& job : jobs) PrintJob(job);
+    std::cerr << jobs.size() << " of " << catalog.rows() << " jobs matched in " << (elapsed * 1000.0) << " ms (access path: "
+              << stats.access_path << ", " << stats.candidates << " records examined)" << std::endl;
+    return 0;
+}
+
+// search <words>... [options]: finds the jobs whose receipts printed all the given words,
+// through the text index next to the job catalog (brought up to date first)
+int CmdSearch(const std::vector<std::string>& args) {
+    const char* usage =
+        "Usage: capture_tool search <word>... [--dir <printer_data>] [--from <time>] [--to <time>] [--limit <n>]\n"
+        "                           [--lines] [--threads <n>] [--no-update]\n"
+        "  Jobs must contain every word; word* matches words starting with it. Without words, only\n"
+        "  updates the index.";
+    fs::path dir = "printer_data";
+    std::string text;
+    JobQuery filter;
+    bool lines = false, update = true;
+    uint64_t threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        bool has_value = i + 1 < args.size();
+        bool ok = true;
+        if (arg == "--lines") {
+            lines = true;
+        } else if (arg == "--no-update") {
+            update = false;
+        } else if (arg.rfind("--", 0) != 0) {
+            text += (text.empty() ? "" : " ") + arg;
+        } else if (!has_value) {
+            ok = false;
+        } else if (arg == "--dir") {
+            dir = args[++i];
+        } else if (arg == "--from") {
+            ok = ParseTimeArgument(args[++i], filter.from_unix_us);
+        } else if (arg == "--to") {
+            ok = ParseTimeArgument(args[++i], filter.to_unix_us);
+        } else if (arg == "--limit") {
+            uint64_t limit = 0;
+            ok = ParseUnsigned(args[++i], limit);
+            filter.limit = (size_t)limit;
+        } else if (arg == "--threads") {
+            ok = ParseUnsigned(args[++i], threads) && threads > 0;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "[ERROR] Invalid argument: " << arg << (i < args.size() && args[i] != arg ? " " + args[i] : "") << std::endl;
+            std::cerr << usage << std::endl;
+            return 2;
+        }
+    }
+    std::vector<JobTextTerm> query = ParseJobTextQuery(text);
+    if (query.empty() && !text.empty()) {
+        std::cerr << "[ERROR] No searchable words in: " << text << std::endl;
+        return 2;
+    }
+
+    JobCatalog catalog;
+    JobTextIndex index;
+    std::string error;
+    if (!catalog.Open(dir, error) || !index.Open(dir, catalog.rows(), error)) {
+        std::cerr << "[ERROR] " << (dir / JOB_CATALOG_FILENAME).string() << ": " << error << std::endl;
+        return 1;
+    }
+    if (update && index.covered() < catalog.rows()) {
+        auto start = std::chrono::steady_clock::now();
+        JobTextUpdateStats stats;
+        if (!index.Update(catalog, (unsigned)threads, &stats, error)) {
+            std::cerr << "[WARN] Could not update the text index (" << error << "); matching unindexed jobs directly." << std::endl;
+        }
+        std::cerr << "Indexed " << stats.jobs << " jobs (" << stats.with_text << " with text, " << stats.unreadable
+                  << " unreadable) in " << SecondsSince(start) << " s" << std::endl;
+    }
+    if (query.empty()) {
+        std::cout << index.covered() << " of " << catalog.rows() << " jobs indexed: " << index.segments() << " segments, "
+                  << index.terms() << " terms, " << index.bytes() / 1024 << " KB" << std::endl;
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    JobTextSearchStats stats;
+    std::vector<uint64_t> rows = index.Search(query, &catalog, &stats);
+    std::vector<JobRecord> jobs;
+    for (auto it = rows.rbegin(); it != rows.rend() && (filter.limit == 0 || jobs.size() < filter.limit); ++it) {
+        JobRecord job = catalog.record(*it);
+        if (filter.Matches(job)) jobs.push_back(std::move(job));
+    }
+    std::reverse(jobs.begin(), jobs.end());
+    double elapsed = SecondsSince(start);
+
+    PrintJobHeader();
+    for (const JobRecord& job : jobs) {
+        PrintJob(job);
+        if (!lines || job.capture.empty()) continue;
+        CaptureFile capture;
+        if (!capture.Open(dir / job.capture, error)) continue;
+        std::string printed = ExtractReceiptText(capture.client_stream());
+        for (size_t at = 0; at < printed.size();) {
+            size_t end = std::min(printed.find('\n', at), printed.size());
+            std::string line = printed.substr(at, end - at);
+            at = end + 1;
+            bool hit = false;
+            ForEachReceiptTerm(line, true, [&](const std::string& term) {
+                for (const JobTextTerm& q : query) hit = hit || JobTextTermMatches(q, term);
+            });
+            if (hit) std::printf("          | %s\n", line.c_str());
+        }
+    }
+    std::cerr << jobs.size() << " of " << catalog.rows() << " jobs matched in " << (elapsed * 1000.0) << " ms ("
+              << stats.segments << " segments, " << stats.postings << " postings decoded, " << stats.probes << " blocks probed, "
+              << stats.unindexed << " unindexed jobs read)" << std::endl;
+    return 0;
+}
+
+// Opens the catalog and its receipt hashes in dir, hashing the jobs appended since the
+// last update unless update is false. Returns false after printing the error.
+bool OpenJobHashes(const fs::path& dir, bool update, unsigned threads, JobCatalog& catalog, JobHashIndex& index) {
+    std::string error;
+    if (!catalog.Open(dir, error) || !index.Open(dir, catalog.rows(), error)) {
+        std::cerr << "[ERROR] " << (dir / JOB_CATALOG_FILENAME).string() << ": " << error << std::endl;
+        return false;
+    }
+    if (update && index.covered() < catalog.rows()) {
+        auto start = std::chrono::steady_clock::now();
+        JobHashUpdateStats stats;
+        if (!index.Update(catalog, threads, &stats, error)) {
+            std::cerr << "[WARN] Could not update the receipt hashes (" << error << "); jobs past them are left out." << std::endl;
+        }
+        std::cerr << "Hashed " << stats.jobs << " jobs (" << stats.hashed << " with a receipt, " << stats.unreadable
+                  << " unreadable) in " << SecondsSince(start) << " s" << std::endl;
+    }
+    return true;
+}
+
+// cluster [options]: groups the jobs whose receipts look alike, through the perceptual
+// hashes kept next to the job catalog (brought up to date first)
+int CmdCluster(const std::vector<std::string>& args) {
+    const char* usage =
+        "Usage: capture_tool cluster [--dir <printer_data>] [--distance <n>] [--min-size <n>] [--limit <n>] [--list]\n"
+        "                            [--threads <n>] [--no-update]\n"
+        "  Receipts whose hashes differ in at most <n> of 256 bits (default 12) are near-duplicates; a\n"
+        "  cluster joins them directly or through other jobs. --limit shows the largest <n> clusters.";
+    fs::path dir = "printer_data";
+    uint64_t distance = JOB_HASH_DISTANCE, min_size = 2, limit = 20;
+    bool list = false, update = true;
+    uint64_t threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        bool has_value = i + 1 < args.size();
+        bool ok = true;
+        if (arg == "--list") {
+            list = true;
+        } else if (arg == "--no-update") {
+            update = false;
+        } else if (!has_value) {
+            ok = false;
+        } else if (arg == "--dir") {
+            dir = args[++i];
+        } else if (arg == "--distance") {
+            ok = ParseUnsigned(args[++i], distance) && distance < RECEIPT_HASH_BITS;
+        } else if (arg == "--min-size") {
+            ok = ParseUnsigned(args[++i], min_size) && min_size >= 2;
+        } else if (arg == "--limit") {
+            ok = ParseUnsigned(args[++i], limit);
+        } else if (arg == "--threads") {
+            ok = ParseUnsigned(args[++i], threads) && threads > 0;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "[ERROR] Invalid argument: " << arg << (i < args.size() && args[i] != arg ? " " + args[i] : "") << std::endl;
+            std::cerr << usage << std::endl;
+            return 2;
+        }
+    }
+
+    JobCatalog catalog;
+    JobHashIndex index;
+    if (!OpenJobHashes(dir, update, (unsigned)threads, catalog, index)) return 1;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint32_t> rows = index.HashedRows();
+    ReceiptHashClusters result = ClusterReceiptHashes(index.Hashes(), rows, (int)distance, (unsigned)threads);
+    double elapsed = SecondsSince(start);
+    std::vector<std::vector<uint32_t>>& clusters = result.clusters;
+    clusters.erase(std::find_if(clusters.begin(), clusters.end(), [min_size](const std::vector<uint32_t>& c) { return c.size() < min_size; }),
+                   clusters.end());
+
+    uint64_t clustered = 0;
+    for (const std::vector<uint32_t>& cluster : clusters) clustered += cluster.size();
+    for (size_t i = 0; i < clusters.size() && (limit == 0 || i < limit); ++i) {
+        const std::vector<uint32_t>& cluster = clusters[i];
+        JobRecord first = catalog.record(cluster.front()), last = catalog.record(cluster.back());
+        int spread = 0; // Farthest from the first job's receipt
+        for (uint32_t row : cluster) spread = std::max(spread, ReceiptHashDistance(index.job(cluster.front()).hash, index.job(row).hash));
+        std::printf("%sCluster %zu: %zu jobs, #%llu (%s) to #%llu (%s), up to %d bits from the first\n", i > 0 && list ? "\n" : "", i + 1,
+                    cluster.size(), (unsigned long long)first.job_id, FormatLocalTime(first.start_unix_us).c_str(),
+                    (unsigned long long)last.job_id, FormatLocalTime(last.start_unix_us).c_str(), spread);
+        if (!list) continue;
+        PrintJobHeader();
+        for (uint32_t row : cluster) PrintJob(catalog.record(row));
+    }
+    if (limit > 0 && clusters.size() > limit) std::printf("... %zu more clusters\n", clusters.size() - (size_t)limit);
+    std::cerr << clustered << " of " << rows.size() << " hashed jobs in " << clusters.size() << " clusters of " << min_size
+              << " or more, within " << distance << " bits, in " << (elapsed * 1000.0) << " ms (" << result.distinct << " distinct hashes, "
+              << result.pairs << " close pairs, " << result.queries.candidates << " candidates checked, "
+              << DiffKernelName(DiffSelectedKernel()) << ")" << std::endl;
+    return 0;
+}
+
+// similar <job id|capture> [options]: lists the catalog's jobs whose receipts look like the
+// given job's or capture's, nearest first
+int CmdSimilar(const std::vector<std::string>& args) {
+    const char* usage =
+        "Usage: capture_tool similar <job id|capture> [--dir <printer_data>] [--distance <n>] [--limit <n>]\n"
+        "                            [--threads <n>] [--no-update]\n"
+        "  Lists the jobs whose receipt hashes differ in at most <n> of 256 bits (default 12).";
+    fs::path dir = "printer_data";
+    std::string target;
+    uint64_t distance = JOB_HASH_DISTANCE, limit = 20;
+    bool update = true;
+    uint64_t threads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t i = 0; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        bool has_value = i + 1 < args.size();
+        bool ok = true;
+        if (arg == "--no-update") {
+            update = false;
+        } else if (arg.rfind("--", 0) != 0) {
+            ok = target.empty();
+            target = arg;
+        } else if (!has_value) {
+            ok = false;
+        } else if (arg == "--dir") {
+            dir = args[++i];
+        } else if (arg == "--distance") {
+            ok = ParseUnsigned(args[++i], distance) && distance < RECEIPT_HASH_BITS;
+        } else if (arg == "--limit") {
+            ok = ParseUnsigned(args[++i], limit);
+        } else if (arg == "--threads") {
+            ok = ParseUnsigned(args[++i], threads) && threads > 0;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "[ERROR] Invalid argument: " << arg << (i < args.size() && args[i] != arg ? " " + args[i] : "") << std::endl;
+            std::cerr << usage << std::endl;
+            return 2;
+        }
+    }
+    if (target.empty()) {
+        std::cerr << usage << std::endl;
+        return 2;
+    }
+
+    JobCatalog catalog;
+    JobHashIndex index;
+    if (!OpenJobHashes(dir, update, (unsigned)threads, catalog, index)) return 1;
+    // A job id, unless a capture of that name exists
+    std::error_code ec;
+    uint64_t job_id = 0;
+    JobHash query;
+    if (!fs::exists(target, ec) && ParseUnsigned(target, job_id)) {
+        if (job_id == 0 || job_id > catalog.rows()) {
+            std::cerr << "[ERROR] No job " << target << " in " << (dir / JOB_CATALOG_FILENAME).string() << std::endl;
+            return 1;
+        }
+        query = job_id <= index.covered() ? index.job(job_id - 1) : HashJob(dir, catalog.record(job_id - 1), BytePatternFilter(DefaultReceiptPatterns()));
+    } else {
+        query = HashCapture(target, BytePatternFilter(DefaultReceiptPatterns()));
+    }
+    if (query.state != JobHashState::Hashed) {
+        std::cerr << "[ERROR] " << target << (query.state == JobHashState::Blank ? " printed nothing." : " cannot be decoded.") << std::endl;
+        return 1;
+    }
+    std::cerr << "Receipt " << query.width << "x" << query.rows << " (" << PrintLanguageInfo(query.language).name
+              << "), hash " << FormatReceiptHash(query.hash) << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<uint32_t> rows = index.HashedRows();
+    ReceiptHashTable table;
+    table.Build(index.Hashes(), &rows);
+    double build = SecondsSince(start);
+    start = std::chrono::steady_clock::now();
+    std::vector<ReceiptHashMatch> matches;
+    ReceiptHashScratch scratch;
+    ReceiptHashQueryStats stats;
+    table.Query(query.hash, (int)distance, matches, scratch, &stats);
+    double elapsed = SecondsSince(start);
+    matches.erase(std::remove_if(matches.begin(), matches.end(), [job_id](const ReceiptHashMatch& m) { return m.id + 1 == job_id; }),
+                  matches.end());
+    std::sort(matches.begin(), matches.end(), [](const ReceiptHashMatch& a, const ReceiptHashMatch& b) {
+        return a.distance != b.distance ? a.distance < b.distance : a.id > b.id; // Then the latest first
+    });
+
+    std::printf("%4s  ", "Bits");
+    PrintJobHeader();
+    for (size_t i = 0; i < matches.size() && (limit == 0 || i < limit); ++i) {
+        std::printf("%4d  ", matches[i].distance);
+        PrintJob(catalog.record(matches[i].id));
+    }
+    std::cerr << matches.size() << " of " << rows.size() << " hashed jobs within " << distance << " bits in " << (elapsed * 1000.0)
+              << " ms (table built in " << (build * 1000.0) << " ms; " << stats.candidates << " candidates checked)" << std::endl;
+    return 0;
+}
+
+// escpos <capture> [--limit n] [--summary]: decodes the client -> printer stream into
+// ESC/POS commands, one line each (payload bytes are summarized, not dumped)
+int CmdEscPos(const std::vector<std::string>& args) {
+    std::string input;
+    uint64_t limit = UINT64_MAX;
+    bool summary = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--limit" && i + 1 < args.size() && ParseUnsigned(args[i + 1], limit)) {
+            ++i;
+        } else if (args[i] == "--summary") {
+            summary = true;
+        } else if (input.empty() && args[i].rfind("--", 0) != 0) {
+            input = args[i];
+        } else {
+            input.clear();
+            break;
+        }
+    }
+    if (input.empty()) {
+        std::cerr << "Usage: capture_tool escpos <capture> [--limit n] [--summary]" << std::endl;
+        return 2;
+    }
+    CaptureFile capture;
+    std::string error;
+    if (!capture.Open(input, error)) {
+        std::cerr << "[ERROR] " << input << ": " << error << std::endl;
+        return 1;
+    }
+
+    std::map<std::string, uint64_t> counts;
+    uint64_t printed = 0;
+    uint64_t text_bytes = 0, data_bytes = 0;
+    auto sink = [&](const EscPosEvent& e) {
+        if (e.type == EscPosEventType::Data) {
+            data_bytes += e.data.size;
+            return;
+        }
+        if (e.type == EscPosEventType::Text) text_bytes += e.data.size;
+        counts[e.type == EscPosEventType::Command || e.type == EscPosEventType::Text ? e.name : EscPosEventTypeName(e.type)]++;
+        if (summary || printed >= limit) return;
+        printed++;
+
+        char line[160];
+        int n = std::snprintf(line, sizeof(line), "%10llu  %-10s %-8s", (unsigned long long)e.offset, EscPosEventTypeName(e.type), e.name);
+        std::string text(line, n > 0 ? (size_t)n : 0);
+        switch (e.type) {
+            case EscPosEventType::Text:
+                text += " \"" + std::string(reinterpret_cast<const char*>(e.data.data), std::min<size_t>(e.data.size, 60)) +
+                        (e.data.size > 60 ? "...\"" : "\"");
+                break;
+            case EscPosEventType::FeedDots:
+            case EscPosEventType::FeedLines:
+                text += " n=" + std::to_string(e.value);
+                break;
+            case EscPosEventType::Raster:
+                text += " m=" + std::to_string(e.mode) + " " + std::to_string(e.width * 8) + "x" + std::to_string(e.height) + " dots";
+                break;
+            case EscPosEventType::BitImage:
+                text += " m=" + std::to_string(e.mode) + " " + std::to_string(e.width) + "x" + std::to_string(e.height) + " dots";
+                break;
+            case EscPosEventType::Cut:
+                text += " m=" + std::to_string(e.mode) + (e.value ? " feed=" + std::to_string(e.value) : std::string());
+                break;
+            case EscPosEventType::Unknown:
+                for (size_t i = 0; i < e.data.size; ++i) text += " " + HexByte(e.data.data[i]);
+                break;
+            case EscPosEventType::Incomplete:
+                text += " (stream ends inside the command)";
+                break;
+            default:
+                for (uint8_t i = 0; i < e.param_count; ++i) text += " " + HexByte(e.params[i]);
+                break;
+        }
+        if (e.data_length > 0 && e.type != EscPosEventType::Incomplete) text += " +" + std::to_string(e.data_length) + " bytes";
+        std::cout << text << "\n";
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    EscPosParser parser;
+    for (const ByteSpan& segment : capture.client_stream().segments) parser.Feed(segment, sink);
+    parser.Finish(sink);
+    double elapsed = SecondsSince(start);
+
+    if (!summary && printed >= limit) std::cout << "..." << std::endl;
+    std::cout << "Commands:" << std::endl;
+    for (const auto& entry : counts) std::printf("  %-12s %llu\n", entry.first.c_str(), (unsigned long long)entry.second);
+    uint64_t total = capture.client_stream().size;
+    std::printf("%llu bytes: %llu text, %llu payload, %llu command bytes; parsed in %.1f ms (%.0f MB/s)\n", (unsigned long long)total,
+                (unsigned long long)text_bytes, (unsigned long long)data_bytes, (unsigned long long)(total - text_bytes - data_bytes),
+                elapsed * 1000.0, elapsed > 0 ? total / 1e6 / elapsed : 0.0);
+    return 0;
+}
+
+// width <capture> [--min n] [--max n] [--scan]: detects the raster width the viewers would
+// open the capture at; --scan ignores GS v 0 headers and ranks widths from the bit stream
+int CmdWidth(const std::vector<std::string>& args) {
+    std::string input;
+    uint64_t min_width = 64, max_width = 1200;
+    bool scan = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--min" && i + 1 < args.size() && ParseUnsigned(args[i + 1], min_width)) {
+            ++i;
+        } else if (args[i] == "--max" && i + 1 < args.size() && ParseUnsigned(args[i + 1], max_width)) {
+            ++i;
+        } else if (args[i] == "--scan") {
+            scan = true;
+        } else if (input.empty() && args[i].rfind("--", 0) != 0) {
+            input = args[i];
+        } else {
+            input.clear();
+            break;
+        }
+    }
+    if (input.empty() || min_width > max_width || max_width > 65535) {
+        std::cerr << "Usage: capture_tool width <capture> [--min n] [--max n (up to 65535)] [--scan]" << std::endl;
+        return 2;
+    }
+    CaptureFile capture;
+    std::string error;
+    if (!capture.Open(input, error)) {
+        std::cerr << "[ERROR] " << input << ": " << error << std::endl;
+        return 1;
+    }
+    ReceiptBits bits;
+    if (!ExtractReceiptBits(capture.client_stream(), BytePatternFilter(DefaultReceiptPatterns()), bits, error)) {
+        std::cerr << "[ERROR] " << input << ": " << error << std::endl;
+        return 1;
+    }
+    if (scan) bits.raster = EscPosRasterInfo();
+
+    auto start = std::chrono::steady_clock::now();
+    WidthDetection detection = DetectReceiptWidth(bits, (int)min_width, (int)max_width);
+    double elapsed = SecondsSince(start);
+    if (detection.width == 0) {
+        std::cout << "No width detected (" << bits.bytes.size() << " image bytes)" << std::endl;
+        return 1;
+    }
+    std::printf("Width %d dots (%s), %.1f ms\n", detection.width, WidthSourceName(detection.source), elapsed * 1000.0);
+    for (const WidthCandidate& candidate : detection.candidates) {
+        std::printf("  %5d  score %.3f  %d rows\n", candidate.width, candidate.score, bits.rows(candidate.width));
+    }
+    return 0;
+}
+
+// split <capture|dir>... [--list] [--rescan] [--quiet]: finds where the paper was cut in
+// each capture and brings its .receipts index up to date, scanning only what was added
+// since the index was written; --list prints every receipt's range of the client stream
+int CmdSplit(const std::vector<std::string>& args) {
+    std::vector<std::string> inputs;
+    bool list = false, rescan = false, quiet = false, usage = false;
+    for (const std::string& arg : args) {
+        if (arg == "--list") list = true;
+        else if (arg == "--rescan") rescan = true;
+        else if (arg == "--quiet") quiet = true;
+        else if (arg.rfind("--", 0) == 0) usage = true;
+        else inputs.push_back(arg);
+    }
+    if (inputs.empty() || usage) {
+        std::cerr << "Usage: capture_tool split <capture|dir>... [--list] [--rescan] [--quiet]" << std::endl;
+        return 2;
+    }
+    std::vector<fs::path> paths = ExpandCaptureInputs(inputs);
+    size_t failed = 0, written = 0, receipts = 0, split = 0;
+    uint64_t scanned = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (const fs::path& path : paths) {
+        std::error_code ec;
+        if (rescan) fs::remove(ReceiptIndexPath(path), ec);
+        ReceiptIndex index;
+        ReceiptIndexUpdate update;
+        std::string error;
+        if (!UpdateReceiptIndex(path, index, update, error)) {
+            std::cout << "FAILED  " << path.string() << ": " << error << std::endl;
+            ++failed;
+            continue;
+        }
+        written += update.written ? 1 : 0;
+        scanned += update.bytes_scanned;
+        receipts += index.receipts.size();
+        split += index.receipts.size() > 1 ? 1 : 0;
+        if (!quiet) {
+            std::printf("%s: %zu receipt%s%s\n", path.string().c_str(), index.receipts.size(), index.receipts.size() == 1 ? "" : "s",
+                        !update.written ? " (index up to date)" : update.bytes_scanned < index.scanned ? " (index extended)" : "");
+        }
+        if (list) {
+            for (size_t k = 0; k < index.receipts.size(); ++k) {
+                const ReceiptRange& r = index.receipts[k];
+                std::printf("  %5zu  %12llu - %-12llu %10llu bytes%s\n", k + 1, (unsigned long long)r.start, (unsigned long long)r.end,
+                            (unsigned long long)r.size(), k < index.closed ? "" : "  (not cut)");
+            }
+        }
+    }
+    double elapsed = SecondsSince(start);
+    std::printf("%zu captures, %zu with several receipts, %zu receipts; %zu indexes written, %.1f MB scanned in %.2f s (%.0f MB/s), %zu failed\n",
+                paths.size() - failed, split, receipts, written, scanned / 1e6, elapsed, elapsed > 0 ? scanned / 1e6 / elapsed : 0.0, failed);
+    return failed > 0 ? 1 : 0;
+}
+
+constexpr int RENDER_BAND_ROWS = 1024; // Rows packed per write
+
+// render <capture|dir>... [-o dir] [--format png|pbm] [--width n|auto] [--lsb] [--invert] [--receipt k|all]
+//        [--threads n] [--quiet]:
+// decodes captures the way the viewer does and writes each as a 1-bit PNG (default) or PBM
+// image, on all cores. Each worker holds one decoded capture and a band of output rows at
+// a time. --receipt decodes only the given receipt of each capture (or each receipt, as
+// an image of its own), located through the capture's .receipts index.
+int CmdRender(const std::vector<std::string>& args) {
+    std::vector<std::string> inputs;
+    fs::path output_dir;
+    uint64_t fixed_width = 0; // 0: detected per capture
+    uint64_t receipt = 0;     // 1-based; 0: the whole capture
+    bool all_receipts = false;
+    bool msb_first = true, invert = false, quiet = false, png = true;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool usage = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        uint64_t n = 0;
+        if (args[i] == "-o" && i + 1 < args.size()) {
+            output_dir = args[++i];
+        } else if (args[i] == "--format" && i + 1 < args.size()) {
+            ++i;
+            if (args[i] == "png") png = true;
+            else if (args[i] == "pbm") png = false;
+            else usage = true;
+        } else if (args[i] == "--width" && i + 1 < args.size()) {
+            ++i;
+            if (args[i] == "auto") fixed_width = 0;
+            else if (!ParseUnsigned(args[i], fixed_width) || fixed_width == 0 || fixed_width > 65535) usage = true;
+        } else if (args[i] == "--lsb") {
+            msb_first = false;
+        } else if (args[i] == "--invert") {
+            invert = true;
+        } else if (args[i] == "--receipt" && i + 1 < args.size()) {
+            ++i;
+            if (args[i] == "all") all_receipts = true;
+            else if (!ParseUnsigned(args[i], receipt) || receipt == 0) usage = true;
+        } else if (args[i] == "--threads" && i + 1 < args.size() && ParseUnsigned(args[i + 1], n) && n > 0) {
+            threads = (unsigned)n;
+            ++i;
+        } else if (args[i] == "--quiet") {
+            quiet = true;
+        } else if (args[i].rfind("--", 0) == 0) {
+            usage = true;
+        } else {
+            inputs.push_back(args[i]);
+        }
+    }
+    if (inputs.empty() || usage) {
+        std::cerr << "Usage: capture_tool render <capture|dir>... [-o dir] [--format png|pbm] [--width n|auto] [--lsb] [--invert]" << std::endl;
+        std::cerr << "                           [--receipt k|all] [--threads n] [--quiet]" << std::endl;
+        return 2;
+    }
+
+    // One image per capture, or per selected receipt
+    struct RenderItem {
+        fs::path path;
+        size_t receipt = 0;   // 1-based; 0: the whole capture
+        ReceiptRange range;   // Of the client stream, when receipt > 0
+        std::string name() const { return receipt > 0 ? path.string() + " #" + std::to_string(receipt) : path.string(); }
+    };
+    std::vector<RenderItem> items;
+    size_t missing = 0;
+    for (const fs::path& path : ExpandCaptureInputs(inputs)) {
+        if (receipt == 0 && !all_receipts) {
+            items.push_back({ path, 0, {} });
+            continue;
+        }
+        ReceiptIndex index;
+        ReceiptIndexUpdate update;
+        std::string error;
+        if (!UpdateReceiptIndex(path, index, update, error)) {
+            std::cout << "FAILED  " << path.string() << ": " << error << std::endl;
+            ++missing;
+        } else if (all_receipts) {
+            for (size_t k = 0; k < index.receipts.size(); ++k) items.push_back({ path, k + 1, index.receipts[k] });
+        } else if (receipt <= index.receipts.size()) {
+            items.push_back({ path, (size_t)receipt, index.receipts[(size_t)receipt - 1] });
+        } else {
+            std::cout << "FAILED  " << path.string() << ": has " << index.receipts.size() << " receipts" << std::endl;
+            ++missing;
+        }
+    }
+    if (!output_dir.empty()) {
+        std::error_code ec;
+        fs::create_directories(output_dir, ec);
+        if (ec) {
+            std::cerr << "[ERROR] Cannot create " << output_dir.string() << ": " << ec.message() << std::endl;
+            return 1;
+        }
+    }
+
+    struct RenderResult {
+        bool ok = false;
+        std::string detail;
+        fs::path output;
+        uint64_t input_bytes = 0;
+        uint64_t output_bytes = 0;
+    };
+    std::vector<RenderResult> results(items.size());
+
+    // Largest first: with workers taking the next file as they finish, a long capture then
+    // never starts last and holds up the end of the run
+    std::vector<size_t> order(items.size());
+    std::vector<uint64_t> sizes(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        std::error_code ec;
+        order[i] = i;
+        sizes[i] = items[i].receipt > 0 ? items[i].range.size() : fs::file_size(items[i].path, ec);
+    }
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sizes[a] > sizes[b]; });
+
+    const BytePatternFilter filter(DefaultReceiptPatterns());
+    std::atomic<size_t> next{ 0 };
+    auto start = std::chrono::steady_clock::now();
+    auto worker = [&]() {
+        std::vector<uint8_t> band;
+        for (size_t k = next++; k < order.size(); k = next++) {
+            size_t i = order[k];
+            const RenderItem& item = items[i];
+            RenderResult& result = results[i];
+            CaptureFile capture;
+            ReceiptBits bits;
+            std::string error;
+            if (!capture.Open(item.path, error)) {
+                result.detail = error;
+                continue;
+            }
+            ByteSpanList stream = capture.client_stream();
+            if (item.receipt > 0) stream = stream.Skip(item.range.start).Take(item.range.size());
+            if (!ExtractReceiptBits(stream, filter, bits, error)) {
+                result.detail = error;
+                continue;
+            }
+            result.input_bytes = stream.size;
+
+            int width = (int)fixed_width;
+            const char* source = "given";
+            if (width == 0) {
+                WidthDetection detection = DetectReceiptWidth(bits, 64, 1200);
+                width = detection.width > 0 ? detection.width : 576;
+                source = detection.width > 0 ? WidthSourceName(detection.source) : "default";
+            }
+            int rows = bits.rows(width);
+            if (rows == 0) {
+                result.detail = "no complete row at width " + std::to_string(width);
+                continue;
+            }
+
+            result.output = (output_dir.empty() ? item.path.parent_path() : output_dir) / item.path.filename();
+            if (item.receipt > 0) result.output.replace_filename(item.path.stem().string() + ".r" + std::to_string(item.receipt) + ".bin");
+            if (png) {
+                result.output.replace_extension(PNG_EXTENSION);
+                if (!WriteReceiptPng(result.output, bits, width, msb_first, invert, error)) {
+                    result.detail = error;
+                    continue;
+                }
+                std::error_code ec;
+                result.ok = true;
+                result.output_bytes = fs::file_size(result.output, ec);
+                result.detail = std::to_string(width) + "x" + std::to_string(rows) + ", width " + source;
+                continue;
+            }
+            result.output.replace_extension(".pbm");
+            std::ofstream out(result.output, std::ios::binary);
+            std::string header = "P4\n" + std::to_string(width) + " " + std::to_string(rows) + "\n";
+            out.write(header.data(), (std::streamsize)header.size());
+            size_t row_bytes = ((size_t)width + 7) / 8;
+            band.resize(row_bytes * RENDER_BAND_ROWS);
+            for (int row = 0; row < rows && out; row += RENDER_BAND_ROWS) {
+                int count = std::min(RENDER_BAND_ROWS, rows - row);
+                PackReceiptRows(bits, width, msb_first, invert, row, count, band.data(), row_bytes);
+                out.write(reinterpret_cast<const char*>(band.data()), (std::streamsize)(row_bytes * count));
+            }
+            out.close();
+            if (!out) {
+                result.detail = "cannot write " + result.output.string();
+                continue;
+            }
+            result.ok = true;
+            result.output_bytes = header.size() + row_bytes * rows;
+            result.detail = std::to_string(width) + "x" + std::to_string(rows) + ", width " + source;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < std::min<size_t>(threads, items.size()); ++t) pool.emplace_back(worker);
+    worker();
+    for (std::thread& t : pool) t.join();
+    double elapsed = SecondsSince(start);
+
+    size_t failed = 0;
+    uint64_t input_bytes = 0, output_bytes = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+        const RenderResult& r = results[i];
+        failed += r.ok ? 0 : 1;
+        input_bytes += r.input_bytes;
+        output_bytes += r.output_bytes;
+        if (!r.ok) std::cout << "FAILED  " << items[i].name() << ": " << r.detail << std::endl;
+        else if (!quiet) std::cout << "ok  " << items[i].name() << " -> " << r.output.string() << " (" << r.detail << ")" << std::endl;
+    }
+    std::printf("%zu %s rendered, %zu failed: %.1f MB in, %.1f MB out in %.2f s (%.1f files/s, %.1f MB/s, %u threads)\n",
+                items.size() - failed, receipt > 0 || all_receipts ? "receipts" : "captures", failed + missing, input_bytes / 1e6,
+                output_bytes / 1e6, elapsed, elapsed > 0 ? items.size() / elapsed : 0.0, elapsed > 0 ? input_bytes / 1e6 / elapsed : 0.0,
+                (unsigned)std::min<size_t>(threads, std::max<size_t>(items.size(), 1)));
+    return failed + missing > 0 ? 1 : 0;
+}
+
+// thumbs <capture|dir>... [--width n|auto] [--threads n] [--no-cache] [--pgm dir] [--quiet]:
+// renders the previews the viewer's folder grid shows, through the thumbnail cache kept
+// next to the captures, and reports how many were cached; --pgm writes each as a PGM image
+int CmdThumbs(const std::vector<std::string>& args) {
+    std::vector<std::string> inputs;
+    fs::path pgm_dir;
+    ThumbnailParams params;
+    unsigned threads = 0;
+    bool use_cache = true, quiet = false, usage = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        uint64_t n = 0;
+        if (args[i] == "--width" && i + 1 < args.size()) {
+            ++i;
+            if (args[i] == "auto") params.width = 0;
+            else if (!ParseUnsigned(args[i], n) || n == 0 || n > 65535) usage = true;
+            else params.width = (int)n;
+        } else if (args[i] == "--threads" && i + 1 < args.size() && ParseUnsigned(args[i + 1], n) && n > 0) {
+            threads = (unsigned)n;
+            ++i;
+        } else if (args[i] == "--no-cache") {
+            use_cache = false;
+        } else if (args[i] == "--pgm" && i + 1 < args.size()) {
+            pgm_dir = args[++i];
+        } else if (args[i] == "--quiet") {
+            quiet = true;
+        } else if (args[i].rfind("--", 0) == 0) {
+            usage = true;
+        } else {
+            inputs.push_back(args[i]);
+        }
+    }
+    if (inputs.empty() || usage) {
+        std::cerr << "Usage: capture_tool thumbs <capture|dir>... [--width n|auto] [--threads n] [--no-cache] [--pgm dir] [--quiet]" << std::endl;
+        return 2;
+    }
+    std::vector<fs::path> paths = ExpandCaptureInputs(inputs);
+    if (!pgm_dir.empty()) {
+        std::error_code ec;
+        fs::create_directories(pgm_dir, ec);
+        if (ec) {
+            std::cerr << "[ERROR] Cannot create " << pgm_dir.string() << ": " << ec.message() << std::endl;
+            return 1;
+        }
+    }
+
+    // One cache per directory, as the viewer keeps it; captures are requested a directory at a time
+    std::map<fs::path, std::vector<fs::path>> by_dir;
+    for (const fs::path& path : paths) by_dir[path.parent_path()].push_back(path);
+
+    const BytePatternFilter filter(DefaultReceiptPatterns());
+    size_t done = 0, cached = 0, failed = 0;
+    double elapsed = 0;
+    for (const auto& [dir, dir_paths] : by_dir) {
+        ThumbnailCache cache;
+        std::string error;
+        if (use_cache && !cache.Open(dir.empty() ? fs::path(".") : dir, error)) {
+            std::cerr << "[ERROR] " << error << std::endl;
+            return 1;
+        }
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::vector<ThumbnailUpdate> updates;
+        auto start = std::chrono::steady_clock::now();
+        {
+            ThumbnailGenerator generator(filter, params, use_cache ? &cache : nullptr, [&](ThumbnailUpdate&& update) {
+                std::lock_guard<std::mutex> lock(mutex);
+                updates.push_back(std::move(update));
+                if (updates.size() == dir_paths.size()) finished.notify_one();
+            }, threads);
+            generator.Request(dir_paths, false);
+            std::unique_lock<std::mutex> lock(mutex);
+            finished.wait(lock, [&] { return updates.size() == dir_paths.size(); });
+        }
+        elapsed += SecondsSince(start);
+
+        for (const ThumbnailUpdate& update : updates) {
+            done++;
+            const Thumbnail& t = update.thumbnail;
+            if (!update.ok) {
+                failed++;
+                std::cout << "FAILED  " << update.path.string() << ": " << update.error << std::endl;
+                continue;
+            }
+            cached += update.cached ? 1 : 0;
+            if (!quiet) {
+                std::cout << (update.cached ? "cached  " : "ok  ") << update.path.string() << " (" << t.width << "x" << t.height
+                          << " from " << t.source_width << "x" << t.source_rows << ")" << std::endl;
+            }
+            if (pgm_dir.empty()) continue;
+            fs::path output = pgm_dir / update.path.filename();
+            output.replace_extension(".pgm");
+            std::ofstream out(output, std::ios::binary);
+            std::string header = "P5\n" + std::to_string(t.width) + " " + std::to_string(t.height) + "\n255\n";
+            out.write(header.data(), (std::streamsize)header.size());
+            out.write(reinterpret_cast<const char*>(t.pixels.data()), (std::streamsize)t.pixels.size());
+            if (!out) std::cerr << "[ERROR] Cannot write " << output.string() << std::endl;
+        }
+        if (use_cache && !quiet) {
+            std::cout << cache.path().string() << ": " << cache.size() << " thumbnails, " << cache.file_bytes() / 1024 << " KB" << std::endl;
+        }
+    }
+    std::printf("%zu thumbnails, %zu from the cache, %zu failed in %.2f s (%.1f files/s)\n", done - failed, cached, failed,
+                elapsed, elapsed > 0 ? done / elapsed : 0.0);
+    return failed > 0 ? 1 : 0;
+}
+
+// diff <before> <after> [--receipt k] [--width n|auto] [--lsb] [--shift n] [-o diff.png]:
+// compares two captures (or the given receipt of each) as printed: lines the second up with
+// the first within [--shift] rows (default 256; 0: as they are), counts the dots both
+// printed, the ones removed and the ones added, and lists the bands of changed rows; -o
+// writes the comparison as an image. Exits 0 when the receipts match dot for dot, 1 when
+// they differ and 2 when they cannot be compared, like diff.
+int CmdDiff(const std::vector<std::string>& args) {
+    std::vector<std::string> inputs;
+    fs::path output;
+    uint64_t fixed_width = 0; // 0: detected per capture
+    uint64_t receipt = 0;     // 1-based; 0: the whole capture
+    uint64_t max_shift = 256;
+    bool msb_first = true, usage = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "-o" && i + 1 < args.size()) {
+            output = args[++i];
+        } else if (args[i] == "--width" && i + 1 < args.size()) {
+            ++i;
+            if (args[i] == "auto") fixed_width = 0;
+            else if (!ParseUnsigned(args[i], fixed_width) || fixed_width == 0 || fixed_width > 65535) usage = true;
+        } else if (args[i] == "--receipt" && i + 1 < args.size()) {
+            if (!ParseUnsigned(args[++i], receipt) || receipt == 0) usage = true;
+        } else if (args[i] == "--shift" && i + 1 < args.size()) {
+            if (!ParseUnsigned(args[++i], max_shift) || max_shift > 100000) usage = true;
+        } else if (args[i] == "--lsb") {
+            msb_first = false;
+        } else if (args[i].rfind("--", 0) == 0) {
+            usage = true;
+        } else {
+            inputs.push_back(args[i]);
+        }
+    }
+    if (inputs.size() != 2 || usage) {
+        std::cerr << "Usage: capture_tool diff <before> <after> [--receipt k] [--width n|auto] [--lsb] [--shift n] [-o diff.png]" << std::endl;
+        return 2;
+    }
+
+    const BytePatternFilter filter(DefaultReceiptPatterns());
+    ReceiptBits bits[2];
+    int widths[2] = { 0, 0 };
+    for (int side = 0; side < 2; ++side) {
+        fs::path path = inputs[(size_t)side];
+        CaptureFile capture;
+        std::string error;
+        if (!capture.Open(path, error)) {
+            std::cerr << "[ERROR] " << path.string() << ": " << error << std::endl;
+            return 2;
+        }
+        ByteSpanList stream = capture.client_stream();
+        if (receipt > 0) {
+            ReceiptIndex index;
+            ReceiptIndexUpdate update;
+            if (!UpdateReceiptIndex(path, index, update, error)) {
+                std::cerr << "[ERROR] " << path.string() << ": " << error << std::endl;
+                return 2;
+            }
+            if (receipt > index.receipts.size()) {
+                std::cerr << "[ERROR] " << path.string() << " has " << index.receipts.size() << " receipts." << std::endl;
+                return 2;
+            }
+            const ReceiptRange& range = index.receipts[(size_t)receipt - 1];
+            stream = stream.Skip(range.start).Take(range.size());
+        }
+        if (!ExtractReceiptBits(stream, filter, bits[side], error)) {
+            std::cerr << "[ERROR] " << path.string() << ": " << error << std::endl;
+            return 2;
+        }
+        int width = (int)fixed_width;
+        const char* source = "given";
+        if (width == 0) {
+            WidthDetection detection = DetectReceiptWidth(bits[side], 64, 1200);
+            width = detection.width > 0 ? detection.width : 576;
+            source = detection.width > 0 ? WidthSourceName(detection.source) : "default";
+        }
+        widths[side] = width;
+        std::printf("%-7s %s%s: %dx%d, width %s\n", side == 0 ? "Before" : "After", path.string().c_str(),
+                    receipt > 0 ? (" #" + std::to_string(receipt)).c_str() : "", width, bits[side].rows(width), source);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t row_bytes = DiffRowBytes(widths[0], widths[1]);
+    PackedReceipt before = PackReceipt(bits[0], widths[0], msb_first, row_bytes);
+    PackedReceipt after = PackReceipt(bits[1], widths[1], msb_first, row_bytes);
+    int shift = FindReceiptShift(before, after, (int)max_shift);
+    ReceiptDiff diff = DiffPackedReceipts(before, after, shift);
+    double elapsed = SecondsSince(start);
+    if (before.rows == 0 && after.rows == 0) {
+        std::cerr << "[ERROR] Neither capture has a complete row." << std::endl;
+        return 2;
+    }
+
+    if (shift != 0) std::printf("Shift:  the second moved %s %d rows\n", shift > 0 ? "down" : "up", std::abs(shift));
+    std::printf("Dots:   %llu in both, %llu removed, %llu added\n", (unsigned long long)diff.total.both,
+                (unsigned long long)diff.total.removed, (unsigned long long)diff.total.added);
+    std::printf("Similarity %.4f: %d of %d rows changed, %zu bands (%.1f ms, %s)\n", diff.similarity(), diff.changed_rows, diff.rows,
+                diff.bands.size(), elapsed * 1000.0, DiffKernelName(DiffSelectedKernel()));
+    const size_t shown = 20;
+    for (size_t i = 0; i < diff.bands.size() && i < shown; ++i) {
+        DiffCounts counts;
+        for (int y = diff.bands[i].first; y < diff.bands[i].second; ++y) counts += diff.row_counts[(size_t)y];
+        // Rows of the first receipt, which may be negative (above it) when the second was moved down
+        std::printf("  rows %6d - %-6d %8llu removed %8llu added\n", diff.row_a(diff.bands[i].first), diff.row_a(diff.bands[i].second) - 1,
+                    (unsigned long long)counts.removed, (unsigned long long)counts.added);
+    }
+    if (diff.bands.size() > shown) std::printf("  ... %zu more bands\n", diff.bands.size() - shown);
+
+    if (!output.empty()) {
+        std::string error;
+        if (!WriteReceiptDiffPng(output, before, after, diff, error)) {
+            std::cerr << "[ERROR] " << error << std::endl;
+            return 2;
+        }
+        std::cout << "Wrote " << output.string() << " (gray: both, red: removed, blue: added)" << std::endl;
+    }
+    return diff.total.changed() > 0 ? 1 : 0;
+}
+
+// bench catalog [rows]: builds a synthetic catalog in a temporary directory and times
+// index maintenance and typical queries
+int CmdBenchCatalog(const std::vector<std::string>& args) {
+    uint64_t rows = 1000000;
+    if (!args.empty() && !ParseUnsigned(args[0], rows)) {
+        std::cerr << "Usage: capture_tool bench catalog [rows]" << std::endl;
+        return 2;
+    }
+    fs::path dir = fs::temp_directory_path() / "capture_tool_bench_catalog";
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir, ec);
+
+    // A year of jobs from 200 clients to 8 printers, in completion order
+    const uint64_t year_start_us = 1704067200ull * 1000000ull; // 2024-01-01 UTC
+    const uint64_t step_us = 365ull * 24 * 3600 * 1000000ull / std::max<uint64_t>(rows, 1);
+    std::mt19937_64 rng(42);
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::ofstream out(dir / JOB_CATALOG_FILENAME, std::ios::binary | std::ios::trunc);
+        uint8_t header[JOB_CATALOG_HEADER_SIZE];
+        EncodeJobCatalogHeader(header);
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        std::vector<uint8_t> block;
+        block.reserve(4096 * JOB_RECORD_SIZE);
+        for (uint64_t row = 0; row < rows; ++row) {
+            JobRecord job;
+            job.job_id = row + 1;
+            job.start_unix_us = year_start_us + row * step_us + rng() % (step_us + 1) / 2;
+            job.end_unix_us = job.start_unix_us + 200000 + rng() % 3000000;
+            job.bytes_to_printer = 500 + rng() % 400000;
+            job.bytes_from_printer = rng() % 64;
+            job.outcome = rng() % 100 == 0 ? JobOutcome::Reset : JobOutcome::Completed;
+            job.client = "192.168." + std::to_string(1 + rng() % 2) + "." + std::to_string(1 + rng() % 100) + ":" + std::to_string(49152 + rng() % 16384);
+            job.upstream = "10.0.0." + std::to_string(10 + rng() % 8) + ":9100";
+            job.capture = "data_2024-01-01_00_00_00_000_" + job.client + RAW_CAPTURE_EXTENSION;
+            block.resize(block.size() + JOB_RECORD_SIZE);
+            EncodeJobRecord(job, block.data() + block.size() - JOB_RECORD_SIZE);
+            if (block.size() == block.capacity()) {
+                out.write(reinterpret_cast<const char*>(block.data()), (std::streamsize)block.size());
+                block.clear();
+            }
+        }
+        out.write(reinterpret_cast<const char*>(block.data()), (std::streamsize)block.size());
+        if (!out) {
+            std::cerr << "[ERROR] Cannot write the synthetic catalog in " << dir.string() << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "Generated " << rows << " records in " << SecondsSince(start) << " s" << std::endl;
+
+    JobCatalog catalog;
+    std::string error;
+    start = std::chrono::steady_clock::now();
+    if (!catalog.Open(dir, error) || !catalog.UpdateIndexes(1, error)) {
+        std::cerr << "[ERROR] " << error << std::endl;
+        return 1;
+    }
+    std::cout << "Built indexes in " << SecondsSince(start) << " s" << std::endl;
+
+    auto run = [&](const char* name, const JobQuery& query) {
+        const int repeats = 5;
+        size_t matches = 0;
+        JobQueryStats stats;
+        auto query_start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeats; ++i) matches = catalog.Query(query, &stats).size();
+        std::printf("  %-32s %9zu matches  %9.3f ms  (%s)\n", name, matches, SecondsSince(query_start) * 1000.0 / repeats, stats.access_path);
+    };
+    JobQuery day;
+    day.from_unix_us = year_start_us + 180ull * 24 * 3600 * 1000000ull;
+    day.to_unix_us = day.from_unix_us + 24ull * 3600 * 1000000ull;
+    JobQuery client;
+    client.client_host = "192.168.1.42";
+    JobQuery client_day = day;
+    client_day.client_host = client.client_host;
+    JobQuery printer;
+    printer.printer_host = "10.0.0.13";
+    printer.limit = 100;
+    JobQuery large;
+    large.min_bytes = 399000;
+    JobQuery resets = day;
+    resets.outcome = (int)JobOutcome::Reset;
+    std::cout << "Queries (mean of 5):" << std::endl;
+    run("one day", day);
+    run("one client, whole year", client);
+    run("one client, one day", client_day);
+    run("one printer, last 100", printer);
+    run("to printer >= 399000 bytes", large);
+    run("resets in one day", resets);
+
+    catalog = JobCatalog();
+    fs::remove_all(dir, ec);
+    return 0;
+}
+
+// bench crc [MB]: CRC32C throughput of each implementation, in relay-sized 4 KB chunks
+// and over one large buffer
+int CmdBenchCrc(const std::vector<std::string>& args) {
+    uint64_t megabytes = 256;
+    if (!args.empty() && (!ParseUnsigned(args[0], megabytes) || megabytes == 0)) {
+        std::cerr << "Usage: capture_tool bench crc [MB]" << std::endl;
+        return 2;
+    }
+    const size_t chunk = 4096; // The relay's BUFFER_SIZE
+    std::vector<uint8_t> data(64 * 1024 * 1024);
+    std::mt19937_64 rng(1);
+    for (size_t i = 0; i + 8 <= data.size(); i += 8) {
+        uint64_t v = rng();
+        std::memcpy(&data[i], &v, 8);
+    }
+    const char* check = "123456789";
+    uint64_t total = megabytes * 1024 * 1024;
+
+    struct Impl {
+        const char* name;
+        Crc32cFunction f;
+    };
+    std::vector<Impl> impls = { { "slicing-by-8", Crc32cSoftware } };
+    if (Crc32cHardwareFunction()) impls.push_back({ Crc32cHardwareName(), Crc32cHardwareFunction() });
+
+    std::cout << "CRC32C, " << megabytes << " MB per run, selected implementation: " << Crc32cImplementation() << std::endl;
+    for (const Impl& impl : impls) {
+        if (impl.f(0, reinterpret_cast<const uint8_t*>(check), 9) != 0xE3069283u) {
+            std::cerr << "[ERROR] " << impl.name << " fails the check value." << std::endl;
+            return 1;
+        }
+        uint32_t crc = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t done = 0; done < total; done += chunk) crc = impl.f(crc, data.data() + done % data.size(), chunk);
+        double chunked = SecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        for (uint64_t done = 0; done < total; done += data.size()) crc ^= impl.f(0, data.data(), data.size());
+        double large = SecondsSince(start);
+        std::printf("  %-14s 4 KB chunks: %7.2f GB/s (%6.0f ns per chunk)   64 MB buffer: %7.2f GB/s   [%08x]\n", impl.name,
+                    total / chunked / 1e9, chunked * 1e9 / (double)(total / chunk), (double)(total / data.size() * data.size()) / large / 1e9, crc);
+    }
+    return 0;
+}
+
+// bench filter [MB]: removes the raster block headers from a synthetic print stream with
+// the single-pass filter and with the former search-and-erase loop
+int CmdBenchFilter(const std::vector<std::string>& args) {
+    uint64_t megabytes = 50;
+    if (!args.empty() && (!ParseUnsigned(args[0], megabytes) || megabytes == 0)) {
+        std::cerr << "Usage: capture_tool bench filter [MB]" << std::endl;
+        return 2;
+    }
+    std::vector<BytePattern> patterns = DefaultReceiptPatterns();
+
+    // 576-dot raster blocks of 24 rows (the last one of each job 16 rows), as the relay sees them
+    std::vector<uint8_t> data;
+    data.reserve((size_t)(megabytes * 1024 * 1024 + 4096));
+    std::mt19937_64 rng(1);
+    uint64_t blocks = 0;
+    while (data.size() < megabytes * 1024 * 1024) {
+        const BytePattern& header = patterns[++blocks % 20 == 0 ? 1 : 0];
+        data.insert(data.end(), header.begin(), header.end());
+        size_t rows = header[9];
+        for (size_t i = 0; i < rows * 72; i += 8) {
+            uint64_t v = rng() & rng(); // Mostly white, like receipts
+            uint8_t bytes[8];
+            std::memcpy(bytes, &v, 8);
+            data.insert(data.end(), bytes, bytes + 8);
+        }
+    }
+    std::cout << "Stream: " << data.size() / 1e6 << " MB, " << blocks << " raster blocks" << std::endl;
+
+    BytePatternFilter filter(patterns);
+    std::vector<uint8_t> work = data;
+    auto start = std::chrono::steady_clock::now();
+    size_t kept = filter.Remove(work.data(), work.size());
+    double single_pass = SecondsSince(start);
+    std::printf("  single pass:      %9.1f ms  %8.0f MB/s  %llu bytes removed\n", single_pass * 1000.0, data.size() / 1e6 / single_pass,
+                (unsigned long long)(data.size() - kept));
+
+    // The erase loop is quadratic; run it on a prefix small enough to finish and scale up
+    size_t sample = std::min<size_t>(data.size(), 4 * 1024 * 1024);
+    std::vector<uint8_t> legacy(data.begin(), data.begin() + sample);
+    start = std::chrono::steady_clock::now();
+    for (const BytePattern& pattern : patterns) {
+        auto it = legacy.begin();
+        while ((it = std::search(it, legacy.end(), pattern.begin(), pattern.end())) != legacy.end()) {
+            it = legacy.erase(it, it + pattern.size());
+        }
+    }
+    double erase_loop = SecondsSince(start);
+    double scale = (double)data.size() / sample;
+    std::printf("  search + erase:   %9.1f ms on the first %.1f MB, ~%.1f s estimated for the whole stream (quadratic)\n",
+                erase_loop * 1000.0, sample / 1e6, erase_loop * scale * scale);
+
+    std::vector<uint8_t> check(data.begin(), data.begin() + sample);
+    check.resize(filter.Remove(check.data(), check.size()));
+    if (check != legacy) {
+        std::cerr << "[ERROR] Single-pass output differs from the erase loop." << std::endl;
+        return 1;
+    }
+    std::cout << "  outputs match on the sample." << std::endl;
+    return 0;
+}
+
+// The viewers' original per-bit expansion, kept as the reference for bench unpack
+void UnpackBitsReference(const std::vector<uint8_t>& data, bool msb_first, bool invert, std::vector<uint32_t>& pixels) {
+    for (uint8_t byte : data) {
+        for (int k = 0; k < 8; ++k) {
+            int i = msb_first ? 7 - k : k;
+            bool bit = (byte >> i) & 1;
+            pixels.push_back(bit ? (invert ? UNPACK_WHITE : UNPACK_BLACK) : (invert ? UNPACK_BLACK : UNPACK_WHITE));
+        }
+    }
+}
+
+// bench unpack [Mpixels]: checks every unpack kernel against the original per-bit loop
+// (all bit orders, polarities and row offsets) and measures their throughput
+int CmdBenchUnpack(const std::vector<std::string>& args) {
+    uint64_t megapixels = 256;
+    if (!args.empty() && (!ParseUnsigned(args[0], megapixels) || megapixels == 0)) {
+        std::cerr << "Usage: capture_tool bench unpack [Mpixels]" << std::endl;
+        return 2;
+    }
+    std::vector<UnpackKernel> kernels;
+    for (UnpackKernel kernel : { UnpackKernel::Table, UnpackKernel::Sse2, UnpackKernel::Avx2 }) {
+        if (UnpackKernelSupported(kernel)) kernels.push_back(kernel);
+    }
+
+    std::vector<uint8_t> data(4096);
+    std::mt19937_64 rng(1);
+    for (uint8_t& b : data) b = (uint8_t)rng();
+    for (bool msb_first : { true, false }) {
+        for (bool invert : { false, true }) {
+            std::vector<uint32_t> expected;
+            UnpackBitsReference(data, msb_first, invert, expected);
+            for (UnpackKernel kernel : kernels) {
+                std::vector<uint32_t> out(expected.size());
+                // Rows of 577 pixels start at every bit position
+                for (size_t offset = 0; offset < expected.size(); offset += 577) {
+                    size_t count = std::min<size_t>(577, expected.size() - offset);
+                    UnpackBits(msb_first, invert, data.data(), offset, count, out.data() + offset, kernel);
+                }
+                if (out != expected) {
+                    std::cerr << "[ERROR] " << UnpackKernelName(kernel) << " differs from the reference (msb_first=" << msb_first
+                              << ", invert=" << invert << ")." << std::endl;
+                    return 1;
+                }
+            }
+        }
+    }
+    std::cout << "All kernels match the reference. Selected kernel: " << UnpackKernelName(UnpackSelectedKernel()) << std::endl;
+
+    // Rows of 576 dots. The first runs stay in cache (kernel speed), the last writes a 256 MB
+    // destination (what a very long receipt costs, bound by memory bandwidth).
+    const size_t row = 576;
+    uint64_t total = megapixels * 1000000;
+    std::vector<uint32_t> out;
+
+    auto report = [&](const char* name, double seconds, uint64_t pixels) {
+        std::printf("  %-10s %9.0f Mpixels/s  (%.2f ns per pixel)\n", name, pixels / 1e6 / seconds, seconds * 1e9 / pixels);
+    };
+    std::vector<uint32_t> reference;
+    reference.reserve(data.size() * 8);
+    data.resize(row / 8 * 112); // 64K pixels, 256 KB of output
+    auto start = std::chrono::steady_clock::now();
+    uint64_t done = 0;
+    while (done < total / 8) { // The original loop is slow; a smaller run is enough
+        reference.clear();
+        UnpackBitsReference(data, true, false, reference);
+        done += reference.size();
+    }
+    report("original", SecondsSince(start), done);
+
+    auto run = [&](UnpackKernel kernel, const char* name) {
+        size_t rows_per_pass = data.size() * 8 / row;
+        out.resize(rows_per_pass * row);
+        start = std::chrono::steady_clock::now();
+        done = 0;
+        while (done < total) {
+            for (size_t r = 0; r < rows_per_pass; ++r) UnpackBits<true, false>(data.data(), r * row, row, out.data() + r * row, kernel);
+            done += out.size();
+        }
+        report(name, SecondsSince(start), done);
+    };
+    for (UnpackKernel kernel : kernels) run(kernel, UnpackKernelName(kernel));
+
+    data.resize(8 * 1024 * 1024);
+    for (uint8_t& b : data) b = (uint8_t)rng();
+    run(UnpackSelectedKernel(), "256 MB out");
+    return 0;
+}
+
+// Peak memory (working set / resident set) of this process so far
+uint64_t PeakMemoryBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+    struct rusage usage;
+    return getrusage(RUSAGE_SELF, &usage) == 0 ? (uint64_t)usage.ru_maxrss * 1024 : 0;
+#endif
+}
+
+// A raw capture of megabytes of 576-dot GS v 0 raster blocks with random dots, as a
+// relay would record a long graphics-only receipt
+bool WriteSyntheticRasterCapture(const fs::path& path, uint64_t megabytes) {
+    std::ofstream out(path, std::ios::binary);
+    std::vector<uint8_t> block = { 0x1B, 0x40, 0x1B, 0x61, 0x01 };
+    out.write(reinterpret_cast<const char*>(block.data()), (std::streamsize)block.size());
+    std::mt19937_64 rng(1);
+    const uint8_t header[] = { 0x1B, 0x4A, 0x18, 0x1D, 0x76, 0x30, 0x00, 0x48, 0x00, 0x18, 0x00 };
+    block.assign(header, header + sizeof(header));
+    block.resize(sizeof(header) + 72 * 24);
+    for (uint64_t written = 0; written < megabytes * 1024 * 1024; written += block.size()) {
+        for (size_t i = sizeof(header); i < block.size(); ++i) block[i] = (uint8_t)(rng() & rng());
+        out.write(reinterpret_cast<const char*>(block.data()), (std::streamsize)block.size());
+    }
+    return (bool)out;
+}
+
+// bench decode [MB]: writes a synthetic raster capture and decodes it at 576 dots into a
+// full-size 32-bit destination, directly and the way the viewer used to (raw copy, a
+// pixel vector, then the bitmap), reporting time and peak memory of each
+int CmdBenchDecode(const std::vector<std::string>& args) {
+    uint64_t megabytes = 20;
+    if (!args.empty() && (!ParseUnsigned(args[0], megabytes) || megabytes == 0)) {
+        std::cerr << "Usage: capture_tool bench decode [MB]" << std::endl;
+        return 2;
+    }
+    fs::path path = fs::temp_directory_path() / ("capture_tool_bench_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".bin");
+    if (!WriteSyntheticRasterCapture(path, megabytes)) {
+        std::cerr << "[ERROR] Cannot write " << path.string() << std::endl;
+        return 1;
+    }
+    const int width = 576;
+    BytePatternFilter filter(DefaultReceiptPatterns());
+    int status = 0;
+    uint64_t direct_checksum = 0;
+    {
+        CaptureFile capture;
+        std::string error;
+        if (!capture.Open(path, error)) {
+            std::cerr << "[ERROR] " << error << std::endl;
+            fs::remove(path);
+            return 1;
+        }
+        uint64_t output_bytes = 0;
+        std::cout << "Capture: " << capture.client_stream().size / 1e6 << " MB, decoded at " << width << " dots" << std::endl;
+
+        // Direct: image bits, then rows expanded into the destination
+        uint64_t before = PeakMemoryBytes();
+        auto start = std::chrono::steady_clock::now();
+        {
+            ReceiptBits bits;
+            if (!ExtractReceiptBits(capture.client_stream(), filter, bits, error)) {
+                std::cerr << "[ERROR] " << error << std::endl;
+                status = 1;
+            } else {
+                int rows = bits.rows(width);
+                std::unique_ptr<uint32_t[]> bitmap(new uint32_t[(size_t)width * rows]); // Stands in for the GDI+ bitmap
+                RenderReceiptRows(bits, width, true, false, 0, rows, reinterpret_cast<uint8_t*>(bitmap.get()), width * 4);
+                output_bytes = (uint64_t)width * rows * 4;
+                for (size_t i = 0; i < (size_t)width * rows; i += 4093) direct_checksum += bitmap[i];
+            }
+        }
+        double direct_time = SecondsSince(start);
+        uint64_t direct_peak = PeakMemoryBytes() - before;
+        std::printf("  direct:   %8.0f ms   peak +%7.1f MB   (output %.1f MB)\n", direct_time * 1000.0, direct_peak / 1e6, output_bytes / 1e6);
+
+        // Former pipeline; run second because peak memory only grows
+        before = PeakMemoryBytes();
+        start = std::chrono::steady_clock::now();
+        uint64_t legacy_checksum = 0;
+        {
+            std::vector<uint8_t> pixel_data;
+            for (const ByteSpan& segment : capture.client_stream().Skip(RECEIPT_HEADER_SIZE).segments) {
+                pixel_data.insert(pixel_data.end(), segment.begin(), segment.end());
+            }
+            pixel_data.resize(filter.Remove(pixel_data.data(), pixel_data.size()));
+            std::vector<uint32_t> pixels;
+            pixels.reserve(pixel_data.size() * 8);
+            UnpackBitsReference(pixel_data, true, false, pixels);
+            size_t rows = pixels.size() / width;
+            std::unique_ptr<uint32_t[]> bitmap(new uint32_t[(size_t)width * rows]);
+            for (size_t y = 0; y < rows; ++y) std::memcpy(bitmap.get() + y * width, pixels.data() + y * width, width * 4);
+            for (size_t i = 0; i < (size_t)width * rows; i += 4093) legacy_checksum += bitmap[i];
+        }
+        double legacy_time = SecondsSince(start);
+        uint64_t legacy_peak = PeakMemoryBytes() - before + direct_peak; // Includes what the direct run already reached
+        std::printf("  former:   %8.0f ms   peak +%7.1f MB\n", legacy_time * 1000.0, legacy_peak / 1e6);
+        if (legacy_checksum != direct_checksum) {
+            std::cerr << "[ERROR] Direct and former decoding differ." << std::endl;
+            status = 1;
+        }
+    }
+    fs::remove(path);
+    return status;
+}
+
+// bench tiles [rows]: scrolls a 900-row viewport through a synthetic roll with the viewer's
+// tile cache (line steps, then random jumps) and reports per-frame cost and cache memory
+int CmdBenchTiles(const std::vector<std::string>& args) {
+    uint64_t rows = 200000;
+    if (!args.empty() && (!ParseUnsigned(args[0], rows) || rows == 0 || rows > 2000000)) {
+        std::cerr << "Usage: capture_tool bench tiles [rows (up to 2000000)]" << std::endl;
+        return 2;
+    }
+    const int width = 576, viewport = 900;
+    auto bits = std::make_shared<ReceiptBits>();
+    bits->bytes.resize((size_t)rows * width / 8);
+    std::mt19937_64 rng(1);
+    for (uint8_t& b : bits->bytes) b = (uint8_t)(rng() & rng());
+
+    ReceiptTileCache cache;
+    cache.Reset(bits, width, true, false);
+    std::cout << "Roll: " << cache.rows() << " rows (" << (double)cache.rows() * width * 4 / 1e6 << " MB as one bitmap), cache budget "
+              << cache.capacity() << " tiles of " << ReceiptTileCache::TILE_ROWS << " rows" << std::endl;
+
+    uint64_t checksum = 0;
+    auto frame = [&](int top) {
+        cache.ForEachTile(top, top + viewport, [&](const ReceiptTileCache::Tile& tile) { checksum += tile.pixels[0]; });
+        cache.Prefetch(top, top + viewport, ReceiptTileCache::TILE_ROWS);
+    };
+    auto run = [&](const char* name, const std::vector<int>& tops) {
+        double worst = 0;
+        size_t peak = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int top : tops) {
+            auto frame_start = std::chrono::steady_clock::now();
+            frame(top);
+            worst = std::max(worst, SecondsSince(frame_start));
+            peak = std::max(peak, cache.memory_bytes());
+        }
+        double elapsed = SecondsSince(start);
+        std::printf("  %-12s %7zu frames  avg %7.3f ms  worst %7.3f ms  cache peak %6.1f MB\n", name, tops.size(),
+                    elapsed * 1000.0 / tops.size(), worst * 1000.0, peak / 1e6);
+    };
+
+    std::vector<int> tops;
+    for (int top = 0; top + viewport <= cache.rows(); top += 40) tops.push_back(top);
+    run("scroll", tops);
+    for (int& top : tops) top = (int)(rng() % (uint64_t)std::max(cache.rows() - viewport, 1));
+    run("jumps", tops);
+    const ReceiptTileCache::Stats& stats = cache.stats();
+    std::printf("  tiles rendered %llu, reused %llu, evicted %llu  [%llx]\n", (unsigned long long)stats.misses,
+                (unsigned long long)stats.hits, (unsigned long long)stats.evictions, (unsigned long long)checksum);
+    return 0;
+}
+
+// Receipt-like 1bpp rows, MSB-first: lines of glyphs, rules, barcodes, dithered logos and
+// blank feeds, so bench width sees the structure real captures have
+std::vector<uint8_t> SyntheticReceiptBits(int width, int rows, uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    const int glyph_w = 12, glyph_h = 24;
+    std::vector<std::vector<uint8_t>> font(96, std::vector<uint8_t>(glyph_w * glyph_h, 0));
+    for (auto& glyph : font) { // A few strokes per glyph
+        for (int stroke = 0; stroke < 3; ++stroke) {
+            bool vertical = rng() & 1;
+            int at = 2 + (int)(rng() % (vertical ? glyph_w - 4 : glyph_h - 8));
+            int from = 2 + (int)(rng() % 6), to = from + 4 + (int)(rng() % (vertical ? 12 : 4));
+            for (int t = from; t < to; ++t) {
+                for (int thick = 0; thick < 2; ++thick) {
+                    int x = vertical ? at + thick : t, y = vertical ? t : at + thick;
+                    if (x < glyph_w && y < glyph_h) glyph[y * glyph_w + x] = 1;
+                }
+            }
+        }
+    }
+    std::vector<uint8_t> dots((size_t)width * rows, 0);
+    int y = 0;
+    while (y < rows) {
+        int kind = (int)(rng() % 10);
+        int height = kind < 6 ? glyph_h : kind == 6 ? 3 : kind == 7 ? 60 : kind == 8 ? 80 : 30;
+        if (kind < 6) { // Text line, left aligned
+            int chars = (int)(rng() % (width / glyph_w + 1));
+            for (int c = 0; c < chars; ++c) {
+                const auto& glyph = font[rng() % font.size()];
+                for (int gy = 0; gy < glyph_h && y + gy < rows; ++gy) {
+                    for (int gx = 0; gx < glyph_w; ++gx) dots[(size_t)(y + gy) * width + c * glyph_w + gx] = glyph[gy * glyph_w + gx];
+                }
+            }
+        } else if (kind == 6) { // Rule
+            for (int r = 0; r < 2 && y + r < rows; ++r) std::fill_n(dots.begin() + (size_t)(y + r) * width, width, 1);
+        } else if (kind == 7) { // Barcode
+            std::vector<uint8_t> bars(width, 0);
+            for (int x = width / 8; x < width - width / 8;) {
+                int bar = 1 + (int)(rng() % 4);
+                bool black = rng() & 1;
+                for (int i = 0; i < bar && x < width; ++i, ++x) bars[x] = black;
+            }
+            for (int r = 0; r < height && y + r < rows; ++r) std::copy(bars.begin(), bars.end(), dots.begin() + (size_t)(y + r) * width);
+        } else if (kind == 8) { // Logo: ordered dither of a radial gradient
+            static const int bayer[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+            int cx = width / 2, cy = height / 2, radius = std::min(width / 4, height / 2);
+            for (int r = 0; r < height && y + r < rows; ++r) {
+                for (int x = 0; x < width; ++x) {
+                    double d = std::sqrt(double((x - cx) * (x - cx) + (r - cy) * (r - cy))) / radius;
+                    dots[(size_t)(y + r) * width + x] = d < 1 && (1 - d) * 16 > bayer[r % 4][x % 4];
+                }
+            }
+        }
+        y += height + (int)(rng() % 8);
+    }
+    std::vector<uint8_t> packed((dots.size() + 7) / 8, 0);
+    for (size_t i = 0; i < dots.size(); ++i) packed[i / 8] |= (uint8_t)(dots[i] << (7 - i % 8));
+    return packed;
+}
+
+// bench width [rows]: detects the width of synthetic receipts of common and odd widths
+// from the bit stream alone, reporting the best candidates and the time taken
+int CmdBenchWidth(const std::vector<std::string>& args) {
+    uint64_t rows = 8000;
+    if (!args.empty() && (!ParseUnsigned(args[0], rows) || rows < 100 || rows > 1000000)) {
+        std::cerr << "Usage: capture_tool bench width [rows (100 to 1000000)]" << std::endl;
+        return 2;
+    }
+    const int widths[] = { 384, 432, 512, 576, 640, 832, 203, 1000 };
+    int failures = 0;
+    for (int width : widths) {
+        ReceiptBits bits;
+        bits.bytes = SyntheticReceiptBits(width, (int)rows, (uint64_t)width);
+        auto start = std::chrono::steady_clock::now();
+        WidthDetection detection = DetectReceiptWidth(bits, 64, 1200);
+        double elapsed = SecondsSince(start);
+        bool ok = detection.width == width;
+        failures += ok ? 0 : 1;
+        std::printf("  %5d dots, %6.2f MB: %-4s %6.1f ms  ", width, bits.bytes.size() / 1e6, ok ? "ok" : "MISS", elapsed * 1000.0);
+        for (size_t i = 0; i < detection.candidates.size() && i < 3; ++i) {
+            std::printf(" %5d (%.2f)", detection.candidates[i].width, detection.candidates[i].score);
+        }
+        std::printf("\n");
+    }
+    std::cout << (failures == 0 ? "All widths detected" : std::to_string(failures) + " widths missed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+// bench zoom [rows]: checks the zoom pyramid's box filter against a per-dot reference and
+// times zooming out over a long synthetic receipt: a tile of each level, a screen of each
+// level with the tile cache, and random zoom and pan jumps
+int CmdBenchZoom(const std::vector<std::string>& args) {
+    uint64_t rows = 300000;
+    if (!args.empty() && (!ParseUnsigned(args[0], rows) || rows < 1000 || rows > 2000000)) {
+        std::cerr << "Usage: capture_tool bench zoom [rows (1000 to 2000000)]" << std::endl;
+        return 2;
+    }
+    const int width = 576, viewport = 900;
+    auto bits = std::make_shared<ReceiptBits>();
+    bits->bytes = SyntheticReceiptBits(width, (int)rows, 5);
+    std::printf("Receipt: %d x %llu dots (%.1f MB packed)\n", width, (unsigned long long)rows, bits->bytes.size() / 1e6);
+
+    // Reference: every dot of the square looked at on its own, at an odd width so groups
+    // straddle words and the right edge is partial
+    int status = 0;
+    const int check_width = 573;
+    std::mt19937_64 rng(3);
+    for (int level = 1; level <= ReceiptTileCache::MAX_LEVEL; ++level) {
+        const int scale = 1 << level, source_rows = bits->rows(check_width);
+        int tiles = (ReceiptTileCache::LevelSize(source_rows, level) + ReceiptTileCache::TILE_ROWS - 1) / ReceiptTileCache::TILE_ROWS;
+        for (int index : { 0, tiles - 1, (int)(rng() % (uint64_t)tiles) }) {
+            for (bool msb_first : { true, false }) {
+                ReceiptTileCache::Tile tile = ReceiptTileCache::RenderLevel(*bits, check_width, msb_first, false, index, level);
+                for (int y = 0; y < tile.rows; ++y) {
+                    for (int x = 0; x < tile.width; ++x) {
+                        int dark = 0, area = 0;
+                        for (int sy = (tile.first_row + y) * scale; sy < std::min((tile.first_row + y + 1) * scale, source_rows); ++sy) {
+                            for (int sx = x * scale; sx < std::min((x + 1) * scale, check_width); ++sx) {
+                                uint64_t bit = (uint64_t)sy * check_width + sx;
+                                int shift = msb_first ? 7 - (int)(bit % 8) : (int)(bit % 8);
+                                dark += (bits->bytes[bit / 8] >> shift) & 1;
+                                area++;
+                            }
+                        }
+                        int expected = 255 - (dark * 255 + area / 2) / area;
+                        if (tile.gray[(size_t)y * tile.stride + x] != expected) {
+                            if (status == 0) {
+                                std::cerr << "[ERROR] Level " << level << " tile " << index << " pixel " << x << "," << y << ": "
+                                          << (int)tile.gray[(size_t)y * tile.stride + x] << ", expected " << expected << std::endl;
+                            }
+                            status = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    std::printf("Box filter against per-dot reference: %s\n", status == 0 ? "match" : "MISMATCH");
+
+    std::printf("Level  scale   rows   tiles   ms/tile   screen ms (cold)\n");
+    ReceiptTileCache cache;
+    cache.Reset(bits, width, true, false);
+    uint64_t checksum = 0;
+    for (int level = 0; level <= ReceiptTileCache::MAX_LEVEL; ++level) {
+        int level_rows = cache.rows(level);
+        int tiles = (level_rows + ReceiptTileCache::TILE_ROWS - 1) / ReceiptTileCache::TILE_ROWS;
+        int samples = std::min(tiles, 8);
+        auto start = std::chrono::steady_clock::now();
+        for (int k = 0; k < samples; ++k) {
+            ReceiptTileCache::Tile tile = ReceiptTileCache::Render(*bits, width, true, false, k * tiles / samples, level);
+            checksum += tile.bytes();
+        }
+        double per_tile = SecondsSince(start) / samples;
+        int top = std::max(level_rows - viewport, 0) / 2;
+        start = std::chrono::steady_clock::now();
+        for (int index : cache.Missing(top, top + viewport, 0, level)) checksum += cache.Get(index, level)->rows;
+        std::printf("%5d  1:%-4d %7d %7d  %8.3f   %8.2f\n", level, 1 << level, level_rows, tiles, per_tile * 1000.0,
+                    SecondsSince(start) * 1000.0);
+    }
+
+    // Zoom and pan as the canvas does: each frame asks for the screen's tiles of the level
+    double worst = 0, total = 0;
+    const int frames = 2000;
+    for (int frame = 0; frame < frames; ++frame) {
+        int level = (int)(rng() % (ReceiptTileCache::MAX_LEVEL + 1));
+        int top = (int)(rng() % (uint64_t)std::max(cache.rows(level) - viewport, 1));
+        auto start = std::chrono::steady_clock::now();
+        for (int index : cache.Missing(top, top + viewport, 0, level)) checksum += cache.Get(index, level)->rows;
+        double elapsed = SecondsSince(start);
+        worst = std::max(worst, elapsed);
+        total += elapsed;
+    }
+    const ReceiptTileCache::Stats& stats = cache.stats();
+    std::printf("Random zoom and pan: %d frames, avg %.3f ms, worst %.2f ms, cache %.1f MB, %llu tiles rendered  [%llx]\n", frames,
+                total * 1000.0 / frames, worst * 1000.0, cache.memory_bytes() / 1e6, (unsigned long long)stats.misses,
+                (unsigned long long)checksum);
+    if (status != 0) std::cerr << "[ERROR] Zoom check failed." << std::endl;
+    return status;
+}
+
+// bench png [rows]: writes a synthetic receipt as a 1-bit PNG with each row filter and
+// compares size and time with the 32-bit RGBA image the GDI+ export used to encode
+// (deflated here with the same compressor, so only the pixel format differs)
+int CmdBenchPng(const std::vector<std::string>& args) {
+    uint64_t rows = 20000;
+    if (!args.empty() && (!ParseUnsigned(args[0], rows) || rows < 100 || rows > 1000000)) {
+        std::cerr << "Usage: capture_tool bench png [rows (100 to 1000000)]" << std::endl;
+        return 2;
+    }
+    const int width = 576;
+    ReceiptBits bits;
+    bits.bytes = SyntheticReceiptBits(width, (int)rows, 7);
+    std::printf("Receipt %dx%d: 32bpp bitmap %.1f MB, PBM %.2f MB\n", width, (int)rows,
+                (double)width * rows * 4 / 1e6, (double)(width / 8) * rows / 1e6);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t argb_bytes = 0;
+    {
+        DeflateWriter deflate([&](const uint8_t*, size_t len) { argb_bytes += len; });
+        std::vector<uint8_t> row((size_t)width * 4 + 1, 0);  // Filter byte None, then RGBA
+        for (int r = 0; r < (int)rows; ++r) {
+            RenderReceiptRows(bits, width, true, false, r, 1, row.data() + 1, (ptrdiff_t)width * 4);
+            deflate.Write(row.data(), row.size());
+        }
+        deflate.Finish();
+    }
+    double argb_time = SecondsSince(start);
+    std::printf("  %-22s %9.1f KB %8.1f ms\n", "32bpp RGBA, deflated", argb_bytes / 1e3, argb_time * 1000.0);
+
+    fs::path path = fs::temp_directory_path() / ("capture_tool_bench_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".png");
+    const std::pair<PngFilter, const char*> filters[] = { { PngFilter::None, "1-bit, filter None" }, { PngFilter::Sub, "1-bit, filter Sub" },
+                                                          { PngFilter::Up, "1-bit, filter Up" }, { PngFilter::Paeth, "1-bit, filter Paeth" },
+                                                          { PngFilter::Adaptive, "1-bit, adaptive" } };
+    int result = 0;
+    for (const auto& filter : filters) {
+        std::string error;
+        start = std::chrono::steady_clock::now();
+        if (!WriteReceiptPng(path, bits, width, true, false, error, filter.first)) {
+            std::cerr << "[ERROR] " << error << std::endl;
+            result = 1;
+            break;
+        }
+        double elapsed = SecondsSince(start);
+        std::error_code ec;
+        uint64_t size = fs::file_size(path, ec);
+        std::printf("  %-22s %9.1f KB %8.1f ms  (%.0fx smaller, %.1fx faster)\n", filter.second, size / 1e3, elapsed * 1000.0,
+                    size ? (double)argb_bytes / size : 0.0, elapsed > 0 ? argb_time / elapsed : 0.0);
+    }
+    std::error_code ec;
+    fs::remove(path, ec);
+    return result;
+}
+
+// Printed dots of both, the first only and the second only, one dot at a time: bits b moved
+// down by shift rows against bits a, both MSB-first at width
+DiffCounts DiffReference(const ReceiptBits& a, const ReceiptBits& b, int width, int shift) {
+    auto dot = [&](const ReceiptBits& bits, int row, int x) {
+        if (row < 0 || row >= bits.rows(width)) return 0;
+        uint64_t bit = (uint64_t)row * width + x;
+        return (bits.bytes[bit / 8] >> (7 - bit % 8)) & 1;
+    };
+    DiffCounts counts;
+    for (int y = std::min(0, shift); y < std::max(a.rows(width), b.rows(width) + shift); ++y) {
+        for (int x = 0; x < width; ++x) {
+            int da = dot(a, y, x), db = dot(b, y - shift, x);
+            counts.both += da & db;
+            counts.removed += da & !db;
+            counts.added += db & !da;
+        }
+    }
+    return counts;
+}
+
+// bench diff [rows] [--png path]: compares a synthetic receipt of [rows] rows (default
+// 50000) with itself, with a wider copy and with an edited copy (a header added on top, a
+// line changed, a logo dropped and the end cut short); checks the shift found and each
+// kernel's counts against a dot-by-dot count, then times the comparison per kernel.
+// --png writes the edited comparison out for inspection.
+int CmdBenchDiff(const std::vector<std::string>& args) {
+    uint64_t rows = 50000;
+    std::string png;
+    bool usage = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--png" && i + 1 < args.size()) {
+            png = args[++i];
+        } else if (!ParseUnsigned(args[i], rows) || rows < 1000 || rows > 1000000) {
+            usage = true;
+        }
+    }
+    if (usage) {
+        std::cerr << "Usage: capture_tool bench diff [rows (1000 to 1000000)] [--png path]" << std::endl;
+        return 2;
+    }
+    const int width = 576, wide = 640, inserted = 37;
+    const size_t row_bytes = width / 8;
+    ReceiptBits before, wider, after;
+    before.bytes = SyntheticReceiptBits(width, (int)rows, 11);
+    for (uint64_t r = 0; r < rows; ++r) {
+        wider.bytes.insert(wider.bytes.end(), before.bytes.begin() + (ptrdiff_t)(r * row_bytes), before.bytes.begin() + (ptrdiff_t)((r + 1) * row_bytes));
+        wider.bytes.resize(wider.bytes.size() + (wide - width) / 8, 0);
+    }
+    std::mt19937_64 rng(13);
+    after.bytes.assign(inserted * row_bytes, 0);
+    for (int r = 10; r < 34; ++r) {
+        for (size_t k = 4; k < 40; ++k) after.bytes[r * row_bytes + k] = r < 12 ? 0xFF : (uint8_t)(rng() & rng());
+    }
+    after.bytes.insert(after.bytes.end(), before.bytes.begin(), before.bytes.end() - (ptrdiff_t)(100 * row_bytes));
+    uint8_t* edited = after.bytes.data() + inserted * row_bytes;
+    for (uint64_t r = rows / 3; r < rows / 3 + 24; ++r) {
+        for (size_t k = 10; k < 30; ++k) edited[r * row_bytes + k] ^= (uint8_t)(rng() & rng());
+    }
+    std::fill_n(edited + rows * 2 / 3 * row_bytes, 80 * row_bytes, 0);
+
+    int status = 0;
+    DiffCounts expected = DiffReference(before, after, width, -inserted);
+    std::printf("Receipt %dx%llu; edited copy: %llu dots in both, %llu removed, %llu added\n", width, (unsigned long long)rows,
+                (unsigned long long)expected.both, (unsigned long long)expected.removed, (unsigned long long)expected.added);
+    std::printf("%-7s %10s %10s %9s %11s %9s %9s %9s\n", "Kernel", "Identical", "Wider", "Shift", "Counts", "Search ms", "Diff ms", "MB/s");
+    for (DiffKernel kernel : { DiffKernel::Scalar, DiffKernel::Avx2 }) {
+        if (!DiffKernelSupported(kernel)) continue;
+        ReceiptDiff same = CompareReceipts(before, width, before, width, true, 256, kernel);
+        ReceiptDiff widened = CompareReceipts(before, width, wider, wide, true, 256, kernel);
+        bool identical = same.shift == 0 && same.total.changed() == 0 && same.similarity() == 1.0;
+        bool wider_same = widened.shift == 0 && widened.total.changed() == 0 && widened.width == wide;
+
+        size_t packed_bytes = DiffRowBytes(width, width);
+        PackedReceipt a = PackReceipt(before, width, true, packed_bytes), b = PackReceipt(after, width, true, packed_bytes);
+        double search = 1e9, compare = 1e9;
+        int shift = 0;
+        ReceiptDiff diff;
+        for (int round = 0; round < 5; ++round) { // Best of five
+            auto start = std::chrono::steady_clock::now();
+            shift = FindReceiptShift(a, b, 256, kernel);
+            search = std::min(search, SecondsSince(start));
+            start = std::chrono::steady_clock::now();
+            diff = DiffPackedReceipts(a, b, shift, kernel);
+            compare = std::min(compare, SecondsSince(start));
+        }
+        bool counts = diff.total.both == expected.both && diff.total.removed == expected.removed && diff.total.added == expected.added;
+        std::printf("%-7s %10s %10s %9d %11s %9.2f %9.2f %9.0f\n", DiffKernelName(kernel), identical ? "ok" : "WRONG", wider_same ? "ok" : "WRONG",
+                    shift, counts ? "ok" : "WRONG", search * 1000.0, compare * 1000.0, 2.0 * a.data.size() / 1048576.0 / std::max(compare, 1e-9));
+        if (!identical || !wider_same || shift != -inserted || !counts) status = 1;
+        if (kernel == DiffSelectedKernel()) {
+            std::printf("Similarity %.4f, %d rows changed in %zu bands:", diff.similarity(), diff.changed_rows, diff.bands.size());
+            for (const auto& band : diff.bands) std::printf(" %d-%d", diff.row_a(band.first), diff.row_a(band.second) - 1);
+            std::printf("\n");
+            if (!png.empty()) {
+                std::string error;
+                if (!WriteReceiptDiffPng(png, a, b, diff, error)) {
+                    std::cerr << "[ERROR] " << error << std::endl;
+                    status = 1;
+                }
+            }
+        }
+    }
+    if (status != 0) std::cerr << "[ERROR] Diff check failed." << std::endl;
+    return status;
+}
+
+// bench pipeline [MB]: drives the viewer's background pipeline without a window: decodes a
+// synthetic capture, reopens it from the decoded-file cache, supersedes a decode in
+// flight, then replays a width slider drag (a relayout per step, each asking for the first
+// screen of tiles) and checks that the last layout's tiles arrive and match the cache's
+// own rendering
+int CmdBenchPipeline(const std::vector<std::string>& args) {
+    uint64_t megabytes = 20;
+    if (!args.empty() && (!ParseUnsigned(args[0], megabytes) || megabytes == 0)) {
+        std::cerr << "Usage: capture_tool bench pipeline [MB]" << std::endl;
+        return 2;
+    }
+    fs::path path = fs::temp_directory_path() / ("capture_tool_bench_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".bin");
+    if (!WriteSyntheticRasterCapture(path, megabytes)) {
+        std::cerr << "[ERROR] Cannot write " << path.string() << std::endl;
+        return 1;
+    }
+
+    // Stands in for the window's message queue
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::vector<ReceiptUpdate> updates;
+    auto take = [&](std::function<bool(const std::vector<ReceiptUpdate>&)> done) {
+        std::unique_lock<std::mutex> lock(mutex);
+        arrived.wait_for(lock, std::chrono::seconds(30), [&] { return done(updates); });
+        std::vector<ReceiptUpdate> taken;
+        taken.swap(updates);
+        return taken;
+    };
+    auto count = [](const std::vector<ReceiptUpdate>& list, uint64_t generation) {
+        return (size_t)std::count_if(list.begin(), list.end(), [&](const ReceiptUpdate& u) { return u.generation == generation; });
+    };
+
+    BytePatternFilter filter(DefaultReceiptPatterns());
+    int status = 0;
+    {
+        ReceiptPipeline pipeline([&](ReceiptUpdate&& update) {
+            std::lock_guard<std::mutex> lock(mutex);
+            updates.push_back(std::move(update));
+            arrived.notify_all();
+        });
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t generation = pipeline.Decode(path, filter, 64, 1200);
+        double queued = SecondsSince(start);
+        std::vector<ReceiptUpdate> received = take([&](const std::vector<ReceiptUpdate>& list) { return count(list, generation) > 0; });
+        double decoded = SecondsSince(start);
+        if (received.empty() || received.back().kind != ReceiptUpdate::Kind::Decoded) {
+            std::cerr << "[ERROR] Decode failed: " << (received.empty() ? "no result" : received.back().error) << std::endl;
+            fs::remove(path);
+            return 1;
+        }
+        std::shared_ptr<const ReceiptBits> bits = received.back().bits;
+        int width = received.back().detection.width;
+        std::printf("Decode %.1f MB: %.2f ms on the calling thread, result after %.0f ms, width %d (%s)\n", bits->bytes.size() / 1e6,
+                    queued * 1000.0, decoded * 1000.0, width, WidthSourceName(received.back().detection.source));
+
+        // The same file opened again comes from the decoded-file cache
+        start = std::chrono::steady_clock::now();
+        generation = pipeline.Decode(path, filter, 64, 1200);
+        received = take([&](const std::vector<ReceiptUpdate>& list) { return count(list, generation) > 0; });
+        bool cached = !received.empty() && received.back().kind == ReceiptUpdate::Kind::Decoded && received.back().cached;
+        std::printf("Reopen: result after %.2f ms (%s)\n", SecondsSince(start) * 1000.0, cached ? "cached" : "decoded again");
+        if (!cached) status = 1;
+
+        // Next/previous navigation: the neighbour is prefetched while the open file is shown
+        fs::path next = path;
+        next += ".next.bin";
+        fs::copy_file(path, next, fs::copy_options::overwrite_existing);
+        start = std::chrono::steady_clock::now();
+        pipeline.Prefetch({ next }, filter);
+        for (int wait = 0; wait < 30000 && pipeline.prefetch_pending() > 0; ++wait) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        double prefetched = SecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        generation = pipeline.Decode(next, filter, 64, 1200);
+        received = take([&](const std::vector<ReceiptUpdate>& list) { return count(list, generation) > 0; });
+        cached = !received.empty() && received.back().kind == ReceiptUpdate::Kind::Decoded && received.back().cached;
+        std::printf("Next capture: prefetched in %.0f ms, result after %.2f ms (%s)\n", prefetched * 1000.0,
+                    SecondsSince(start) * 1000.0, cached ? "cached" : "decoded again");
+        if (!cached) status = 1;
+
+        // Stepping on before the prefetch finishes waits for it rather than decoding twice
+        fs::path after = path;
+        after += ".after.bin";
+        fs::copy_file(path, after, fs::copy_options::overwrite_existing);
+        pipeline.Prefetch({ after }, filter);
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        start = std::chrono::steady_clock::now();
+        generation = pipeline.Decode(after, filter, 64, 1200);
+        received = take([&](const std::vector<ReceiptUpdate>& list) { return count(list, generation) > 0; });
+        std::printf("Next capture while still prefetching: result after %.0f ms (%s, a full decode took %.0f ms)\n",
+                    SecondsSince(start) * 1000.0,
+                    !received.empty() && received.back().cached ? "prefetch finished" : "decoded", decoded * 1000.0);
+        if (received.empty() || received.back().kind != ReceiptUpdate::Kind::Decoded) status = 1;
+        fs::remove(next);
+        fs::remove(after);
+
+        // Another file picked while one is still decoding
+        fs::path other = path;
+        other += ".other.bin";
+        fs::copy_file(path, other, fs::copy_options::overwrite_existing);
+        uint64_t superseded = pipeline.Decode(other, filter, 64, 1200);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        generation = pipeline.Decode(path, filter, 64, 1200);
+        received = take([&](const std::vector<ReceiptUpdate>& list) { return count(list, generation) > 0; });
+        std::printf("Superseded decode: %zu results published (0 expected)\n", count(received, superseded));
+        if (count(received, superseded) != 0) status = 1;
+        fs::remove(other);
+
+        // Slider drag: a step every 5 ms, each wanting the first 900 rows
+        std::vector<int> first_screen;
+        for (int index = 0; index * ReceiptTileCache::TILE_ROWS < 900; ++index) first_screen.push_back(index);
+        double calling_thread = 0;
+        uint64_t last = 0;
+        int steps = 0;
+        for (int step_width = 500; step_width <= 600; step_width += 2, ++steps) {
+            auto step_start = std::chrono::steady_clock::now();
+            last = pipeline.Relayout(bits, step_width, true, false);
+            pipeline.RenderTiles(last, first_screen);
+            calling_thread += SecondsSince(step_start);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        auto drag_end = std::chrono::steady_clock::now();
+        received = take([&](const std::vector<ReceiptUpdate>& list) { return count(list, last) >= first_screen.size(); });
+        double settled = SecondsSince(drag_end);
+        size_t stale = received.size() - count(received, last);
+
+        size_t matched = 0;
+        for (const ReceiptUpdate& update : received) {
+            if (update.generation != last) continue;
+            ReceiptTileCache::Tile expected = ReceiptTileCache::Render(*bits, 600, true, false, update.tile.index);
+            if (expected.pixels == update.tile.pixels && expected.rows == update.tile.rows) matched++;
+        }
+        std::printf("Drag over %d widths: %.3f ms total on the calling thread, last screen complete %.1f ms after the drag\n", steps,
+                    calling_thread * 1000.0, settled * 1000.0);
+        std::printf("  %zu of %zu tiles of the last layout match, %zu tiles of earlier layouts published (dropped by the viewer)\n",
+                    matched, first_screen.size(), stale);
+        if (matched != first_screen.size()) status = 1;
+
+        // The same drag rendered on the calling thread, as before
+        auto sync_start = std::chrono::steady_clock::now();
+        uint64_t checksum = 0;
+        for (int step_width = 500; step_width <= 600; step_width += 2) {
+            for (int index : first_screen) checksum += ReceiptTileCache::Render(*bits, step_width, true, false, index).pixels[0];
+        }
+        std::printf("  Rendering every step on the calling thread instead: %.1f ms  [%llx]\n", SecondsSince(sync_start) * 1000.0,
+                    (unsigned long long)checksum);
+
+        // What one step used to cost: decode the file again and expand every row
+        auto former_start = std::chrono::steady_clock::now();
+        {
+            CaptureFile capture;
+            std::string error;
+            ReceiptBits again;
+            if (capture.Open(path, error) && ExtractReceiptBits(capture.client_stream(), filter, again, error)) {
+                int rows = again.rows(600);
+                std::vector<uint32_t> pixels((size_t)rows * 600);
+                RenderReceiptRows(again, 600, true, false, 0, rows, reinterpret_cast<uint8_t*>(pixels.data()), 600 * 4);
+            }
+        }
+        std::printf("  One step with the former full decode and render: %.1f ms\n", SecondsSince(former_start) * 1000.0);
+    }
+    fs::remove(path);
+    if (status != 0) std::cerr << "[ERROR] Pipeline check failed." << std::endl;
+    return status;
+}
+
+// A print stream of about bytes: 576-dot GS v 0 raster blocks of random dots behind an
+// ESC @ ESC a 1 header, or (raster false) the same rows without raster commands, each
+// block behind the given marker for the pattern filter to remove
+std::vector<uint8_t> SyntheticPrintStream(uint64_t bytes, bool raster, const BytePattern& marker, uint64_t seed) {
+    std::vector<uint8_t> stream = { 0x1B, 0x40, 0x1B, 0x61, 0x01 };
+    if (!raster) stream.resize(RECEIPT_HEADER_SIZE, 0x00);
+    std::mt19937_64 rng(seed);
+    const uint8_t header[] = { 0x1B, 0x4A, 0x18, 0x1D, 0x76, 0x30, 0x00, 0x48, 0x00, 0x18, 0x00 };
+    while (stream.size() < bytes) {
+        if (raster) stream.insert(stream.end(), header, header + sizeof(header));
+        else stream.insert(stream.end(), marker.begin(), marker.end());
+        for (int i = 0; i < 72 * 24; ++i) {
+            uint8_t b = (uint8_t)(rng() & rng());
+            stream.push_back(!raster && b == 0x1D ? 0x1C : b); // No stray GS v 0 in the fallback stream
+        }
+    }
+    return stream;
+}
+
+// The stream as a framed capture, in relay-sized frames with printer status replies between
+std::vector<uint8_t> FrameCaptureStream(const std::vector<uint8_t>& stream) {
+    std::vector<uint8_t> file(CAPTURE_FILE_HEADER_SIZE);
+    EncodeCaptureFileHeader(CaptureFileHeader(), file.data());
+    auto frame = [&](CaptureFrameKind kind, const uint8_t* data, size_t len) {
+        uint8_t header[CAPTURE_MAX_FRAME_HEADER];
+        size_t n = PutVarint(header, ((uint64_t)len << 2) | (uint8_t)kind);
+        n += PutVarint(header + n, 250);
+        file.insert(file.end(), header, header + n);
+        file.insert(file.end(), data, data + len);
+    };
+    const uint8_t status[] = { 0x12, 0x00 };
+    for (size_t offset = 0; offset < stream.size(); offset += 4096) {
+        frame(CaptureFrameKind::ClientToPrinter, stream.data() + offset, std::min<size_t>(4096, stream.size() - offset));
+        if (offset % (16 * 4096) == 0) frame(CaptureFrameKind::PrinterToClient, status, sizeof(status));
+    }
+    return file;
+}
+
+// A till receipt as a POS sends it: centred double-size header, item lines with prices
+// placed by ESC $, emphasized total, an EAN-13 barcode with its digits, a QR code, a cut
+std::vector<uint8_t> SyntheticTextReceipt(uint64_t seed) {
+    std::mt19937_64 rng(seed);
+    std::string s;
+    auto cmd = [&](std::initializer_list<int> bytes) {
+        for (int b : bytes) s += (char)b;
+    };
+    auto at = [&](int dots) { cmd({ 0x1B, '$', dots & 0xFF, dots >> 8 }); };
+    static const char* const kItems[] = { "Coffee beans 1kg", "Oat milk", "Croissant", "Sparkling water", "Dark chocolate",
+                                          "Apples (loose)", "Sourdough loaf", "Green tea", "Butter 250g", "Orange juice" };
+    cmd({ 0x1B, '@', 0x1B, 'a', 1, 0x1D, '!', 0x11 });
+    s += "CORNER MARKET\n";
+    cmd({ 0x1D, '!', 0x00 });
+    s += "12 Harbour Street\nTel 555-0134\n";
+    cmd({ 0x1B, 'a', 0 });
+    s += "Receipt " + std::to_string(10000 + seed % 90000) + "   Till 3   Op 17\n";
+    s += "------------------------------------------------\n";
+    int cents = 0;
+    int items = 8 + (int)(rng() % 12);
+    for (int i = 0; i < items; ++i) {
+        int price = 50 + (int)(rng() % 2000);
+        cents += price;
+        s += kItems[rng() % 10];
+        at(456);
+        char amount[16];
+        std::snprintf(amount, sizeof(amount), "%5d.%02d", price / 100, price % 100);
+        s += amount;
+        s += "\n";
+    }
+    s += "------------------------------------------------\n";
+    cmd({ 0x1B, 'E', 1, 0x1B, '!', 0x10 });
+    char total[64];
+    std::snprintf(total, sizeof(total), "TOTAL%*d.%02d\n", 40, cents / 100, cents % 100);
+    s += total;
+    cmd({ 0x1B, '!', 0x00, 0x1B, 'E', 0 });
+    s += "Card\tVISA ****1234\n";
+    cmd({ 0x1B, '-', 1 });
+    s += "Thank you for shopping with us!\n";
+    cmd({ 0x1B, '-', 0, 0x1B, 'a', 1, 0x1D, 'h', 80, 0x1D, 'H', 2, 0x1D, 'k', 67, 12 });
+    for (int i = 0; i < 12; ++i) s += (char)('0' + rng() % 10);
+    std::string url = "https://example.com/r/" + std::to_string(seed);
+    int length = (int)url.size() + 3;
+    cmd({ 0x1D, '(', 'k', 3, 0, 49, 67, 4, 0x1D, '(', 'k', 3, 0, 49, 69, 49, 0x1D, '(', 'k', length & 0xFF, length >> 8, 49, 80, 48 });
+    s += url;
+    cmd({ 0x1D, '(', 'k', 3, 0, 49, 81, 48, 0x1B, 'd', 3, 0x1D, 'V', 66, 24 });
+    return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+// bench tail [MB]: appends synthetic captures (raw and framed raster streams, and a stream
+// without raster commands that only the pattern filter decodes) to a file in uneven pieces
+// while following it, checking that the followed bits always equal a full decode of the
+// file so far; then follows a capture written by another thread through the viewer's
+// pipeline, mirroring its tile cache, and reports how soon new rows are published
+int CmdBenchTail(const std::vector<std::string>& args) {
+    uint64_t megabytes = 4;
+    if (!args.empty() && (!ParseUnsigned(args[0], megabytes) || megabytes == 0 || megabytes > 256)) {
+        std::cerr << "Usage: capture_tool bench tail [MB (1 to 256)]" << std::endl;
+        return 2;
+    }
+    fs::path path = fs::temp_directory_path() / ("capture_tool_bench_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".bin");
+    BytePattern marker;
+    ParseHexPattern("1B 4A 18 AA 55", marker);
+    std::vector<BytePattern> patterns = DefaultReceiptPatterns();
+    patterns.push_back(marker);
+    BytePatternFilter filter(patterns);
+    int status = 0;
+
+    struct Case {
+        const char* name;
+        std::vector<uint8_t> file;
+    };
+    std::vector<uint8_t> raster = SyntheticPrintStream(megabytes * 1024 * 1024, true, marker, 1);
+    std::vector<Case> cases;
+    cases.push_back({ "raw raster", raster });
+    cases.push_back({ "framed raster", FrameCaptureStream(raster) });
+    cases.push_back({ "filtered stream", SyntheticPrintStream(megabytes * 1024 * 1024, false, marker, 2) });
+    // A raster logo and then text receipts: taken for raster at first, text once they follow
+    std::vector<uint8_t> logo = { 0x1B, '@', 0x1D, 'v', '0', 0, 72, 0, 400 & 0xFF, 400 >> 8 }; // Longer than a piece
+    for (int i = 0; i < 72 * 400; ++i) logo.push_back((uint8_t)(i % 72 < 36 ? 0xFF : 0x00));
+    for (uint64_t seed = 1; logo.size() < megabytes * 1024 * 1024 / 8; ++seed) {
+        std::vector<uint8_t> receipt = SyntheticTextReceipt(seed);
+        logo.insert(logo.end(), receipt.begin(), receipt.end());
+    }
+    cases.push_back({ "logo and text", logo });
+    std::printf("%-16s %8s %7s %11s %12s %13s %11s\n", "Capture", "MB", "Pieces", "Mismatches", "Follow ms", "Snapshots ms", "Decode ms");
+    for (const Case& c : cases) {
+        fs::remove(path);
+        std::ofstream out(path, std::ios::binary);
+        ReceiptTail tail(path, filter);
+        std::mt19937_64 rng(3);
+        size_t pieces = 0, mismatches = 0;
+        double following = 0, snapshots = 0;
+        for (size_t offset = 0; offset < c.file.size(); ++pieces) {
+            size_t piece = rng() % 8 == 0 ? 1 + rng() % 16 : 1 + rng() % 12288; // Cuts frames, commands and patterns anywhere
+            piece = std::min(piece, c.file.size() - offset);
+            out.write(reinterpret_cast<const char*>(c.file.data() + offset), (std::streamsize)piece);
+            out.flush();
+            offset += piece;
+
+            std::string error;
+            auto start = std::chrono::steady_clock::now();
+            if (!tail.Poll(error)) {
+                std::cerr << "[ERROR] " << c.name << ": " << error << std::endl;
+                status = 1;
+                break;
+            }
+            following += SecondsSince(start);
+            bool last = offset == c.file.size();
+            if (pieces % 50 != 0 && !last) continue;
+            start = std::chrono::steady_clock::now();
+            std::shared_ptr<const ReceiptBits> followed = tail.Snapshot();
+            snapshots += SecondsSince(start);
+
+            // A full decode of what is in the file now; captures too short to hold an image count as empty
+            CaptureFile capture;
+            ReceiptBits full;
+            if (capture.Open(path, error)) ExtractReceiptBits(capture.client_stream(), filter, full, error);
+            if (followed->bytes != full.bytes || followed->removed != full.removed || followed->raster.blocks != full.raster.blocks) mismatches++;
+        }
+        out.close();
+        auto start = std::chrono::steady_clock::now();
+        {
+            CaptureFile capture;
+            ReceiptBits full;
+            std::string error;
+            if (capture.Open(path, error)) ExtractReceiptBits(capture.client_stream(), filter, full, error);
+        }
+        double decode = SecondsSince(start);
+        std::printf("%-16s %8.1f %7zu %11zu %12.1f %13.1f %11.1f\n", c.name, c.file.size() / 1048576.0, pieces, mismatches,
+                    following * 1000.0, snapshots * 1000.0, decode * 1000.0);
+        if (mismatches > 0) status = 1;
+    }
+    std::printf("  (Follow: all polls together, each decoding only the new piece; Decode: one full decode of the file.\n"
+                "   Decoding the whole file at every poll instead would cost about pieces x Decode / 2.)\n");
+
+    // A capture written while the pipeline follows it, a raster block every 2 ms
+    fs::remove(path);
+    std::mutex mutex;
+    std::condition_variable arrived;
+    std::vector<ReceiptUpdate> updates;
+    const size_t blocks = std::max<size_t>(200, (size_t)megabytes * 1024 * 1024 / (11 + 72 * 24) / 4);
+    const size_t block_size = 11 + 72 * 24;
+    std::vector<std::atomic<int64_t>> appended(blocks); // Steady clock nanoseconds when block i was written
+    {
+        ReceiptPipeline pipeline([&](ReceiptUpdate&& update) {
+            std::lock_guard<std::mutex> lock(mutex);
+            updates.push_back(std::move(update));
+            arrived.notify_all();
+        });
+        { std::ofstream create(path, std::ios::binary); }
+        uint64_t generation = pipeline.Follow(path, filter, 64, 1200);
+        std::atomic<bool> writing{ true };
+        std::thread writer([&] {
+            std::ofstream out(path, std::ios::binary | std::ios::app);
+            out.write(reinterpret_cast<const char*>(raster.data()), 5);
+            for (size_t i = 0; i < blocks; ++i) {
+                appended[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+                out.write(reinterpret_cast<const char*>(raster.data() + 5 + i * block_size), (std::streamsize)block_size);
+                out.flush();
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+            writing = false;
+        });
+
+        // The viewer's side: lay out the first result, then take each Grown update into the
+        // tile cache and ask for the tiles at the end, as a view kept at the bottom does
+        ReceiptTileCache cache;
+        std::shared_ptr<const ReceiptBits> bits;
+        std::vector<double> latencies; // Per block, from writing it to the first update holding it
+        size_t grown = 0, tiles = 0, shown = 0;
+        auto done = [&] { return !writing && bits && bits->bytes.size() == blocks * 72 * 24; };
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+        while (!done() && std::chrono::steady_clock::now() < deadline) {
+            std::vector<ReceiptUpdate> taken;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                arrived.wait_for(lock, std::chrono::milliseconds(50), [&] { return !updates.empty(); });
+                taken.swap(updates);
+            }
+            int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+            for (ReceiptUpdate& update : taken) {
+                if (update.generation != generation) continue;
+                if (update.kind == ReceiptUpdate::Kind::Failed) {
+                    std::cerr << "[ERROR] Follow failed: " << update.error << std::endl;
+                    status = 1;
+                    continue;
+                }
+                if (update.kind == ReceiptUpdate::Kind::Decoded) {
+                    bits = update.bits;
+                    generation = pipeline.Relayout(bits, 576, true, false);
+                    cache.Reset(bits, 576, true, false);
+                } else if (update.kind == ReceiptUpdate::Kind::Grown) {
+                    bits = update.bits;
+                    cache.Extend(bits);
+                    grown++;
+                } else {
+                    tiles++;
+                    cache.Insert(std::move(update.tile));
+                    continue;
+                }
+                for (; shown < bits->bytes.size() / (72 * 24); ++shown) latencies.push_back((now - appended[shown]) / 1e9);
+                pipeline.RenderTiles(generation, cache.Missing(std::max(cache.rows() - 900, 0), cache.rows(), 0));
+            }
+        }
+        writer.join();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200)); // Last tiles
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (ReceiptUpdate& update : updates) {
+                if (update.generation == generation && update.kind == ReceiptUpdate::Kind::Tile) cache.Insert(std::move(update.tile));
+            }
+        }
+
+        size_t stale = 0, checked = 0;
+        if (bits) {
+            for (int index = 0; index * ReceiptTileCache::TILE_ROWS < cache.rows(); ++index) {
+                const ReceiptTileCache::Tile* tile = cache.Find(index);
+                if (!tile) continue;
+                checked++;
+                if (tile->pixels != ReceiptTileCache::Render(*bits, 576, true, false, index).pixels) stale++;
+            }
+        }
+        std::sort(latencies.begin(), latencies.end());
+        double average = 0;
+        for (double latency : latencies) average += latency;
+        if (!latencies.empty()) average /= latencies.size();
+        std::printf("Follow through the pipeline: %zu blocks written over %.1f s, %zu updates (polled every %d ms), %zu tiles\n",
+                    blocks, blocks * 0.002, grown + 1, FOLLOW_POLL_MS, tiles);
+        std::printf("  Blocks shown %.1f ms after they were written on average, %.1f ms median, %.1f ms at worst\n", average * 1000.0,
+                    latencies.empty() ? 0.0 : latencies[latencies.size() / 2] * 1000.0, latencies.empty() ? 0.0 : latencies.back() * 1000.0);
+        std::printf("  Final bits %s the written stream; %zu of %zu cached tiles out of date\n",
+                    bits && bits->bytes.size() == blocks * 72 * 24 ? "cover" : "do NOT cover", stale, checked);
+        if (!bits || bits->bytes.size() != blocks * 72 * 24 || stale > 0 || checked == 0) status = 1;
+    }
+    fs::remove(path);
+    if (status != 0) std::cerr << "[ERROR] Tail check failed." << std::endl;
+    return status;
+}
+
+// bench escpos [receipts] [--png path]: emulates synthetic text receipts, checks that feeding
+// them in arbitrary pieces and ExtractReceiptBits give the same page, and reports the time
+// per receipt
+int CmdBenchEscPos(const std::vector<std::string>& args) {
+    uint64_t receipts = 1000;
+    std::string png;
+    bool usage = false;
+    for (size_t i = 0; i < args.size(); ++i) {
+        if (args[i] == "--png" && i + 1 < args.size()) {
+            png = args[++i];
+        } else if (!ParseUnsigned(args[i], receipts) || receipts == 0 || receipts > 1000000) {
+            usage = true;
+        }
+    }
+    if (usage) {
+        std::cerr << "Usage: capture_tool bench escpos [receipts (1 to 1000000)] [--png path]" << std::endl;
+        return 2;
+    }
+    std::vector<std::vector<uint8_t>> streams;
+    for (uint64_t i = 0; i < std::min<uint64_t>(receipts, 64); ++i) streams.push_back(SyntheticTextReceipt(i + 1));
+
+    int status = 0;
+    EscPosEmulator first;
+    first.Feed(streams[0].data(), streams[0].size());
+    first.Finish();
+    const EscPosEmulatorStats& stats = first.stats();
+    std::printf("Receipt: %zu bytes -> %dx%d dots; %llu characters, %llu lines, %llu barcode, %llu QR code, %llu cut\n",
+                streams[0].size(), first.width(), first.rows(), (unsigned long long)stats.characters, (unsigned long long)stats.lines,
+                (unsigned long long)stats.barcodes, (unsigned long long)stats.qr_codes, (unsigned long long)stats.cuts);
+    if (stats.barcodes != 1 || stats.qr_codes != 1 || stats.cuts != 1 || stats.ignored != 0) {
+        std::cerr << "[ERROR] The receipt's barcode, QR code or cut was not printed." << std::endl;
+        status = 1;
+    }
+
+    // The same page whatever the pieces the stream arrives in, and from the decoder
+    std::mt19937_64 rng(5);
+    int mismatches = 0;
+    for (const std::vector<uint8_t>& stream : streams) {
+        EscPosEmulator whole, pieces;
+        whole.Feed(stream.data(), stream.size());
+        std::vector<uint8_t> snapshot;
+        whole.Snapshot(snapshot);
+        whole.Finish();
+        for (size_t offset = 0; offset < stream.size();) {
+            size_t n = std::min<size_t>(1 + rng() % 64, stream.size() - offset);
+            pieces.Feed(stream.data() + offset, n);
+            offset += n;
+        }
+        pieces.Finish();
+        ReceiptBits bits;
+        std::string error;
+        ByteSpanList list;
+        list.Append(ByteSpan(stream.data(), stream.size()));
+        bool decoded = ExtractReceiptBits(list, BytePatternFilter(DefaultReceiptPatterns()), bits, error);
+        WidthDetection detection = DetectReceiptWidth(bits, 64, 1200);
+        if (pieces.page() != whole.page() || snapshot != whole.page() || !decoded || bits.bytes != whole.page() ||
+            detection.width != whole.width() || detection.source != WidthSource::Emulated) {
+            mismatches++;
+        }
+    }
+    std::printf("Pieces, snapshot and decoder agree: %d of %zu receipts differ\n", mismatches, streams.size());
+    if (mismatches > 0) status = 1;
+
+    // Symbol capacities against the standard's tables
+    const std::pair<int, int> capacities[] = { { 1, 19 }, { 5, 108 }, { 10, 274 }, { 40, 2956 } };
+    for (const auto& capacity : capacities) {
+        if (QrCode::DataCodewords(capacity.first, (int)QrEcc::Low) != capacity.second) {
+            std::cerr << "[ERROR] QR version " << capacity.first << " holds " << QrCode::DataCodewords(capacity.first, (int)QrEcc::Low)
+                      << " data codewords, not " << capacity.second << "." << std::endl;
+            status = 1;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t rows = 0, checksum = 0;
+    for (uint64_t i = 0; i < receipts; ++i) {
+        const std::vector<uint8_t>& stream = streams[i % streams.size()];
+        EscPosEmulator emulator;
+        emulator.Feed(stream.data(), stream.size());
+        emulator.Finish();
+        rows += (uint64_t)emulator.rows();
+        checksum += Crc32cUpdate(0, emulator.page().data(), emulator.page().size());
+    }
+    double elapsed = SecondsSince(start);
+    std::printf("Emulated %llu receipts (%llu rows) in %.1f ms: %.1f us per receipt  [%llx]\n", (unsigned long long)receipts,
+                (unsigned long long)rows, elapsed * 1000.0, elapsed * 1e6 / receipts, (unsigned long long)checksum);
+
+    if (!png.empty()) {
+        ReceiptBits bits;
+        bits.bytes = first.page();
+        bits.page_width = first.width();
+        std::string error;
+        if (!WriteReceiptPng(png, bits, first.width(), true, false, error)) {
+            std::cerr << "[ERROR] " << error << std::endl;
+            status = 1;
+        }
+    }
+    if (status != 0) std::cerr << "[ERROR] Emulator check failed." << std::endl;
+    return status;
+}
+
+// A synthetic job of [labels] labels or pages in language, each with the text "Parcel
+// <seed>-<label>". ZPL and EPL labels carry text, a Code 128 barcode, a QR code, a box and a
+// graphic; PCL pages are raster rows in PackBits and delta row compression after a text line;
+// Star tickets are a text line and raster rows. first_page gets the first PCL page's dots.
+std::vector<uint8_t> SyntheticLanguageJob(PrintLanguage language, uint64_t seed, int labels, std::vector<uint8_t>* first_page = nullptr) {
+    std::mt19937_64 rng(seed);
+    std::string s;
+    auto digits = [&](int count) {
+        std::string text;
+        for (int i = 0; i < count; ++i) text += (char)('0' + rng() % 10);
+        return text;
+    };
+    const int width = language == PrintLanguage::Star ? 576 : language == PrintLanguage::Zpl ? 600 : 608;
+    const size_t row_bytes = (size_t)width / 8;
+    if (language == PrintLanguage::Pcl) s += "\x1B%-12345X@PJL JOB NAME=\"bench\"\r\n@PJL ENTER LANGUAGE=PCL\r\n\x1B" "E";
+    if (language == PrintLanguage::Star) s += "\x1B@";
+    for (int label = 1; label <= labels; ++label) {
+        std::string name = "Parcel " + std::to_string(seed) + "-" + std::to_string(label);
+        if (language == PrintLanguage::Zpl) {
+            static const char kHex[] = "0123456789ABCDEF";
+            std::string graphic;
+            for (int i = 0; i < 128; ++i) graphic += kHex[rng() % 16];
+            s += "^XA^PW600^LL400\n^FO20,20^A0N,30,20^FD" + name + "^FS\n";
+            s += "^BY2^FO20,70^BCN,60,Y,N,N^FD" + digits(12) + "^FS\n";
+            s += "^FO400,60^BQN,2,4^FDQA,https://example.com/l/" + std::to_string(seed) + "-" + std::to_string(label) + "^FS\n";
+            s += "^FO10,10^GB580,380,3^FS\n^FO20,300^GFA,64,64,8," + graphic + "^FS\n^XZ\n";
+        } else if (language == PrintLanguage::Epl) {
+            s += "N\nq608\nQ400,24\nA20,20,0,3,1,1,N,\"" + name + "\"\n";
+            s += "B20,70,0,1,2,4,60,B,\"" + digits(12) + "\"\n";
+            s += "b400,60,Q,s4,\"https://example.com/l/" + std::to_string(seed) + "-" + std::to_string(label) + "\"\n";
+            s += "X10,10,3,590,390\nGW20,300,8,8,";
+            for (int i = 0; i < 64; ++i) s += (char)(rng() & 0xFF); // May hold line breaks
+            s += "\nP1\n";
+        } else if (language == PrintLanguage::Pcl) {
+            s += name + "\r\n\x1B*r" + std::to_string(width) + "S\x1B*r1A";
+            std::vector<uint8_t> previous(row_bytes, 0), page;
+            int rows = 120 + (int)(rng() % 80);
+            for (int r = 0; r < rows; ++r) {
+                if (r % 40 == 39) { // Skipped rows, which also clear the seed row
+                    s += "\x1B*b3Y";
+                    page.resize(page.size() + 3 * row_bytes, 0);
+                    std::fill(previous.begin(), previous.end(), 0);
+                    continue;
+                }
+                std::vector<uint8_t> row = previous;
+                for (int k = 0; k < 6; ++k) row[rng() % row_bytes] = (uint8_t)rng();
+                if (r % 8 == 0) std::fill(row.begin() + (long)(rng() % row_bytes / 2), row.begin() + (long)(row_bytes * 3 / 4), 0xFF);
+                std::string data;
+                if (r % 2 == 0) { // PackBits: runs of 3 or more, literals between them
+                    s += "\x1B*b2M";
+                    for (size_t i = 0; i < row.size();) {
+                        size_t run = 1;
+                        while (i + run < row.size() && row[i + run] == row[i] && run < 128) ++run;
+                        if (run >= 3) {
+                            data += (char)(int8_t)(1 - (int)run);
+                            data += (char)row[i];
+                            i += run;
+                            continue;
+                        }
+                        size_t literal = 0;
+                        while (i + literal < row.size() && literal < 128 &&
+                               !(i + literal + 2 < row.size() && row[i + literal] == row[i + literal + 1] && row[i + literal] == row[i + literal + 2])) {
+                            ++literal;
+                        }
+                        data += (char)(literal - 1);
+                        data.append(reinterpret_cast<const char*>(row.data() + i), literal);
+                        i += literal;
+                    }
+                } else { // Delta row: each changed byte, at its offset from the last replacement
+                    s += "\x1B*b3M";
+                    size_t position = 0;
+                    for (size_t i = 0; i < row.size(); ++i) {
+                        if (row[i] == previous[i]) continue;
+                        size_t offset = i - position;
+                        data += (char)std::min<size_t>(offset, 31);
+                        if (offset >= 31) {
+                            for (offset -= 31; offset >= 255; offset -= 255) data += (char)255;
+                            data += (char)offset;
+                        }
+                        data += (char)row[i];
+                        position = i + 1;
+                    }
+                }
+                s += "\x1B*b" + std::to_string(data.size()) + "W" + data;
+                page.insert(page.end(), row.begin(), row.end());
+                previous = row;
+            }
+            s += "\x1B*rC\x0C";
+            if (label == 1 && first_page) *first_page = page;
+        } else if (language == PrintLanguage::Star) {
+            s += "\x1B\x1D" "a\x01" + name + "\n\x1B\x1D" "a" + std::string(1, '\0') + "\x1B*rA";
+            int rows = 60 + (int)(rng() % 60);
+            for (int r = 0; r < rows; ++r) {
+                s += "b";
+                s += (char)row_bytes;
+                s += '\0';
+                for (size_t k = 0; k < row_bytes; ++k) s += (char)(r % 16 < 8 ? rng() & 0xFF : 0);
+            }
+            s += "\x1B*rY24" + std::string(1, '\0') + "\x1B*rB";
+        }
+    }
+    if (language == PrintLanguage::Pcl) s += "\x1B" "E\x1B%-12345X";
+    return std::vector<uint8_t>(s.begin(), s.end());
+}
+
+// bench languages [jobs]: decodes synthetic ZPL, EPL, PCL and Star jobs, checks that each is
+// sniffed as its language (and ESC/POS receipts as ESC/POS), that feeding them in pieces,
+// snapshots, the decoder and a live tail agree, that PCL rows decompress to what was
+// compressed and that the text index finds their text, then times decoding [jobs] (default
+// 2000) jobs of each language
+int CmdBenchLanguages(const std::vector<std::string>& args) {
+    uint64_t jobs = 2000;
+    if (args.size() > 1 || (!args.empty() && (!ParseUnsigned(args[0], jobs) || jobs == 0 || jobs > 1000000))) {
+        std::cerr << "Usage: capture_tool bench languages [jobs (1 to 1000000)]" << std::endl;
+        return 2;
+    }
+    const PrintLanguage languages[] = { PrintLanguage::Zpl, PrintLanguage::Epl, PrintLanguage::Pcl, PrintLanguage::Star };
+    BytePatternFilter filter(DefaultReceiptPatterns());
+    fs::path path = fs::temp_directory_path() / ("capture_tool_bench_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".bin");
+    int status = 0;
+
+    int missniffed = 0;
+    for (uint64_t seed = 1; seed <= 64; ++seed) {
+        std::vector<uint8_t> receipt = SyntheticTextReceipt(seed);
+        if (SniffPrintLanguage(std::string_view(reinterpret_cast<const char*>(receipt.data()), receipt.size())).language != PrintLanguage::EscPos) missniffed++;
+    }
+    BytePattern marker;
+    ParseHexPattern("1B 4A 18 AA 55", marker);
+    std::vector<uint8_t> raster = SyntheticPrintStream(64 * 1024, true, marker, 1);
+    if (SniffPrintLanguage(std::string_view(reinterpret_cast<const char*>(raster.data()), raster.size())).language != PrintLanguage::EscPos) missniffed++;
+
+    std::printf("%-9s %5s %6s %8s %11s %9s %9s %11s\n", "Language", "Jobs", "Pages", "Width", "Mismatches", "Text", "Rows", "Sniffed");
+    std::mt19937_64 rng(7);
+    for (PrintLanguage language : languages) {
+        const PrintLanguageSpec& spec = PrintLanguageInfo(language);
+        int mismatches = 0, text_missing = 0, rows_differ = 0, sniffed = 0, jobs_checked = 0;
+        uint64_t pages = 0;
+        int width = 0;
+        for (uint64_t seed = 1; seed <= 24; ++seed, ++jobs_checked) {
+            int labels = 1 + (int)(seed % 3);
+            std::vector<uint8_t> first_page;
+            std::vector<uint8_t> job = SyntheticLanguageJob(language, seed, labels, &first_page);
+            if (SniffPrintLanguage(std::string_view(reinterpret_cast<const char*>(job.data()), job.size())).language == language) sniffed++;
+
+            std::unique_ptr<PageDecoder> whole = spec.create(), pieces = spec.create(), prefix = spec.create();
+            whole->Feed(job.data(), job.size());
+            whole->Finish();
+            size_t split = (size_t)(rng() % job.size());
+            std::vector<uint8_t> snapshot;
+            std::vector<uint64_t> snapshot_cuts;
+            for (size_t offset = 0; offset < job.size();) {
+                size_t n = std::min<size_t>(1 + rng() % 97, job.size() - offset);
+                if (offset < split && offset + n > split) n = split - offset; // Stop at the split to snapshot there
+                pieces->Feed(job.data() + offset, n);
+                offset += n;
+                if (offset == split) pieces->Snapshot(snapshot, snapshot_cuts);
+            }
+            pieces->Finish();
+            prefix->Feed(job.data(), split);
+            prefix->Finish();
+            pages += whole->pages();
+            width = whole->width();
+
+            ByteSpanList list;
+            list.Append(ByteSpan(job.data(), job.size()));
+            ReceiptBits bits;
+            std::string error;
+            bool decoded = ExtractReceiptBits(list, filter, bits, error);
+            WidthDetection detection = DetectReceiptWidth(bits, 64, 1200);
+
+            // The tail of the job written in pieces
+            fs::remove(path);
+            std::shared_ptr<const ReceiptBits> tailed;
+            {
+                std::ofstream out(path, std::ios::binary);
+                ReceiptTail tail(path, filter);
+                for (size_t offset = 0; offset < job.size();) {
+                    size_t n = std::min<size_t>(1 + rng() % 300, job.size() - offset);
+                    out.write(reinterpret_cast<const char*>(job.data() + offset), (std::streamsize)n);
+                    out.flush();
+                    offset += n;
+                    if (!tail.Poll(error)) break;
+                    tailed = tail.Snapshot();
+                }
+            }
+
+            if (whole->pages() != (uint64_t)labels || whole->cuts().size() != (size_t)labels - 1 || pieces->page() != whole->page() ||
+                pieces->cuts() != whole->cuts() || snapshot != prefix->page() || snapshot_cuts != prefix->cuts() || !decoded ||
+                bits.language != language || bits.bytes != whole->page() || bits.cuts != whole->cuts() ||
+                detection.source != WidthSource::Emulated || detection.width != whole->width() || !tailed ||
+                tailed->language != language || tailed->bytes != bits.bytes || tailed->cuts != bits.cuts) {
+                mismatches++;
+            }
+            if (!first_page.empty() && (whole->page().size() < first_page.size() || !std::equal(first_page.begin(), first_page.end(), whole->page().begin()))) {
+                rows_differ++;
+            }
+            std::string text = ExtractReceiptText(list);
+            for (int label = 1; label <= labels; ++label) {
+                if (text.find("Parcel " + std::to_string(seed) + "-" + std::to_string(label)) == std::string::npos) {
+                    text_missing++;
+                    break;
+                }
+            }
+        }
+        std::printf("%-9s %5d %6llu %8d %11d %9d %9d %8d/%d\n", spec.name, jobs_checked, (unsigned long long)pages, width, mismatches,
+                    text_missing, rows_differ, sniffed, jobs_checked);
+        if (mismatches > 0 || text_missing > 0 || rows_differ > 0 || sniffed != jobs_checked) status = 1;
+    }
+    fs::remove(path);
+    std::printf("ESC/POS receipts sniffed as another language: %d of 65\n", missniffed);
+    if (missniffed > 0) status = 1;
+
+    // PCL XL is recognized, not decoded
+    std::string pclxl = "\x1B%-12345X@PJL ENTER LANGUAGE=PCLXL\r\n) HP-PCL XL;2;0;Comment\r\n";
+    pclxl += std::string("\xC0\x00\xF8\x86\xC0\x03\xF8\x8F\xD1\x58\x02\x58\x02\xF8\x89\x41", 16);
+    ByteSpanList pclxl_list;
+    pclxl_list.Append(ByteSpan(reinterpret_cast<const uint8_t*>(pclxl.data()), pclxl.size()));
+    ReceiptBits pclxl_bits;
+    std::string pclxl_error;
+    if (SniffPrintLanguage(pclxl_list).language != PrintLanguage::PclXl || ExtractReceiptBits(pclxl_list, filter, pclxl_bits, pclxl_error) ||
+        !ExtractReceiptText(pclxl_list).empty()) {
+        std::cerr << "[ERROR] PCL XL was decoded rather than reported." << std::endl;
+        status = 1;
+    } else {
+        std::printf("PCL XL: %s\n", pclxl_error.c_str());
+    }
+
+    std::printf("%-9s %8s %8s %11s %8s %8s\n", "Language", "MB", "Pages", "Decode ms", "MB/s", "us/job");
+    for (PrintLanguage language : languages) {
+        std::vector<std::vector<uint8_t>> samples;
+        for (uint64_t seed = 1; seed <= 16; ++seed) samples.push_back(SyntheticLanguageJob(language, seed, 2));
+        uint64_t bytes = 0, pages = 0, checksum = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < jobs; ++i) {
+            const std::vector<uint8_t>& job = samples[i % samples.size()];
+            ByteSpanList list;
+            list.Append(ByteSpan(job.data(), job.size()));
+            ReceiptBits bits;
+            std::string error;
+            if (!ExtractReceiptBits(list, filter, bits, error)) status = 1;
+            bytes += job.size();
+            pages += bits.cuts.size() + 1;
+            checksum += Crc32cUpdate(0, bits.bytes.data(), bits.bytes.size());
+        }
+        double elapsed = SecondsSince(start);
+        std::printf("%-9s %8.2f %8llu %11.1f %8.1f %8.1f  [%llx]\n", PrintLanguageInfo(language).name, bytes / 1048576.0, (unsigned long long)pages,
+                    elapsed * 1000.0, bytes / 1048576.0 / std::max(elapsed, 1e-9), elapsed * 1e6 / jobs, (unsigned long long)checksum);
+    }
+    if (status != 0) std::cerr << "[ERROR] Printer language check failed." << std::endl;
+    return status;
+}
+
+// bench search [jobs]: indexes synthetic receipt captures through a real catalog in rounds,
+// checks queries against a brute-force scan, then times queries on an index of [jobs]
+// (default one million) synthetic receipts
+int CmdBenchSearch(const std::vector<std::string>& args) {
+    uint64_t scale = 1000000;
+    if (args.size() > 1 || (!args.empty() && (!ParseUnsigned(args[0], scale) || scale == 0 || scale > UINT32_MAX))) {
+        std::cerr << "Usage: capture_tool bench search [jobs]" << std::endl;
+        return 2;
+    }
+    fs::path dir = fs::temp_directory_path() / "capture_tool_bench_search";
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir / "scale", ec);
+    int status = 0;
+    auto fail = [&status](const std::string& what) {
+        std::cout << "[FAIL] " << what << std::endl;
+        status = 1;
+    };
+
+    // Receipts from the emulator bench; every 10th adds a line in code page PC858, every
+    // 50th is a raster image without text
+    const uint64_t jobs = 1000, indexed = 900, round = 100;
+    JobCatalogWriter writer;
+    std::string error;
+    if (!writer.Open(dir / JOB_CATALOG_FILENAME, error)) {
+        std::cerr << "[ERROR] " << error << std::endl;
+        return 1;
+    }
+    std::vector<std::vector<std::string>> truth;
+    auto add_job = [&](uint64_t seed) {
+        std::vector<uint8_t> stream = SyntheticTextReceipt(seed);
+        if (seed % 50 == 0) {
+            stream = { 0x1B, '@', 0x1D, 'v', '0', 0, 4, 0, 2, 0 };
+            stream.insert(stream.end(), 8, (uint8_t)(seed & 0xFF));
+        } else if (seed % 10 == 0) {
+            const uint8_t line[] = { 0x1B, 't', 19, 'C', 'a', 'f', 0x82, ' ', 'C', 'r', 0x8A, 'm', 'e', ' ', 0xD5, '4', '.', '5', '0', '\n' };
+            stream.insert(stream.end(), line, line + sizeof(line));
+        }
+        JobRecord job;
+        job.start_unix_us = 1704067200ull * 1000000ull + seed * 60000000ull;
+        job.end_unix_us = job.start_unix_us + 500000;
+        job.bytes_to_printer = stream.size();
+        job.client = "192.168.1.20:50000";
+        job.upstream = "10.0.0.10:9100";
+        job.capture = "job_" + std::to_string(seed) + RAW_CAPTURE_EXTENSION;
+        std::ofstream(dir / job.capture, std::ios::binary).write(reinterpret_cast<const char*>(stream.data()), (std::streamsize)stream.size());
+        writer.Append(job, error);
+        ByteSpanList list;
+        list.Append(ByteSpan{ stream.data(), stream.size() });
+        truth.push_back(ReceiptTerms(ExtractReceiptText(list)));
+    };
+    auto start = std::chrono::steady_clock::now();
+    JobTextUpdateStats update;
+    double update_seconds = 0;
+    for (uint64_t seed = 1; seed <= jobs; ++seed) {
+        add_job(seed);
+        if (seed % round != 0 || seed > indexed) continue;
+        JobCatalog catalog;
+        JobTextIndex index;
+        auto update_start = std::chrono::steady_clock::now();
+        if (!catalog.Open(dir, error) || !index.Open(dir, catalog.rows(), error) || !index.Update(catalog, 4, &update, error)) {
+            std::cerr << "[ERROR] " << error << std::endl;
+            return 1;
+        }
+        update_seconds += SecondsSince(update_start);
+    }
+    std::printf("Indexed %llu of %llu captures in rounds of %llu: %.1f ms (%.0f jobs/s), %llu with text, %llu unreadable, %zu merges\n",
+                (unsigned long long)update.jobs, (unsigned long long)jobs, (unsigned long long)round, update_seconds * 1000.0,
+                update_seconds > 0 ? update.jobs / update_seconds : 0.0, (unsigned long long)update.with_text,
+                (unsigned long long)update.unreadable, update.merges);
+
+    JobCatalog catalog;
+    JobTextIndex index;
+    if (!catalog.Open(dir, error) || !index.Open(dir, catalog.rows(), error)) {
+        std::cerr << "[ERROR] " << error << std::endl;
+        return 1;
+    }
+    size_t files = 0;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        files += it->path().filename().string().rfind(JOB_TEXT_PREFIX, 0) == 0 ? 1 : 0;
+    }
+    std::printf("Index: %llu jobs in %zu segments (%zu files), %llu terms, %llu KB; %llu jobs left unindexed\n",
+                (unsigned long long)index.covered(), index.segments(), files, (unsigned long long)index.terms(),
+                (unsigned long long)(index.bytes() / 1024), (unsigned long long)(catalog.rows() - index.covered()));
+    if (index.covered() != indexed || files != index.segments()) fail("index does not cover the indexed rounds exactly");
+
+    auto brute_force = [&](const std::vector<JobTextTerm>& query) {
+        std::vector<uint64_t> rows;
+        for (uint64_t row = 0; row < truth.size(); ++row) {
+            const std::vector<std::string>& terms = truth[row];
+            bool all = std::all_of(query.begin(), query.end(), [&terms](const JobTextTerm& q) {
+                return std::any_of(terms.begin(), terms.end(), [&q](const std::string& t) { return JobTextTermMatches(q, t); });
+            });
+            if (all) rows.push_back(row);
+        }
+        return rows;
+    };
+    std::vector<std::string> queries = { "CAFÉ", "caf*", "crème 4.50", "sourdough", "butter 250g", "spark* water", "Oat milk",
+                                         "green tea 3.57", "example.com/r/42", "total", "10042", "Receipt 10999", "visa ****1234",
+                                         "thank you", "1*", "no such word" };
+    for (uint64_t seed = 3; seed <= jobs; seed += 37) queries.push_back("Receipt " + std::to_string(10000 + seed));
+    size_t mismatched = 0, matched = 0;
+    start = std::chrono::steady_clock::now();
+    for (const std::string& text : queries) {
+        std::vector<JobTextTerm> query = ParseJobTextQuery(text);
+        std::vector<uint64_t> rows = index.Search(query, &catalog);
+        matched += rows.size();
+        if (rows != brute_force(query)) {
+            ++mismatched;
+            fail("\"" + text + "\" matched " + std::to_string(rows.size()) + " jobs, " + std::to_string(brute_force(query).size()) + " expected");
+        }
+    }
+    std::printf("%zu queries against a brute-force scan: %zu differ, %zu matches, %.2f ms per query (100 jobs read per query)\n",
+                queries.size(), mismatched, matched, SecondsSince(start) * 1000.0 / queries.size());
+    if (brute_force(ParseJobTextQuery("café")).size() != jobs / 10 - jobs / 50) fail("code page PC858 text was not decoded");
+
+    // Scale: synthetic receipt text straight into segments, as an update would write them
+    static const char* const kWords[] = { "Coffee beans 1kg", "Oat milk", "Croissant", "Sparkling water", "Dark chocolate",
+                                          "Apples (loose)", "Sourdough loaf", "Green tea", "Butter 250g", "Orange juice",
+                                          "Bagel", "Cheddar 200g", "Bananas", "Rice 2kg", "Olive oil", "Tomatoes", "Pasta 500g",
+                                          "Yoghurt", "Eggs x12", "Honey" };
+    auto receipt_text = [&](uint64_t row) {
+        uint64_t h = row * 0x9E3779B97F4A7C15ull + 1;
+        auto next = [&h]() {
+            h ^= h >> 31;
+            h *= 0xBF58476D1CE4E5B9ull;
+            h ^= h >> 29;
+            return h;
+        };
+        std::string text = "CORNER MARKET " + std::to_string(next() % 40) + "\nReceipt " + std::to_string(100000000 + row) + " Till " +
+                           std::to_string(next() % 8) + "\n";
+        int items = 6 + (int)(next() % 10);
+        for (int i = 0; i < items; ++i) {
+            uint64_t price = 50 + next() % 2000;
+            text += std::string(kWords[next() % 20]) + " " + std::to_string(price / 100) + "." + std::to_string(10 + price % 90) + "\n";
+        }
+        return text + "TOTAL\nVISA ****" + std::to_string(1000 + next() % 9000) + "\n";
+    };
+    JobTextIndex big;
+    if (!big.Open(dir / "scale", 0, error)) {
+        std::cerr << "[ERROR] " << error << std::endl;
+        return 1;
+    }
+    start = std::chrono::steady_clock::now();
+    JobTextUpdateStats scale_update;
+    for (uint64_t first = 0; first < scale; first += JOB_TEXT_BATCH_ROWS) {
+        uint64_t end = std::min(scale, first + JOB_TEXT_BATCH_ROWS);
+        std::vector<std::vector<std::string>> terms((size_t)(end - first));
+        std::atomic<uint64_t> next(first);
+        auto work = [&]() {
+            for (uint64_t row; (row = next.fetch_add(1)) < end;) terms[(size_t)(row - first)] = ReceiptTerms(receipt_text(row));
+        };
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < std::max(1u, std::thread::hardware_concurrency()); ++t) workers.emplace_back(work);
+        work();
+        for (std::thread& worker : workers) worker.join();
+        JobTextSegmentBuilder builder(first);
+        for (uint64_t row = first; row < end; ++row) builder.Add(row, terms[(size_t)(row - first)]);
+        if (!big.AddSegment(builder, end, &scale_update, error)) {
+            std::cerr << "[ERROR] " << error << std::endl;
+            return 1;
+        }
+    }
+    std::printf("Indexed %llu synthetic receipts in %.2f s: %zu segments after %zu merges, %llu terms, %.1f MB\n",
+                (unsigned long long)scale, SecondsSince(start), big.segments(), scale_update.merges,
+                (unsigned long long)big.terms(), big.bytes() / 1048576.0);
+
+    auto run = [&](const std::string& text, uint64_t expect_row) {
+        const int repeats = 20;
+        std::vector<JobTextTerm> query = ParseJobTextQuery(text);
+        std::vector<uint64_t> rows;
+        JobTextSearchStats stats;
+        auto query_start = std::chrono::steady_clock::now();
+        for (int i = 0; i < repeats; ++i) {
+            stats = JobTextSearchStats();
+            rows = big.Search(query, nullptr, &stats);
+        }
+        std::printf("  %-34s %9zu matches  %9.3f ms  (%llu postings, %llu blocks probed)\n", ("\"" + text + "\"").c_str(), rows.size(),
+                    SecondsSince(query_start) * 1000.0 / repeats, (unsigned long long)stats.postings, (unsigned long long)stats.probes);
+        if (expect_row != UINT64_MAX && (rows.size() != 1 || rows[0] != expect_row)) fail("\"" + text + "\" did not find only its receipt");
+    };
+    uint64_t probe_row = scale * 2 / 3;
+    std::string number = std::to_string(100000000 + probe_row);
+    run(number, probe_row);
+    run("Receipt " + number + " total", probe_row);
+    run("visa " + number, probe_row);
+    run(number.substr(0, number.size() - 1) + "*", UINT64_MAX);
+    run("butter tea", UINT64_MAX);
+    run("Sourdough 12.34", UINT64_MAX);
+    run("corner market receipt total", UINT64_MAX);
+
+    std::mt19937_64 rng(7);
+    size_t wrong = 0;
+    const int lookups = 1000;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < lookups; ++i) {
+        uint64_t row = rng() % scale;
+        std::vector<uint64_t> rows = big.Search(ParseJobTextQuery("receipt " + std::to_string(100000000 + row)));
+        wrong += rows.size() == 1 && rows[0] == row ? 0 : 1;
+    }
+    std::printf("%d random receipt numbers: %zu not found exactly, %.3f ms per query\n", lookups, wrong, SecondsSince(start) * 1000.0 / lookups);
+    if (wrong > 0) fail("receipt number lookups");
+    fs::remove_all(dir, ec);
+    return status;
+}
+
+// A driver's session of [receipts] tickets on one connection, and where each should end:
+// text receipts cut by GS V (function B), ESC i or ESC m, raster receipts whose image data
+// holds GS V bytes, a partial cut followed by a full one, feeds and a second cut between
+// receipts, and a trailing feed that is no receipt
+std::vector<uint8_t> SyntheticShiftStream(uint64_t receipts, uint64_t seed, std::vector<ReceiptRange>& expected) {
+    std::mt19937_64 rng(seed);
+    std::vector<uint8_t> stream;
+    auto cmd = [&](std::initializer_list<int> bytes) {
+        for (int b : bytes) stream.push_back((uint8_t)b);
+    };
+    expected.clear();
+    for (uint64_t i = 0; i < receipts; ++i) {
+        uint64_t start = stream.size();
+        switch (i % 4) {
+            case 0: { // Ends with GS V 66 24
+                std::vector<uint8_t> receipt = SyntheticTextReceipt(seed + i);
+                stream.insert(stream.end(), receipt.begin(), receipt.end());
+            } break;
+            case 1: { // Raster, partial cut then full cut
+                cmd({ 0x1B, '@' });
+                int rows = 24 + (int)(rng() % 200);
+                cmd({ 0x1D, 'v', '0', 0, 72, 0, rows & 0xFF, rows >> 8 });
+                for (int k = 0; k < 72 * rows; ++k) stream.push_back((uint8_t)(rng() & rng()));
+                cmd({ 0x1D, 'V', 0, 0x1D, 'V', 1, 0x1B, 'd', 3, 0x1B, 'i', 0x1D, 'V', 0 });
+            } break;
+            case 2: { // Text, cut, then feeds and another cut
+                std::vector<uint8_t> receipt = SyntheticTextReceipt(seed + i);
+                receipt.resize(receipt.size() - 4);
+                stream.insert(stream.end(), receipt.begin(), receipt.end());
+                cmd({ 0x1B, 'd', 4, 0x1D, 'V', 1, 0x1B, 'J', 48, 0x1D, 'V', 66, 0 });
+            } break;
+            default: { // Text, ESC m
+                std::vector<uint8_t> receipt = SyntheticTextReceipt(seed + i);
+                receipt.resize(receipt.size() - 4);
+                stream.insert(stream.end(), receipt.begin(), receipt.end());
+                cmd({ 0x1B, 'd', 5, 0x1B, 'm' });
+            } break;
+        }
+        expected.push_back({ start, stream.size() });
+    }
+    cmd({ 0x1B, 'd', 2 });
+    return stream;
+}
+
+bool SameReceipts(const std::vector<ReceiptRange>& a, const std::vector<ReceiptRange>& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](const ReceiptRange& x, const ReceiptRange& y) {
+        return x.start == y.start && x.end == y.end;
+    });
+}
+
+// bench split [receipts]: splits a synthetic session of many receipts whole, in uneven
+// pieces as the relay sees it, through the .receipts index of a raw and a framed capture
+// (resuming after the capture grew) and through the decoder's cut offsets, checking every
+// boundary; decodes receipts alone from the index and compares them with their part of
+// the whole page; then times splitting a long session
+int CmdBenchSplit(const std::vector<std::string>& args) {
+    uint64_t receipts = 400;
+    if (args.size() > 1 || (!args.empty() && (!ParseUnsigned(args[0], receipts) || receipts == 0 || receipts > 100000))) {
+        std::cerr << "Usage: capture_tool bench split [receipts (1 to 100000)]" << std::endl;
+        return 2;
+    }
+    int status = 0;
+    auto fail = [&](const std::string& what) {
+        std::cerr << "[ERROR] " << what << " differ." << std::endl;
+        status = 1;
+    };
+    std::vector<ReceiptRange> expected;
+    std::vector<uint8_t> stream = SyntheticShiftStream(receipts, 1, expected);
+    ByteSpanList list;
+    list.Append(ByteSpan(stream.data(), stream.size()));
+    std::printf("Session: %llu receipts, %.1f MB\n", (unsigned long long)receipts, stream.size() / 1e6);
+
+    ReceiptIndex whole = SplitReceipts(list, stream.size());
+    if (!SameReceipts(whole.receipts, expected) || whole.closed != expected.size()) fail("Receipts split from the whole stream");
+
+    std::mt19937_64 rng(7);
+    ReceiptSplitter pieces;
+    for (size_t offset = 0; offset < stream.size();) {
+        size_t n = std::min<size_t>(1 + rng() % 8192, stream.size() - offset);
+        pieces.Feed(stream.data() + offset, n);
+        offset += n;
+    }
+    pieces.Finish();
+    if (!SameReceipts(pieces.Index(0).receipts, expected)) fail("Receipts split from pieces");
+
+    // An open receipt at the end counts once it prints
+    std::vector<uint8_t> open = stream;
+    const char tail[] = "Receipt still printing\n";
+    open.insert(open.end(), tail, tail + sizeof(tail) - 1);
+    ByteSpanList open_list;
+    open_list.Append(ByteSpan(open.data(), open.size()));
+    ReceiptIndex open_index = SplitReceipts(open_list, open.size());
+    if (open_index.closed != expected.size() || open_index.receipts.size() != expected.size() + 1 ||
+        open_index.receipts.back().start != expected.back().end || open_index.receipts.back().end != open.size()) {
+        fail("Open receipt");
+    }
+
+    // Index files: written for half the capture, extended when it grew, then up to date
+    fs::path dir = fs::temp_directory_path() / ("capture_tool_bench_split_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    std::vector<uint8_t> framed = FrameCaptureStream(stream);
+    struct Capture {
+        const char* name;
+        const std::vector<uint8_t>* bytes;
+    };
+    const Capture captures[] = { { "raw", &stream }, { "framed", &framed } };
+    for (const Capture& capture : captures) {
+        fs::path path = dir / (std::string("data_") + capture.name + (capture.bytes == &framed ? ".cap" : ".bin"));
+        auto write = [&](size_t size) {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(capture.bytes->data()), (std::streamsize)size);
+        };
+        ReceiptIndex index, reread;
+        ReceiptIndexUpdate first, second, third;
+        std::string error;
+        write(capture.bytes->size() / 2);
+        bool ok = UpdateReceiptIndex(path, index, first, error);
+        write(capture.bytes->size());
+        ok = ok && UpdateReceiptIndex(path, index, second, error) && UpdateReceiptIndex(path, index, third, error);
+        ok = ok && ReadReceiptIndex(path, reread);
+        std::printf("%-6s capture: index extended by scanning %.1f of %.1f MB, then up to date: %s\n", capture.name,
+                    second.bytes_scanned / 1e6, stream.size() / 1e6, ok && second.written && !third.written ? "yes" : "no");
+        if (!ok || !SameReceipts(index.receipts, expected) || !SameReceipts(reread.receipts, expected) ||
+            second.bytes_scanned >= stream.size() || !second.written || third.written) {
+            fail(std::string("Receipts of the ") + capture.name + " capture's index");
+        }
+    }
+
+    // The decoder's cuts start the same receipts, and each receipt decoded alone from the
+    // index begins its part of the whole page (raster receipts alone are decoded without
+    // the emulator, so without the cut's dashed line; text ones fill their part exactly)
+    const BytePatternFilter filter(DefaultReceiptPatterns());
+    ReceiptBits bits;
+    std::string error;
+    if (!ExtractReceiptBits(list, filter, bits, error) || bits.page_width == 0) {
+        fail("Decoded page");
+    } else {
+        std::vector<uint64_t> starts = bits.receipt_starts();
+        starts.push_back(bits.bytes.size());
+        size_t different = 0;
+        if (starts.size() != expected.size() + 1) {
+            fail("Receipt starts from the decoder's cuts");
+        } else {
+            for (size_t k = 0; k < expected.size(); ++k) {
+                ReceiptBits alone;
+                uint64_t part = starts[k + 1] - starts[k];
+                bool exact = k + 1 < expected.size();
+                if (!ExtractReceiptBits(list.Skip(expected[k].start).Take(expected[k].size()), filter, alone, error) ||
+                    alone.bytes.size() > part || (exact && alone.page_width > 0 && alone.bytes.size() != part) ||
+                    !std::equal(alone.bytes.begin(), alone.bytes.end(), bits.bytes.begin() + (ptrdiff_t)starts[k])) {
+                    ++different;
+                }
+            }
+        }
+        std::printf("Decoder: %zu receipt starts, %zu receipts decoded alone differ from the page\n", starts.size() - 1, different);
+        if (different > 0) fail("Receipts decoded alone");
+    }
+    fs::remove_all(dir, ec);
+
+    // Throughput, fed in relay-sized pieces
+    std::vector<uint8_t> big;
+    while (big.size() < 64u * 1024 * 1024) big.insert(big.end(), stream.begin(), stream.end());
+    auto start = std::chrono::steady_clock::now();
+    ReceiptSplitter splitter;
+    for (size_t offset = 0; offset < big.size(); offset += 4096) splitter.Feed(big.data() + offset, std::min<size_t>(4096, big.size() - offset));
+    splitter.Finish();
+    double elapsed = SecondsSince(start);
+    ReceiptIndex big_index = splitter.Index(big.size());
+    std::printf("Split %.1f MB into %zu receipts in %.1f ms: %.0f MB/s\n", big.size() / 1e6, big_index.receipts.size(),
+                elapsed * 1000.0, elapsed > 0 ? big.size() / 1e6 / elapsed : 0.0);
+    if (status != 0) std::cerr << "[ERROR] Split check failed." << std::endl;
+    return status;
+}
+
+// bench <what> [arguments]: micro-benchmarks for the tools' building blocks
+// bench hash [hashes]: checks receipt hashes on rendered jobs kept in a synthetic catalog,
+// and the multi-index table and clustering against a scan on [hashes] synthetic hashes
+int CmdBenchHash(const std::vector<std::string>& args) {
+    uint64_t count = 1000000;
+    if (args.size() > 1 || (!args.empty() && (!ParseUnsigned(args[0], count) || count < 1000 || count > 100000000))) {
+        std::cerr << "Usage: capture_tool bench hash [hashes (1000 to 100000000)]" << std::endl;
+        return 2;
+    }
+    int status = 0;
+    auto fail = [&status](const std::string& what) {
+        std::cout << "[FAIL] " << what << std::endl;
+        status = 1;
+    };
+    const int distance = JOB_HASH_DISTANCE;
+    const unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    // Receipts printed three ways (as sent, with paper fed before and after, and as a copy
+    // with another receipt number), then labels and pages of the other languages, appended
+    // to a catalog and hashed in rounds as they come
+    fs::path dir = fs::temp_directory_path() / "capture_tool_bench_hash";
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    fs::create_directories(dir, ec);
+    const uint64_t receipts = 100;
+    std::vector<std::vector<uint8_t>> streams;
+    std::vector<uint64_t> group;          // Per job: the receipt it prints, 0 for the other languages
+    for (uint64_t seed = 1; seed <= receipts; ++seed) {
+        std::vector<uint8_t> stream = SyntheticTextReceipt(seed);
+        std::vector<uint8_t> fed = { 0x1B, 'J', 240 };
+        fed.insert(fed.end(), stream.begin(), stream.end());
+        fed.insert(fed.end(), { '\n', '\n', '\n', '\n', 0x1B, 'J', 200 });
+        std::vector<uint8_t> copy = stream;
+        const std::string number = "Receipt ";
+        auto at = std::search(copy.begin(), copy.end(), number.begin(), number.end());
+        if (at != copy.end()) std::fill(at + (ptrdiff_t)number.size(), at + (ptrdiff_t)number.size() + 5, (uint8_t)'9');
+        for (std::vector<uint8_t>* job : { &stream, &fed, &copy }) {
+            streams.push_back(std::move(*job));
+            group.push_back(seed);
+        }
+    }
+    for (PrintLanguage language : { PrintLanguage::Zpl, PrintLanguage::Epl, PrintLanguage::Pcl, PrintLanguage::Star }) {
+        for (uint64_t seed = 1; seed <= 25; ++seed) {
+            streams.push_back(SyntheticLanguageJob(language, seed, 1));
+            group.push_back(0);
+        }
+    }
+    const uint64_t jobs = streams.size(), round = 128;
+    JobCatalogWriter writer;
+    std::string error;
+    if (!writer.Open(dir / JOB_CATALOG_FILENAME, error)) {
+        std::cerr << "[ERROR] " << error << std::endl;
+        return 1;
+    }
+    JobHashUpdateStats update;
+    double update_seconds = 0;
+    for (uint64_t row = 0; row < jobs; ++row) {
+        JobRecord job;
+        job.start_unix_us = 1704067200ull * 1000000ull + row * 60000000ull;
+        job.end_unix_us = job.start_unix_us + 500000;
+        job.bytes_to_printer = streams[row].size();
+        job.client = "192.168.1.20:50000";
+        job.upstream = "10.0.0.10:9100";
+        job.capture = "job_" + std::to_string(row + 1) + RAW_CAPTURE_EXTENSION;
+        std::ofstream(dir / job.capture, std::ios::binary).write(reinterpret_cast<const char*>(streams[row].data()), (std::streamsize)streams[row].size());
+        writer.Append(job, error);
+        if ((row + 1) % round != 0 && row + 1 != jobs) continue;
+        JobCatalog catalog;
+        JobHashIndex index;
+        auto start = std::chrono::steady_clock::now();
+        if (!catalog.Open(dir, error) || !index.Open(dir, catalog.rows(), error) || !index.Update(catalog, threads, &update, error)) {
+            std::cerr << "[ERROR] " << error << std::endl;
+            return 1;
+        }
+        update_seconds += SecondsSince(start);
+    }
+    JobCatalog catalog;
+    JobHashIndex index;
+    if (!catalog.Open(dir, error) || !index.Open(dir, catalog.rows(), error)) {
+        std::cerr << "[ERROR] " << error << std::endl;
+        return 1;
+    }
+    std::printf("Hashed %llu jobs in rounds of %llu: %.1f ms (%.0f jobs/s), %llu with a receipt, %llu unreadable; %llu KB\n",
+                (unsigned long long)update.jobs, (unsigned long long)round, update_seconds * 1000.0,
+                update_seconds > 0 ? update.jobs / update_seconds : 0.0, (unsigned long long)update.hashed,
+                (unsigned long long)update.unreadable, (unsigned long long)(fs::file_size(dir / JOB_HASH_FILENAME, ec) / 1024));
+    if (index.covered() != jobs || update.jobs != jobs || update.hashed != jobs) fail("not every job has a hash");
+    const BytePatternFilter filter(DefaultReceiptPatterns());
+    for (uint64_t row = 0; row < index.covered(); row += 7) {
+        JobHash direct = HashJob(dir, catalog.record(row), filter);
+        if (direct.hash != index.job(row).hash || direct.rows != index.job(row).rows) fail("stored hash of job " + std::to_string(row + 1));
+    }
+
+    // Distances: each receipt's reprints and the receipt moved 16 dots right on the paper,
+    // other receipts of the template, and the other languages
+    int fed_max = 0, copy_max = 0, moved_max = 0, template_min = RECEIPT_HASH_BITS, language_min = RECEIPT_HASH_BITS;
+    double template_sum = 0;
+    uint64_t template_pairs = 0;
+    for (uint64_t r = 0; r < receipts; ++r) {
+        const ReceiptHash& sent = index.job(3 * r).hash;
+        fed_max = std::max(fed_max, ReceiptHashDistance(sent, index.job(3 * r + 1).hash));
+        copy_max = std::max(copy_max, ReceiptHashDistance(sent, index.job(3 * r + 2).hash));
+        ReceiptBits bits, moved;
+        ByteSpanList list;
+        list.Append(ByteSpan{ streams[3 * r].data(), streams[3 * r].size() });
+        ExtractReceiptBits(list, filter, bits, error);
+        size_t row_bytes = (size_t)bits.page_width / 8, rows = bits.bytes.size() / row_bytes;
+        moved.bytes.assign(rows * (row_bytes + 2), 0); // On paper 16 dots wider
+        for (size_t y = 0; y < rows; ++y) std::memcpy(moved.bytes.data() + y * (row_bytes + 2) + 2, bits.bytes.data() + y * row_bytes, row_bytes);
+        ReceiptHash hash;
+        ComputeReceiptHash(moved, bits.page_width + 16, true, hash);
+        moved_max = std::max(moved_max, ReceiptHashDistance(sent, hash));
+        for (uint64_t other = r + 1; other < receipts; ++other) {
+            int d = ReceiptHashDistance(sent, index.job(3 * other).hash);
+            template_min = std::min(template_min, d);
+            template_sum += d;
+            template_pairs++;
+        }
+        for (uint64_t row = 3 * receipts; row < jobs; ++row) language_min = std::min(language_min, ReceiptHashDistance(sent, index.job(row).hash));
+    }
+    std::printf("Distances of %d bits: paper fed %d, moved %d, copy %d at most; other receipts %d to %.1f on average; labels and pages %d or more\n",
+                RECEIPT_HASH_BITS, fed_max, moved_max, copy_max, template_min, template_pairs ? template_sum / template_pairs : 0.0, language_min);
+    if (fed_max != 0 || moved_max != 0) fail("paper fed or a move on the paper changed the hash");
+    if (copy_max > distance) fail("a copy is not a near-duplicate");
+    if (language_min <= distance) fail("a label or page is a near-duplicate of a receipt");
+
+    ReceiptHashClusters rendered = ClusterReceiptHashes(index.Hashes(), index.HashedRows(), distance, threads);
+    size_t split = 0, mixed = 0;
+    std::vector<size_t> cluster_of(jobs, SIZE_MAX);
+    for (size_t c = 0; c < rendered.clusters.size(); ++c) {
+        for (uint32_t row : rendered.clusters[c]) {
+            cluster_of[row] = c;
+            if ((group[row] == 0) != (group[rendered.clusters[c].front()] == 0)) mixed++;
+        }
+    }
+    for (uint64_t r = 0; r < receipts; ++r) {
+        if (cluster_of[3 * r] == SIZE_MAX || cluster_of[3 * r + 1] != cluster_of[3 * r] || cluster_of[3 * r + 2] != cluster_of[3 * r]) split++;
+    }
+    std::printf("Clustered %llu jobs within %d bits: %zu clusters, %llu distinct hashes; %zu receipts split from a reprint, %zu with both receipts and labels\n",
+                (unsigned long long)jobs, distance, rendered.clusters.size(), (unsigned long long)rendered.distinct, split, mixed);
+    if (split > 0) fail("reprints of a receipt in different clusters");
+    if (mixed > 0) fail("clusters of receipts and labels or pages");
+    fs::remove_all(dir, ec);
+
+    // Synthetic hashes: count / 100 random receipts, each printed as copies up to 6 bits
+    // apart from it, so copies are within 12 of each other and receipts about 128 apart
+    std::mt19937_64 rng(7);
+    const uint64_t bases = std::max<uint64_t>(1, count / 100);
+    std::vector<ReceiptHash> hashes((size_t)count);
+    std::vector<uint32_t> base_of((size_t)count);
+    std::vector<ReceiptHash> base_hashes((size_t)bases);
+    for (ReceiptHash& base : base_hashes) {
+        for (uint64_t& word : base.words) word = rng();
+    }
+    auto flip = [&rng](ReceiptHash& hash, int bits) {
+        for (int k = 0; k < bits; ++k) {
+            unsigned bit = (unsigned)(rng() % RECEIPT_HASH_BITS);
+            hash.words[bit / 64] ^= 1ull << (bit % 64);
+        }
+    };
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        base_of[i] = (uint32_t)(rng() % bases);
+        hashes[i] = base_hashes[base_of[i]];
+        flip(hashes[i], (int)(rng() % 4)); // Up to 3 flips each way; with repeats, at most 6 bits
+        flip(hashes[i], (int)(rng() % 4));
+    }
+
+    std::vector<uint16_t> scalar(hashes.size()), fast(hashes.size());
+    auto start = std::chrono::steady_clock::now();
+    HashDistancesScalar(hashes[0], hashes.data(), nullptr, hashes.size(), scalar.data());
+    double scalar_seconds = SecondsSince(start);
+    std::printf("Distance scan: %-6s %8.2f ms (%.0f M hashes/s)\n", "scalar", scalar_seconds * 1000.0, hashes.size() / scalar_seconds / 1e6);
+    for (DiffKernel kernel : { DiffKernel::Avx2 }) {
+        if (!DiffKernelSupported(kernel)) continue;
+        start = std::chrono::steady_clock::now();
+        HashDistances(kernel, hashes[0], hashes.data(), nullptr, hashes.size(), fast.data());
+        double seconds = SecondsSince(start);
+        std::printf("Distance scan: %-6s %8.2f ms (%.0f M hashes/s, %.1fx)\n", DiffKernelName(kernel), seconds * 1000.0,
+                    hashes.size() / seconds / 1e6, scalar_seconds / seconds);
+        if (fast != scalar) fail(std::string(DiffKernelName(kernel)) + " distances");
+    }
+
+    start = std::chrono::steady_clock::now();
+    ReceiptHashTable table;
+    table.Build(hashes);
+    std::printf("Table of %llu hashes built in %.1f ms\n", (unsigned long long)count, SecondsSince(start) * 1000.0);
+    const int queries = 200;
+    for (int radius : { 8, 16, 24, 40, 56 }) {
+        ReceiptHashScratch scratch;
+        ReceiptHashQueryStats stats;
+        std::vector<ReceiptHashMatch> matches;
+        double query_seconds = 0, scan_seconds = 0;
+        size_t found = 0, mismatched = 0;
+        for (int q = 0; q < queries; ++q) {
+            ReceiptHash query = hashes[(size_t)(rng() % count)];
+            flip(query, (int)(rng() % 8));
+            start = std::chrono::steady_clock::now();
+            table.Query(query, radius, matches, scratch, &stats);
+            query_seconds += SecondsSince(start);
+            start = std::chrono::steady_clock::now();
+            HashDistances(DiffSelectedKernel(), query, hashes.data(), nullptr, hashes.size(), fast.data());
+            std::vector<uint32_t> expected;
+            for (size_t i = 0; i < fast.size(); ++i) {
+                if (fast[i] <= radius) expected.push_back((uint32_t)i);
+            }
+            scan_seconds += SecondsSince(start);
+            std::vector<uint32_t> got;
+            for (const ReceiptHashMatch& match : matches) got.push_back(match.id);
+            std::sort(got.begin(), got.end());
+            mismatched += got != expected ? 1 : 0;
+            found += got.size();
+        }
+        std::printf("Within %2d bits: %8.3f ms per query (%5.1f matches, %8.0f candidates%s), scan %7.3f ms (%.0fx)\n", radius,
+                    query_seconds * 1000.0 / queries, (double)found / queries, (double)stats.candidates / queries,
+                    stats.scans > 0 ? ", scanned" : "", scan_seconds * 1000.0 / queries, query_seconds > 0 ? scan_seconds / query_seconds : 0.0);
+        if (mismatched > 0) fail(std::to_string(mismatched) + " queries within " + std::to_string(radius) + " bits differ from a scan");
+    }
+
+    std::vector<uint32_t> all(hashes.size());
+    std::iota(all.begin(), all.end(), 0u);
+    std::vector<unsigned> thread_counts = { 1 };
+    if (threads > 1) thread_counts.push_back(threads);
+    for (unsigned t : thread_counts) {
+        start = std::chrono::steady_clock::now();
+        ReceiptHashClusters result = ClusterReceiptHashes(hashes, all, distance, t);
+        double seconds = SecondsSince(start);
+        // Every cluster is one receipt's copies, all of them
+        std::vector<uint64_t> copies((size_t)bases, 0);
+        for (uint32_t b : base_of) copies[b]++;
+        size_t wrong = 0, expected = 0;
+        for (uint64_t c : copies) expected += c >= 2 ? 1 : 0;
+        for (const std::vector<uint32_t>& cluster : result.clusters) {
+            uint32_t b = base_of[cluster.front()];
+            bool whole = cluster.size() == copies[b] && std::all_of(cluster.begin(), cluster.end(), [&](uint32_t i) { return base_of[i] == b; });
+            wrong += whole ? 0 : 1;
+        }
+        std::printf("Clustered %llu hashes on %u threads: %8.1f ms, %zu clusters (%llu distinct, %llu pairs, %.0f candidates per hash)\n",
+                    (unsigned long long)count, t, seconds * 1000.0, result.clusters.size(), (unsigned long long)result.distinct,
+                    (unsigned long long)result.pairs, result.distinct ? (double)result.queries.candidates / result.distinct : 0.0);
+        if (wrong > 0 || result.clusters.size() != expected) fail("clusters are not the receipts' copies");
+    }
+    std::cout << (status == 0 ? "All checks passed." : "Some checks failed.") << std::endl;
+    return status;
+}
+
+int CmdBench(const std::vector<std::string>& args) {
+    std::vector<std::string> rest(args.begin() + (args.empty() ? 0 : 1), args.end());
+    if (!args.empty() && args[0] == "catalog") return CmdBenchCatalog(rest);
+    if (!args.empty() && args[0] == "crc") return CmdBenchCrc(rest);
+    if (!args.empty() && args[0] == "filter") return CmdBenchFilter(rest);
+    if (!args.empty() && args[0] == "unpack") return CmdBenchUnpack(rest);
+    if (!args.empty() && args[0] == "decode") return CmdBenchDecode(rest);
+    if (!args.empty() && args[0] == "tiles") return CmdBenchTiles(rest);
+    if (!args.empty() && args[0] == "width") return CmdBenchWidth(rest);
+    if (!args.empty() && args[0] == "pipeline") return CmdBenchPipeline(rest);
+    if (!args.empty() && args[0] == "png") return CmdBenchPng(rest);
+    if (!args.empty() && args[0] == "diff") return CmdBenchDiff(rest);
+    if (!args.empty() && args[0] == "zoom") return CmdBenchZoom(rest);
+    if (!args.empty() && args[0] == "tail") return CmdBenchTail(rest);
+    if (!args.empty() && args[0] == "escpos") return CmdBenchEscPos(rest);
+    if (!args.empty() && args[0] == "languages") return CmdBenchLanguages(rest);
+    if (!args.empty() && args[0] == "search") return CmdBenchSearch(rest);
+    if (!args.empty() && args[0] == "split") return CmdBenchSplit(rest);
+    if (!args.empty() && args[0] == "hash") return CmdBenchHash(rest);
+    std::cerr << "Usage: capture_tool bench <catalog [rows] | crc [MB] | filter [MB] | unpack [Mpixels] | decode [MB] | tiles [rows] |" << std::endl;
+    std::cerr << "                          width [rows] | pipeline [MB] | png [rows] | diff [rows] | zoom [rows] | tail [MB] | escpos [receipts] |" << std::endl;
+    std::cerr << "                          languages [jobs] | search [jobs] | split [receipts] | hash [hashes]>" << std::endl;
+    return 2;
+}
+
+void PrintUsage() {
+    std::cerr << "Usage: capture_tool <command> [arguments]" << std::endl;
+    std::cerr << "Commands:" << std::endl;
+    std::cerr << "  info <capture>                       Show format, endpoints and per-direction totals" << std::endl;
+    std::cerr << "  to-raw <capture.cap> [output.bin]    Convert a framed capture to the raw .bin layout" << std::endl;
+    std::cerr << "  to-pcapng <capture|dir>... -o <out.pcapng> [--printer ip:port]" << std::endl;
+    std::cerr << "                                       Export captures as synthetic TCP flows, merged by time" << std::endl;
+    std::cerr << "  jobs [--from t] [--to t] [--client ip[:port]] [--printer ip[:port]] [--min-bytes n]" << std::endl;
+    std::cerr << "       [--max-bytes n] [--outcome name] [--limit n] [--dir printer_data] [--reindex]" << std::endl;
+    std::cerr << "                                       Query the job catalog" << std::endl;
+    std::cerr << "  search <word>... [--from t] [--to t] [--limit n] [--lines] [--dir printer_data] [--threads n]" << std::endl;
+    std::cerr << "         [--no-update]" << std::endl;
+    std::cerr << "                                       Find the jobs that printed all the words, through the text index" << std::endl;
+    std::cerr << "  cluster [--distance n] [--min-size n] [--limit n] [--list] [--dir printer_data] [--threads n] [--no-update]" << std::endl;
+    std::cerr << "                                       Group the jobs whose receipts look alike, by perceptual hash" << std::endl;
+    std::cerr << "  similar <job id|capture> [--distance n] [--limit n] [--dir printer_data] [--threads n] [--no-update]" << std::endl;
+    std::cerr << "                                       List the jobs whose receipts look like the given one" << std::endl;
+    std::cerr << "  verify <capture|dir>... [--threads n] [--quiet]" << std::endl;
+    std::cerr << "                                       Check capture checksums against the checksum frames and job catalog" << std::endl;
+    std::cerr << "  escpos <capture> [--limit n] [--summary]" << std::endl;
+    std::cerr << "                                       List the ESC/POS commands sent to the printer" << std::endl;
+    std::cerr << "  width <capture> [--min n] [--max n] [--scan]" << std::endl;
+    std::cerr << "                                       Detect the raster width of the printed image" << std::endl;
+    std::cerr << "  split <capture|dir>... [--list] [--rescan] [--quiet]" << std::endl;
+    std::cerr << "                                       Find the receipts of each capture and update its .receipts index" << std::endl;
+    std::cerr << "  render <capture|dir>... [-o dir] [--format png|pbm] [--width n|auto] [--lsb] [--invert]" << std::endl;
+    std::cerr << "         [--receipt k|all] [--threads n] [--quiet]" << std::endl;
+    std::cerr << "                                       Write captures (or single receipts) as 1-bit PNG or PBM images, in parallel" << std::endl;
+    std::cerr << "  thumbs <capture|dir>... [--width n|auto] [--threads n] [--no-cache] [--pgm dir] [--quiet]" << std::endl;
+    std::cerr << "                                       Build the folder preview thumbnails and their cache" << std::endl;
+    std::cerr << "  diff <before> <after> [--receipt k] [--width n|auto] [--lsb] [--shift n] [-o diff.png]" << std::endl;
+    std::cerr << "                                       Compare two captured receipts dot by dot and draw the differences" << std::endl;
+    std::cerr << "  bench catalog [rows]                 Time catalog indexing and queries on synthetic data" << std::endl;
+    std::cerr << "  bench crc [MB]                       Measure CRC32C throughput per implementation" << std::endl;
+    std::cerr << "  bench filter [MB]                    Time raster header removal on a synthetic print stream" << std::endl;
+    std::cerr << "  bench unpack [Mpixels]               Check and time the 1bpp to ARGB unpack kernels" << std::endl;
+    std::cerr << "  bench decode [MB]                    Time and measure peak memory of decoding a large capture" << std::endl;
+    std::cerr << "  bench tiles [rows]                   Scroll a long synthetic roll through the viewer's tile cache" << std::endl;
+    std::cerr << "  bench width [rows]                   Detect the width of synthetic receipts from their bit stream" << std::endl;
+    std::cerr << "  bench pipeline [MB]                  Run the viewer's background decode and render pipeline headless" << std::endl;
+    std::cerr << "  bench png [rows]                     Compare 1-bit PNG export with the former 32bpp image" << std::endl;
+    std::cerr << "  bench diff [rows] [--png path]       Check and time comparing receipts on a synthetic edited copy" << std::endl;
+    std::cerr << "  bench zoom [rows]                    Check and time the zoom pyramid on a long synthetic receipt" << std::endl;
+    std::cerr << "  bench tail [MB]                      Check and time following captures while they are written" << std::endl;
+    std::cerr << "  bench escpos [receipts] [--png path] Check and time the ESC/POS emulator on text receipts" << std::endl;
+    std::cerr << "  bench languages [jobs]               Check and time the ZPL, EPL, PCL and Star decoders" << std::endl;
+    std::cerr << "  bench search [jobs]                  Check the text index against a scan and time queries over [jobs]" << std::endl;
+    std::cerr << "  bench split [receipts]               Check receipt boundaries of a synthetic session and time splitting" << std::endl;
+    std::cerr << "  bench hash [hashes]                  Check receipt hashes and time near-duplicate search and clustering" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        PrintUsage();
+        return 2;
+    }
+    std::string command = argv[1];
+    std::vector<std::string> args(argv + 2, argv + argc);
+
+    if (command == "info") return CmdInfo(args);
+    if (command == "to-raw") return CmdToRaw(args);
+    if (command == "to-pcapng") return CmdToPcapng(args);
+    if (command == "jobs") return CmdJobs(args);
+    if (command == "search") return CmdSearch(args);
+    if (command == "cluster") return CmdCluster(args);
+    if (command == "similar") return CmdSimilar(args);
+    if (command == "verify") return CmdVerify(args);
+    if (command == "escpos") return CmdEscPos(args);
+    if (command == "width") return CmdWidth(args);
+    if (command == "split") return CmdSplit(args);
+    if (command == "render") return CmdRender(args);
+    if (command == "thumbs") return CmdThumbs(args);
+    if (command == "diff") return CmdDiff(args);
+    if (command == "bench") return CmdBench(args);
+
+    std::cerr << "[ERROR] Unknown command: " << command << std::endl;
+    PrintUsage();
+    return 2;
+}
@@ -0,0 +1,215 @@
+#pragma once
+
+// 1 bit per pixel -> 32-bit ARGB expansion for the receipt viewers and tools.
+//
+// A set bit is a printed (black) dot. MsbFirst selects which bit of a byte is the leftmost
+// pixel, Invert swaps black and white; both are template parameters so each combination
+// compiles to its own branch-free kernel. UnpackBits() takes a bit offset because the
+// viewers wrap the bit stream at an arbitrary width, so rows rarely start on a byte.
+//
+// Kernels: AVX2 (8 pixels per byte in one register), SSE2 (two registers per byte) and a
+// 256-entry table of 8 pixels per byte. The table is used everywhere: one 32-byte copy per
+// byte beats both vector kernels while the output stays in cache (bench unpack), and large
+// outputs are bound by memory bandwidth whichever kernel runs. The vector kernels stay
+// selectable for the benchmark.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BIT_UNPACK_X86 1
+#include <emmintrin.h>
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define BIT_UNPACK_TARGET_AVX2
+#define BIT_UNPACK_TARGET_SSE2
+#else
+#include <cpuid.h>
+#define BIT_UNPACK_TARGET_AVX2 __attribute__((target("avx2")))
+#define BIT_UNPACK_TARGET_SSE2 __attribute__((target("sse2")))
+#endif
+#endif
+
+constexpr uint32_t UNPACK_BLACK = 0xFF000000;
+constexpr uint32_t UNPACK_WHITE = 0xFFFFFFFF;
+
+template <bool MsbFirst, bool Invert>
+constexpr uint32_t UnpackPixel(unsigned bit) {
+    return (bit != 0) != Invert ? UNPACK_BLACK : UNPACK_WHITE;
+}
+
+template <bool MsbFirst>
+constexpr unsigned UnpackBitAt(uint8_t byte, unsigned position) { // position 0 = leftmost pixel
+    return MsbFirst ? (byte >> (7 - position)) & 1 : (byte >> position) & 1;
+}
+
+// --- Scalar kernels ---
+
+template <bool MsbFirst, bool Invert>
+struct UnpackTable {
+    uint32_t pixels[256][8];
+
+    UnpackTable() {
+        for (unsigned b = 0; b < 256; ++b) {
+            for (unsigned i = 0; i < 8; ++i) pixels[b][i] = UnpackPixel<MsbFirst, Invert>(UnpackBitAt<MsbFirst>((uint8_t)b, i));
+        }
+    }
+
+    static const UnpackTable& Get() {
+        static const UnpackTable table;
+        return table;
+    }
+};
+
+// Whole bytes: 8 pixels per source byte
+template <bool MsbFirst, bool Invert>
+inline void UnpackBytesTable(const uint8_t* src, size_t bytes, uint32_t* dst) {
+    const auto& table = UnpackTable<MsbFirst, Invert>::Get().pixels;
+    for (size_t i = 0; i < bytes; ++i, dst += 8) std::memcpy(dst, table[src[i]], 32);
+}
+
+#if defined(BIT_UNPACK_X86)
+// --- SIMD kernels ---
+// Each byte is broadcast to all lanes, ANDed with a per-lane bit mask and compared, giving
+// all-ones where the dot is printed; pixel = base ^ (mask & 0x00FFFFFF) then flips white to
+// black (or black to white when inverted).
+
+template <bool MsbFirst, bool Invert>
+BIT_UNPACK_TARGET_SSE2 inline void UnpackBytesSse2(const uint8_t* src, size_t bytes, uint32_t* dst) {
+    const __m128i bits_lo = MsbFirst ? _mm_setr_epi32(0x80, 0x40, 0x20, 0x10) : _mm_setr_epi32(0x01, 0x02, 0x04, 0x08);
+    const __m128i bits_hi = MsbFirst ? _mm_setr_epi32(0x08, 0x04, 0x02, 0x01) : _mm_setr_epi32(0x10, 0x20, 0x40, 0x80);
+    const __m128i base = _mm_set1_epi32((int)(Invert ? UNPACK_BLACK : UNPACK_WHITE));
+    const __m128i flip = _mm_set1_epi32(0x00FFFFFF);
+    for (size_t i = 0; i < bytes; ++i, dst += 8) {
+        __m128i b = _mm_set1_epi32(src[i]);
+        __m128i lo = _mm_cmpeq_epi32(_mm_and_si128(b, bits_lo), bits_lo);
+        __m128i hi = _mm_cmpeq_epi32(_mm_and_si128(b, bits_hi), bits_hi);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_xor_si128(base, _mm_and_si128(lo, flip)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4), _mm_xor_si128(base, _mm_and_si128(hi, flip)));
+    }
+}
+
+template <bool MsbFirst, bool Invert>
+BIT_UNPACK_TARGET_AVX2 inline void UnpackBytesAvx2(const uint8_t* src, size_t bytes, uint32_t* dst) {
+    const __m256i bits = MsbFirst ? _mm256_setr_epi32(0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01)
+                                  : _mm256_setr_epi32(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+    const __m256i base = _mm256_set1_epi32((int)(Invert ? UNPACK_BLACK : UNPACK_WHITE));
+    const __m256i flip = _mm256_set1_epi32(0x00FFFFFF);
+    // Four source bytes per iteration: one load, then a byte shuffle broadcasts each byte
+    const __m256i select[4] = {
+        _mm256_set1_epi32((int)0x80808000), _mm256_set1_epi32((int)0x80808001),
+        _mm256_set1_epi32((int)0x80808002), _mm256_set1_epi32((int)0x80808003),
+    };
+    size_t i = 0;
+    for (; i + 4 <= bytes; i += 4, dst += 32) {
+        uint32_t word;
+        std::memcpy(&word, src + i, 4);
+        __m256i v = _mm256_set1_epi32((int)word);
+        for (int k = 0; k < 4; ++k) {
+            __m256i b = _mm256_shuffle_epi8(v, select[k]);
+            __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(b, bits), bits);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 8 * k), _mm256_xor_si256(base, _mm256_and_si256(set, flip)));
+        }
+    }
+    for (; i < bytes; ++i, dst += 8) {
+        __m256i b = _mm256_set1_epi32(src[i]);
+        __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(b, bits), bits);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_xor_si256(base, _mm256_and_si256(set, flip)));
+    }
+}
+
+inline bool UnpackAvx2Supported() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 6) != 6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE)) return false;
+    unsigned int xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6) return false;
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2) != 0;
+#endif
+}
+
+inline bool UnpackSse2Supported() {
+#if defined(_M_X64) || defined(__x86_64__)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & bit_SSE2) != 0;
+#endif
+}
+#endif
+
+// --- Dispatch ---
+
+enum class UnpackKernel { Table, Sse2, Avx2 };
+
+inline const char* UnpackKernelName(UnpackKernel kernel) {
+    switch (kernel) {
+        case UnpackKernel::Table: return "table";
+        case UnpackKernel::Sse2: return "sse2";
+        case UnpackKernel::Avx2: return "avx2";
+    }
+    return "?";
+}
+
+inline bool UnpackKernelSupported(UnpackKernel kernel) {
+#if defined(BIT_UNPACK_X86)
+    if (kernel == UnpackKernel::Avx2) return UnpackAvx2Supported();
+    if (kernel == UnpackKernel::Sse2) return UnpackSse2Supported();
+#else
+    if (kernel != UnpackKernel::Table) return false;
+#endif
+    return true;
+}
+
+inline UnpackKernel UnpackSelectedKernel() {
+    return UnpackKernel::Table;
+}
+
+template <bool MsbFirst, bool Invert>
+inline void UnpackBytes(UnpackKernel kernel, const uint8_t* src, size_t bytes, uint32_t* dst) {
+#if defined(BIT_UNPACK_X86)
+    if (kernel == UnpackKernel::Avx2) return UnpackBytesAvx2<MsbFirst, Invert>(src, bytes, dst);
+    if (kernel == UnpackKernel::Sse2) return UnpackBytesSse2<MsbFirst, Invert>(src, bytes, dst);
+#endif
+    UnpackBytesTable<MsbFirst, Invert>(src, bytes, dst);
+}
+
+// Expands count pixels starting at bit bit_offset of src into dst
+template <bool MsbFirst, bool Invert>
+inline void UnpackBits(const uint8_t* src, uint64_t bit_offset, size_t count, uint32_t* dst, UnpackKernel kernel = UnpackSelectedKernel()) {
+    src += bit_offset / 8;
+    unsigned skip = (unsigned)(bit_offset % 8);
+    if (skip != 0) { // Partial first byte
+        for (; skip < 8 && count > 0; ++skip, --count) *dst++ = UnpackPixel<MsbFirst, Invert>(UnpackBitAt<MsbFirst>(*src, skip));
+        ++src;
+    }
+    size_t bytes = count / 8;
+    UnpackBytes<MsbFirst, Invert>(kernel, src, bytes, dst);
+    src += bytes;
+    dst += bytes * 8;
+    for (unsigned i = 0; i < count % 8; ++i) *dst++ = UnpackPixel<MsbFirst, Invert>(UnpackBitAt<MsbFirst>(*src, i));
+}
+
+// Runtime options -> the matching specialization
+inline void UnpackBits(bool msb_first, bool invert, const uint8_t* src, uint64_t bit_offset, size_t count, uint32_t* dst,
+                       UnpackKernel kernel = UnpackSelectedKernel()) {
+    if (msb_first) {
+        invert ? UnpackBits<true, true>(src, bit_offset, count, dst, kernel) : UnpackBits<true, false>(src, bit_offset, count, dst, kernel);
+    } else {
+        invert ? UnpackBits<false, true>(src, bit_offset, count, dst, kernel) : UnpackBits<false, false>(src, bit_offset, count, dst, kernel);
+    }
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+// Multi-pattern byte filter. BytePatternFilter finds any number of byte patterns in one
+// left-to-right pass (Aho-Corasick over a dense transition table) and can remove them
+// in place, compacting the buffer as it goes, so the cost is linear in the data size
+// whatever the number of matches.
+//
+// Matches do not overlap: scanning restarts after each match, and where several patterns
+// end at the same byte the longest wins. Bytes that cannot start a pattern are skipped
+// with memchr when all patterns share one first byte (the usual case: ESC or GS).
+//
+// Pattern files hold one pattern per line as hex bytes ("1B 4A 18" or "1B4A18"); text
+// after '#' or ';' is a comment.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+
+using BytePattern = std::vector<uint8_t>;
+
+// Parses hex digit pairs, ignoring whitespace. False on odd digits or other characters.
+inline bool ParseHexPattern(const std::string& text, BytePattern& pattern) {
+    pattern.clear();
+    int high = -1;
+    for (char c : text) {
+        int v;
+        if (c >= '0' && c <= '9') v = c - '0';
+        else if (c >= 'a' && c <= 'f') v = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v = c - 'A' + 10;
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') continue;
+        else return false;
+        if (high < 0) {
+            high = v;
+        } else {
+            pattern.push_back((uint8_t)(high << 4 | v));
+            high = -1;
+        }
+    }
+    return high < 0;
+}
+
+inline std::string FormatHexPattern(const BytePattern& pattern) {
+    static const char digits[] = "0123456789ABCDEF";
+    std::string text;
+    for (uint8_t b : pattern) {
+        if (!text.empty()) text += ' ';
+        text += digits[b >> 4];
+        text += digits[b & 15];
+    }
+    return text;
+}
+
+// Reads a pattern file. Returns false (with error set) if the file cannot be read or a
+// line is not valid hex; an existing file without patterns yields an empty list.
+inline bool LoadBytePatterns(const std::filesystem::path& path, std::vector<BytePattern>& patterns, std::string& error) {
+    std::ifstream file(path);
+    if (!file) {
+        error = "Cannot open " + path.string();
+        return false;
+    }
+    patterns.clear();
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        size_t comment = line.find_first_of("#;");
+        if (comment != std::string::npos) line.erase(comment);
+        BytePattern pattern;
+        if (!ParseHexPattern(line, pattern)) {
+            error = path.string() + " line " + std::to_string(line_number) + ": not a hex byte pattern";
+            return false;
+        }
+        if (!pattern.empty()) patterns.push_back(pattern);
+    }
+    return true;
+}
+
+
+class BytePatternFilter {
+public:
+    BytePatternFilter() = default;
+    explicit BytePatternFilter(const std::vector<BytePattern>& patterns) { Build(patterns); }
+
+    void Build(const std::vector<BytePattern>& patterns) {
+        patterns_.clear();
+        for (const BytePattern& p : patterns) {
+            if (!p.empty()) patterns_.push_back(p);
+        }
+        next_.assign(256, 0);
+        fail_.assign(1, 0);
+        match_.assign(1, -1);
+
+        // Trie
+        for (size_t i = 0; i < patterns_.size(); ++i) {
+            int32_t state = 0;
+            for (uint8_t b : patterns_[i]) {
+                int32_t& slot = next_[(size_t)state * 256 + b];
+                if (slot == 0) {
+                    slot = (int32_t)fail_.size();
+                    next_.resize(next_.size() + 256, 0);
+                    fail_.push_back(0);
+                    match_.push_back(-1);
+                }
+                state = next_[(size_t)state * 256 + b];
+            }
+            if (match_[state] < 0 || patterns_[match_[state]].size() < patterns_[i].size()) match_[state] = (int32_t)i;
+        }
+
+        // Failure links breadth-first, turning the trie into a full transition table; a state
+        // also reports the longest pattern ending at any of its suffixes
+        std::vector<int32_t> queue;
+        for (int b = 0; b < 256; ++b) {
+            if (next_[b] != 0) queue.push_back(next_[b]);
+        }
+        for (size_t head = 0; head < queue.size(); ++head) {
+            int32_t state = queue[head];
+            int32_t fail = fail_[state];
+            if (match_[state] < 0) match_[state] = match_[fail];
+            for (int b = 0; b < 256; ++b) {
+                int32_t& slot = next_[(size_t)state * 256 + b];
+                if (slot != 0) {
+                    fail_[slot] = next_[(size_t)fail * 256 + b];
+                    queue.push_back(slot);
+                } else {
+                    slot = next_[(size_t)fail * 256 + b];
+                }
+            }
+        }
+
+        first_byte_ = -1;
+        for (const BytePattern& p : patterns_) {
+            if (first_byte_ == -1) first_byte_ = p[0];
+            else if (first_byte_ != p[0]) first_byte_ = -2;
+        }
+    }
+
+    bool empty() const { return patterns_.empty(); }
+    const std::vector<BytePattern>& patterns() const { return patterns_; }
+
+    // Calls on_match(size_t offset, size_t pattern_index) for each match, in order
+    template <typename F>
+    void ForEachMatch(const uint8_t* data, size_t n, F on_match) const {
+        if (patterns_.empty()) return;
+        const int32_t* next = next_.data();
+        int32_t state = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (state == 0 && first_byte_ >= 0) {
+                const void* hit = std::memchr(data + i, first_byte_, n - i);
+                if (!hit) return;
+                i = static_cast<const uint8_t*>(hit) - data;
+            }
+            state = next[(size_t)state * 256 + data[i]];
+            int32_t m = match_[state];
+            if (m >= 0) {
+                size_t length = patterns_[m].size();
+                on_match(i + 1 - length, (size_t)m);
+                state = 0;
+            }
+        }
+    }
+
+    // Removes all matches in place and returns the new length. removed_per_pattern, if
+    // given, is indexed like patterns() and receives the number of bytes removed.
+    size_t Remove(uint8_t* data, size_t n, std::vector<size_t>* removed_per_pattern = nullptr) const {
+        if (removed_per_pattern) removed_per_pattern->assign(patterns_.size(), 0);
+        size_t write = 0;
+        size_t read = 0;
+        ForEachMatch(data, n, [&](size_t offset, size_t index) {
+            if (offset > read) {
+                if (write != read) std::memmove(data + write, data + read, offset - read);
+                write += offset - read;
+            }
+            read = offset + patterns_[index].size();
+            if (removed_per_pattern) (*removed_per_pattern)[index] += patterns_[index].size();
+        });
+        if (n > read) {
+            if (write != read) std::memmove(data + write, data + read, n - read);
+            write += n - read;
+        }
+        return write;
+    }
+
+private:
+    std::vector<BytePattern> patterns_;
+    std::vector<int32_t> next_;  // 256 transitions per state
+    std::vector<int32_t> fail_;
+    std::vector<int32_t> match_; // Longest pattern ending in this state, or -1
+    int first_byte_ = -1;        // Shared first byte of all patterns, or -2
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+// Naming conventions of the printer_data directory. The relay names every capture
+// data_<YYYY-MM-DD>[ _]<HH_MM_SS_mmm>_<client ip>_<client port><ext> (see GenerateDataFilename()).
+
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <cctype>
+
+struct CaptureFileInfo {
+    std::filesystem::path path;
+    uint64_t start_unix_us = 0; // From the filename; 0 if the name does not follow the convention
+    std::string client;         // "ip:port" from the filename, empty if unknown
+};
+
+inline bool IsCaptureExtension(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+    return ext == ".bin" || ext == ".cap";
+}
+
+// Parses the timestamp and client endpoint embedded by GenerateDataFilename()
+inline bool ParseCaptureFilename(const std::string& filename, uint64_t& start_unix_us, std::string& client) {
+    std::string stem = std::filesystem::path(filename).stem().string();
+    // data_ + "YYYY-MM-DD" + sep + "HH_MM_SS_mmm" + "_" + client
+    if (stem.size() < 5 + 10 + 1 + 12 + 2 || stem.compare(0, 5, "data_") != 0) return false;
+    std::tm tm = {};
+    int ms = 0;
+    const char* p = stem.c_str() + 5;
+    auto num = [](const char* s, int digits, int& out) {
+        out = 0;
+        for (int i = 0; i < digits; ++i) {
+            if (s[i] < '0' || s[i] > '9') return false;
+            out = out * 10 + (s[i] - '0');
+        }
+        return true;
+    };
+    int year, month, day, hour, minute, second;
+    if (!num(p, 4, year) || p[4] != '-' || !num(p + 5, 2, month) || p[7] != '-' || !num(p + 8, 2, day)) return false;
+    if ((p[10] != '_' && p[10] != ' ') || !num(p + 11, 2, hour) || p[13] != '_' || !num(p + 14, 2, minute) ||
+        p[16] != '_' || !num(p + 17, 2, second) || p[19] != '_' || !num(p + 20, 3, ms) || p[23] != '_') {
+        return false;
+    }
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = second;
+    tm.tm_isdst = -1; // Filenames use local time
+    std::time_t t = std::mktime(&tm);
+    if (t == (std::time_t)-1) return false;
+    start_unix_us = (uint64_t)t * 1000000ull + (uint64_t)ms * 1000ull;
+
+    std::string client_info = stem.substr(5 + 24);
+    size_t port_sep = client_info.rfind('_');
+    if (port_sep == std::string::npos) {
+        client.clear();
+    } else {
+        std::string host = client_info.substr(0, port_sep);
+        std::replace(host.begin(), host.end(), '_', ':'); // IPv6 colons were replaced too
+        client = host + ":" + client_info.substr(port_sep + 1);
+    }
+    return true;
+}
+
+// Lists the captures of a directory, oldest first (by embedded timestamp, then name)
+inline std::vector<CaptureFileInfo> ListCaptureFiles(const std::filesystem::path& dir) {
+    std::vector<CaptureFileInfo> files;
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        if (!it->is_regular_file(ec) || !IsCaptureExtension(it->path())) continue;
+        CaptureFileInfo info;
+        info.path = it->path();
+        ParseCaptureFilename(info.path.filename().string(), info.start_unix_us, info.client);
+        files.push_back(std::move(info));
+    }
+    std::sort(files.begin(), files.end(), [](const CaptureFileInfo& a, const CaptureFileInfo& b) {
+        if (a.start_unix_us != b.start_unix_us) return a.start_unix_us < b.start_unix_us;
+        return a.path.filename() < b.path.filename();
+    });
+    return files;
+}
@@ -0,0 +1,372 @@
+#pragma once
+
+// Capture file formats shared by the relay, the service and the capture tools.
+//
+// Raw captures (.bin) hold the client -> printer byte stream exactly as it was relayed.
+//
+// Framed captures (.cap) record both directions with timing. The file starts with a
+// CAPTURE_FILE_HEADER_SIZE byte header followed by a sequence of frames:
+//
+//   varint tag       (payload_length << 2) | CaptureFrameKind
+//   varint delta_us  microseconds since the previous frame (steady clock, never negative)
+//   payload          payload_length bytes
+//
+// A relayed 4 KB chunk costs 3-5 bytes of framing. All integers are little-endian,
+// varints are LEB128.
+//
+// Every CAPTURE_CHECKSUM_INTERVAL bytes of a direction, and for both directions when the
+// capture is closed, a Checksum meta frame records the CRC32C of everything recorded in
+// that direction so far. A capture without final checksum frames was cut short.
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include <chrono>
+#include <memory>
+
+#include "byte_order.h"
+#include "crc32c.h"
+#include "pcapng_writer.h"
+
+const std::string RAW_CAPTURE_EXTENSION = ".bin";
+const std::string FRAMED_CAPTURE_EXTENSION = ".cap";
+
+constexpr char CAPTURE_MAGIC[8] = { 'P', 'R', 'L', 'C', 'A', 'P', '\r', '\n' };
+constexpr uint16_t CAPTURE_VERSION = 1;
+constexpr size_t CAPTURE_FILE_HEADER_SIZE = 32;
+constexpr size_t CAPTURE_WRITE_BUFFER_SIZE = 64 * 1024;
+constexpr auto CAPTURE_FLUSH_INTERVAL = std::chrono::milliseconds(100); // While data flows, it reaches the file at least this often (viewers follow it)
+constexpr size_t CAPTURE_MAX_FRAME_HEADER = 20; // Two 10-byte varints
+constexpr uint64_t CAPTURE_CHECKSUM_INTERVAL = 1024 * 1024;
+constexpr size_t CAPTURE_CHECKSUM_META_SIZE = 15;
+
+enum class CaptureFormat {
+    Raw,
+    Framed
+};
+
+enum class CaptureFrameKind : uint8_t {
+    ClientToPrinter = 0,
+    PrinterToClient = 1,
+    Meta = 2
+};
+
+// First payload byte of a CaptureFrameKind::Meta frame
+enum class CaptureMetaType : uint8_t {
+    Session = 1, // Followed by "<client ip:port>\0<upstream ip:port>\0"
+    Checksum = 2 // Followed by u8 direction (CaptureFrameKind), u8 flags, u64 bytes, u32 CRC32C
+};
+
+// Checksum meta flags
+constexpr uint8_t CAPTURE_CHECKSUM_FINAL = 0x01; // Written by Close(); no more data follows
+
+struct CaptureChecksum {
+    CaptureFrameKind direction = CaptureFrameKind::ClientToPrinter;
+    bool final = false;
+    uint64_t bytes = 0; // Payload bytes of this direction covered by crc
+    uint32_t crc = 0;
+};
+
+struct CaptureFileHeader {
+    uint16_t version = CAPTURE_VERSION;
+    uint16_t header_size = CAPTURE_FILE_HEADER_SIZE;
+    uint32_t flags = 0;
+    uint64_t start_unix_us = 0; // Wall clock time of the first frame's time base
+};
+
+struct CaptureFrame {
+    CaptureFrameKind kind = CaptureFrameKind::ClientToPrinter;
+    uint64_t delta_us = 0;
+    uint64_t time_us = 0; // Accumulated delta_us, i.e. offset from start_unix_us
+    size_t payload_size = 0;
+};
+
+// --- Varint helpers ---
+
+// Returns the number of bytes written (at most 10)
+inline size_t PutVarint(uint8_t* p, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+// Returns the number of bytes consumed, or 0 if the varint is truncated or malformed
+inline size_t GetVarint(const uint8_t* p, size_t available, uint64_t& v) {
+    v = 0;
+    for (size_t i = 0; i < available && i < 10; ++i) {
+        v |= (uint64_t)(p[i] & 0x7F) << (7 * i);
+        if ((p[i] & 0x80) == 0) return i + 1;
+    }
+    return 0;
+}
+
+inline void EncodeCaptureFileHeader(const CaptureFileHeader& header, uint8_t out[CAPTURE_FILE_HEADER_SIZE]) {
+    std::memset(out, 0, CAPTURE_FILE_HEADER_SIZE);
+    std::memcpy(out, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC));
+    PutLE16(out + 8, header.version);
+    PutLE16(out + 10, header.header_size);
+    PutLE32(out + 12, header.flags);
+    PutLE64(out + 16, header.start_unix_us);
+}
+
+inline bool IsFramedCapture(const uint8_t* data, size_t size) {
+    return size >= sizeof(CAPTURE_MAGIC) && std::memcmp(data, CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC)) == 0;
+}
+
+inline bool DecodeCaptureFileHeader(const uint8_t* data, size_t size, CaptureFileHeader& header) {
+    if (size < CAPTURE_FILE_HEADER_SIZE || !IsFramedCapture(data, size)) return false;
+    header.version = GetLE16(data + 8);
+    header.header_size = GetLE16(data + 10);
+    header.flags = GetLE32(data + 12);
+    header.start_unix_us = GetLE64(data + 16);
+    return header.version == CAPTURE_VERSION && header.header_size >= CAPTURE_FILE_HEADER_SIZE;
+}
+
+// Parses the Session meta payload (including its leading type byte)
+inline bool ParseSessionMeta(const uint8_t* payload, size_t size, std::string& client, std::string& upstream) {
+    if (size < 1 || payload[0] != (uint8_t)CaptureMetaType::Session) return false;
+    const char* begin = reinterpret_cast<const char*>(payload + 1);
+    const char* end = reinterpret_cast<const char*>(payload + size);
+    const char* sep = static_cast<const char*>(std::memchr(begin, '\0', end - begin));
+    if (!sep) return false;
+    client.assign(begin, sep);
+    const char* second = sep + 1;
+    const char* term = static_cast<const char*>(std::memchr(second, '\0', end - second));
+    upstream.assign(second, term ? term : end);
+    return true;
+}
+
+// Parses the Checksum meta payload (including its leading type byte)
+inline bool ParseChecksumMeta(const uint8_t* payload, size_t size, CaptureChecksum& checksum) {
+    if (size < CAPTURE_CHECKSUM_META_SIZE || payload[0] != (uint8_t)CaptureMetaType::Checksum) return false;
+    checksum.direction = (CaptureFrameKind)payload[1];
+    checksum.final = (payload[2] & CAPTURE_CHECKSUM_FINAL) != 0;
+    checksum.bytes = GetLE64(payload + 3);
+    checksum.crc = GetLE32(payload + 11);
+    return true;
+}
+
+
+// Buffered writer for one relayed session. Both pipe threads write through the same
+// instance, so every public member takes the mutex. In Raw format only client -> printer
+// data reaches the file; in Framed format both directions and meta frames are recorded.
+// Optionally every chunk is also mirrored live into a pcapng file as a synthetic TCP flow,
+// flushed on the same cadence as the capture; the mirror is dropped at its first write error
+// while the capture goes on.
+class CaptureWriter {
+public:
+    CaptureWriter() = default;
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+    ~CaptureWriter() { Close(); }
+
+    bool Open(const std::string& filename, CaptureFormat format) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        filename_ = filename;
+        format_ = format;
+        file_.open(filename, std::ios::binary | std::ios::app); // Append mode just in case, though should be new file
+        if (!file_.is_open()) return false;
+        buffer_.clear();
+        buffer_.reserve(CAPTURE_WRITE_BUFFER_SIZE);
+        start_ = last_ = flushed_ = std::chrono::steady_clock::now();
+        for (int d = 0; d < 2; ++d) crc_[d] = 0, bytes_[d] = 0, checkpoint_[d] = 0;
+        start_unix_us_ = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        if (format_ == CaptureFormat::Framed) {
+            CaptureFileHeader header;
+            header.start_unix_us = start_unix_us_;
+            uint8_t encoded[CAPTURE_FILE_HEADER_SIZE];
+            EncodeCaptureFileHeader(header, encoded);
+            Append(encoded, sizeof(encoded));
+        }
+        return true;
+    }
+
+    // Mirrors the session into a pcapng file. Endpoints are "ip:port" strings; unparsable
+    // ones are replaced by placeholder addresses. Call after Open().
+    bool OpenPcapng(const std::string& filename, const std::string& client, const std::string& upstream) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pcapng_ = std::make_unique<PcapngWriter>();
+        pcapng_filename_ = filename;
+        if (!pcapng_->Open(filename)) {
+            pcapng_.reset();
+            return false;
+        }
+        PcapngEndpoint client_ep, upstream_ep;
+        if (!ParseEndpoint(client, client_ep)) client_ep = DefaultEndpoint(1, 0);
+        if (!ParseEndpoint(upstream, upstream_ep)) upstream_ep = DefaultEndpoint(2, 9100);
+        flow_ = pcapng_->BeginFlow(client_ep, upstream_ep, WallTimeUs(std::chrono::steady_clock::now()));
+        if (!pcapng_->is_open()) {
+            pcapng_.reset();
+            return false;
+        }
+        return true;
+    }
+
+    // Returns true once after the pcapng mirror failed and was dropped, with the message
+    bool TakePcapngError(std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pcapng_error_.empty()) return false;
+        error.swap(pcapng_error_);
+        pcapng_error_.clear();
+        return true;
+    }
+
+    // Records the endpoints of the session; ignored for raw captures
+    bool WriteSession(const std::string& client, const std::string& upstream) {
+        if (format_ != CaptureFormat::Framed) return true;
+        std::string meta(1, (char)CaptureMetaType::Session);
+        meta += client;
+        meta.push_back('\0');
+        meta += upstream;
+        meta.push_back('\0');
+        return Write(CaptureFrameKind::Meta, meta.data(), meta.size());
+    }
+
+    // Returns false if the file is (or just became) unusable
+    bool Write(CaptureFrameKind kind, const char* data, size_t len) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_.is_open()) return false;
+        auto now = std::chrono::steady_clock::now();
+        if (pcapng_ && kind != CaptureFrameKind::Meta &&
+            !pcapng_->WriteData(flow_, kind == CaptureFrameKind::ClientToPrinter, WallTimeUs(now),
+                                reinterpret_cast<const uint8_t*>(data), len)) {
+            DropPcapng();
+        }
+        if (format_ == CaptureFormat::Raw) {
+            if (kind != CaptureFrameKind::ClientToPrinter) return FlushIfDue(now); // The pcapng mirror may be due
+            return Append(reinterpret_cast<const uint8_t*>(data), len) && FlushIfDue(now);
+        }
+        if (!AppendFrame(kind, reinterpret_cast<const uint8_t*>(data), len, now)) return false;
+        if (kind == CaptureFrameKind::Meta) return true;
+
+        int d = (int)kind;
+        crc_[d] = Crc32cUpdate(crc_[d], data, len);
+        bytes_[d] += len;
+        if (bytes_[d] - checkpoint_[d] >= CAPTURE_CHECKSUM_INTERVAL && !AppendChecksum(kind, false, now)) return false;
+        return FlushIfDue(now);
+    }
+
+    bool Close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        if (pcapng_) {
+            bool ended = pcapng_->EndFlow(flow_, WallTimeUs(now));
+            if (!pcapng_->Close() || !ended) DropPcapng();
+            pcapng_.reset();
+        }
+        if (!file_.is_open()) return false;
+        bool ok = true;
+        if (format_ == CaptureFormat::Framed) {
+            ok = AppendChecksum(CaptureFrameKind::ClientToPrinter, true, now) &&
+                 AppendChecksum(CaptureFrameKind::PrinterToClient, true, now);
+        }
+        ok = FlushLocked() && ok;
+        file_.close();
+        return ok;
+    }
+
+    bool is_open() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return file_.is_open();
+    }
+
+    const std::string& filename() const { return filename_; }
+    CaptureFormat format() const { return format_; }
+
+private:
+    uint64_t WallTimeUs(std::chrono::steady_clock::time_point t) const {
+        return start_unix_us_ + (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(t - start_).count();
+    }
+
+    bool AppendFrame(CaptureFrameKind kind, const uint8_t* data, size_t len, std::chrono::steady_clock::time_point now) {
+        uint64_t delta_us = 0;
+        if (now > last_) {
+            delta_us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(now - last_).count();
+            last_ += std::chrono::microseconds(delta_us); // Keep the sub-microsecond remainder for the next frame
+        }
+
+        uint8_t frame_header[CAPTURE_MAX_FRAME_HEADER];
+        size_t n = PutVarint(frame_header, ((uint64_t)len << 2) | (uint8_t)kind);
+        n += PutVarint(frame_header + n, delta_us);
+        return Append(frame_header, n) && Append(data, len);
+    }
+
+    bool AppendChecksum(CaptureFrameKind direction, bool final, std::chrono::steady_clock::time_point now) {
+        int d = (int)direction;
+        uint8_t meta[CAPTURE_CHECKSUM_META_SIZE];
+        meta[0] = (uint8_t)CaptureMetaType::Checksum;
+        meta[1] = (uint8_t)direction;
+        meta[2] = final ? CAPTURE_CHECKSUM_FINAL : 0;
+        PutLE64(meta + 3, bytes_[d]);
+        PutLE32(meta + 11, crc_[d]);
+        checkpoint_[d] = bytes_[d];
+        return AppendFrame(CaptureFrameKind::Meta, meta, sizeof(meta), now);
+    }
+
+    bool Append(const uint8_t* data, size_t len) {
+        if (buffer_.size() + len > CAPTURE_WRITE_BUFFER_SIZE && !FlushLocked()) return false;
+        if (len >= CAPTURE_WRITE_BUFFER_SIZE) {
+            file_.write(reinterpret_cast<const char*>(data), (std::streamsize)len);
+            return CheckStream();
+        }
+        buffer_.insert(buffer_.end(), data, data + len);
+        return true;
+    }
+
+    bool FlushIfDue(std::chrono::steady_clock::time_point now) {
+        bool pcapng_due = pcapng_ && pcapng_->buffered();
+        if ((buffer_.empty() && !pcapng_due) || now - flushed_ < CAPTURE_FLUSH_INTERVAL) return true;
+        flushed_ = now;
+        if (pcapng_due && !pcapng_->Flush()) DropPcapng();
+        if (buffer_.empty()) return true;
+        if (!FlushLocked()) return false;
+        file_.flush(); // Past the stream's own buffer too
+        return CheckStream();
+    }
+
+    bool FlushLocked() {
+        if (buffer_.empty()) return true;
+        file_.write(reinterpret_cast<const char*>(buffer_.data()), (std::streamsize)buffer_.size());
+        buffer_.clear();
+        return CheckStream();
+    }
+
+    bool CheckStream() {
+        if (file_) return true;
+        file_.close(); // Close file on error
+        return false;
+    }
+
+    void DropPcapng() {
+        pcapng_error_ = "Error writing pcapng output " + pcapng_filename_ + "; pcapng output stopped for this session.";
+        pcapng_.reset();
+    }
+
+    std::mutex mutex_;
+    std::ofstream file_;
+    std::string filename_;
+    CaptureFormat format_ = CaptureFormat::Raw;
+    std::vector<uint8_t> buffer_;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point last_;
+    std::chrono::steady_clock::time_point flushed_;
+    uint64_t start_unix_us_ = 0;
+    std::unique_ptr<PcapngWriter> pcapng_;
+    PcapngWriter::Flow flow_;
+    std::string pcapng_filename_;
+    std::string pcapng_error_; // Set when pcapng_ is dropped, until TakePcapngError()
+    // Per direction (indexed by CaptureFrameKind) running CRC32C of the recorded payload
+    uint32_t crc_[2] = { 0, 0 };
+    uint64_t bytes_[2] = { 0, 0 };
+    uint64_t checkpoint_[2] = { 0, 0 };
+};
+
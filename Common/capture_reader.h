@@ -0,0 +1,340 @@
+#pragma once
+
+// Memory-mapped, zero-copy access to relay captures (raw .bin and framed .cap).
+//
+// CaptureFile maps the whole file read-only and exposes the client -> printer stream as a
+// list of spans pointing into the mapping: a single span for raw captures, one span per
+// frame for framed captures. Nothing is copied when a capture is opened, so a 200 MB file
+// costs address space and page cache but no private memory. That address space is why the
+// tools that read captures are built 64-bit: a 32-bit process cannot map a capture of a
+// gigabyte or more, and Open() says so.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "capture_format.h"
+
+struct ByteSpan {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    ByteSpan() = default;
+    ByteSpan(const uint8_t* d, size_t n) : data(d), size(n) {}
+
+    const uint8_t* begin() const { return data; }
+    const uint8_t* end() const { return data + size; }
+    bool empty() const { return size == 0; }
+    ByteSpan subspan(size_t offset, size_t count = SIZE_MAX) const {
+        if (offset > size) offset = size;
+        if (count > size - offset) count = size - offset;
+        return ByteSpan(data + offset, count);
+    }
+};
+
+// A logically contiguous byte stream made of zero-copy segments
+struct ByteSpanList {
+    std::vector<ByteSpan> segments;
+    uint64_t size = 0;
+
+    void Append(ByteSpan span) {
+        if (span.empty()) return;
+        segments.push_back(span);
+        size += span.size;
+    }
+
+    // Copies up to n leading bytes (used for the small fixed headers), returns the count
+    size_t CopyPrefix(uint8_t* out, size_t n) const {
+        size_t copied = 0;
+        for (const ByteSpan& s : segments) {
+            if (copied == n) break;
+            size_t take = std::min(n - copied, s.size);
+            std::memcpy(out + copied, s.data, take);
+            copied += take;
+        }
+        return copied;
+    }
+
+    // The first n bytes of the stream
+    ByteSpanList Take(uint64_t n) const {
+        ByteSpanList head;
+        for (const ByteSpan& s : segments) {
+            if (n == 0) break;
+            head.Append(s.subspan(0, (size_t)std::min<uint64_t>(n, s.size)));
+            n -= std::min<uint64_t>(n, s.size);
+        }
+        return head;
+    }
+
+    // The same stream without its first n bytes
+    ByteSpanList Skip(uint64_t n) const {
+        ByteSpanList rest;
+        for (const ByteSpan& s : segments) {
+            if (n >= s.size) {
+                n -= s.size;
+                continue;
+            }
+            rest.Append(s.subspan((size_t)n));
+            n = 0;
+        }
+        return rest;
+    }
+
+    // Copies [offset, offset + n) into out, returns the count copied
+    size_t CopyRange(uint64_t offset, uint8_t* out, size_t n) const {
+        size_t copied = 0;
+        for (const ByteSpan& s : segments) {
+            if (copied == n) break;
+            if (offset >= s.size) {
+                offset -= s.size;
+                continue;
+            }
+            size_t take = std::min(n - copied, s.size - (size_t)offset);
+            std::memcpy(out + copied, s.data + offset, take);
+            copied += take;
+            offset = 0;
+        }
+        return copied;
+    }
+};
+
+
+// Read-only mapping of a whole file. Move-only.
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+    MappedFile& operator=(MappedFile&& other) noexcept {
+        if (this != &other) {
+            Close();
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+#ifdef _WIN32
+            std::swap(file_, other.file_);
+            std::swap(mapping_, other.mapping_);
+#else
+            std::swap(fd_, other.fd_);
+#endif
+        }
+        return *this;
+    }
+    ~MappedFile() { Close(); }
+
+    bool Open(const std::filesystem::path& path, std::string& error) {
+        Close();
+#ifdef _WIN32
+        file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file_ == INVALID_HANDLE_VALUE) {
+            error = "Failed to open file (error " + std::to_string(GetLastError()) + ").";
+            return false;
+        }
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_, &file_size)) {
+            error = "Failed to get file size (error " + std::to_string(GetLastError()) + ").";
+            Close();
+            return false;
+        }
+        if ((unsigned long long)file_size.QuadPart > (unsigned long long)SIZE_MAX) {
+            error = "File is too large to map in a 32-bit process; use the 64-bit build.";
+            Close();
+            return false;
+        }
+        size_ = (size_t)file_size.QuadPart;
+        if (size_ == 0) return true; // Empty files cannot be mapped; data() stays null
+        mapping_ = CreateFileMappingW(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping_) {
+            error = "Failed to create file mapping (error " + std::to_string(GetLastError()) + ").";
+            Close();
+            return false;
+        }
+        data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        if (!data_) {
+            DWORD map_error = GetLastError();
+            if (sizeof(void*) == 4 && map_error == ERROR_NOT_ENOUGH_MEMORY) { // No room for the whole view
+                error = "File is too large to map in a 32-bit process; use the 64-bit build.";
+            } else {
+                error = "Failed to map file (error " + std::to_string(map_error) + ").";
+            }
+            Close();
+            return false;
+        }
+#else
+        fd_ = open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            error = "Failed to open file.";
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            error = "Failed to get file size.";
+            Close();
+            return false;
+        }
+        size_ = (size_t)st.st_size;
+        if (size_ == 0) return true;
+        void* p = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            error = "Failed to map file.";
+            Close();
+            return false;
+        }
+        madvise(p, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const uint8_t*>(p);
+#endif
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = NULL;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+        if (fd_ >= 0) close(fd_);
+        fd_ = -1;
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    ByteSpan span() const { return ByteSpan(data_, size_); }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = NULL;
+#else
+    int fd_ = -1;
+#endif
+};
+
+
+// Parses the frame at p. Returns the total frame length (header + payload), or 0 if the
+// frame is incomplete. time_us accumulates the deltas.
+inline size_t ParseCaptureFrame(const uint8_t* p, size_t available, uint64_t& time_us, CaptureFrame& frame, ByteSpan& payload) {
+    uint64_t tag = 0, delta = 0;
+    size_t n1 = GetVarint(p, available, tag);
+    if (n1 == 0) return 0;
+    size_t n2 = GetVarint(p + n1, available - n1, delta);
+    if (n2 == 0) return 0;
+    uint64_t payload_size = tag >> 2;
+    if (payload_size > available - n1 - n2) return 0;
+    frame.kind = (CaptureFrameKind)(tag & 3);
+    frame.payload_size = (size_t)payload_size;
+    frame.delta_us = delta;
+    time_us += delta;
+    frame.time_us = time_us;
+    payload = ByteSpan(p + n1 + n2, (size_t)payload_size);
+    return n1 + n2 + (size_t)payload_size;
+}
+
+
+class CaptureFile {
+public:
+    bool Open(const std::filesystem::path& path, std::string& error) {
+        path_ = path;
+        client_stream_ = ByteSpanList();
+        truncated_ = false;
+        if (!file_.Open(path, error)) return false;
+        framed_ = DecodeCaptureFileHeader(file_.data(), file_.size(), header_) && header_.header_size <= file_.size();
+        if (!framed_) {
+            if (IsFramedCapture(file_.data(), file_.size())) {
+                error = "Unsupported framed capture version.";
+                return false;
+            }
+            client_stream_.Append(file_.span());
+            return true;
+        }
+        ForEachFrame([this](const CaptureFrame& frame, ByteSpan payload) {
+            if (frame.kind == CaptureFrameKind::ClientToPrinter) {
+                client_stream_.Append(payload);
+            } else if (frame.kind == CaptureFrameKind::Meta) {
+                ParseSessionMeta(payload.data, payload.size, client_, upstream_);
+            }
+            return true;
+        });
+        return true;
+    }
+
+    // Calls f(const CaptureFrame&, ByteSpan payload) for each frame until f returns false.
+    // Raw captures have no frames.
+    template <typename F>
+    void ForEachFrame(F f) {
+        FrameCursor cursor;
+        CaptureFrame frame;
+        ByteSpan payload;
+        while (NextFrame(cursor, frame, payload)) {
+            if (!f(frame, payload)) break;
+        }
+    }
+
+    struct FrameCursor {
+        size_t offset = 0; // 0 = before the first frame
+        uint64_t time_us = 0;
+    };
+
+    // Incremental form of ForEachFrame for callers that interleave several captures
+    bool NextFrame(FrameCursor& cursor, CaptureFrame& frame, ByteSpan& payload) {
+        if (!framed_) return false;
+        if (cursor.offset == 0) cursor.offset = header_.header_size;
+        if (cursor.offset >= file_.size()) return false;
+        size_t used = ParseCaptureFrame(file_.data() + cursor.offset, file_.size() - cursor.offset, cursor.time_us, frame, payload);
+        if (used == 0) {
+            truncated_ = true;
+            return false;
+        }
+        cursor.offset += used;
+        return true;
+    }
+
+    bool framed() const { return framed_; }
+    bool truncated() const { return truncated_; }
+    const CaptureFileHeader& framed_header() const { return header_; }
+    const std::filesystem::path& path() const { return path_; }
+    ByteSpan file() const { return file_.span(); }
+    // Client -> printer bytes (what the printer received), zero-copy
+    const ByteSpanList& client_stream() const { return client_stream_; }
+    // Session endpoints recorded in framed captures, empty otherwise
+    const std::string& client() const { return client_; }
+    const std::string& upstream() const { return upstream_; }
+
+private:
+    std::filesystem::path path_;
+    MappedFile file_;
+    bool framed_ = false;
+    bool truncated_ = false;
+    CaptureFileHeader header_;
+    ByteSpanList client_stream_;
+    std::string client_;
+    std::string upstream_;
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+// CRC32C (Castagnoli) as used for the per-direction session checksums in the job catalog
+// and the checksum frames of framed captures.
+//
+// Crc32cUpdate() picks the fastest implementation once at runtime: the SSE4.2 crc32
+// instruction on x86/x64, the ARMv8 CRC extension on ARM64, and slicing-by-8 tables
+// everywhere else. Values are plain (pre/post-inverted) CRC32C, so
+//   Crc32cUpdate(Crc32cUpdate(0, a, n), b, m) == CRC32C of a followed by b
+// and CRC32C("123456789") == 0xE3069283.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CRC32C_X86 1
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CRC32C_TARGET_SSE42
+#else
+#include <cpuid.h>
+#define CRC32C_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#elif defined(_M_ARM64) || defined(__aarch64__)
+#define CRC32C_ARM64 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define CRC32C_TARGET_CRC
+#else
+#include <arm_acle.h>
+#define CRC32C_TARGET_CRC __attribute__((target("+crc")))
+#if defined(__linux__)
+#include <sys/auxv.h>
+#endif
+#endif
+#endif
+
+using Crc32cFunction = uint32_t (*)(uint32_t crc, const uint8_t* data, size_t len);
+
+// --- Table fallback (slicing-by-8) ---
+
+struct Crc32cTables {
+    uint32_t t[8][256];
+
+    Crc32cTables() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int s = 1; s < 8; ++s) t[s][i] = (t[s - 1][i] >> 8) ^ t[0][t[s - 1][i] & 0xFF];
+        }
+    }
+
+    static const Crc32cTables& Get() {
+        static const Crc32cTables tables;
+        return tables;
+    }
+};
+
+inline uint32_t Crc32cSoftware(uint32_t crc, const uint8_t* p, size_t len) {
+    const auto& t = Crc32cTables::Get().t;
+    crc = ~crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+        uint32_t hi = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+              t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    }
+    while (len--) crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xFF];
+    return ~crc;
+}
+
+// --- Hardware implementations ---
+
+#if defined(CRC32C_X86)
+CRC32C_TARGET_SSE42 inline uint32_t Crc32cSse42(uint32_t crc, const uint8_t* p, size_t len) {
+    crc = ~crc;
+    for (; len > 0 && ((uintptr_t)p & 7) != 0; --len) crc = _mm_crc32_u8(crc, *p++);
+#if defined(_M_X64) || defined(__x86_64__)
+    uint64_t crc64 = crc;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        crc64 = _mm_crc32_u64(crc64, v);
+    }
+    crc = (uint32_t)crc64;
+#else
+    for (; len >= 4; p += 4, len -= 4) { // 32-bit builds have no 64-bit crc32
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        crc = _mm_crc32_u32(crc, v);
+    }
+#endif
+    while (len--) crc = _mm_crc32_u8(crc, *p++);
+    return ~crc;
+}
+
+inline bool Crc32cHardwareSupported() {
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    unsigned int eax, ebx, ecx, edx;
+    return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2) != 0;
+#endif
+}
+
+inline Crc32cFunction Crc32cHardwareFunction() { return Crc32cHardwareSupported() ? Crc32cSse42 : nullptr; }
+inline const char* Crc32cHardwareName() { return "sse4.2"; }
+
+#elif defined(CRC32C_ARM64)
+CRC32C_TARGET_CRC inline uint32_t Crc32cArm(uint32_t crc, const uint8_t* p, size_t len) {
+    crc = ~crc;
+    for (; len > 0 && ((uintptr_t)p & 7) != 0; --len) crc = __crc32cb(crc, *p++);
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t v;
+        std::memcpy(&v, p, 8);
+        crc = __crc32cd(crc, v);
+    }
+    while (len--) crc = __crc32cb(crc, *p++);
+    return ~crc;
+}
+
+inline bool Crc32cHardwareSupported() {
+#if defined(_MSC_VER)
+    return true; // Windows on ARM64 requires the CRC extension
+#elif defined(__linux__) && defined(HWCAP_CRC32)
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#elif defined(__APPLE__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+inline Crc32cFunction Crc32cHardwareFunction() { return Crc32cHardwareSupported() ? Crc32cArm : nullptr; }
+inline const char* Crc32cHardwareName() { return "armv8-crc"; }
+
+#else
+inline Crc32cFunction Crc32cHardwareFunction() { return nullptr; }
+inline const char* Crc32cHardwareName() { return "none"; }
+#endif
+
+// --- Dispatch ---
+
+inline Crc32cFunction Crc32cSelected() {
+    static const Crc32cFunction selected = Crc32cHardwareFunction() ? Crc32cHardwareFunction() : Crc32cSoftware;
+    return selected;
+}
+
+inline const char* Crc32cImplementation() {
+    return Crc32cSelected() == Crc32cSoftware ? "slicing-by-8" : Crc32cHardwareName();
+}
+
+inline uint32_t Crc32cUpdate(uint32_t crc, const void* data, size_t len) {
+    return Crc32cSelected()(crc, static_cast<const uint8_t*>(data), len);
+}
@@ -0,0 +1,465 @@
+#pragma once
+
+// Streaming zlib (RFC 1950/1951) compressor for the image writers, so exporting a PNG
+// needs neither zlib nor GDI+.
+//
+// Input is compressed in DEFLATE_BLOCK_SIZE blocks: a greedy LZ77 pass over a hash chain
+// of at most DEFLATE_MAX_PROBES candidates per position finds matches within the last
+// 32 KB, and each block is then written with Huffman codes built for it, with the fixed
+// codes, or stored, whichever is smallest. Receipt rows are long runs of white with
+// repeating glyph rows, which short chains already capture, so this stays fast without
+// giving up much against zlib's default level. Memory is the window, one block and its
+// tokens, whatever the length of the stream.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+constexpr size_t DEFLATE_WINDOW_SIZE = 32768;
+constexpr size_t DEFLATE_BLOCK_SIZE = 65536;
+constexpr int DEFLATE_HASH_BITS = 15;
+constexpr int DEFLATE_MAX_PROBES = 8;
+constexpr size_t DEFLATE_MIN_MATCH = 4;  // Bytes hashed per position; deflate itself allows 3
+constexpr size_t DEFLATE_MAX_MATCH = 258;
+
+inline uint32_t Adler32Update(uint32_t adler, const uint8_t* data, size_t len) {
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (len > 0) {
+        size_t n = len < 5552 ? len : 5552;  // Most bytes before b can overflow 32 bits
+        len -= n;
+        while (n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
+
+// --- Code tables ---
+
+struct DeflateTables {
+    static constexpr uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                                  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static constexpr uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static constexpr uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                                    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                                    8193, 12289, 16385, 24577 };
+    static constexpr uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                                    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+    // Order in which the code length code lengths are sent
+    static constexpr uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    uint8_t length_code[DEFLATE_MAX_MATCH + 1];  // Match length -> length code - 257
+    uint8_t distance_code[512];                  // See DistanceCode()
+    uint8_t fixed_literal_lengths[288];
+    uint8_t fixed_distance_lengths[30];
+
+    DeflateTables() {
+        for (int code = 0; code < 29; ++code) {
+            for (int len = LENGTH_BASE[code]; len < LENGTH_BASE[code] + (1 << LENGTH_EXTRA[code]) && len <= 258; ++len) {
+                length_code[len] = (uint8_t)code;
+            }
+        }
+        length_code[258] = 28;  // 258 also falls in code 27's range but has its own code
+        for (int code = 0; code < 30; ++code) {
+            for (int d = DISTANCE_BASE[code]; d < DISTANCE_BASE[code] + (1 << DISTANCE_EXTRA[code]); ++d) {
+                distance_code[d <= 256 ? d - 1 : 256 + ((d - 1) >> 7)] = (uint8_t)code;
+            }
+        }
+        for (int i = 0; i < 288; ++i) fixed_literal_lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+        for (int i = 0; i < 30; ++i) fixed_distance_lengths[i] = 5;
+    }
+
+    // Distances up to 256 are looked up directly, longer ones by their top bits
+    int DistanceCode(uint32_t distance) const {
+        return distance <= 256 ? distance_code[distance - 1] : distance_code[256 + ((distance - 1) >> 7)];
+    }
+
+    static const DeflateTables& Get() {
+        static const DeflateTables tables;
+        return tables;
+    }
+};
+
+// Huffman code lengths for freq[0, n) of at most limit bits. Unused symbols get 0. At
+// least two symbols get a code, as some inflaters reject a tree with a single one.
+inline void DeflateCodeLengths(const uint32_t* freq, int n, int limit, uint8_t* lengths) {
+    std::fill(lengths, lengths + n, (uint8_t)0);
+    std::vector<std::pair<uint32_t, int>> symbols;  // (frequency, symbol)
+    for (int i = 0; i < n; ++i) {
+        if (freq[i]) symbols.push_back({ freq[i], i });
+    }
+    for (int i = 0; symbols.size() < 2 && i < n; ++i) {
+        if (!freq[i]) symbols.push_back({ 1, i });
+    }
+    std::sort(symbols.begin(), symbols.end());
+
+    // Two-queue Huffman construction over the sorted leaves: nodes [0, m) are leaves,
+    // [m, 2m - 1) internal nodes in the order they are made, which is by weight
+    size_t m = symbols.size();
+    std::vector<uint64_t> weight(2 * m - 1);
+    std::vector<size_t> parent(2 * m - 1, 0);
+    for (size_t i = 0; i < m; ++i) weight[i] = symbols[i].first;
+    size_t leaf = 0, node = m;
+    for (size_t next = m; next < 2 * m - 1; ++next) {
+        size_t pick[2];
+        for (size_t& p : pick) {
+            if (leaf < m && (node >= next || weight[leaf] <= weight[node])) p = leaf++;
+            else p = node++;
+        }
+        weight[next] = weight[pick[0]] + weight[pick[1]];
+        parent[pick[0]] = parent[pick[1]] = next;
+    }
+    std::vector<int> depth(2 * m - 1, 0);
+    std::vector<uint32_t> count(std::max<size_t>(m, (size_t)limit) + 1, 0);
+    for (size_t i = 2 * m - 1; i-- > 0;) {
+        if (i + 1 < 2 * m - 1) depth[i] = depth[parent[i]] + 1;
+        if (i < m) count[std::min(depth[i], limit)]++;
+    }
+
+    // Codes cut to the limit oversubscribe it; lengthen shorter codes until they fit
+    uint64_t total = 0;
+    for (int len = 1; len <= limit; ++len) total += (uint64_t)count[len] << (limit - len);
+    while (total > (1ull << limit)) {
+        count[limit]--;
+        for (int len = limit - 1; len > 0; --len) {
+            if (count[len]) {
+                count[len]--;
+                count[len + 1] += 2;
+                break;
+            }
+        }
+        total--;
+    }
+
+    // The least frequent symbols take the longest codes
+    size_t k = 0;
+    for (int len = limit; len > 0; --len) {
+        for (uint32_t c = 0; c < count[len]; ++c) lengths[symbols[k++].second] = (uint8_t)len;
+    }
+}
+
+// Canonical codes for the lengths, bit-reversed as deflate sends them
+inline void DeflateCodes(const uint8_t* lengths, int n, uint16_t* codes) {
+    uint16_t length_count[16] = {}, next_code[16] = {};
+    for (int i = 0; i < n; ++i) length_count[lengths[i]]++;
+    length_count[0] = 0;
+    uint16_t code = 0;
+    for (int bits = 1; bits < 16; ++bits) {
+        code = (uint16_t)((code + length_count[bits - 1]) << 1);
+        next_code[bits] = code;
+    }
+    for (int i = 0; i < n; ++i) {
+        int len = lengths[i];
+        if (!len) continue;
+        uint16_t c = next_code[len]++, reversed = 0;
+        for (int b = 0; b < len; ++b) reversed = (uint16_t)(reversed << 1 | ((c >> b) & 1));
+        codes[i] = reversed;
+    }
+}
+
+// --- Compressor ---
+
+class DeflateWriter {
+public:
+    // Receives the zlib stream as it is produced
+    using Sink = std::function<void(const uint8_t* data, size_t len)>;
+
+    explicit DeflateWriter(Sink sink)
+        : sink_(std::move(sink)), head_((size_t)1 << DEFLATE_HASH_BITS, 0), chain_(DEFLATE_WINDOW_SIZE, 0) {
+        buffer_.reserve(DEFLATE_WINDOW_SIZE + DEFLATE_BLOCK_SIZE);
+        tokens_.reserve(DEFLATE_BLOCK_SIZE);
+        const uint8_t header[2] = { 0x78, 0x01 };  // Deflate, 32 KB window, fastest level
+        Emit(header, 2);
+    }
+
+    DeflateWriter(const DeflateWriter&) = delete;
+    DeflateWriter& operator=(const DeflateWriter&) = delete;
+
+    void Write(const uint8_t* data, size_t len) {
+        adler_ = Adler32Update(adler_, data, len);
+        bytes_in_ += len;
+        while (len > 0) {
+            size_t n = std::min(len, history_ + DEFLATE_BLOCK_SIZE - buffer_.size());
+            buffer_.insert(buffer_.end(), data, data + n);
+            data += n;
+            len -= n;
+            if (buffer_.size() == history_ + DEFLATE_BLOCK_SIZE) CompressBlock(false);
+        }
+    }
+
+    // Compresses what is left and ends the stream; nothing may be written afterwards
+    void Finish() {
+        if (finished_) return;
+        CompressBlock(true);
+        AlignToByte();
+        uint8_t trailer[4] = { (uint8_t)(adler_ >> 24), (uint8_t)(adler_ >> 16), (uint8_t)(adler_ >> 8), (uint8_t)adler_ };
+        out_.insert(out_.end(), trailer, trailer + 4);
+        Emit(out_.data(), out_.size());
+        out_.clear();
+        finished_ = true;
+    }
+
+    uint64_t bytes_in() const { return bytes_in_; }
+    uint64_t bytes_out() const { return bytes_out_; }
+
+private:
+    static constexpr uint32_t MATCH_FLAG = 0x80000000u;  // Token: flag | (length - 3) << 16 | (distance - 1)
+
+    static uint32_t Hash(const uint8_t* p) {
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        return (v * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+    }
+
+    static size_t MatchLength(const uint8_t* a, const uint8_t* b, size_t max) {
+        size_t n = 0;
+        while (n + 8 <= max) {
+            uint64_t x, y;
+            std::memcpy(&x, a + n, 8);
+            std::memcpy(&y, b + n, 8);
+            if (x != y) break;
+            n += 8;
+        }
+        while (n < max && a[n] == b[n]) n++;
+        return n;
+    }
+
+    // Links position i of buffer_ into its hash chain; returns the previous head (offset + 1, 0: none)
+    uint64_t Insert(size_t i) {
+        uint64_t position = base_ + i;
+        uint32_t h = Hash(buffer_.data() + i);
+        uint64_t previous = head_[h];
+        chain_[position & (DEFLATE_WINDOW_SIZE - 1)] = previous;
+        head_[h] = position + 1;
+        return previous;
+    }
+
+    void CompressBlock(bool final) {
+        const uint8_t* data = buffer_.data();
+        size_t end = buffer_.size();
+        tokens_.clear();
+        for (size_t i = history_; i < end;) {
+            size_t best_length = 0;
+            uint32_t best_distance = 0;
+            if (end - i >= DEFLATE_MIN_MATCH) {
+                uint64_t position = base_ + i;
+                uint64_t candidate = Insert(i);
+                size_t max = std::min(DEFLATE_MAX_MATCH, end - i);
+                // Links to positions that have left the window point anywhere, possibly
+                // ahead; the distance check ends the walk there
+                for (int probe = 0; candidate != 0 && probe < DEFLATE_MAX_PROBES; ++probe) {
+                    uint64_t distance = position - (candidate - 1);
+                    if (distance == 0 || distance > DEFLATE_WINDOW_SIZE || distance > position - base_) break;
+                    size_t length = MatchLength(data + i - distance, data + i, max);
+                    if (length > best_length) {
+                        best_length = length;
+                        best_distance = (uint32_t)distance;
+                        if (length == max) break;
+                    }
+                    candidate = chain_[(candidate - 1) & (DEFLATE_WINDOW_SIZE - 1)];
+                }
+            }
+            if (best_length >= DEFLATE_MIN_MATCH) {
+                tokens_.push_back(MATCH_FLAG | (uint32_t)(best_length - 3) << 16 | (best_distance - 1));
+                for (size_t k = i + 1; k < i + best_length && end - k >= DEFLATE_MIN_MATCH; ++k) Insert(k);
+                i += best_length;
+            } else {
+                tokens_.push_back(data[i]);
+                i++;
+            }
+        }
+        WriteBlock(data + history_, end - history_, final);
+
+        // Keep the last window of input for matches in the next block
+        size_t keep = std::min(end, DEFLATE_WINDOW_SIZE);
+        buffer_.erase(buffer_.begin(), buffer_.begin() + (end - keep));
+        base_ += end - keep;
+        history_ = keep;
+    }
+
+    // Writes the block's tokens in whichever form is smallest
+    void WriteBlock(const uint8_t* raw, size_t raw_len, bool final) {
+        const DeflateTables& tables = DeflateTables::Get();
+        uint32_t literal_freq[286] = {}, distance_freq[30] = {};
+        for (uint32_t token : tokens_) {
+            if (token & MATCH_FLAG) {
+                literal_freq[257 + tables.length_code[((token >> 16) & 0xFF) + 3]]++;
+                distance_freq[tables.DistanceCode((token & 0xFFFF) + 1)]++;
+            } else {
+                literal_freq[token]++;
+            }
+        }
+        literal_freq[256] = 1;
+
+        uint8_t literal_lengths[286], distance_lengths[30];
+        DeflateCodeLengths(literal_freq, 286, 15, literal_lengths);
+        DeflateCodeLengths(distance_freq, 30, 15, distance_lengths);
+
+        // Dynamic header: both length lists run-length coded with symbols 16-18
+        int literal_count = 286, distance_count = 30;
+        while (literal_count > 257 && !literal_lengths[literal_count - 1]) literal_count--;
+        while (distance_count > 1 && !distance_lengths[distance_count - 1]) distance_count--;
+        uint8_t all_lengths[286 + 30];
+        std::memcpy(all_lengths, literal_lengths, literal_count);
+        std::memcpy(all_lengths + literal_count, distance_lengths, distance_count);
+        int all_count = literal_count + distance_count;
+        std::vector<std::pair<uint8_t, uint8_t>> runs;  // (symbol, extra bits value)
+        uint32_t code_length_freq[19] = {};
+        for (int i = 0; i < all_count;) {
+            uint8_t value = all_lengths[i];
+            int run = 1;
+            while (i + run < all_count && all_lengths[i + run] == value) run++;
+            i += run;
+            if (value == 0) {
+                while (run >= 11) {
+                    int n = std::min(run, 138);
+                    runs.push_back({ 18, (uint8_t)(n - 11) });
+                    run -= n;
+                }
+                if (run >= 3) {
+                    runs.push_back({ 17, (uint8_t)(run - 3) });
+                    run = 0;
+                }
+            } else {
+                runs.push_back({ value, 0 });
+                run--;
+                while (run >= 3) {
+                    int n = std::min(run, 6);
+                    runs.push_back({ 16, (uint8_t)(n - 3) });
+                    run -= n;
+                }
+            }
+            while (run-- > 0) runs.push_back({ value, 0 });
+        }
+        for (const auto& r : runs) code_length_freq[r.first]++;
+        uint8_t code_length_lengths[19];
+        DeflateCodeLengths(code_length_freq, 19, 7, code_length_lengths);
+        int order_count = 19;
+        while (order_count > 4 && !code_length_lengths[DeflateTables::CODE_LENGTH_ORDER[order_count - 1]]) order_count--;
+
+        // Sizes in bits of the three forms
+        auto data_bits = [&](const uint8_t* lit, const uint8_t* dist) {
+            uint64_t bits = lit[256];
+            for (int s = 0; s < 286; ++s) {
+                if (s == 256) continue;
+                bits += (uint64_t)literal_freq[s] * (lit[s] + (s > 256 ? DeflateTables::LENGTH_EXTRA[s - 257] : 0));
+            }
+            for (int s = 0; s < 30; ++s) bits += (uint64_t)distance_freq[s] * (dist[s] + DeflateTables::DISTANCE_EXTRA[s]);
+            return bits;
+        };
+        uint64_t dynamic_bits = 3 + 14 + 3 * (uint64_t)order_count + data_bits(literal_lengths, distance_lengths);
+        static const uint8_t extra_bits[19] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7 };
+        for (const auto& r : runs) dynamic_bits += code_length_lengths[r.first] + extra_bits[r.first];
+        uint64_t fixed_bits = 3 + data_bits(tables.fixed_literal_lengths, tables.fixed_distance_lengths);
+        uint64_t stored_bits = 3 + 7 + ((raw_len + 65534) / 65535 * 4 + raw_len) * 8;
+
+        if (raw_len > 0 && stored_bits < dynamic_bits && stored_bits < fixed_bits) {
+            WriteStored(raw, raw_len, final);
+        } else if (fixed_bits <= dynamic_bits) {
+            PutBits(final ? 1 : 0, 1);
+            PutBits(1, 2);
+            WriteTokens(tables.fixed_literal_lengths, 288, tables.fixed_distance_lengths);
+        } else {
+            PutBits(final ? 1 : 0, 1);
+            PutBits(2, 2);
+            PutBits((uint32_t)(literal_count - 257), 5);
+            PutBits((uint32_t)(distance_count - 1), 5);
+            PutBits((uint32_t)(order_count - 4), 4);
+            for (int i = 0; i < order_count; ++i) PutBits(code_length_lengths[DeflateTables::CODE_LENGTH_ORDER[i]], 3);
+            uint16_t code_length_codes[19] = {};
+            DeflateCodes(code_length_lengths, 19, code_length_codes);
+            for (const auto& r : runs) {
+                PutBits(code_length_codes[r.first], code_length_lengths[r.first]);
+                if (extra_bits[r.first]) PutBits(r.second, extra_bits[r.first]);
+            }
+            WriteTokens(literal_lengths, 286, distance_lengths);
+        }
+        Emit(out_.data(), out_.size());
+        out_.clear();
+    }
+
+    // literal_count: 288 for the fixed codes, whose two unused symbols still take code space
+    void WriteTokens(const uint8_t* literal_lengths, int literal_count, const uint8_t* distance_lengths) {
+        const DeflateTables& tables = DeflateTables::Get();
+        uint16_t literal_codes[288] = {}, distance_codes[30] = {};
+        DeflateCodes(literal_lengths, literal_count, literal_codes);
+        DeflateCodes(distance_lengths, 30, distance_codes);
+        for (uint32_t token : tokens_) {
+            if (!(token & MATCH_FLAG)) {
+                PutBits(literal_codes[token], literal_lengths[token]);
+                continue;
+            }
+            uint32_t length = ((token >> 16) & 0xFF) + 3, distance = (token & 0xFFFF) + 1;
+            int lc = tables.length_code[length];
+            PutBits(literal_codes[257 + lc], literal_lengths[257 + lc]);
+            PutBits(length - DeflateTables::LENGTH_BASE[lc], DeflateTables::LENGTH_EXTRA[lc]);
+            int dc = tables.DistanceCode(distance);
+            PutBits(distance_codes[dc], distance_lengths[dc]);
+            PutBits(distance - DeflateTables::DISTANCE_BASE[dc], DeflateTables::DISTANCE_EXTRA[dc]);
+        }
+        PutBits(literal_codes[256], literal_lengths[256]);
+    }
+
+    void WriteStored(const uint8_t* raw, size_t len, bool final) {
+        do {
+            size_t n = std::min<size_t>(len, 65535);
+            PutBits(final && n == len ? 1 : 0, 1);
+            PutBits(0, 2);
+            AlignToByte();
+            uint8_t header[4] = { (uint8_t)n, (uint8_t)(n >> 8), (uint8_t)~n, (uint8_t)(~n >> 8) };
+            out_.insert(out_.end(), header, header + 4);
+            out_.insert(out_.end(), raw, raw + n);
+            raw += n;
+            len -= n;
+        } while (len > 0);
+    }
+
+    // Bits go out least significant first; at most 16 per call
+    void PutBits(uint32_t value, int count) {
+        bit_buffer_ |= (uint64_t)value << bit_count_;
+        bit_count_ += count;
+        if (bit_count_ >= 32) {
+            for (int k = 0; k < 4; ++k) out_.push_back((uint8_t)(bit_buffer_ >> (8 * k)));
+            bit_buffer_ >>= 32;
+            bit_count_ -= 32;
+        }
+    }
+
+    void AlignToByte() {
+        while (bit_count_ > 0) {
+            out_.push_back((uint8_t)bit_buffer_);
+            bit_buffer_ >>= 8;
+            bit_count_ = std::max(bit_count_ - 8, 0);
+        }
+        bit_buffer_ = 0;
+    }
+
+    void Emit(const uint8_t* data, size_t len) {
+        if (len == 0) return;
+        bytes_out_ += len;
+        sink_(data, len);
+    }
+
+    Sink sink_;
+    std::vector<uint8_t> buffer_;  // The window kept from earlier blocks, then the pending block
+    size_t history_ = 0;           // Bytes of buffer_ before the pending block
+    uint64_t base_ = 0;            // Stream offset of buffer_[0]
+    std::vector<uint64_t> head_;   // Hash -> latest stream offset + 1 (0: none)
+    std::vector<uint64_t> chain_;  // Stream offset % window -> previous offset + 1 with the same hash
+    std::vector<uint32_t> tokens_;
+    std::vector<uint8_t> out_;
+    uint64_t bit_buffer_ = 0;
+    int bit_count_ = 0;
+    uint32_t adler_ = 1;
+    uint64_t bytes_in_ = 0;
+    uint64_t bytes_out_ = 0;
+    bool finished_ = false;
+};
@@ -0,0 +1,275 @@
+#pragma once
+
+// EPL2, the line-oriented language of Eltron and older Zebra desktop label printers, for
+// page_decoder.h.
+//
+// Each command is one line: a name of one or two letters and comma-separated parameters.
+// N clears the label and P prints it. Drawn: A text in fonts 1-5 with its multipliers, B
+// barcodes (Code 128, Code 39, EAN-13, UPC-A, interleaved 2 of 5), b QR codes, LO and X
+// lines and boxes, and GW graphics, whose binary data follows the parameters on the same
+// line with 0 bits printed. q sets the label width, Q its length and R the reference
+// point. Rotated text and barcodes are drawn unrotated; LE and LW lines and the other
+// symbologies are not drawn, and P copies print once.
+
+#include <cstdint>
+#include <cstddef>
+#include <cctype>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "page_decoder.h"
+
+constexpr int EPL_DEFAULT_WIDTH = 832;        // 4-inch printhead at 203 dpi
+constexpr size_t EPL_LINE_MAX = 64 * 1024;    // Longer command lines are cut
+
+// Fonts 1-5 (width, height) at multiplier 1
+const int kEplFonts[5][2] = { { 8, 12 }, { 10, 16 }, { 12, 20 }, { 14, 24 }, { 32, 48 } };
+
+class EplDecoder : public PageDecoder {
+public:
+    EplDecoder() : PageDecoder(EPL_DEFAULT_WIDTH) {}
+
+    void Feed(const uint8_t* p, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            if (graphic_left_ > 0) { // GW data, which may hold line breaks
+                size_t take = std::min<size_t>(graphic_left_, n - i);
+                graphic_.insert(graphic_.end(), p + i, p + i + take);
+                graphic_left_ -= take;
+                i += take - 1;
+                if (graphic_left_ == 0) DrawGraphic();
+                continue;
+            }
+            uint8_t c = p[i];
+            if (c == '\n') {
+                RunLine();
+                continue;
+            }
+            if (line_.size() < EPL_LINE_MAX) line_ += (char)c;
+            if (c == ',' && line_.size() >= 2 && line_[0] == 'G' && line_[1] == 'W' && std::count(line_.begin(), line_.end(), ',') == 4) {
+                StartGraphic();
+            }
+        }
+    }
+
+    void Finish() override {
+        if (graphic_left_ > 0) {
+            graphic_left_ = 0;
+            DrawGraphic();
+        }
+        if (!line_.empty()) RunLine();
+        if (drawn_) PrintLabel(); // Data that never reached P
+    }
+
+    std::unique_ptr<PageDecoder> Clone() const override { return std::make_unique<EplDecoder>(*this); }
+
+private:
+    static std::vector<std::string> Params(std::string_view text) {
+        std::vector<std::string> params;
+        std::string current;
+        bool quoted = false;
+        for (size_t i = 0; i < text.size(); ++i) {
+            char c = text[i];
+            if (quoted && c == '\\' && i + 1 < text.size()) {
+                current += text[++i];
+            } else if (c == '"') {
+                quoted = !quoted;
+            } else if (c == ',' && !quoted) {
+                params.push_back(current);
+                current.clear();
+            } else {
+                current += c;
+            }
+        }
+        params.push_back(current);
+        return params;
+    }
+
+    static int Int(const std::vector<std::string>& params, size_t i, int fallback) {
+        if (i >= params.size() || params[i].empty()) return fallback;
+        char* end = nullptr;
+        long value = std::strtol(params[i].c_str(), &end, 10);
+        return end == params[i].c_str() ? fallback : (int)std::clamp<long>(value, -PAGE_CANVAS_MAX_ROWS, PAGE_CANVAS_MAX_ROWS);
+    }
+
+    void RunLine() {
+        running_.swap(line_); // Both keep their buffers from line to line
+        line_.clear();
+        std::string& line = running_;
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.pop_back();
+        if (line.empty()) return;
+        static const char* const kTwoLetterNames[] = { "LO", "LE", "LW", "GW", "GG", "GK", "ZB", "ZT", "JF", "JB", "OD", "UN", "US" };
+        std::string name = line.substr(0, 1);
+        for (const char* two : kTwoLetterNames) {
+            if (line.compare(0, 2, two) == 0) name = two;
+        }
+        std::vector<std::string> params = Params(std::string_view(line).substr(name.size()));
+        if (name == "N") {
+            ClearLabel();
+        } else if (name == "P") {
+            PrintLabel();
+        } else if (name == "q") {
+            width_setting_ = std::max(1, Int(params, 0, EPL_DEFAULT_WIDTH));
+        } else if (name == "Q") {
+            length_setting_ = std::max(0, Int(params, 0, 0));
+        } else if (name == "R") {
+            reference_x_ = Int(params, 0, 0);
+            reference_y_ = Int(params, 1, 0);
+        } else if (name == "A") {
+            DrawTextLine(params);
+        } else if (name == "B") {
+            DrawBarcode(params);
+        } else if (name == "b") {
+            DrawQrCode(params);
+        } else if (name == "LO") {
+            if (!text_only_) Canvas().FillRect(X(params, 0), Y(params, 1), Int(params, 2, 0), Int(params, 3, 0));
+        } else if (name == "X") {
+            DrawBox(params);
+        }
+    }
+
+    int X(const std::vector<std::string>& params, size_t i) const { return reference_x_ + Int(params, i, 0); }
+    int Y(const std::vector<std::string>& params, size_t i) const { return reference_y_ + Int(params, i, 0); }
+
+    PageCanvas& Canvas() {
+        if (!drawn_) {
+            ResetCanvas(canvas_, width_setting_ > 0 ? width_setting_ : EPL_DEFAULT_WIDTH);
+            drawn_ = true;
+        }
+        return canvas_;
+    }
+
+    void ClearLabel() {
+        drawn_ = false;
+        canvas_ = PageCanvas();
+    }
+
+    void PrintLabel() {
+        Canvas();
+        if (length_setting_ > 0) canvas_.SetRows(length_setting_);
+        EmitPage(canvas_);
+        ClearLabel();
+    }
+
+    // A x,y,rotation,font,h,v,N|R,"data"
+    void DrawTextLine(const std::vector<std::string>& params) {
+        if (params.size() < 8) return;
+        const std::string& text = params[7];
+        PutTextLine(text);
+        if (text_only_) return;
+        int font = std::clamp(Int(params, 3, 1), 1, 5) - 1;
+        int h = std::clamp(Int(params, 4, 1), 1, 8), v = std::clamp(Int(params, 5, 1), 1, 9);
+        Canvas().DrawText(X(params, 0), Y(params, 1), text, GlyphsForCell(kEplFonts[font][0] * h, kEplFonts[font][1] * v));
+    }
+
+    // B x,y,rotation,type,narrow,wide,height,B|N,"data"
+    void DrawBarcode(const std::vector<std::string>& params) {
+        if (params.size() < 9) return;
+        const std::string& data = params[8];
+        std::string type = params[3];
+        int module = std::clamp(Int(params, 4, 2), 1, 10);
+        int height = std::max(1, Int(params, 6, 50));
+        EscPosBarcode barcode;
+        bool encoded = false;
+        if (type == "1" || type == "1A" || type == "1B" || type == "1C" || type == "1E") {
+            encoded = EncodeCode128Data(data, module, barcode);
+        } else if (type == "3" || type == "3C") {
+            encoded = EncodeEscPosBarcode(69, data, module, barcode);
+        } else if (type == "E30" || type == "E32" || type == "E35") {
+            encoded = EncodeEscPosBarcode(67, data, module, barcode);
+        } else if (type == "UA0" || type == "UA2" || type == "UA5") {
+            encoded = EncodeEscPosBarcode(65, data, module, barcode);
+        } else if (type == "2" || type == "2C" || type == "2D") {
+            encoded = EncodeEscPosBarcode(70, data, module, barcode);
+        }
+        PutTextLine(encoded ? barcode.text : data);
+        if (!encoded || text_only_) return;
+        PageCanvas& canvas = Canvas();
+        int x = X(params, 0), y = Y(params, 1);
+        int width = canvas.DrawBarcode(x, y, barcode, height);
+        if (!params[7].empty() && std::toupper((unsigned char)params[7][0]) == 'B') {
+            const GlyphSet& glyphs = GlyphsForCell(kEplFonts[1][0], kEplFonts[1][1]);
+            int text_width = (int)barcode.text.size() * glyphs.width();
+            canvas.DrawText(x + (width - text_width) / 2, y + height, barcode.text, glyphs);
+        }
+    }
+
+    // b x,y,Q,[m<model>,][s<scale>,][e<level>,]..."data"
+    void DrawQrCode(const std::vector<std::string>& params) {
+        if (params.size() < 4 || params[2] != "Q") return;
+        const std::string& data = params.back();
+        PutTextLine(data);
+        int module = 3;
+        QrEcc ecc = QrEcc::Medium;
+        for (size_t i = 3; i + 1 < params.size(); ++i) {
+            if (params[i].size() < 2) continue;
+            if (params[i][0] == 's') module = std::clamp(std::atoi(params[i].c_str() + 1), 1, 99);
+            if (params[i][0] == 'e') {
+                switch (params[i][1]) {
+                    case 'L': ecc = QrEcc::Low; break;
+                    case 'Q': ecc = QrEcc::Quartile; break;
+                    case 'H': ecc = QrEcc::High; break;
+                    default: break;
+                }
+            }
+        }
+        QrCode code;
+        if (text_only_ || data.empty() || !code.Encode(reinterpret_cast<const uint8_t*>(data.data()), data.size(), ecc)) return;
+        Canvas().DrawQrCode(X(params, 0), Y(params, 1), code, module);
+    }
+
+    // X x1,y1,thickness,x2,y2
+    void DrawBox(const std::vector<std::string>& params) {
+        if (text_only_) return;
+        int x1 = X(params, 0), y1 = Y(params, 1), t = std::max(1, Int(params, 2, 1));
+        int x2 = X(params, 3), y2 = Y(params, 4);
+        if (x2 < x1) std::swap(x1, x2);
+        if (y2 < y1) std::swap(y1, y2);
+        PageCanvas& canvas = Canvas();
+        canvas.FillRect(x1, y1, x2 - x1, t);
+        canvas.FillRect(x1, y2 - t, x2 - x1, t);
+        canvas.FillRect(x1, y1, t, y2 - y1);
+        canvas.FillRect(x2 - t, y1, t, y2 - y1);
+    }
+
+    // GW x,y,row bytes,rows, then row bytes x rows of data
+    void StartGraphic() {
+        std::vector<std::string> params = Params(std::string_view(line_).substr(2));
+        graphic_x_ = X(params, 0);
+        graphic_y_ = Y(params, 1);
+        graphic_row_bytes_ = (size_t)std::max(0, Int(params, 2, 0));
+        graphic_left_ = graphic_row_bytes_ * (size_t)std::max(0, Int(params, 3, 0));
+        graphic_.clear();
+        line_.clear();
+    }
+
+    void DrawGraphic() {
+        image_bytes_ += graphic_.size();
+        if (graphic_row_bytes_ > 0 && !text_only_) {
+            PageCanvas& canvas = Canvas();
+            std::vector<uint8_t> row(graphic_row_bytes_);
+            for (size_t r = 0; r < graphic_.size() / graphic_row_bytes_; ++r) {
+                for (size_t k = 0; k < graphic_row_bytes_; ++k) row[k] = (uint8_t)~graphic_[r * graphic_row_bytes_ + k];
+                canvas.OrRow(graphic_x_, graphic_y_ + (int)r, row.data(), (int)std::min<size_t>(graphic_row_bytes_ * 8, PAGE_CANVAS_MAX_WIDTH));
+            }
+        }
+        std::vector<uint8_t>().swap(graphic_);
+    }
+
+    std::string line_;
+    std::string running_; // The line being run
+    size_t graphic_left_ = 0;
+    std::vector<uint8_t> graphic_;
+    size_t graphic_row_bytes_ = 0;
+    int graphic_x_ = 0, graphic_y_ = 0;
+
+    int width_setting_ = 0;
+    int length_setting_ = 0;
+    int reference_x_ = 0, reference_y_ = 0;
+
+    bool drawn_ = false; // The label has a canvas, so P prints it
+    PageCanvas canvas_;
+};
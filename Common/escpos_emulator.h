@@ -0,0 +1,794 @@
+#pragma once
+
+// ESC/POS printer emulation: renders what a receipt printer would print for a stream of
+// text and commands, for captures that are not (only) raster images.
+//
+// EscPosEmulator sits on EscPosParser and lays the stream out on a page of a fixed width,
+// as rows of 1-bit dots in the format of GS v 0 raster data, so the result goes through
+// the same tiles, zoom levels and image writers as raster captures. Characters are drawn
+// from the pre-rendered glyphs of ReceiptGlyphCache into a line buffer and the line is
+// placed on the page at LF with the current alignment; fonts A/B, emphasis, underline,
+// reverse, ESC ! / GS ! sizes, character and line spacing, tabs, margins and absolute
+// positions follow the Epson command set. Raster blocks (GS v 0) and bit images (ESC *)
+// print in place, 1D barcodes (GS k: UPC-A, EAN-13, EAN-8, CODE39, ITF, CODE128) with their
+// human-readable text, and QR codes (GS ( k) through qr_code.h. Cuts leave a dashed line
+// and their row in cuts(). Other symbologies and stored graphics are counted in
+// stats().ignored and not drawn.
+//
+// Like the parser, the emulator takes the stream in pieces of any size; Snapshot() shows
+// the page as it would look if the stream ended here, without changing the state.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "escpos_parser.h"
+#include "receipt_font.h"
+#include "qr_code.h"
+
+constexpr int ESCPOS_PAGE_WIDTH = 576;        // 80 mm paper at 203 dpi
+constexpr int ESCPOS_LINE_SPACING = 30;       // Dots per line feed after ESC @ / ESC 2
+constexpr int ESCPOS_TAB_COLUMNS = 8;         // Default tab stops, in characters
+constexpr int ESCPOS_BARCODE_HEIGHT = 162;
+constexpr int ESCPOS_BARCODE_MODULE = 3;
+constexpr int ESCPOS_QR_MODULE = 3;
+constexpr int ESCPOS_LINE_ROWS = FONT_A_HEIGHT * FONT_MAX_SCALE; // Tallest thing a line can hold
+constexpr size_t ESCPOS_SYMBOL_MAX = 65535;   // Barcode and 2D symbol data kept per command
+constexpr uint64_t ESCPOS_TEXT_UNKNOWN_RATIO = 64; // Text bytes a receipt shows per unknown byte at least
+
+// A stream is emulated when it prints text and is not mostly bytes the parser does not
+// know, which is what raw pixel data without raster commands looks like
+inline bool EscPosLooksLikeText(const EscPosRasterInfo& info) {
+    return info.text_bytes > 0 && info.unknown_bytes * ESCPOS_TEXT_UNKNOWN_RATIO <= info.text_bytes;
+}
+
+struct EscPosEmulatorStats {
+    uint64_t characters = 0;
+    uint64_t lines = 0;
+    uint64_t images = 0;    // Raster blocks and bit images
+    uint64_t barcodes = 0;
+    uint64_t qr_codes = 0;
+    uint64_t cuts = 0;
+    uint64_t ignored = 0;   // Symbols and graphics that are not drawn
+};
+
+// A 1D barcode as alternating bar and space widths in dots, starting with a bar
+struct EscPosBarcode {
+    std::vector<int> runs;
+    std::string text; // Human-readable interpretation
+    int width() const {
+        int total = 0;
+        for (int run : runs) total += run;
+        return total;
+    }
+};
+
+// EAN/UPC modulo 10 check digit over ASCII digits
+inline char EanCheckDigit(const std::string& digits) {
+    int sum = 0, weight = 3;
+    for (size_t i = digits.size(); i-- > 0; weight = 4 - weight) sum += (digits[i] - '0') * weight;
+    return (char)('0' + (10 - sum % 10) % 10);
+}
+
+// digits: 12 (EAN-13) or 7 (EAN-8) digits without the check digit
+inline void EncodeEan(const std::string& digits, int module, EscPosBarcode& out) {
+    static const uint8_t kLeftOdd[10] = { 0x0D, 0x19, 0x13, 0x3D, 0x23, 0x31, 0x2F, 0x3B, 0x37, 0x0B };
+    static const char* const kParity[10] = { "LLLLLL", "LLGLGG", "LLGGLG", "LLGGGL", "LGLLGG", "LGGLLG", "LGGGLL", "LGLGLG", "LGLGGL", "LGGLGL" };
+    std::string full = digits + EanCheckDigit(digits);
+    std::string modules = "101";
+    auto put = [&](uint8_t pattern) {
+        for (int i = 6; i >= 0; --i) modules += (pattern >> i) & 1 ? '1' : '0';
+    };
+    auto reversed = [](uint8_t pattern) {
+        uint8_t r = 0;
+        for (int i = 0; i < 7; ++i) r |= (uint8_t)(((pattern >> i) & 1) << (6 - i));
+        return r;
+    };
+    bool ean8 = full.size() == 8;
+    size_t half = ean8 ? 4 : 6;
+    size_t first = ean8 ? 0 : 1; // EAN-13: the first digit is carried by the parity of the left half
+    for (size_t i = 0; i < half; ++i) {
+        uint8_t left = kLeftOdd[full[first + i] - '0'];
+        put(!ean8 && kParity[full[0] - '0'][i] == 'G' ? reversed((uint8_t)(left ^ 0x7F)) : left);
+    }
+    modules += "01010";
+    for (size_t i = 0; i < half; ++i) put((uint8_t)(kLeftOdd[full[first + half + i] - '0'] ^ 0x7F));
+    modules += "101";
+    for (size_t i = 0; i < modules.size();) {
+        size_t j = i;
+        while (j < modules.size() && modules[j] == modules[i]) ++j;
+        out.runs.push_back((int)(j - i) * module);
+        i = j;
+    }
+    out.text = full;
+}
+
+// Narrow/wide symbologies: each pattern character is 'n' or 'w', bars and spaces
+// alternating and continuing the runs already there
+inline void AppendWidePattern(const char* pattern, int narrow, int wide, EscPosBarcode& out) {
+    for (const char* p = pattern; *p; ++p) out.runs.push_back(*p == 'w' ? wide : narrow);
+}
+
+inline bool EncodeCode39(const std::string& data, int module, EscPosBarcode& out) {
+    static const char kChars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ-. $/+%*";
+    static const char* const kTable[44] = {
+        "nnnwwnwnn", "wnnwnnnnw", "nnwwnnnnw", "wnwwnnnnn", "nnnwwnnnw", "wnnwwnnnn", "nnwwwnnnn", "nnnwnnwnw", "wnnwnnwnn", "nnwwnnwnn",
+        "wnnnnwnnw", "nnwnnwnnw", "wnwnnwnnn", "nnnnwwnnw", "wnnnwwnnn", "nnwnwwnnn", "nnnnnwwnw", "wnnnnwwnn", "nnwnnwwnn", "nnnnwwwnn",
+        "wnnnnnnww", "nnwnnnnww", "wnwnnnnwn", "nnnnwnnww", "wnnnwnnwn", "nnwnwnnwn", "nnnnnnwww", "wnnnnnwwn", "nnwnnnwwn", "nnnnwnwwn",
+        "wwnnnnnnw", "nwwnnnnnw", "wwwnnnnnn", "nwnnwnnnw", "wwnnwnnnn", "nwwnwnnnn", "nwnnnnwnw", "wwnnnnwnn", "nwwnnnwnn", "nwnwnwnnn",
+        "nwnwnnnwn", "nwnnnwnwn", "nnnwnwnwn", "nwnnwnwnn",
+    };
+    std::string text = "*" + data + "*";
+    int wide = (module * 5 + 1) / 2;
+    for (size_t i = 0; i < text.size(); ++i) {
+        const char* found = text[i] ? std::strchr(kChars, text[i]) : nullptr;
+        if (!found || (text[i] == '*' && i != 0 && i + 1 != text.size())) return false;
+        if (i > 0) AppendWidePattern("n", module, wide, out);
+        AppendWidePattern(kTable[found - kChars], module, wide, out);
+    }
+    out.text = text;
+    return true;
+}
+
+// Interleaved 2 of 5; an odd last digit is not printed, as by the printer
+inline bool EncodeItf(const std::string& data, int module, EscPosBarcode& out) {
+    static const char* const kDigits[10] = { "nnwwn", "wnnnw", "nwnnw", "wwnnn", "nnwnw", "wnwnn", "nwwnn", "nnnww", "wnnwn", "nwnwn" };
+    size_t pairs = data.size() / 2;
+    if (pairs == 0) return false;
+    int wide = (module * 5 + 1) / 2;
+    AppendWidePattern("nnnn", module, wide, out);
+    for (size_t i = 0; i < pairs; ++i) {
+        const char* bars = kDigits[data[2 * i] - '0'];
+        const char* spaces = kDigits[data[2 * i + 1] - '0'];
+        char pattern[11] = {};
+        for (int k = 0; k < 5; ++k) {
+            pattern[2 * k] = bars[k];
+            pattern[2 * k + 1] = spaces[k];
+        }
+        AppendWidePattern(pattern, module, wide, out);
+    }
+    AppendWidePattern("wnn", module, wide, out);
+    out.text = data.substr(0, pairs * 2);
+    return true;
+}
+
+// Epson's CODE128 data: "{A", "{B" or "{C" first, "{" escapes code set changes, FNC1-4,
+// SHIFT and a literal '{'; code set C characters are the byte values 0 .. 99
+inline bool EncodeCode128(const std::string& data, int module, EscPosBarcode& out) {
+    static const char* const kPatterns[107] = {
+        "212222", "222122", "222221", "121223", "121322", "131222", "122213", "122312", "132212", "221213",
+        "221312", "231212", "112232", "122132", "122231", "113222", "123122", "123221", "223211", "221132",
+        "221231", "213212", "223112", "312131", "311222", "321122", "321221", "312212", "322112", "322211",
+        "212123", "212321", "232121", "111323", "131123", "131321", "112313", "132113", "132311", "211313",
+        "231113", "231311", "112133", "112331", "132131", "113123", "113321", "133121", "313121", "211331",
+        "231131", "213113", "213311", "213131", "311123", "311321", "331121", "312113", "312311", "332111",
+        "314111", "221411", "431111", "111224", "111422", "121124", "121421", "141122", "141221", "112214",
+        "112412", "122114", "122411", "142112", "142211", "241211", "221114", "413111", "241112", "134111",
+        "111242", "121142", "121241", "114212", "124112", "124211", "411212", "421112", "421211", "212141",
+        "214121", "412121", "111143", "111341", "131141", "114113", "114311", "411113", "411311", "113141",
+        "114131", "311141", "411131", "211412", "211214", "211232", "2331112",
+    };
+    if (data.size() < 2 || data[0] != '{' || data[1] < 'A' || data[1] > 'C') return false;
+    char set = data[1];
+    std::vector<int> values = { 103 + (set - 'A') };
+    std::string text;
+    for (size_t i = 2; i < data.size(); ++i) {
+        uint8_t c = (uint8_t)data[i];
+        if (c == '{' && i + 1 < data.size()) {
+            char code = data[++i];
+            switch (code) {
+                case 'A': values.push_back(101); set = 'A'; continue;
+                case 'B': values.push_back(100); set = 'B'; continue;
+                case 'C': values.push_back(99); set = 'C'; continue;
+                case 'S': values.push_back(98); continue;
+                case '1': values.push_back(102); continue;
+                case '2': values.push_back(97); continue;
+                case '3': values.push_back(96); continue;
+                case '4': values.push_back(set == 'A' ? 101 : 100); continue;
+                case '{': c = '{'; break;
+                default: return false;
+            }
+        }
+        if (set == 'C') {
+            if (c > 99) return false;
+            values.push_back(c);
+            text += (char)('0' + c / 10);
+            text += (char)('0' + c % 10);
+        } else if (set == 'A') {
+            if (c > 0x5F) return false;
+            values.push_back(c < 0x20 ? c + 64 : c - 32);
+            if (c >= 0x20) text += (char)c;
+        } else {
+            if (c < 0x20 || c > 0x7F) return false;
+            values.push_back(c - 32);
+            if (c < 0x7F) text += (char)c;
+        }
+    }
+    int check = values[0];
+    for (size_t i = 1; i < values.size(); ++i) check = (check + values[i] * (int)i) % 103;
+    values.push_back(check);
+    values.push_back(106);
+    for (int value : values) {
+        for (const char* p = kPatterns[value]; *p; ++p) out.runs.push_back((*p - '0') * module);
+    }
+    out.text = text;
+    return true;
+}
+
+// GS k m: false for symbologies that are not drawn and for data the symbology cannot hold
+inline bool EncodeEscPosBarcode(uint8_t mode, const std::string& data, int module, EscPosBarcode& out) {
+    out = EscPosBarcode();
+    bool digits = !data.empty() && std::all_of(data.begin(), data.end(), [](char c) { return c >= '0' && c <= '9'; });
+    switch (mode) {
+        case 0: case 65: // UPC-A: EAN-13 with a leading zero
+            if (!digits || (data.size() != 11 && data.size() != 12)) return false;
+            EncodeEan("0" + data.substr(0, 11), module, out);
+            out.text = out.text.substr(1);
+            return true;
+        case 2: case 67:
+            if (!digits || (data.size() != 12 && data.size() != 13)) return false;
+            EncodeEan(data.substr(0, 12), module, out);
+            return true;
+        case 3: case 68:
+            if (!digits || (data.size() != 7 && data.size() != 8)) return false;
+            EncodeEan(data.substr(0, 7), module, out);
+            return true;
+        case 4: case 69:
+            return EncodeCode39(data, module, out);
+        case 5: case 70:
+            return digits && EncodeItf(data, module, out);
+        case 73:
+            return EncodeCode128(data, module, out);
+        default: // UPC-E, CODABAR, CODE93, GS1 DataBar
+            return false;
+    }
+}
+
+
+class EscPosEmulator {
+public:
+    explicit EscPosEmulator(int page_width = ESCPOS_PAGE_WIDTH)
+        : width_(std::max(8, page_width / 8 * 8)), row_bytes_((size_t)width_ / 8) {
+        line_.assign((size_t)ESCPOS_LINE_ROWS * row_bytes_ + 4, 0); // Slack for PutChar's word writes
+        Initialize();
+    }
+
+    void Feed(const uint8_t* p, size_t n) {
+        parser_.Feed(p, n, [this](const EscPosEvent& e) { OnEvent(e); });
+    }
+
+    // The stream has ended: a command cut short is dropped, text waiting for LF is printed
+    void Finish() {
+        parser_.Finish([this](const EscPosEvent& e) { OnEvent(e); });
+        if (line_height_ > 0) PrintLine(0);
+    }
+
+    // The page as if the stream ended here
+    void Snapshot(std::vector<uint8_t>& out) const {
+        out = page_;
+        if (line_height_ > 0) RenderLine(out, 0);
+    }
+
+    // Rows of width() dots, 8 per byte, MSB = leftmost dot, 1 = black
+    const std::vector<uint8_t>& page() const { return page_; }
+    std::vector<uint8_t> TakePage() { return std::move(page_); }
+    int width() const { return width_; }
+    int rows() const { return (int)(page_.size() / row_bytes_); }
+    bool empty() const { return page_.empty() && line_height_ == 0; }
+    const std::vector<int>& cuts() const { return cuts_; } // Row of each cut's dashed line
+    const EscPosEmulatorStats& stats() const { return stats_; }
+
+private:
+    enum class Payload { None, Raster, BitImage, Barcode, Symbol, Tabs };
+
+    void Initialize() {
+        style_ = ReceiptFontStyle();
+        glyphs_ = nullptr;
+        char_spacing_ = 0;
+        line_spacing_ = ESCPOS_LINE_SPACING;
+        align_ = 0;
+        left_margin_ = 0;
+        area_width_ = width_;
+        tabs_.clear();
+        barcode_height_ = ESCPOS_BARCODE_HEIGHT;
+        barcode_module_ = ESCPOS_BARCODE_MODULE;
+        hri_position_ = 0;
+        hri_font_b_ = false;
+        qr_module_ = ESCPOS_QR_MODULE;
+        qr_ecc_ = QrEcc::Low;
+        ClearLine();
+    }
+
+    const GlyphSet& Glyphs() {
+        if (!glyphs_) glyphs_ = &ReceiptGlyphCache::Shared().Get(style_);
+        return *glyphs_;
+    }
+
+    void SetStyle(const ReceiptFontStyle& style) {
+        style_ = style;
+        glyphs_ = nullptr;
+    }
+
+    uint8_t* LineRow(int row) { return line_.data() + (size_t)row * row_bytes_; }
+    const uint8_t* LineRow(int row) const { return line_.data() + (size_t)row * row_bytes_; }
+
+    int AlignedX(int content_width) const {
+        int free = std::max(0, area_width_ - content_width);
+        return left_margin_ + (align_ == 1 ? free / 2 : align_ == 2 ? free : 0);
+    }
+
+    size_t AppendRows(std::vector<uint8_t>& page, int rows) const {
+        size_t first = page.size() / row_bytes_;
+        page.resize(page.size() + (size_t)std::max(0, rows) * row_bytes_, 0);
+        return first;
+    }
+
+    // The line buffer onto the page, then the feed; the line takes at least its own height
+    void RenderLine(std::vector<uint8_t>& page, int feed) const {
+        size_t first = AppendRows(page, std::max(feed, line_height_));
+        int x = AlignedX(line_extent_);
+        int count = std::min(line_extent_, width_ - x);
+        if (count <= 0) return;
+        for (int r = 0; r < line_height_; ++r) {
+            OrDots(page.data() + (first + r) * row_bytes_, (size_t)x, LineRow(ESCPOS_LINE_ROWS - line_height_ + r), (size_t)count);
+        }
+    }
+
+    void PrintLine(int feed) {
+        if (line_height_ > 0) stats_.lines++;
+        RenderLine(page_, feed);
+        ClearLine();
+    }
+
+    // Prints what the line holds without feeding; barcodes and raster images start a line
+    void FlushLine() {
+        if (line_height_ > 0) PrintLine(0);
+        line_x_ = 0;
+    }
+
+    void ClearLine() {
+        if (line_height_ > 0) std::fill(line_.begin() + (size_t)(ESCPOS_LINE_ROWS - line_height_) * row_bytes_, line_.end(), 0);
+        line_x_ = 0;
+        line_extent_ = 0;
+        line_height_ = 0;
+    }
+
+    // Space for something width dots wide at the current position; a full line is printed
+    // first, as the printer does. False if it does not fit even an empty line.
+    bool MakeRoom(int width) {
+        if (line_x_ + width > area_width_ && line_x_ > 0) PrintLine(line_spacing_);
+        return line_x_ + width <= area_width_;
+    }
+
+    void PutChar(uint8_t c) {
+        const GlyphSet& glyphs = Glyphs();
+        int advance = glyphs.width() + char_spacing_ * style_.width_scale;
+        if (!MakeRoom(glyphs.width())) return;
+        const uint8_t* glyph = glyphs.glyph(c);
+        int top = ESCPOS_LINE_ROWS - glyphs.rows();
+        size_t glyph_bytes = glyphs.row_bytes();
+        if (glyph_bytes <= 3) {
+            // Font A and B at normal width: one shifted word per row. Glyph rows are zero past
+            // their width, so the extra bytes written are no-ops.
+            unsigned shift = (unsigned)(line_x_ % 8);
+            uint8_t* d = LineRow(top) + line_x_ / 8;
+            for (int r = 0; r < glyphs.rows(); ++r, glyph += glyph_bytes, d += row_bytes_) {
+                uint32_t word = (uint32_t)glyph[0] << 24;
+                if (glyph_bytes > 1) word |= (uint32_t)glyph[1] << 16;
+                if (glyph_bytes > 2) word |= (uint32_t)glyph[2] << 8;
+                word >>= shift;
+                d[0] |= (uint8_t)(word >> 24);
+                d[1] |= (uint8_t)(word >> 16);
+                d[2] |= (uint8_t)(word >> 8);
+                d[3] |= (uint8_t)word;
+            }
+        } else {
+            for (int r = 0; r < glyphs.rows(); ++r) OrDots(LineRow(top + r), (size_t)line_x_, glyph + r * glyph_bytes, (size_t)glyphs.width());
+        }
+        line_extent_ = std::max(line_extent_, line_x_ + glyphs.width());
+        line_x_ = std::min(area_width_, line_x_ + advance);
+        line_height_ = std::max(line_height_, glyphs.rows());
+        stats_.characters++;
+    }
+
+    void Tab() {
+        int column = Glyphs().width() + char_spacing_ * style_.width_scale;
+        int next = -1;
+        if (tabs_.empty()) {
+            int step = column * ESCPOS_TAB_COLUMNS;
+            next = (line_x_ / step + 1) * step;
+        } else {
+            for (int tab : tabs_) {
+                if (tab * column > line_x_) {
+                    next = tab * column;
+                    break;
+                }
+            }
+        }
+        if (next >= 0 && next <= area_width_) line_x_ = next;
+    }
+
+    void OnEvent(const EscPosEvent& e) {
+        if (e.type == EscPosEventType::Data) {
+            OnData(e);
+            return;
+        }
+        payload_ = Payload::None;
+        switch (e.type) {
+            case EscPosEventType::Text:
+                for (size_t i = 0; i < e.data.size; ++i) PutChar(e.data.data[i]);
+                break;
+            case EscPosEventType::LineFeed:
+            case EscPosEventType::FormFeed:
+                PrintLine(line_spacing_);
+                break;
+            case EscPosEventType::Tab:
+                Tab();
+                break;
+            case EscPosEventType::Initialize:
+                Initialize();
+                break;
+            case EscPosEventType::FeedDots:
+                PrintLine((int)e.value);
+                break;
+            case EscPosEventType::FeedLines:
+                PrintLine((int)e.value * line_spacing_);
+                break;
+            case EscPosEventType::Raster:
+                FlushLine();
+                stats_.images++;
+                raster_width_ = e.width;
+                raster_mode_ = e.mode;
+                raster_row_.clear();
+                if (e.data_length > 0 && e.width > 0) payload_ = Payload::Raster;
+                break;
+            case EscPosEventType::BitImage:
+                stats_.images++;
+                StartPayload(e, Payload::BitImage);
+                break;
+            case EscPosEventType::Cut:
+                Cut(e);
+                break;
+            case EscPosEventType::Command:
+                OnCommand(e);
+                break;
+            default: // CR (the printer feeds on LF), unknown bytes, a command cut short
+                break;
+        }
+    }
+
+    void StartPayload(const EscPosEvent& e, Payload kind) {
+        payload_ = kind;
+        payload_mode_ = e.mode;
+        payload_width_ = e.width;
+        payload_height_ = e.height;
+        payload_data_.clear();
+    }
+
+    void OnData(const EscPosEvent& e) {
+        if (payload_ == Payload::None) return;
+        if (payload_ == Payload::Raster) {
+            RasterData(e.data.data, e.data.size);
+            if (e.data_length == 0) payload_ = Payload::None;
+            return;
+        }
+        size_t take = std::min(e.data.size, ESCPOS_SYMBOL_MAX - std::min(ESCPOS_SYMBOL_MAX, payload_data_.size()));
+        payload_data_.insert(payload_data_.end(), e.data.data, e.data.data + take);
+        if (e.data_length == 0) EndPayload();
+    }
+
+    void EndPayload() {
+        Payload kind = payload_;
+        payload_ = Payload::None;
+        switch (kind) {
+            case Payload::BitImage: DrawBitImage(); break;
+            case Payload::Barcode: PrintBarcode(); break;
+            case Payload::Symbol: SymbolCommand(); break;
+            case Payload::Tabs:
+                for (uint8_t tab : payload_data_) {
+                    if (tabs_.empty() || tab > tabs_.back()) tabs_.push_back(tab);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void OnCommand(const EscPosEvent& e) {
+        uint8_t n = e.param_count > 0 ? e.params[0] : 0;
+        uint16_t n16 = e.param_count > 1 ? (uint16_t)(e.params[0] | (e.params[1] << 8)) : 0;
+        uint8_t digit = n >= '0' ? (uint8_t)(n - '0') : n; // Several commands take 0/1/2 or '0'/'1'/'2'
+        ReceiptFontStyle style = style_;
+        switch (e.prefix << 8 | e.function) {
+            case ESCPOS_ESC << 8 | '!':
+                style.font_b = n & 0x01;
+                style.emphasized = n & 0x08;
+                style.height_scale = n & 0x10 ? 2 : 1;
+                style.width_scale = n & 0x20 ? 2 : 1;
+                style.underline = n & 0x80 ? 1 : 0;
+                SetStyle(style);
+                break;
+            case ESCPOS_ESC << 8 | 'E':
+            case ESCPOS_ESC << 8 | 'G':
+                style.emphasized = n & 0x01;
+                SetStyle(style);
+                break;
+            case ESCPOS_ESC << 8 | '-':
+                style.underline = std::min<uint8_t>(digit, 2);
+                SetStyle(style);
+                break;
+            case ESCPOS_ESC << 8 | 'M':
+                style.font_b = digit != 0;
+                SetStyle(style);
+                break;
+            case ESCPOS_GS << 8 | '!':
+                style.width_scale = (uint8_t)(((n >> 4) & 7) + 1);
+                style.height_scale = (uint8_t)((n & 7) + 1);
+                SetStyle(style);
+                break;
+            case ESCPOS_GS << 8 | 'B':
+                style.reverse = n & 0x01;
+                SetStyle(style);
+                break;
+            case ESCPOS_ESC << 8 | ' ':
+                char_spacing_ = n;
+                break;
+            case ESCPOS_ESC << 8 | '2':
+                line_spacing_ = ESCPOS_LINE_SPACING;
+                break;
+            case ESCPOS_ESC << 8 | '3':
+                line_spacing_ = n;
+                break;
+            case ESCPOS_ESC << 8 | 'a':
+                align_ = std::min<int>(digit, 2);
+                break;
+            case ESCPOS_ESC << 8 | '$':
+                line_x_ = std::min<int>(n16, area_width_);
+                break;
+            case ESCPOS_ESC << 8 | '\\':
+                line_x_ = std::clamp(line_x_ + (int16_t)n16, 0, area_width_);
+                break;
+            case ESCPOS_ESC << 8 | 'D':
+                tabs_.clear();
+                StartPayload(e, Payload::Tabs);
+                break;
+            case ESCPOS_GS << 8 | 'L':
+                left_margin_ = std::min<int>(n16, width_ - 8);
+                area_width_ = std::min(area_width_, width_ - left_margin_);
+                break;
+            case ESCPOS_GS << 8 | 'W':
+                area_width_ = std::clamp<int>(n16, 8, width_ - left_margin_);
+                break;
+            case ESCPOS_GS << 8 | 'h':
+                barcode_height_ = std::max<int>(n, 1);
+                break;
+            case ESCPOS_GS << 8 | 'w':
+                barcode_module_ = std::clamp<int>(n, 1, 6);
+                break;
+            case ESCPOS_GS << 8 | 'H':
+                hri_position_ = digit & 3;
+                break;
+            case ESCPOS_GS << 8 | 'f':
+                hri_font_b_ = (digit & 1) != 0;
+                break;
+            case ESCPOS_GS << 8 | 'k':
+                StartPayload(e, Payload::Barcode);
+                break;
+            case ESCPOS_GS << 8 | '(':
+                if (e.mode == 'k') {
+                    StartPayload(e, Payload::Symbol);
+                } else if (e.mode == 'L') {
+                    stats_.ignored++; // Stored graphics
+                }
+                break;
+            case ESCPOS_GS << 8 | '8':
+            case ESCPOS_GS << 8 | '*':
+                stats_.ignored++;
+                break;
+            default: // Code pages, peripherals, real-time status and the like print nothing
+                break;
+        }
+    }
+
+    void Cut(const EscPosEvent& e) {
+        FlushLine();
+        if (e.mode >= 65) AppendRows(page_, (int)e.value); // Function B: feed, then cut
+        cuts_.push_back(rows());
+        size_t row = AppendRows(page_, 1);
+        for (size_t k = 0; k < row_bytes_; ++k) page_[row * row_bytes_ + k] = 0xF0;
+        stats_.cuts++;
+    }
+
+    // GS v 0 rows as they arrive; m bit 0 doubles the width, bit 1 the height
+    void RasterData(const uint8_t* p, size_t n) {
+        while (n > 0) {
+            if (raster_row_.empty() && n >= raster_width_) {
+                RasterRow(p);
+                p += raster_width_;
+                n -= raster_width_;
+                continue;
+            }
+            size_t take = std::min<size_t>(n, raster_width_ - raster_row_.size());
+            raster_row_.insert(raster_row_.end(), p, p + take);
+            p += take;
+            n -= take;
+            if (raster_row_.size() == raster_width_) {
+                RasterRow(raster_row_.data());
+                raster_row_.clear();
+            }
+        }
+    }
+
+    void RasterRow(const uint8_t* row) {
+        int scale_x = raster_mode_ & 1 ? 2 : 1, scale_y = raster_mode_ & 2 ? 2 : 1;
+        const uint8_t* source = row;
+        if (scale_x == 2) {
+            wide_row_.assign((size_t)raster_width_ * 2, 0);
+            for (uint32_t k = 0; k < raster_width_; ++k) {
+                uint16_t doubled = 0;
+                for (int b = 0; b < 8; ++b) doubled |= (uint16_t)(((row[k] >> b) & 1) * (3u << (2 * b)));
+                wide_row_[2 * k] = (uint8_t)(doubled >> 8);
+                wide_row_[2 * k + 1] = (uint8_t)doubled;
+            }
+            source = wide_row_.data();
+        }
+        int dots = (int)std::min<uint64_t>((uint64_t)raster_width_ * 8 * scale_x, INT32_MAX);
+        int x = AlignedX(dots);
+        int count = std::min(dots, width_ - x);
+        for (int k = 0; k < scale_y; ++k) {
+            size_t r = AppendRows(page_, 1);
+            if (count > 0) OrDots(page_.data() + r * row_bytes_, (size_t)x, source, (size_t)count);
+        }
+    }
+
+    // ESC *: columns of 8 or 24 dots, MSB on top, placed in the line like a character
+    void DrawBitImage() {
+        int bytes_per_column = (int)payload_height_ / 8;
+        int columns = (int)std::min<size_t>(payload_width_, payload_data_.size() / std::max(1, bytes_per_column));
+        int scale_x = payload_mode_ & 1 ? 1 : 2;         // Single density prints each column twice
+        int scale_y = payload_height_ == 8 ? 3 : 1;      // 8-dot images at a third of the density
+        int width = columns * scale_x, height = (int)payload_height_ * scale_y;
+        if (columns == 0 || !MakeRoom(width)) return;
+        int top = ESCPOS_LINE_ROWS - height;
+        for (int c = 0; c < columns; ++c) {
+            for (int dot = 0; dot < (int)payload_height_; ++dot) {
+                if (!((payload_data_[(size_t)c * bytes_per_column + dot / 8] >> (7 - dot % 8)) & 1)) continue;
+                for (int sy = 0; sy < scale_y; ++sy) {
+                    uint8_t* row = LineRow(top + dot * scale_y + sy);
+                    for (int sx = 0; sx < scale_x; ++sx) {
+                        int x = line_x_ + c * scale_x + sx;
+                        row[x / 8] |= (uint8_t)(0x80 >> (x % 8));
+                    }
+                }
+            }
+        }
+        line_extent_ = std::max(line_extent_, line_x_ + width);
+        line_x_ += width;
+        line_height_ = std::max(line_height_, height);
+    }
+
+    // Text centred on [x, x + width) in new rows, for the barcode's human-readable line
+    void PrintCentredText(const std::string& text, int x, int width) {
+        ReceiptFontStyle style;
+        style.font_b = hri_font_b_;
+        const GlyphSet& glyphs = ReceiptGlyphCache::Shared().Get(style);
+        int fit = std::min<int>((int)text.size(), width_ / glyphs.width());
+        int start = std::clamp(x + (width - fit * glyphs.width()) / 2, 0, width_ - fit * glyphs.width());
+        size_t first = AppendRows(page_, glyphs.rows());
+        for (int i = 0; i < fit; ++i) {
+            const uint8_t* glyph = glyphs.glyph((uint8_t)text[i]);
+            for (int r = 0; r < glyphs.rows(); ++r) {
+                OrDots(page_.data() + (first + r) * row_bytes_, (size_t)(start + i * glyphs.width()), glyph + r * glyphs.row_bytes(),
+                       (size_t)glyphs.width());
+            }
+        }
+    }
+
+    void PrintBarcode() {
+        FlushLine();
+        EscPosBarcode barcode;
+        std::string data(payload_data_.begin(), payload_data_.end());
+        if (!EncodeEscPosBarcode(payload_mode_, data, barcode_module_, barcode) || barcode.width() > area_width_) {
+            stats_.ignored++;
+            return;
+        }
+        int x = AlignedX(barcode.width());
+        std::vector<uint8_t> bars(row_bytes_, 0);
+        int position = x;
+        for (size_t i = 0; i < barcode.runs.size(); ++i) {
+            if (i % 2 == 0) {
+                for (int d = position; d < position + barcode.runs[i]; ++d) bars[d / 8] |= (uint8_t)(0x80 >> (d % 8));
+            }
+            position += barcode.runs[i];
+        }
+        if (hri_position_ & 1) PrintCentredText(barcode.text, x, barcode.width());
+        size_t first = AppendRows(page_, barcode_height_);
+        for (int r = 0; r < barcode_height_; ++r) std::memcpy(page_.data() + (first + r) * row_bytes_, bars.data(), row_bytes_);
+        if (hri_position_ & 2) PrintCentredText(barcode.text, x, barcode.width());
+        stats_.barcodes++;
+    }
+
+    // GS ( k: cn fn [parameters]; only the QR Code functions (cn = 49) are emulated
+    void SymbolCommand() {
+        if (payload_data_.size() < 2) return;
+        uint8_t cn = payload_data_[0], fn = payload_data_[1];
+        uint8_t n = payload_data_.size() > 2 ? payload_data_[2] : 0;
+        if (cn != 49) {
+            if (fn == 81) stats_.ignored++; // PDF417, MaxiCode, DataMatrix, ... printed
+            return;
+        }
+        switch (fn) {
+            case 67: qr_module_ = std::clamp<int>(n, 1, 16); break;
+            case 69: qr_ecc_ = (QrEcc)std::clamp<int>(n - 48, 0, 3); break;
+            case 80: qr_data_.assign(payload_data_.begin() + std::min<size_t>(3, payload_data_.size()), payload_data_.end()); break;
+            case 81: PrintQrCode(); break;
+            default: break;
+        }
+    }
+
+    void PrintQrCode() {
+        FlushLine();
+        QrCode code;
+        if (qr_data_.empty() || !code.Encode(qr_data_.data(), qr_data_.size(), qr_ecc_) || code.size() * qr_module_ > area_width_) {
+            stats_.ignored++;
+            return;
+        }
+        int dots = code.size() * qr_module_;
+        int x = AlignedX(dots);
+        std::vector<uint8_t> row(row_bytes_);
+        for (int y = 0; y < code.size(); ++y) {
+            std::fill(row.begin(), row.end(), 0);
+            for (int m = 0; m < code.size(); ++m) {
+                if (!code.module(m, y)) continue;
+                for (int d = x + m * qr_module_; d < x + (m + 1) * qr_module_; ++d) row[d / 8] |= (uint8_t)(0x80 >> (d % 8));
+            }
+            size_t first = AppendRows(page_, qr_module_);
+            for (int k = 0; k < qr_module_; ++k) std::memcpy(page_.data() + (first + k) * row_bytes_, row.data(), row_bytes_);
+        }
+        stats_.qr_codes++;
+    }
+
+    EscPosParser parser_;
+    int width_;
+    size_t row_bytes_;
+    std::vector<uint8_t> page_;
+    std::vector<int> cuts_;
+    EscPosEmulatorStats stats_;
+
+    // The line being collected: ESCPOS_LINE_ROWS rows, contents bottom-aligned
+    std::vector<uint8_t> line_;
+    int line_x_ = 0;       // Print position, dots from the left margin
+    int line_extent_ = 0;  // Right edge of what was drawn
+    int line_height_ = 0;  // Rows of the tallest item; 0: nothing to print
+
+    // Printer settings (ESC @ restores them)
+    ReceiptFontStyle style_;
+    const GlyphSet* glyphs_ = nullptr;
+    int char_spacing_ = 0;
+    int line_spacing_ = ESCPOS_LINE_SPACING;
+    int align_ = 0;        // 0 left, 1 centre, 2 right
+    int left_margin_ = 0;
+    int area_width_ = 0;
+    std::vector<int> tabs_; // Columns, ascending
+    int barcode_height_ = ESCPOS_BARCODE_HEIGHT;
+    int barcode_module_ = ESCPOS_BARCODE_MODULE;
+    int hri_position_ = 0; // Bit 0 above, bit 1 below
+    bool hri_font_b_ = false;
+    int qr_module_ = ESCPOS_QR_MODULE;
+    QrEcc qr_ecc_ = QrEcc::Low;
+    std::vector<uint8_t> qr_data_;
+
+    // The payload of the command being received
+    Payload payload_ = Payload::None;
+    uint8_t payload_mode_ = 0;
+    uint32_t payload_width_ = 0;
+    uint32_t payload_height_ = 0;
+    std::vector<uint8_t> payload_data_;
+    uint32_t raster_width_ = 0;
+    uint8_t raster_mode_ = 0;
+    std::vector<uint8_t> raster_row_;
+    std::vector<uint8_t> wide_row_;
+};
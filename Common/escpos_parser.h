@@ -0,0 +1,534 @@
+#pragma once
+
+// Incremental ESC/POS tokenizer. EscPosParser turns a byte stream into typed events in a
+// single pass; input may arrive in arbitrary pieces (capture frames, mapped segments) and
+// the parser resumes mid-command. Payloads (raster rows, bit image columns, barcode data,
+// ...) are reported as Data events pointing into the caller's buffer, nothing is copied.
+//
+// Commands are described by kEscPosCommands: prefix byte, function byte, number of fixed
+// parameter bytes and how the payload length follows from the parameters. Unknown commands
+// are reported as Unknown and only their prefix and function bytes are consumed.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+#include "capture_reader.h" // ByteSpan, ByteSpanList
+
+constexpr uint8_t ESCPOS_HT = 0x09;
+constexpr uint8_t ESCPOS_LF = 0x0A;
+constexpr uint8_t ESCPOS_FF = 0x0C;
+constexpr uint8_t ESCPOS_CR = 0x0D;
+constexpr uint8_t ESCPOS_DLE = 0x10;
+constexpr uint8_t ESCPOS_ESC = 0x1B;
+constexpr uint8_t ESCPOS_FS = 0x1C;
+constexpr uint8_t ESCPOS_GS = 0x1D;
+
+enum class EscPosEventType : uint8_t {
+    Text,           // data: printable bytes (one run may be split over several events)
+    LineFeed,       // LF
+    CarriageReturn, // CR
+    FormFeed,       // FF
+    Tab,            // HT
+    Initialize,     // ESC @
+    FeedDots,       // ESC J n: value = n dots
+    FeedLines,      // ESC d n: value = n lines
+    Raster,         // GS v 0 m xL xH yL yH: width = bytes per row, height = rows, mode = m
+    BitImage,       // ESC * m nL nH: width = columns, height = 8 or 24 dots, mode = m
+    Cut,            // GS V m [n] (mode = m, value = n), ESC i / ESC m (mode = 1, partial)
+    Command,        // Any other known command; see name and params
+    Data,           // Payload of the preceding event; data_length = bytes still to come
+    Unknown,        // Unrecognized control byte or command
+    Incomplete      // Finish() inside a command: the stream ended mid-command
+};
+
+// How the payload length of a command follows from its parameters
+enum class EscPosLength : uint8_t {
+    None,
+    NulTerminated,  // Until a NUL byte (ESC D tab positions)
+    Raster,         // GS v 0: xL xH yL yH -> (xL + 256 xH) * (yL + 256 yH)
+    BitImage,       // ESC *: m nL nH -> n or 3n bytes
+    Cut,            // GS V: m >= 65 takes one more parameter
+    Barcode,        // GS k: m <= 6 NUL-terminated, else n then n bytes
+    Length16,       // Last two parameters are pL pH (GS ( and ESC ( families)
+    Length32,       // GS 8 L: p1..p4
+    DownloadImage,  // GS *: x y -> x * y * 8
+    UserChars       // ESC &: y c1 c2, then per character x and y * x bytes
+};
+
+struct EscPosCommandSpec {
+    uint8_t prefix;
+    uint8_t function;
+    uint8_t params; // Fixed parameter bytes after the function byte
+    EscPosLength length;
+    EscPosEventType type;
+    const char* name;
+};
+
+// The commonly used subset of the Epson command set
+const EscPosCommandSpec kEscPosCommands[] = {
+    { ESCPOS_ESC, '@', 0, EscPosLength::None, EscPosEventType::Initialize, "ESC @" },
+    { ESCPOS_ESC, 'J', 1, EscPosLength::None, EscPosEventType::FeedDots, "ESC J" },
+    { ESCPOS_ESC, 'd', 1, EscPosLength::None, EscPosEventType::FeedLines, "ESC d" },
+    { ESCPOS_ESC, '*', 3, EscPosLength::BitImage, EscPosEventType::BitImage, "ESC *" },
+    { ESCPOS_ESC, 'i', 0, EscPosLength::None, EscPosEventType::Cut, "ESC i" },
+    { ESCPOS_ESC, 'm', 0, EscPosLength::None, EscPosEventType::Cut, "ESC m" },
+    { ESCPOS_ESC, 'e', 1, EscPosLength::None, EscPosEventType::Command, "ESC e" },
+    { ESCPOS_ESC, '!', 1, EscPosLength::None, EscPosEventType::Command, "ESC !" },
+    { ESCPOS_ESC, '$', 2, EscPosLength::None, EscPosEventType::Command, "ESC $" },
+    { ESCPOS_ESC, '%', 1, EscPosLength::None, EscPosEventType::Command, "ESC %" },
+    { ESCPOS_ESC, '&', 3, EscPosLength::UserChars, EscPosEventType::Command, "ESC &" },
+    { ESCPOS_ESC, '(', 3, EscPosLength::Length16, EscPosEventType::Command, "ESC (" },
+    { ESCPOS_ESC, '-', 1, EscPosLength::None, EscPosEventType::Command, "ESC -" },
+    { ESCPOS_ESC, '2', 0, EscPosLength::None, EscPosEventType::Command, "ESC 2" },
+    { ESCPOS_ESC, '3', 1, EscPosLength::None, EscPosEventType::Command, "ESC 3" },
+    { ESCPOS_ESC, '=', 1, EscPosLength::None, EscPosEventType::Command, "ESC =" },
+    { ESCPOS_ESC, '?', 1, EscPosLength::None, EscPosEventType::Command, "ESC ?" },
+    { ESCPOS_ESC, 'D', 0, EscPosLength::NulTerminated, EscPosEventType::Command, "ESC D" },
+    { ESCPOS_ESC, 'E', 1, EscPosLength::None, EscPosEventType::Command, "ESC E" },
+    { ESCPOS_ESC, 'G', 1, EscPosLength::None, EscPosEventType::Command, "ESC G" },
+    { ESCPOS_ESC, 'L', 0, EscPosLength::None, EscPosEventType::Command, "ESC L" },
+    { ESCPOS_ESC, 'M', 1, EscPosLength::None, EscPosEventType::Command, "ESC M" },
+    { ESCPOS_ESC, 'R', 1, EscPosLength::None, EscPosEventType::Command, "ESC R" },
+    { ESCPOS_ESC, 'S', 0, EscPosLength::None, EscPosEventType::Command, "ESC S" },
+    { ESCPOS_ESC, 'T', 1, EscPosLength::None, EscPosEventType::Command, "ESC T" },
+    { ESCPOS_ESC, 'U', 1, EscPosLength::None, EscPosEventType::Command, "ESC U" },
+    { ESCPOS_ESC, 'V', 1, EscPosLength::None, EscPosEventType::Command, "ESC V" },
+    { ESCPOS_ESC, 'W', 8, EscPosLength::None, EscPosEventType::Command, "ESC W" },
+    { ESCPOS_ESC, '\\', 2, EscPosLength::None, EscPosEventType::Command, "ESC \\" },
+    { ESCPOS_ESC, 'a', 1, EscPosLength::None, EscPosEventType::Command, "ESC a" },
+    { ESCPOS_ESC, 'c', 2, EscPosLength::None, EscPosEventType::Command, "ESC c" },
+    { ESCPOS_ESC, 'p', 3, EscPosLength::None, EscPosEventType::Command, "ESC p" },
+    { ESCPOS_ESC, 'r', 1, EscPosLength::None, EscPosEventType::Command, "ESC r" },
+    { ESCPOS_ESC, 't', 1, EscPosLength::None, EscPosEventType::Command, "ESC t" },
+    { ESCPOS_ESC, '{', 1, EscPosLength::None, EscPosEventType::Command, "ESC {" },
+    { ESCPOS_ESC, ' ', 1, EscPosLength::None, EscPosEventType::Command, "ESC SP" },
+
+    { ESCPOS_GS, 'v', 6, EscPosLength::Raster, EscPosEventType::Raster, "GS v 0" },
+    { ESCPOS_GS, 'V', 1, EscPosLength::Cut, EscPosEventType::Cut, "GS V" },
+    { ESCPOS_GS, '!', 1, EscPosLength::None, EscPosEventType::Command, "GS !" },
+    { ESCPOS_GS, '$', 2, EscPosLength::None, EscPosEventType::Command, "GS $" },
+    { ESCPOS_GS, '(', 3, EscPosLength::Length16, EscPosEventType::Command, "GS (" },
+    { ESCPOS_GS, '*', 2, EscPosLength::DownloadImage, EscPosEventType::Command, "GS *" },
+    { ESCPOS_GS, '/', 1, EscPosLength::None, EscPosEventType::Command, "GS /" },
+    { ESCPOS_GS, '8', 5, EscPosLength::Length32, EscPosEventType::Command, "GS 8 L" },
+    { ESCPOS_GS, 'B', 1, EscPosLength::None, EscPosEventType::Command, "GS B" },
+    { ESCPOS_GS, 'H', 1, EscPosLength::None, EscPosEventType::Command, "GS H" },
+    { ESCPOS_GS, 'I', 1, EscPosLength::None, EscPosEventType::Command, "GS I" },
+    { ESCPOS_GS, 'L', 2, EscPosLength::None, EscPosEventType::Command, "GS L" },
+    { ESCPOS_GS, 'P', 2, EscPosLength::None, EscPosEventType::Command, "GS P" },
+    { ESCPOS_GS, 'W', 2, EscPosLength::None, EscPosEventType::Command, "GS W" },
+    { ESCPOS_GS, '^', 3, EscPosLength::None, EscPosEventType::Command, "GS ^" },
+    { ESCPOS_GS, 'a', 1, EscPosLength::None, EscPosEventType::Command, "GS a" },
+    { ESCPOS_GS, 'b', 1, EscPosLength::None, EscPosEventType::Command, "GS b" },
+    { ESCPOS_GS, 'f', 1, EscPosLength::None, EscPosEventType::Command, "GS f" },
+    { ESCPOS_GS, 'h', 1, EscPosLength::None, EscPosEventType::Command, "GS h" },
+    { ESCPOS_GS, 'k', 1, EscPosLength::Barcode, EscPosEventType::Command, "GS k" },
+    { ESCPOS_GS, 'r', 1, EscPosLength::None, EscPosEventType::Command, "GS r" },
+    { ESCPOS_GS, 'w', 1, EscPosLength::None, EscPosEventType::Command, "GS w" },
+
+    { ESCPOS_FS, '!', 1, EscPosLength::None, EscPosEventType::Command, "FS !" },
+    { ESCPOS_FS, '&', 0, EscPosLength::None, EscPosEventType::Command, "FS &" },
+    { ESCPOS_FS, '-', 1, EscPosLength::None, EscPosEventType::Command, "FS -" },
+    { ESCPOS_FS, '.', 0, EscPosLength::None, EscPosEventType::Command, "FS ." },
+    { ESCPOS_FS, 'C', 1, EscPosLength::None, EscPosEventType::Command, "FS C" },
+    { ESCPOS_FS, 'S', 2, EscPosLength::None, EscPosEventType::Command, "FS S" },
+    { ESCPOS_FS, 'W', 1, EscPosLength::None, EscPosEventType::Command, "FS W" },
+    { ESCPOS_FS, 'p', 2, EscPosLength::None, EscPosEventType::Command, "FS p" },
+
+    { ESCPOS_DLE, 0x04, 1, EscPosLength::None, EscPosEventType::Command, "DLE EOT" },
+    { ESCPOS_DLE, 0x05, 1, EscPosLength::None, EscPosEventType::Command, "DLE ENQ" },
+    { ESCPOS_DLE, 0x14, 3, EscPosLength::None, EscPosEventType::Command, "DLE DC4" },
+};
+
+// Function byte lookup per prefix, built once from kEscPosCommands
+class EscPosCommandTable {
+public:
+    static const EscPosCommandSpec* Find(uint8_t prefix, uint8_t function) {
+        static const EscPosCommandTable table;
+        int p = PrefixIndex(prefix);
+        return p < 0 ? nullptr : table.specs_[p][function];
+    }
+
+    static int PrefixIndex(uint8_t prefix) {
+        switch (prefix) {
+            case ESCPOS_ESC: return 0;
+            case ESCPOS_GS: return 1;
+            case ESCPOS_FS: return 2;
+            case ESCPOS_DLE: return 3;
+            default: return -1;
+        }
+    }
+
+private:
+    EscPosCommandTable() {
+        std::memset(specs_, 0, sizeof(specs_));
+        for (const EscPosCommandSpec& spec : kEscPosCommands) specs_[PrefixIndex(spec.prefix)][spec.function] = &spec;
+    }
+
+    const EscPosCommandSpec* specs_[4][256];
+};
+
+struct EscPosEvent {
+    EscPosEventType type = EscPosEventType::Unknown;
+    uint64_t offset = 0;      // Stream offset of the command's first byte, or of the data
+    const char* name = "";    // Command name, e.g. "GS v 0"
+    uint8_t prefix = 0;       // Commands: prefix and function byte, e.g. GS and 'v'
+    uint8_t function = 0;
+    uint8_t mode = 0;
+    uint32_t value = 0;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint64_t data_length = 0; // Commands: payload bytes that follow as Data events; Data: bytes still to come after this one
+                              // (NUL-terminated payloads: 1 until the event that ends at the NUL, which may be empty)
+    const uint8_t* params = nullptr;
+    uint8_t param_count = 0;
+    ByteSpan data;            // Text, Data and Unknown bytes
+};
+
+inline const char* EscPosEventTypeName(EscPosEventType type) {
+    switch (type) {
+        case EscPosEventType::Text: return "text";
+        case EscPosEventType::LineFeed: return "LF";
+        case EscPosEventType::CarriageReturn: return "CR";
+        case EscPosEventType::FormFeed: return "FF";
+        case EscPosEventType::Tab: return "HT";
+        case EscPosEventType::Initialize: return "initialize";
+        case EscPosEventType::FeedDots: return "feed-dots";
+        case EscPosEventType::FeedLines: return "feed-lines";
+        case EscPosEventType::Raster: return "raster";
+        case EscPosEventType::BitImage: return "bit-image";
+        case EscPosEventType::Cut: return "cut";
+        case EscPosEventType::Command: return "command";
+        case EscPosEventType::Data: return "data";
+        case EscPosEventType::Unknown: return "unknown";
+        case EscPosEventType::Incomplete: return "incomplete";
+    }
+    return "?";
+}
+
+
+class EscPosParser {
+public:
+    // Parses the next piece of the stream. sink is called as sink(const EscPosEvent&);
+    // pointers in the event are valid during the call only.
+    template <typename Sink>
+    void Feed(const uint8_t* p, size_t n, Sink&& sink) {
+        size_t i = 0;
+        while (i < n) {
+            switch (state_) {
+                case State::Ground: {
+                    size_t start = i;
+                    while (i < n && p[i] >= 0x20) ++i;
+                    if (i > start) EmitBytes(EscPosEventType::Text, offset_ + start, p + start, i - start, sink);
+                    if (i == n) break;
+                    uint8_t b = p[i];
+                    command_offset_ = offset_ + i;
+                    ++i;
+                    if (EscPosCommandTable::PrefixIndex(b) >= 0) {
+                        prefix_ = b;
+                        state_ = State::Function;
+                    } else if (b == ESCPOS_LF) {
+                        EmitSimple(EscPosEventType::LineFeed, "LF", sink);
+                    } else if (b == ESCPOS_CR) {
+                        EmitSimple(EscPosEventType::CarriageReturn, "CR", sink);
+                    } else if (b == ESCPOS_HT) {
+                        EmitSimple(EscPosEventType::Tab, "HT", sink);
+                    } else if (b == ESCPOS_FF) {
+                        EmitSimple(EscPosEventType::FormFeed, "FF", sink);
+                    } else {
+                        EmitBytes(EscPosEventType::Unknown, command_offset_, p + i - 1, 1, sink);
+                    }
+                    break;
+                }
+                case State::Function: {
+                    function_ = p[i++];
+                    spec_ = EscPosCommandTable::Find(prefix_, function_);
+                    if (!spec_) {
+                        uint8_t bytes[2] = { prefix_, function_ };
+                        EmitBytes(EscPosEventType::Unknown, command_offset_, bytes, 2, sink);
+                        state_ = State::Ground;
+                        break;
+                    }
+                    param_count_ = 0;
+                    params_needed_ = spec_->params;
+                    state_ = State::Params;
+                    if (params_needed_ == 0) Resolve(sink);
+                    break;
+                }
+                case State::Params:
+                    params_[param_count_++] = p[i++];
+                    if (param_count_ == params_needed_) Resolve(sink);
+                    break;
+                case State::UserCharWidth: {
+                    // ESC &: each character starts with its width x; y * x column bytes follow
+                    uint8_t x = p[i];
+                    EmitData(offset_ + i, p + i, 1, (uint64_t)params_[0] * x, sink);
+                    ++i;
+                    remaining_ = (uint64_t)params_[0] * x;
+                    state_ = remaining_ > 0 ? State::Data : NextAfterData();
+                    break;
+                }
+                case State::Data: {
+                    size_t take = (size_t)std::min<uint64_t>(remaining_, n - i);
+                    remaining_ -= take;
+                    EmitData(offset_ + i, p + i, take, remaining_, sink);
+                    i += take;
+                    if (remaining_ == 0) state_ = NextAfterData();
+                    break;
+                }
+                case State::NulData: {
+                    const void* nul = std::memchr(p + i, 0, n - i);
+                    size_t end = nul ? static_cast<const uint8_t*>(nul) - p : n;
+                    if (end > i || nul) EmitData(offset_ + i, p + i, end - i, nul ? 0 : 1, sink);
+                    i = nul ? end + 1 : n;
+                    if (nul) state_ = State::Ground;
+                    break;
+                }
+            }
+        }
+        offset_ += n;
+    }
+
+    template <typename Sink>
+    void Feed(ByteSpan span, Sink&& sink) { Feed(span.data, span.size, sink); }
+
+    // Reports a command cut off by the end of the stream
+    template <typename Sink>
+    void Finish(Sink&& sink) {
+        if (state_ != State::Ground) {
+            EscPosEvent e;
+            e.type = EscPosEventType::Incomplete;
+            e.offset = command_offset_;
+            e.name = spec_ ? spec_->name : "?";
+            e.data_length = remaining_;
+            sink(e);
+        }
+        Reset();
+    }
+
+    void Reset() {
+        state_ = State::Ground;
+        spec_ = nullptr;
+        remaining_ = 0;
+        chars_left_ = 0;
+    }
+
+    uint64_t offset() const { return offset_; }
+
+private:
+    enum class State : uint8_t {
+        Ground,
+        Function,      // Got a prefix byte
+        Params,        // Collecting fixed parameters
+        Data,          // remaining_ payload bytes to go
+        NulData,       // Payload up to a NUL byte
+        UserCharWidth  // ESC &: next character's width byte
+    };
+
+    State NextAfterData() {
+        if (spec_ && spec_->length == EscPosLength::UserChars && chars_left_ > 0) {
+            --chars_left_;
+            return State::UserCharWidth;
+        }
+        return State::Ground;
+    }
+
+    // All fixed parameters are in: work out the payload, emit the command event
+    template <typename Sink>
+    void Resolve(Sink& sink) {
+        EscPosEvent e;
+        e.type = spec_->type;
+        e.offset = command_offset_;
+        e.name = spec_->name;
+        e.prefix = spec_->prefix;
+        e.function = spec_->function;
+        uint64_t length = 0;
+        bool nul_terminated = false;
+        const uint8_t* q = params_;
+        switch (spec_->length) {
+            case EscPosLength::None:
+                break;
+            case EscPosLength::NulTerminated:
+                nul_terminated = true;
+                break;
+            case EscPosLength::Raster:
+                if (q[0] != '0' && q[0] != 0) { // Other GS v forms are not raster data
+                    e.type = EscPosEventType::Command;
+                    break;
+                }
+                e.mode = q[1];
+                e.width = q[2] | (q[3] << 8);
+                e.height = q[4] | (q[5] << 8);
+                length = (uint64_t)e.width * e.height;
+                break;
+            case EscPosLength::BitImage:
+                e.mode = q[0];
+                e.width = q[1] | (q[2] << 8);
+                e.height = q[0] >= 32 ? 24 : 8;
+                length = (uint64_t)e.width * (e.height / 8);
+                break;
+            case EscPosLength::Cut:
+                if (param_count_ == 1 && q[0] >= 65) {
+                    params_needed_ = 2; // Function B: feed n, then cut
+                    return;
+                }
+                e.mode = q[0];
+                e.value = param_count_ > 1 ? q[1] : 0;
+                break;
+            case EscPosLength::Barcode:
+                e.mode = q[0];
+                if (q[0] <= 6) {
+                    nul_terminated = true;
+                } else if (param_count_ == 1) {
+                    params_needed_ = 2;
+                    return;
+                } else {
+                    length = q[1];
+                }
+                break;
+            case EscPosLength::Length16:
+                e.mode = q[0];
+                length = q[param_count_ - 2] | (q[param_count_ - 1] << 8);
+                break;
+            case EscPosLength::Length32:
+                length = (uint64_t)q[1] | ((uint64_t)q[2] << 8) | ((uint64_t)q[3] << 16) | ((uint64_t)q[4] << 24);
+                break;
+            case EscPosLength::DownloadImage:
+                e.width = q[0];
+                e.height = q[1];
+                length = (uint64_t)q[0] * q[1] * 8;
+                break;
+            case EscPosLength::UserChars:
+                e.height = q[0];
+                chars_left_ = q[2] >= q[1] ? q[2] - q[1] + 1 : 0;
+                break;
+        }
+        if (spec_->type == EscPosEventType::Cut && spec_->prefix == ESCPOS_ESC) e.mode = 1; // ESC i / ESC m: partial cut
+        if (spec_->type == EscPosEventType::FeedDots || spec_->type == EscPosEventType::FeedLines) e.value = q[0];
+        e.params = params_;
+        e.param_count = param_count_;
+        e.data_length = length;
+        sink(e);
+
+        remaining_ = length;
+        if (nul_terminated) {
+            state_ = State::NulData;
+        } else if (length > 0) {
+            state_ = State::Data;
+        } else {
+            state_ = NextAfterData();
+        }
+    }
+
+    template <typename Sink>
+    void EmitSimple(EscPosEventType type, const char* name, Sink& sink) {
+        EscPosEvent e;
+        e.type = type;
+        e.offset = command_offset_;
+        e.name = name;
+        sink(e);
+    }
+
+    template <typename Sink>
+    void EmitBytes(EscPosEventType type, uint64_t offset, const uint8_t* data, size_t len, Sink& sink) {
+        EscPosEvent e;
+        e.type = type;
+        e.offset = offset;
+        e.name = type == EscPosEventType::Text ? "text" : "?";
+        e.data = ByteSpan(data, len);
+        sink(e);
+    }
+
+    template <typename Sink>
+    void EmitData(uint64_t offset, const uint8_t* data, size_t len, uint64_t still_to_come, Sink& sink) {
+        EscPosEvent e;
+        e.type = EscPosEventType::Data;
+        e.offset = offset;
+        e.name = spec_ ? spec_->name : "";
+        e.data = ByteSpan(data, len);
+        e.data_length = still_to_come;
+        sink(e);
+    }
+
+    State state_ = State::Ground;
+    uint64_t offset_ = 0;
+    uint64_t command_offset_ = 0;
+    uint8_t prefix_ = 0;
+    uint8_t function_ = 0;
+    const EscPosCommandSpec* spec_ = nullptr;
+    uint8_t params_[8] = {};
+    uint8_t param_count_ = 0;
+    uint8_t params_needed_ = 0;
+    uint64_t remaining_ = 0;
+    uint32_t chars_left_ = 0;
+};
+
+
+struct EscPosRasterInfo {
+    uint64_t blocks = 0;      // GS v 0 commands
+    uint32_t width_bytes = 0; // Bytes per row of the first block
+    bool uniform_width = true;
+    uint64_t rows = 0;
+    uint64_t bytes = 0;       // Raster payload bytes delivered
+    uint64_t text_bytes = 0;  // Printable bytes outside command payloads
+    uint64_t unknown_bytes = 0; // Bytes of unrecognized control codes and commands
+    std::vector<uint64_t> cuts; // Raster payload bytes delivered when each cut command came
+};
+
+// Collects the payload of GS v 0 raster blocks from a stream fed in pieces of any size, as
+// ForEachEscPosRaster does for a whole stream: on_data(const uint8_t*, size_t) gets the
+// raster bytes in order, row-major, MSB = leftmost dot, 1 = black.
+class EscPosRasterReader {
+public:
+    template <typename F>
+    void Feed(const uint8_t* p, size_t n, F&& on_data) {
+        parser_.Feed(p, n, [&](const EscPosEvent& e) { OnEvent(e, on_data); });
+    }
+
+    // The stream has ended; a block cut short keeps the rows that arrived
+    void Finish() {
+        parser_.Finish([&](const EscPosEvent&) { in_raster_ = false; });
+    }
+
+    const EscPosRasterInfo& info() const { return info_; }
+
+private:
+    template <typename F>
+    void OnEvent(const EscPosEvent& e, F& on_data) {
+        if (e.type == EscPosEventType::Raster) {
+            if (info_.blocks == 0) info_.width_bytes = e.width;
+            info_.uniform_width = info_.uniform_width && e.width == info_.width_bytes;
+            info_.blocks++;
+            info_.rows += e.height;
+            in_raster_ = e.data_length > 0;
+        } else if (e.type == EscPosEventType::Data) {
+            if (in_raster_) {
+                on_data(e.data.data, e.data.size);
+                info_.bytes += e.data.size;
+                in_raster_ = e.data_length > 0;
+            }
+        } else {
+            if (e.type == EscPosEventType::Text) info_.text_bytes += e.data.size;
+            if (e.type == EscPosEventType::Unknown) info_.unknown_bytes += e.data.size;
+            if (e.type == EscPosEventType::Cut) info_.cuts.push_back(info_.bytes);
+            in_raster_ = false;
+        }
+    }
+
+    EscPosParser parser_;
+    EscPosRasterInfo info_;
+    bool in_raster_ = false;
+};
+
+// Walks a stream and passes the payload of every GS v 0 raster block, in order, to
+// on_data(const uint8_t*, size_t). Row-major, MSB = leftmost dot, 1 = black.
+template <typename F>
+EscPosRasterInfo ForEachEscPosRaster(const ByteSpanList& stream, F on_data) {
+    EscPosRasterReader reader;
+    for (const ByteSpan& segment : stream.segments) reader.Feed(segment.data, segment.size, on_data);
+    reader.Finish();
+    return reader.info();
+}
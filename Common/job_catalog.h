@@ -0,0 +1,531 @@
+#pragma once
+
+// Job catalog: one fixed-size record per relayed session, kept next to the captures in
+// printer_data so jobs can be found without listing and parsing capture filenames.
+//
+// catalog.jcl is an append-only log written by the relay when a session ends:
+//
+//   JOB_CATALOG_HEADER_SIZE byte header (magic, version, record size)
+//   JOB_RECORD_SIZE byte records, row N holding job id N + 1
+//
+// A torn last record (crash during append) is ignored by readers and cut off by the next
+// writer. Queries go through sorted index files (catalog.<name>.idx) holding (key, row)
+// pairs. Indexes are built by the query side, never by the relay, and record how many rows
+// they cover; rows appended since then are scanned linearly until the next index update,
+// which merges the sorted tail into the existing index instead of re-sorting everything.
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <fstream>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include "byte_order.h"
+#include "capture_reader.h" // MappedFile
+
+const std::string JOB_CATALOG_FILENAME = "catalog.jcl";
+constexpr char JOB_CATALOG_MAGIC[8] = { 'P', 'R', 'L', 'J', 'C', 'L', '\r', '\n' };
+constexpr char JOB_INDEX_MAGIC[8] = { 'P', 'R', 'L', 'J', 'I', 'X', '\r', '\n' };
+constexpr uint16_t JOB_CATALOG_VERSION = 1;
+constexpr size_t JOB_CATALOG_HEADER_SIZE = 32;
+constexpr size_t JOB_RECORD_SIZE = 256;
+constexpr size_t JOB_INDEX_HEADER_SIZE = 32;
+constexpr size_t JOB_INDEX_ENTRY_SIZE = 16; // u64 key, u64 row
+constexpr uint64_t JOB_INDEX_MAX_TAIL = 16384; // Unindexed rows tolerated before a query refreshes the indexes
+
+// Field sizes include the terminating NUL
+constexpr size_t JOB_ENDPOINT_FIELD_SIZE = 48;
+constexpr size_t JOB_CAPTURE_FIELD_SIZE = 104;
+
+// Ordered by severity: a session's outcome is the worst outcome of its two directions
+enum class JobOutcome : uint8_t {
+    Completed = 0,           // Both sides closed the connection
+    Reset = 1,               // A peer reset/aborted the connection
+    CaptureError = 2,        // Relayed, but the capture could not be (fully) written
+    RelayError = 3,          // A local send/recv failure cut the session short
+    Interrupted = 4,         // Relay shutdown during the session
+    UpstreamUnavailable = 5  // The printer could not be reached; nothing was relayed
+};
+
+inline JobOutcome WorseOutcome(JobOutcome a, JobOutcome b) {
+    return (uint8_t)a >= (uint8_t)b ? a : b;
+}
+
+// JobRecord::flags
+constexpr uint8_t JOB_FLAG_CHECKSUMS = 0x01; // crc_* fields are valid
+
+struct JobRecord {
+    uint64_t job_id = 0; // Assigned by JobCatalogWriter::Append()
+    uint64_t start_unix_us = 0;
+    uint64_t end_unix_us = 0;
+    uint64_t bytes_to_printer = 0;
+    uint64_t bytes_from_printer = 0;
+    uint32_t crc_to_printer = 0;
+    uint32_t crc_from_printer = 0;
+    JobOutcome outcome = JobOutcome::Completed;
+    uint8_t flags = 0;
+    std::string client;   // "ip:port"
+    std::string upstream; // "ip:port"
+    std::string capture;  // Capture filename relative to the catalog's directory, empty if none
+};
+
+inline uint64_t UnixTimeUs() {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline const char* JobOutcomeName(JobOutcome outcome) {
+    switch (outcome) {
+        case JobOutcome::Completed: return "completed";
+        case JobOutcome::Reset: return "reset";
+        case JobOutcome::CaptureError: return "capture-error";
+        case JobOutcome::RelayError: return "relay-error";
+        case JobOutcome::Interrupted: return "interrupted";
+        case JobOutcome::UpstreamUnavailable: return "upstream-unavailable";
+    }
+    return "unknown";
+}
+
+inline bool ParseJobOutcome(const std::string& name, JobOutcome& outcome) {
+    for (int i = 0; i <= (int)JobOutcome::UpstreamUnavailable; ++i) {
+        if (name == JobOutcomeName((JobOutcome)i)) {
+            outcome = (JobOutcome)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// --- Record encoding ---
+
+inline void PutFixedString(uint8_t* p, size_t field_size, const std::string& s) {
+    std::memset(p, 0, field_size);
+    std::memcpy(p, s.data(), std::min(s.size(), field_size - 1));
+}
+
+inline std::string GetFixedString(const uint8_t* p, size_t field_size) {
+    const void* nul = std::memchr(p, 0, field_size);
+    return std::string(reinterpret_cast<const char*>(p), nul ? static_cast<const uint8_t*>(nul) - p : field_size);
+}
+
+inline void EncodeJobRecord(const JobRecord& r, uint8_t out[JOB_RECORD_SIZE]) {
+    std::memset(out, 0, JOB_RECORD_SIZE);
+    PutLE64(out + 0, r.job_id);
+    PutLE64(out + 8, r.start_unix_us);
+    PutLE64(out + 16, r.end_unix_us);
+    PutLE64(out + 24, r.bytes_to_printer);
+    PutLE64(out + 32, r.bytes_from_printer);
+    PutLE32(out + 40, r.crc_to_printer);
+    PutLE32(out + 44, r.crc_from_printer);
+    out[48] = (uint8_t)r.outcome;
+    out[49] = r.flags;
+    PutFixedString(out + 56, JOB_ENDPOINT_FIELD_SIZE, r.client);
+    PutFixedString(out + 104, JOB_ENDPOINT_FIELD_SIZE, r.upstream);
+    PutFixedString(out + 152, JOB_CAPTURE_FIELD_SIZE, r.capture);
+}
+
+inline JobRecord DecodeJobRecord(const uint8_t* p) {
+    JobRecord r;
+    r.job_id = GetLE64(p + 0);
+    r.start_unix_us = GetLE64(p + 8);
+    r.end_unix_us = GetLE64(p + 16);
+    r.bytes_to_printer = GetLE64(p + 24);
+    r.bytes_from_printer = GetLE64(p + 32);
+    r.crc_to_printer = GetLE32(p + 40);
+    r.crc_from_printer = GetLE32(p + 44);
+    r.outcome = (JobOutcome)p[48];
+    r.flags = p[49];
+    r.client = GetFixedString(p + 56, JOB_ENDPOINT_FIELD_SIZE);
+    r.upstream = GetFixedString(p + 104, JOB_ENDPOINT_FIELD_SIZE);
+    r.capture = GetFixedString(p + 152, JOB_CAPTURE_FIELD_SIZE);
+    return r;
+}
+
+inline void EncodeJobCatalogHeader(uint8_t out[JOB_CATALOG_HEADER_SIZE]) {
+    std::memset(out, 0, JOB_CATALOG_HEADER_SIZE);
+    std::memcpy(out, JOB_CATALOG_MAGIC, sizeof(JOB_CATALOG_MAGIC));
+    PutLE16(out + 8, JOB_CATALOG_VERSION);
+    PutLE16(out + 10, (uint16_t)JOB_CATALOG_HEADER_SIZE);
+    PutLE16(out + 12, (uint16_t)JOB_RECORD_SIZE);
+}
+
+inline bool CheckJobCatalogHeader(const uint8_t* p, size_t size) {
+    return size >= JOB_CATALOG_HEADER_SIZE && std::memcmp(p, JOB_CATALOG_MAGIC, sizeof(JOB_CATALOG_MAGIC)) == 0 &&
+           GetLE16(p + 8) == JOB_CATALOG_VERSION && GetLE16(p + 10) == JOB_CATALOG_HEADER_SIZE &&
+           GetLE16(p + 12) == JOB_RECORD_SIZE;
+}
+
+// --- Endpoint keys ---
+
+// "ip:port" as produced by GetAddressString() (IPv6 addresses are not bracketed)
+inline std::string EndpointHost(const std::string& endpoint) {
+    size_t colon = endpoint.rfind(':');
+    return colon == std::string::npos ? endpoint : endpoint.substr(0, colon);
+}
+
+// Query form: "ip", "ip:port", "ipv6" or "[ipv6]:port". port is -1 when not given.
+inline void SplitEndpointQuery(const std::string& text, std::string& host, int& port) {
+    port = -1;
+    host = text;
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos) return;
+    bool bracketed = !text.empty() && text[0] == '[';
+    if (!bracketed && text.find(':') != colon) return; // Bare IPv6 address
+    try {
+        port = std::stoi(text.substr(colon + 1));
+    } catch (const std::exception&) {
+        port = -1;
+        return;
+    }
+    host = text.substr(0, colon);
+    if (bracketed && host.size() >= 2 && host.back() == ']') host = host.substr(1, host.size() - 2);
+}
+
+inline uint64_t HostKey(const std::string& host) {
+    uint64_t hash = 1469598103934665603ull; // FNV-1a
+    for (unsigned char c : host) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+
+// Appends records to catalog.jcl. One instance is shared by all session threads.
+class JobCatalogWriter {
+public:
+    bool Open(const std::filesystem::path& path, std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::error_code ec;
+        uint64_t size = std::filesystem::exists(path, ec) ? std::filesystem::file_size(path, ec) : 0;
+        if (ec) {
+            error = "Cannot stat " + path.string() + ": " + ec.message();
+            return false;
+        }
+        if (size > 0) {
+            uint8_t header[JOB_CATALOG_HEADER_SIZE] = {};
+            std::ifstream in(path, std::ios::binary);
+            in.read(reinterpret_cast<char*>(header), sizeof(header));
+            if (!CheckJobCatalogHeader(header, (size_t)in.gcount())) {
+                error = path.string() + " is not a job catalog of this version.";
+                return false;
+            }
+            uint64_t torn = (size - JOB_CATALOG_HEADER_SIZE) % JOB_RECORD_SIZE;
+            if (torn != 0) {
+                size -= torn;
+                std::filesystem::resize_file(path, size, ec);
+                if (ec) {
+                    error = "Cannot drop incomplete last record of " + path.string() + ": " + ec.message();
+                    return false;
+                }
+            }
+        }
+        path_ = path;
+        file_.open(path, std::ios::binary | std::ios::app);
+        if (!file_.is_open()) {
+            error = "Cannot open " + path.string() + " for appending.";
+            return false;
+        }
+        if (size == 0) {
+            uint8_t header[JOB_CATALOG_HEADER_SIZE];
+            EncodeJobCatalogHeader(header);
+            file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+            file_.flush();
+            if (!file_) {
+                error = "Cannot write header of " + path.string();
+                file_.close();
+                return false;
+            }
+            size = JOB_CATALOG_HEADER_SIZE;
+        }
+        rows_ = (size - JOB_CATALOG_HEADER_SIZE) / JOB_RECORD_SIZE;
+        return true;
+    }
+
+    // Assigns record.job_id and appends the record. Returns the job id, 0 on failure.
+    // A failed write may have left part of the record behind; it is cut off so the next
+    // record lands at its row. If that fails too, the writer closes and error says so.
+    uint64_t Append(JobRecord& record, std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_.is_open()) return 0;
+        record.job_id = rows_ + 1;
+        uint8_t encoded[JOB_RECORD_SIZE];
+        EncodeJobRecord(record, encoded);
+        file_.write(reinterpret_cast<const char*>(encoded), sizeof(encoded));
+        file_.flush(); // Readers may run while the relay is up
+        if (!file_) {
+            error = "Cannot append job to " + path_.string();
+            file_.close();
+            std::error_code ec;
+            std::filesystem::resize_file(path_, JOB_CATALOG_HEADER_SIZE + rows_ * JOB_RECORD_SIZE, ec);
+            if (ec) {
+                error += "; cannot drop the incomplete record: " + ec.message() + ". Job catalog disabled.";
+                return 0;
+            }
+            file_.open(path_, std::ios::binary | std::ios::app);
+            if (!file_.is_open()) error += "; cannot reopen it. Job catalog disabled.";
+            return 0;
+        }
+        return ++rows_;
+    }
+
+    bool is_open() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return file_.is_open();
+    }
+
+private:
+    std::mutex mutex_;
+    std::filesystem::path path_;
+    std::ofstream file_;
+    uint64_t rows_ = 0;
+};
+
+
+enum class JobIndexKind {
+    Time,    // start_unix_us
+    Client,  // HostKey of the client address
+    Printer, // HostKey of the upstream address
+    Size,    // bytes_to_printer
+    Count
+};
+
+inline const char* JobIndexName(JobIndexKind kind) {
+    switch (kind) {
+        case JobIndexKind::Time: return "time";
+        case JobIndexKind::Client: return "client";
+        case JobIndexKind::Printer: return "printer";
+        case JobIndexKind::Size: return "size";
+        default: return "?";
+    }
+}
+
+inline uint64_t JobIndexKey(JobIndexKind kind, const JobRecord& r) {
+    switch (kind) {
+        case JobIndexKind::Time: return r.start_unix_us;
+        case JobIndexKind::Client: return HostKey(EndpointHost(r.client));
+        case JobIndexKind::Printer: return HostKey(EndpointHost(r.upstream));
+        case JobIndexKind::Size: return r.bytes_to_printer;
+        default: return 0;
+    }
+}
+
+struct JobQuery {
+    uint64_t from_unix_us = 0;          // Start time, inclusive
+    uint64_t to_unix_us = UINT64_MAX;   // Start time, exclusive
+    std::string client_host;            // Empty = any
+    int client_port = -1;
+    std::string printer_host;
+    int printer_port = -1;
+    uint64_t min_bytes = 0;             // bytes_to_printer, inclusive
+    uint64_t max_bytes = UINT64_MAX;
+    int outcome = -1;                   // JobOutcome, -1 = any
+    size_t limit = 0;                   // Keep only the most recent N matches, 0 = all
+
+    bool Matches(const JobRecord& r) const {
+        auto endpoint_matches = [](const std::string& endpoint, const std::string& host, int port) {
+            if (host.empty()) return true;
+            if (EndpointHost(endpoint) != host) return false;
+            if (port < 0) return true;
+            size_t colon = endpoint.rfind(':');
+            return colon != std::string::npos && endpoint.substr(colon + 1) == std::to_string(port);
+        };
+        return r.start_unix_us >= from_unix_us && r.start_unix_us < to_unix_us &&
+               r.bytes_to_printer >= min_bytes && r.bytes_to_printer <= max_bytes &&
+               (outcome < 0 || (int)r.outcome == outcome) &&
+               endpoint_matches(r.client, client_host, client_port) &&
+               endpoint_matches(r.upstream, printer_host, printer_port);
+    }
+};
+
+struct JobQueryStats {
+    const char* access_path = "scan"; // Index used, or "scan"
+    uint64_t candidates = 0;          // Records decoded and filtered
+};
+
+
+// Read side of the catalog: maps catalog.jcl and its indexes
+class JobCatalog {
+public:
+    bool Open(const std::filesystem::path& dir, std::string& error) {
+        dir_ = dir;
+        if (!catalog_.Open(dir / JOB_CATALOG_FILENAME, error)) return false;
+        if (!CheckJobCatalogHeader(catalog_.data(), catalog_.size())) {
+            error = "Not a job catalog of this version.";
+            return false;
+        }
+        rows_ = (catalog_.size() - JOB_CATALOG_HEADER_SIZE) / JOB_RECORD_SIZE;
+        for (int k = 0; k < (int)JobIndexKind::Count; ++k) LoadIndex((JobIndexKind)k);
+        return true;
+    }
+
+    uint64_t rows() const { return rows_; }
+
+    JobRecord record(uint64_t row) const {
+        return DecodeJobRecord(catalog_.data() + JOB_CATALOG_HEADER_SIZE + row * JOB_RECORD_SIZE);
+    }
+
+    // Rows covered by an index; rows() - covered are scanned linearly by queries
+    uint64_t covered(JobIndexKind kind) const { return indexes_[(int)kind].rows_covered; }
+
+    // Brings every index whose unindexed tail is at least min_tail rows up to date
+    bool UpdateIndexes(uint64_t min_tail, std::string& error) {
+        for (int k = 0; k < (int)JobIndexKind::Count; ++k) {
+            if (rows_ - indexes_[k].rows_covered >= std::max<uint64_t>(min_tail, 1) && !UpdateIndex((JobIndexKind)k, error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Matching records in job id order
+    std::vector<JobRecord> Query(const JobQuery& q, JobQueryStats* stats = nullptr) const {
+        // Pick the index with the fewest candidates for the query's filters
+        struct Range {
+            JobIndexKind kind;
+            uint64_t lo, hi;
+        };
+        std::vector<Range> ranges;
+        auto add_range = [&](JobIndexKind kind, uint64_t key_lo, uint64_t key_hi) { // Keys in [key_lo, key_hi]
+            const Index& index = indexes_[(int)kind];
+            if (!index.file.data() || key_lo > key_hi) return;
+            ranges.push_back({ kind, index.LowerBound(key_lo), key_hi == UINT64_MAX ? index.rows_covered : index.LowerBound(key_hi + 1) });
+        };
+        if (!q.client_host.empty()) add_range(JobIndexKind::Client, HostKey(q.client_host), HostKey(q.client_host));
+        if (!q.printer_host.empty()) add_range(JobIndexKind::Printer, HostKey(q.printer_host), HostKey(q.printer_host));
+        if (q.from_unix_us > 0 || q.to_unix_us < UINT64_MAX) {
+            if (q.to_unix_us == 0) return {};
+            add_range(JobIndexKind::Time, q.from_unix_us, q.to_unix_us - 1);
+        }
+        if (q.min_bytes > 0 || q.max_bytes < UINT64_MAX) add_range(JobIndexKind::Size, q.min_bytes, q.max_bytes);
+
+        auto best = std::min_element(ranges.begin(), ranges.end(), [](const Range& a, const Range& b) {
+            return a.hi - a.lo < b.hi - b.lo;
+        });
+        std::vector<uint64_t> rows;
+        uint64_t scan_from = 0;
+        if (best != ranges.end()) {
+            const Index& index = indexes_[(int)best->kind];
+            rows.reserve((size_t)(best->hi - best->lo + rows_ - index.rows_covered));
+            for (uint64_t i = best->lo; i < best->hi; ++i) rows.push_back(index.row(i));
+            std::sort(rows.begin(), rows.end()); // Sequential access into the log, job id order
+            scan_from = index.rows_covered;
+            if (stats) stats->access_path = JobIndexName(best->kind);
+        }
+        for (uint64_t row = scan_from; row < rows_; ++row) rows.push_back(row);
+
+        // Newest first so a limit stops early, then back to job id order
+        std::vector<JobRecord> matches;
+        uint64_t candidates = 0;
+        for (auto it = rows.rbegin(); it != rows.rend() && (q.limit == 0 || matches.size() < q.limit); ++it) {
+            ++candidates;
+            JobRecord r = record(*it);
+            if (q.Matches(r)) matches.push_back(std::move(r));
+        }
+        std::reverse(matches.begin(), matches.end());
+        if (stats) stats->candidates = candidates;
+        return matches;
+    }
+
+private:
+    struct Index {
+        MappedFile file;
+        uint64_t rows_covered = 0;
+
+        uint64_t key(uint64_t i) const { return GetLE64(file.data() + JOB_INDEX_HEADER_SIZE + i * JOB_INDEX_ENTRY_SIZE); }
+        uint64_t row(uint64_t i) const { return GetLE64(file.data() + JOB_INDEX_HEADER_SIZE + i * JOB_INDEX_ENTRY_SIZE + 8); }
+        uint64_t LowerBound(uint64_t k) const {
+            uint64_t lo = 0, hi = rows_covered;
+            while (lo < hi) {
+                uint64_t mid = lo + (hi - lo) / 2;
+                if (key(mid) < k) lo = mid + 1; else hi = mid;
+            }
+            return lo;
+        }
+    };
+
+    std::filesystem::path IndexPath(JobIndexKind kind) const {
+        return dir_ / ("catalog." + std::string(JobIndexName(kind)) + ".idx");
+    }
+
+    void LoadIndex(JobIndexKind kind) {
+        Index& index = indexes_[(int)kind];
+        index.file.Close();
+        index.rows_covered = 0;
+        std::string ignored;
+        if (!index.file.Open(IndexPath(kind), ignored)) return;
+        const uint8_t* p = index.file.data();
+        size_t size = index.file.size();
+        uint64_t covered = size >= JOB_INDEX_HEADER_SIZE ? GetLE64(p + 16) : 0;
+        bool valid = size >= JOB_INDEX_HEADER_SIZE && std::memcmp(p, JOB_INDEX_MAGIC, sizeof(JOB_INDEX_MAGIC)) == 0 &&
+                     GetLE16(p + 8) == JOB_CATALOG_VERSION && GetLE16(p + 10) == (uint16_t)kind &&
+                     covered <= rows_ && size == JOB_INDEX_HEADER_SIZE + covered * JOB_INDEX_ENTRY_SIZE;
+        if (!valid) {
+            index.file.Close(); // Stale or foreign; rebuilt by the next UpdateIndexes()
+            return;
+        }
+        index.rows_covered = covered;
+    }
+
+    // Merges the sorted unindexed tail into the index and atomically replaces the file
+    bool UpdateIndex(JobIndexKind kind, std::string& error) {
+        Index& index = indexes_[(int)kind];
+        std::vector<std::pair<uint64_t, uint64_t>> tail;
+        tail.reserve((size_t)(rows_ - index.rows_covered));
+        for (uint64_t row = index.rows_covered; row < rows_; ++row) tail.emplace_back(JobIndexKey(kind, record(row)), row);
+        std::sort(tail.begin(), tail.end());
+
+        std::vector<uint8_t> out(JOB_INDEX_HEADER_SIZE + (size_t)rows_ * JOB_INDEX_ENTRY_SIZE);
+        std::memcpy(out.data(), JOB_INDEX_MAGIC, sizeof(JOB_INDEX_MAGIC));
+        PutLE16(out.data() + 8, JOB_CATALOG_VERSION);
+        PutLE16(out.data() + 10, (uint16_t)kind);
+        PutLE64(out.data() + 16, rows_);
+        uint8_t* dst = out.data() + JOB_INDEX_HEADER_SIZE;
+        auto emit = [&dst](uint64_t key, uint64_t row) {
+            PutLE64(dst, key);
+            PutLE64(dst + 8, row);
+            dst += JOB_INDEX_ENTRY_SIZE;
+        };
+        uint64_t i = 0;
+        for (const auto& entry : tail) {
+            for (; i < index.rows_covered && std::make_pair(index.key(i), index.row(i)) < entry; ++i) emit(index.key(i), index.row(i));
+            emit(entry.first, entry.second);
+        }
+        for (; i < index.rows_covered; ++i) emit(index.key(i), index.row(i));
+
+        std::filesystem::path path = IndexPath(kind);
+        std::filesystem::path tmp = path;
+        tmp += ".tmp";
+        {
+            std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(out.data()), (std::streamsize)out.size());
+            if (!file) {
+                error = "Cannot write " + tmp.string();
+                return false;
+            }
+        }
+        index.file.Close(); // Windows cannot replace a mapped file
+        index.rows_covered = 0;
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) {
+            error = "Cannot replace " + path.string() + ": " + ec.message();
+            std::filesystem::remove(tmp, ec);
+            LoadIndex(kind);
+            return false;
+        }
+        LoadIndex(kind);
+        return true;
+    }
+
+    std::filesystem::path dir_;
+    MappedFile catalog_;
+    uint64_t rows_ = 0;
+    Index indexes_[(int)JobIndexKind::Count];
+};
@@ -0,0 +1,251 @@
+#pragma once
+
+// Perceptual hashes of the job catalog's receipts, for finding near-duplicate jobs.
+//
+// catalog.hash holds one record per catalog row (job id - 1), in row order:
+//
+//   JOB_HASH_HEADER_SIZE byte header (magic, version, record size, hash grid)
+//   JOB_HASH_RECORD_SIZE byte records: the ReceiptHash (receipt_hash.h) as 4 u64, the
+//   receipt's u32 rows and u16 width, and a u8 state and u8 printer language
+//
+// Like the text index it is written by the query side only, never by the relay. An update
+// decodes and hashes the jobs appended to the catalog since the last one, on several
+// threads, JOB_HASH_BATCH_ROWS at a time, and appends their records, so a job is decoded
+// once however often the corpus is clustered; a new job is matched against the others
+// after hashing only itself. As with the catalog, a torn last record is cut off by the
+// next update, and a file of another version is rebuilt.
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+
+#include "byte_order.h"
+#include "byte_filter.h"
+#include "capture_reader.h" // CaptureFile
+#include "job_catalog.h"
+#include "receipt_decoder.h"
+#include "receipt_hash.h"
+#include "width_detect.h"
+
+const std::string JOB_HASH_FILENAME = "catalog.hash";
+constexpr char JOB_HASH_MAGIC[8] = { 'P', 'R', 'L', 'J', 'H', 'S', '\r', '\n' };
+constexpr uint16_t JOB_HASH_VERSION = 1;
+constexpr size_t JOB_HASH_HEADER_SIZE = 64;
+constexpr size_t JOB_HASH_RECORD_SIZE = 40;
+constexpr uint64_t JOB_HASH_BATCH_ROWS = 4096;  // Jobs hashed before their records are appended
+constexpr int JOB_HASH_MIN_WIDTH = 64;          // Width detection range, as in the viewer
+constexpr int JOB_HASH_MAX_WIDTH = 1200;
+constexpr int JOB_HASH_DISTANCE = 12;           // Default distance of near-duplicates, of RECEIPT_HASH_BITS
+
+enum class JobHashState : uint8_t {
+    Blank = 0,      // No capture (the printer was not reached), or nothing printed
+    Hashed = 1,
+    Unreadable = 2  // The capture is missing or its print data cannot be decoded
+};
+
+struct JobHash {
+    ReceiptHash hash;
+    uint32_t rows = 0;
+    uint16_t width = 0;
+    JobHashState state = JobHashState::Blank;
+    PrintLanguage language = PrintLanguage::EscPos;
+};
+
+inline void EncodeJobHash(const JobHash& job, uint8_t* p) {
+    for (int k = 0; k < RECEIPT_HASH_WORDS; ++k) PutLE64(p + 8 * k, job.hash.words[k]);
+    PutLE32(p + 32, job.rows);
+    PutLE16(p + 36, job.width);
+    p[38] = (uint8_t)job.state;
+    p[39] = (uint8_t)job.language;
+}
+
+inline JobHash DecodeJobHash(const uint8_t* p) {
+    JobHash job;
+    for (int k = 0; k < RECEIPT_HASH_WORDS; ++k) job.hash.words[k] = GetLE64(p + 8 * k);
+    job.rows = GetLE32(p + 32);
+    job.width = GetLE16(p + 36);
+    job.state = p[38] <= (uint8_t)JobHashState::Unreadable ? (JobHashState)p[38] : JobHashState::Unreadable;
+    job.language = (PrintLanguage)p[39];
+    return job;
+}
+
+// Hashes the receipt of a capture's client -> printer stream, at its detected width
+inline JobHash HashCapture(const std::filesystem::path& path, const BytePatternFilter& filter) {
+    JobHash job;
+    CaptureFile capture;
+    ReceiptBits bits;
+    std::string error;
+    if (!capture.Open(path, error) || !ExtractReceiptBits(capture.client_stream(), filter, bits, error)) {
+        job.state = JobHashState::Unreadable;
+        return job;
+    }
+    job.language = bits.language;
+    WidthDetection detection = DetectReceiptWidth(bits, JOB_HASH_MIN_WIDTH, JOB_HASH_MAX_WIDTH);
+    int width = detection.width > 0 ? detection.width : 576;
+    job.width = (uint16_t)std::min(width, 65535);
+    job.rows = (uint32_t)bits.rows(width);
+    job.state = ComputeReceiptHash(bits, width, true, job.hash) ? JobHashState::Hashed : JobHashState::Blank;
+    return job;
+}
+
+inline JobHash HashJob(const std::filesystem::path& dir, const JobRecord& job, const BytePatternFilter& filter) {
+    return job.capture.empty() ? JobHash() : HashCapture(dir / job.capture, filter);
+}
+
+struct JobHashUpdateStats {
+    uint64_t jobs = 0;       // Newly hashed
+    uint64_t hashed = 0;     // ... that printed anything
+    uint64_t unreadable = 0; // ... whose capture is missing or cannot be decoded
+};
+
+
+class JobHashIndex {
+public:
+    // Loads the records of the catalog's first rows; the catalog may have grown since
+    bool Open(const std::filesystem::path& dir, uint64_t catalog_rows, std::string& error) {
+        dir_ = dir;
+        jobs_.clear();
+        rebuild_ = false;
+        std::filesystem::path path = dir / JOB_HASH_FILENAME;
+        std::error_code ec;
+        if (!std::filesystem::exists(path, ec)) return true;
+        std::ifstream in(path, std::ios::binary);
+        if (!in) {
+            error = "Cannot open " + path.string();
+            return false;
+        }
+        uint8_t header[JOB_HASH_HEADER_SIZE] = {};
+        in.read(reinterpret_cast<char*>(header), sizeof(header));
+        if ((size_t)in.gcount() != sizeof(header) || std::memcmp(header, JOB_HASH_MAGIC, 8) != 0 || GetLE16(header + 8) != JOB_HASH_VERSION ||
+            GetLE16(header + 10) != JOB_HASH_RECORD_SIZE || GetLE16(header + 12) != RECEIPT_HASH_GRID) {
+            rebuild_ = true; // Hashed some other way: start over
+            return true;
+        }
+        std::vector<uint8_t> record(JOB_HASH_RECORD_SIZE);
+        while (jobs_.size() < catalog_rows && in.read(reinterpret_cast<char*>(record.data()), (std::streamsize)record.size())) {
+            jobs_.push_back(DecodeJobHash(record.data()));
+        }
+        return true;
+    }
+
+    uint64_t covered() const { return jobs_.size(); }
+    const JobHash& job(uint64_t row) const { return jobs_[(size_t)row]; }
+
+    // Rows of the jobs that have a hash, ascending
+    std::vector<uint32_t> HashedRows() const {
+        std::vector<uint32_t> rows;
+        for (size_t row = 0; row < jobs_.size(); ++row) {
+            if (jobs_[row].state == JobHashState::Hashed) rows.push_back((uint32_t)row);
+        }
+        return rows;
+    }
+
+    // Every row's hash (zero where there is none), indexed by row
+    std::vector<ReceiptHash> Hashes() const {
+        std::vector<ReceiptHash> hashes(jobs_.size());
+        for (size_t row = 0; row < jobs_.size(); ++row) hashes[row] = jobs_[row].hash;
+        return hashes;
+    }
+
+    // Hashes the catalog rows past covered() and appends their records
+    bool Update(const JobCatalog& catalog, unsigned threads, JobHashUpdateStats* stats, std::string& error) {
+        if (covered() >= catalog.rows()) return true;
+        if (catalog.rows() > UINT32_MAX) {
+            error = "The catalog has too many jobs to hash.";
+            return false;
+        }
+        std::ofstream out;
+        if (!OpenForAppend(out, error)) return false;
+        const BytePatternFilter filter(DefaultReceiptPatterns());
+        threads = std::max(1u, threads);
+        while (covered() < catalog.rows()) {
+            uint64_t first = covered(), end = std::min(catalog.rows(), first + JOB_HASH_BATCH_ROWS);
+            std::vector<JobHash> batch((size_t)(end - first));
+            std::atomic<uint64_t> next(first);
+            auto work = [&]() {
+                for (uint64_t row; (row = next.fetch_add(1)) < end;) batch[(size_t)(row - first)] = HashJob(dir_, catalog.record(row), filter);
+            };
+            std::vector<std::thread> workers;
+            for (unsigned t = 1; t < std::min<uint64_t>(threads, end - first); ++t) workers.emplace_back(work);
+            work();
+            for (std::thread& worker : workers) worker.join();
+
+            std::vector<uint8_t> encoded(batch.size() * JOB_HASH_RECORD_SIZE);
+            for (size_t i = 0; i < batch.size(); ++i) {
+                EncodeJobHash(batch[i], encoded.data() + i * JOB_HASH_RECORD_SIZE);
+                if (stats) {
+                    stats->hashed += batch[i].state == JobHashState::Hashed ? 1 : 0;
+                    stats->unreadable += batch[i].state == JobHashState::Unreadable ? 1 : 0;
+                }
+            }
+            out.write(reinterpret_cast<const char*>(encoded.data()), (std::streamsize)encoded.size());
+            out.flush();
+            if (!out) {
+                error = "Cannot append to " + (dir_ / JOB_HASH_FILENAME).string();
+                return false;
+            }
+            jobs_.insert(jobs_.end(), batch.begin(), batch.end());
+            if (stats) stats->jobs += batch.size();
+        }
+        return true;
+    }
+
+private:
+    // Opens catalog.hash for appending after covered() records, writing a new file when
+    // there is none (or one to rebuild) and dropping records past them
+    bool OpenForAppend(std::ofstream& out, std::string& error) {
+        std::filesystem::path path = dir_ / JOB_HASH_FILENAME;
+        std::error_code ec;
+        bool exists = std::filesystem::exists(path, ec);
+        if (!exists || rebuild_) {
+            std::filesystem::path tmp = path;
+            tmp += ".tmp";
+            uint8_t header[JOB_HASH_HEADER_SIZE] = {};
+            std::memcpy(header, JOB_HASH_MAGIC, 8);
+            PutLE16(header + 8, JOB_HASH_VERSION);
+            PutLE16(header + 10, (uint16_t)JOB_HASH_RECORD_SIZE);
+            PutLE16(header + 12, (uint16_t)RECEIPT_HASH_GRID);
+            {
+                std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+                file.write(reinterpret_cast<const char*>(header), sizeof(header));
+                if (!file) {
+                    error = "Cannot write " + tmp.string();
+                    return false;
+                }
+            }
+            std::filesystem::rename(tmp, path, ec);
+            if (ec) {
+                error = "Cannot replace " + path.string() + ": " + ec.message();
+                std::filesystem::remove(tmp, ec);
+                return false;
+            }
+            jobs_.clear();
+            rebuild_ = false;
+        } else {
+            uint64_t size = JOB_HASH_HEADER_SIZE + covered() * JOB_HASH_RECORD_SIZE;
+            if (std::filesystem::file_size(path, ec) != size && !ec) std::filesystem::resize_file(path, size, ec);
+            if (ec) {
+                error = "Cannot resize " + path.string() + ": " + ec.message();
+                return false;
+            }
+        }
+        out.open(path, std::ios::binary | std::ios::app);
+        if (!out.is_open()) {
+            error = "Cannot open " + path.string() + " for appending.";
+            return false;
+        }
+        return true;
+    }
+
+    std::filesystem::path dir_;
+    std::vector<JobHash> jobs_;
+    bool rebuild_ = false;
+};
@@ -0,0 +1,639 @@
+#pragma once
+
+// Full-text index over the job catalog: which jobs printed a given word.
+//
+// Each job's capture is run through ReceiptTextExtractor and split into terms
+// (receipt_text.h); the index maps every term to the catalog rows (job id - 1) whose
+// receipts contain it. It lives next to the catalog as segments, each covering a
+// contiguous range of rows, named catalog.text.<first row>-<end row>.idx:
+//
+//   JOB_TEXT_HEADER_SIZE byte header (magic, version, rows, term count, section offsets)
+//   postings    per term, its rows as varint gaps in blocks of JOB_TEXT_BLOCK_ROWS, after
+//               a table of each block's first row and offset when there is more than one
+//   dictionary  term count + 1 entries: postings offset, job count, string offset
+//   strings     the terms in byte order, concatenated
+//
+// Like the catalog indexes, segments are written by the query side only, never by the
+// relay. An update extracts the jobs appended since the last one, on several threads,
+// into a new segment, then merges the newest segments whenever JOB_TEXT_MERGE_FACTOR of
+// them are of a similar size, so the number of segments grows with the logarithm of the
+// catalog and each job is rewritten only a few times. Files are replaced by rename; readers
+// take the largest segments that cover the rows from 0 without a gap and ignore what a
+// merge left behind. Jobs past the index are extracted and matched by the query itself.
+//
+// Queries intersect the postings of all terms, rarest first. Long lists are probed through
+// their block table instead of being decoded, so a term found in one job among millions
+// costs a few block reads, however common the other terms are.
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <iterator>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <filesystem>
+#include <system_error>
+
+#include "byte_order.h"
+#include "capture_format.h" // PutVarint, GetVarint
+#include "capture_reader.h" // MappedFile, CaptureFile
+#include "job_catalog.h"
+#include "receipt_text.h"
+
+const std::string JOB_TEXT_PREFIX = "catalog.text.";
+constexpr char JOB_TEXT_MAGIC[8] = { 'P', 'R', 'L', 'J', 'T', 'X', '\r', '\n' };
+constexpr uint16_t JOB_TEXT_VERSION = 2;        // 2: text of other printer languages
+constexpr size_t JOB_TEXT_HEADER_SIZE = 64;
+constexpr size_t JOB_TEXT_ENTRY_SIZE = 16;       // u64 postings offset, u32 jobs, u32 string offset
+constexpr uint32_t JOB_TEXT_BLOCK_ROWS = 128;    // Rows per postings block
+constexpr uint64_t JOB_TEXT_BATCH_ROWS = 16384;  // Jobs extracted into one new segment
+constexpr size_t JOB_TEXT_MERGE_FACTOR = 8;
+constexpr uint64_t JOB_TEXT_PROBE_RATIO = 8;     // Probe a list this many times longer than the candidates
+
+struct JobTextTerm {
+    std::string term;
+    bool prefix = false; // Matches every term that starts with it
+};
+
+// Terms of a search string, all of which a job must contain. Words are split like receipt
+// text, keeping compounds whole ("12.50" matches the price, not a 12 and a 50 elsewhere); a
+// trailing * makes the word's last term a prefix.
+inline std::vector<JobTextTerm> ParseJobTextQuery(const std::string& text) {
+    std::vector<JobTextTerm> terms;
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t end = text.find_first_of(" \t", i);
+        if (end == std::string::npos) end = text.size();
+        std::string word = text.substr(i, end - i);
+        i = end + 1;
+        bool prefix = !word.empty() && word.back() == '*';
+        if (prefix) word.pop_back();
+        size_t before = terms.size();
+        ForEachReceiptTerm(word, false, [&terms](const std::string& term) { terms.push_back({ term, false }); });
+        if (prefix && terms.size() > before) terms.back().prefix = true;
+    }
+    return terms;
+}
+
+inline bool JobTextTermMatches(const JobTextTerm& query, std::string_view term) {
+    return query.prefix ? term.size() >= query.term.size() && term.compare(0, query.term.size(), query.term) == 0
+                        : term == query.term;
+}
+
+// Distinct sorted terms of a job's capture; false if the capture cannot be read
+inline bool ReadJobTerms(const std::filesystem::path& dir, const JobRecord& job, std::vector<std::string>& terms) {
+    terms.clear();
+    if (job.capture.empty()) return true; // The printer was not reached
+    CaptureFile capture;
+    std::string error;
+    if (!capture.Open(dir / job.capture, error)) return false;
+    terms = ReceiptTerms(ExtractReceiptText(capture.client_stream()));
+    return true;
+}
+
+struct JobTextSearchStats {
+    size_t segments = 0;
+    uint64_t postings = 0;  // Rows decoded from postings lists
+    uint64_t probes = 0;    // Blocks decoded to probe long lists
+    uint64_t unindexed = 0; // Jobs past the index, extracted and matched directly
+};
+
+struct JobTextUpdateStats {
+    uint64_t jobs = 0;       // Newly indexed
+    uint64_t with_text = 0;  // ... that printed any text
+    uint64_t unreadable = 0; // ... whose capture is missing or unreadable
+    uint64_t postings = 0;   // Distinct terms summed over the jobs
+    size_t merges = 0;
+};
+
+
+// Writes one segment: terms are added in byte order, the dictionary follows the postings
+class JobTextSegmentWriter {
+public:
+    bool Open(const std::filesystem::path& path, uint64_t first_row, std::string& error) {
+        path_ = path;
+        first_row_ = first_row;
+        file_.open(path, std::ios::binary | std::ios::trunc);
+        if (!file_.is_open()) {
+            error = "Cannot create " + path.string();
+            return false;
+        }
+        uint8_t header[JOB_TEXT_HEADER_SIZE] = {};
+        file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+        offset_ = JOB_TEXT_HEADER_SIZE;
+        entries_.clear();
+        strings_.clear();
+        return true;
+    }
+
+    // rows: relative to the first row, ascending and distinct
+    void Add(std::string_view term, const std::vector<uint32_t>& rows) {
+        AddEntry(offset_, (uint32_t)rows.size());
+        strings_.append(term.data(), term.size());
+
+        size_t blocks = (rows.size() + JOB_TEXT_BLOCK_ROWS - 1) / JOB_TEXT_BLOCK_ROWS;
+        size_t table = blocks > 1 ? blocks * 8 : 0;
+        postings_.assign(table, 0);
+        for (size_t b = 0; b < blocks; ++b) {
+            size_t begin = b * JOB_TEXT_BLOCK_ROWS, end = std::min(rows.size(), begin + JOB_TEXT_BLOCK_ROWS);
+            if (table > 0) {
+                PutLE32(postings_.data() + b * 8, rows[begin]);
+                PutLE32(postings_.data() + b * 8 + 4, (uint32_t)(postings_.size() - table));
+            }
+            uint8_t varint[10];
+            postings_.insert(postings_.end(), varint, varint + PutVarint(varint, rows[begin]));
+            for (size_t i = begin + 1; i < end; ++i) {
+                postings_.insert(postings_.end(), varint, varint + PutVarint(varint, rows[i] - rows[i - 1]));
+            }
+        }
+        file_.write(reinterpret_cast<const char*>(postings_.data()), (std::streamsize)postings_.size());
+        offset_ += postings_.size();
+    }
+
+    bool Close(uint64_t end_row, std::string& error) {
+        uint64_t terms = entries_.size() / JOB_TEXT_ENTRY_SIZE;
+        AddEntry(offset_, 0); // Sentinel: ends the last term's postings and string
+        uint64_t dictionary = offset_;
+        uint64_t strings = dictionary + entries_.size();
+        file_.write(reinterpret_cast<const char*>(entries_.data()), (std::streamsize)entries_.size());
+        file_.write(strings_.data(), (std::streamsize)strings_.size());
+
+        uint8_t header[JOB_TEXT_HEADER_SIZE] = {};
+        std::memcpy(header, JOB_TEXT_MAGIC, sizeof(JOB_TEXT_MAGIC));
+        PutLE16(header + 8, JOB_TEXT_VERSION);
+        PutLE16(header + 10, (uint16_t)JOB_TEXT_BLOCK_ROWS);
+        PutLE32(header + 12, (uint32_t)terms);
+        PutLE64(header + 16, first_row_);
+        PutLE64(header + 24, end_row);
+        PutLE64(header + 32, dictionary);
+        PutLE64(header + 40, strings);
+        PutLE64(header + 48, strings + strings_.size());
+        file_.seekp(0);
+        file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file_.close();
+        if (!file_) {
+            error = "Cannot write " + path_.string();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    void AddEntry(uint64_t postings, uint32_t jobs) {
+        size_t at = entries_.size();
+        entries_.resize(at + JOB_TEXT_ENTRY_SIZE);
+        PutLE64(entries_.data() + at, postings);
+        PutLE32(entries_.data() + at + 8, jobs);
+        PutLE32(entries_.data() + at + 12, (uint32_t)strings_.size());
+    }
+
+    std::filesystem::path path_;
+    std::ofstream file_;
+    uint64_t first_row_ = 0;
+    uint64_t offset_ = 0;
+    std::vector<uint8_t> entries_;
+    std::string strings_;
+    std::vector<uint8_t> postings_;
+};
+
+// Collects the terms of consecutive jobs in memory for one new segment
+class JobTextSegmentBuilder {
+public:
+    explicit JobTextSegmentBuilder(uint64_t first_row) : first_row_(first_row) {}
+
+    // Rows ascending; terms distinct
+    void Add(uint64_t row, const std::vector<std::string>& terms) {
+        for (const std::string& term : terms) postings_[term].push_back((uint32_t)(row - first_row_));
+    }
+
+    uint64_t first_row() const { return first_row_; }
+
+    bool Write(const std::filesystem::path& path, uint64_t end_row, std::string& error) const {
+        std::vector<const std::pair<const std::string, std::vector<uint32_t>>*> sorted;
+        sorted.reserve(postings_.size());
+        for (const auto& entry : postings_) sorted.push_back(&entry);
+        std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+        JobTextSegmentWriter writer;
+        if (!writer.Open(path, first_row_, error)) return false;
+        for (const auto* entry : sorted) writer.Add(entry->first, entry->second);
+        return writer.Close(end_row, error);
+    }
+
+private:
+    uint64_t first_row_;
+    std::unordered_map<std::string, std::vector<uint32_t>> postings_;
+};
+
+// A mapped segment
+class JobTextSegment {
+public:
+    bool Open(const std::filesystem::path& path, std::string& error) {
+        path_ = path;
+        if (!file_.Open(path, error)) return false;
+        const uint8_t* p = file_.data();
+        size_t size = file_.size();
+        bool valid = size >= JOB_TEXT_HEADER_SIZE && std::memcmp(p, JOB_TEXT_MAGIC, sizeof(JOB_TEXT_MAGIC)) == 0 &&
+                     GetLE16(p + 8) == JOB_TEXT_VERSION && GetLE16(p + 10) == JOB_TEXT_BLOCK_ROWS;
+        if (valid) {
+            terms_ = GetLE32(p + 12);
+            first_row_ = GetLE64(p + 16);
+            end_row_ = GetLE64(p + 24);
+            uint64_t dictionary = GetLE64(p + 32), strings = GetLE64(p + 40);
+            valid = GetLE64(p + 48) == size && first_row_ <= end_row_ && end_row_ - first_row_ <= UINT32_MAX &&
+                    dictionary >= JOB_TEXT_HEADER_SIZE && strings == dictionary + ((uint64_t)terms_ + 1) * JOB_TEXT_ENTRY_SIZE &&
+                    strings <= size;
+            entries_ = p + dictionary;
+            strings_ = p + strings;
+            valid = valid && postings_offset(terms_) == dictionary && strings + string_offset(terms_) == size;
+        }
+        if (!valid) {
+            file_.Close();
+            error = "Not a text index segment of this version.";
+            return false;
+        }
+        return true;
+    }
+
+    void Close() { file_.Close(); }
+
+    const std::filesystem::path& path() const { return path_; }
+    uint64_t first_row() const { return first_row_; }
+    uint64_t end_row() const { return end_row_; }
+    uint32_t terms() const { return terms_; }
+    uint64_t bytes() const { return file_.size(); }
+
+    std::string_view term(uint32_t i) const {
+        return std::string_view(reinterpret_cast<const char*>(strings_) + string_offset(i), string_offset(i + 1) - string_offset(i));
+    }
+    uint32_t jobs(uint32_t i) const { return GetLE32(entries_ + (size_t)i * JOB_TEXT_ENTRY_SIZE + 8); }
+
+    // First term not less than t
+    uint32_t LowerBound(std::string_view t) const {
+        uint32_t lo = 0, hi = terms_;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (term(mid) < t) lo = mid + 1; else hi = mid;
+        }
+        return lo;
+    }
+
+    // Appends the rows of term i, relative to first_row()
+    void Decode(uint32_t i, std::vector<uint32_t>& rows) const {
+        uint32_t count = jobs(i);
+        size_t blocks = (count + JOB_TEXT_BLOCK_ROWS - 1) / JOB_TEXT_BLOCK_ROWS;
+        const uint8_t* p = file_.data() + postings_offset(i) + (blocks > 1 ? blocks * 8 : 0);
+        const uint8_t* end = file_.data() + postings_offset(i + 1);
+        for (size_t b = 0; b < blocks; ++b) DecodeBlock(p, end, std::min<uint32_t>(JOB_TEXT_BLOCK_ROWS, count - (uint32_t)b * JOB_TEXT_BLOCK_ROWS), rows);
+    }
+
+    // Membership tests against one term's rows for ascending rows, decoding only the
+    // blocks they fall into
+    class Probe {
+    public:
+        Probe(const JobTextSegment& segment, uint32_t i) : segment_(segment) {
+            count_ = segment.jobs(i);
+            blocks_ = (count_ + JOB_TEXT_BLOCK_ROWS - 1) / JOB_TEXT_BLOCK_ROWS;
+            table_ = segment.file_.data() + segment.postings_offset(i);
+            data_ = table_ + (blocks_ > 1 ? blocks_ * 8 : 0);
+            end_ = segment.file_.data() + segment.postings_offset(i + 1);
+        }
+
+        bool Contains(uint32_t row) {
+            if (blocks_ == 0) return false;
+            size_t lo = 0, hi = blocks_; // Last block whose first row is <= row
+            while (hi - lo > 1) {
+                size_t mid = (lo + hi) / 2;
+                if (GetLE32(table_ + mid * 8) <= row) lo = mid; else hi = mid;
+            }
+            if (lo != block_) {
+                block_ = lo;
+                rows_.clear();
+                const uint8_t* p = blocks_ > 1 ? data_ + GetLE32(table_ + lo * 8 + 4) : data_;
+                segment_.DecodeBlock(p, end_, std::min<uint32_t>(JOB_TEXT_BLOCK_ROWS, count_ - (uint32_t)lo * JOB_TEXT_BLOCK_ROWS), rows_);
+                ++decoded_;
+            }
+            return std::binary_search(rows_.begin(), rows_.end(), row);
+        }
+
+        uint64_t decoded() const { return decoded_; }
+
+    private:
+        const JobTextSegment& segment_;
+        uint32_t count_ = 0;
+        size_t blocks_ = 0;
+        const uint8_t* table_ = nullptr;
+        const uint8_t* data_ = nullptr;
+        const uint8_t* end_ = nullptr;
+        size_t block_ = SIZE_MAX;
+        std::vector<uint32_t> rows_;
+        uint64_t decoded_ = 0;
+    };
+
+private:
+    uint64_t postings_offset(uint32_t i) const { return GetLE64(entries_ + (size_t)i * JOB_TEXT_ENTRY_SIZE); }
+    uint32_t string_offset(uint32_t i) const { return GetLE32(entries_ + (size_t)i * JOB_TEXT_ENTRY_SIZE + 12); }
+
+    // A damaged block ends early rather than reading past the term's postings
+    void DecodeBlock(const uint8_t*& p, const uint8_t* end, uint32_t count, std::vector<uint32_t>& rows) const {
+        uint64_t row = 0;
+        for (uint32_t k = 0; k < count; ++k) {
+            uint64_t value = 0;
+            size_t used = GetVarint(p, (size_t)(end - p), value);
+            if (used == 0) return;
+            p += used;
+            row = k == 0 ? value : row + value;
+            rows.push_back((uint32_t)row);
+        }
+    }
+
+    std::filesystem::path path_;
+    MappedFile file_;
+    uint32_t terms_ = 0;
+    uint64_t first_row_ = 0;
+    uint64_t end_row_ = 0;
+    const uint8_t* entries_ = nullptr;
+    const uint8_t* strings_ = nullptr;
+};
+
+
+class JobTextIndex {
+public:
+    // Loads the segments that cover the catalog's first rows; the catalog may have grown since
+    bool Open(const std::filesystem::path& dir, uint64_t catalog_rows, std::string& error) {
+        dir_ = dir;
+        segments_.clear();
+        superseded_.clear();
+        std::vector<std::unique_ptr<JobTextSegment>> found;
+        std::error_code ec;
+        for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            std::string name = it->path().filename().string();
+            unsigned long long first = 0, last = 0;
+            char tail = 0;
+            if (name.compare(0, JOB_TEXT_PREFIX.size(), JOB_TEXT_PREFIX) != 0 ||
+                std::sscanf(name.c_str() + JOB_TEXT_PREFIX.size(), "%llu-%llu.id%c", &first, &last, &tail) != 3 || tail != 'x' ||
+                name != SegmentPath(first, last).filename().string()) {
+                continue;
+            }
+            auto segment = std::make_unique<JobTextSegment>();
+            std::string ignored;
+            if (!segment->Open(it->path(), ignored) || segment->first_row() != first || segment->end_row() != last) continue;
+            found.push_back(std::move(segment));
+        }
+        if (ec) {
+            error = "Cannot list " + dir.string() + ": " + ec.message();
+            return false;
+        }
+        // Widest first, so a merged segment wins over the inputs it replaced
+        std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+            return a->first_row() != b->first_row() ? a->first_row() < b->first_row() : a->end_row() > b->end_row();
+        });
+        uint64_t next = 0;
+        for (auto& segment : found) {
+            if (segment->first_row() == next && segment->end_row() > next && segment->end_row() <= catalog_rows) {
+                next = segment->end_row();
+                segments_.push_back(std::move(segment));
+            } else if (segment->end_row() <= next) {
+                superseded_.push_back(segment->path());
+            }
+        }
+        return true;
+    }
+
+    uint64_t covered() const { return segments_.empty() ? 0 : segments_.back()->end_row(); }
+    size_t segments() const { return segments_.size(); }
+
+    uint64_t terms() const {
+        uint64_t total = 0;
+        for (const auto& segment : segments_) total += segment->terms();
+        return total;
+    }
+
+    uint64_t bytes() const {
+        uint64_t total = 0;
+        for (const auto& segment : segments_) total += segment->bytes();
+        return total;
+    }
+
+    // Indexes the catalog rows past covered(), JOB_TEXT_BATCH_ROWS jobs per new segment
+    bool Update(const JobCatalog& catalog, unsigned threads, JobTextUpdateStats* stats, std::string& error) {
+        for (const auto& path : superseded_) {
+            std::error_code ec;
+            std::filesystem::remove(path, ec); // Still mapped by another reader on Windows: next time
+        }
+        superseded_.clear();
+        threads = std::max(1u, threads);
+        while (covered() < catalog.rows()) {
+            uint64_t first = covered(), end = std::min(catalog.rows(), first + JOB_TEXT_BATCH_ROWS);
+            std::vector<std::vector<std::string>> terms((size_t)(end - first));
+            std::atomic<uint64_t> next(first), unreadable(0);
+            auto work = [&]() {
+                for (uint64_t row; (row = next.fetch_add(1)) < end;) {
+                    if (!ReadJobTerms(dir_, catalog.record(row), terms[(size_t)(row - first)])) unreadable++;
+                }
+            };
+            std::vector<std::thread> workers;
+            for (unsigned t = 1; t < std::min<uint64_t>(threads, end - first); ++t) workers.emplace_back(work);
+            work();
+            for (std::thread& worker : workers) worker.join();
+
+            JobTextSegmentBuilder builder(first);
+            for (uint64_t row = first; row < end; ++row) {
+                const std::vector<std::string>& job_terms = terms[(size_t)(row - first)];
+                builder.Add(row, job_terms);
+                if (stats) {
+                    stats->with_text += job_terms.empty() ? 0 : 1;
+                    stats->postings += job_terms.size();
+                }
+            }
+            terms.clear();
+            if (!AddSegment(builder, end, stats, error)) return false;
+            if (stats) {
+                stats->jobs += end - first;
+                stats->unreadable += unreadable;
+            }
+        }
+        return true;
+    }
+
+    // Writes the builder's jobs as the segment for rows [covered(), end_row), then merges
+    bool AddSegment(const JobTextSegmentBuilder& builder, uint64_t end_row, JobTextUpdateStats* stats, std::string& error) {
+        if (builder.first_row() != covered() || end_row <= covered()) {
+            error = "Text index segment does not continue the index.";
+            return false;
+        }
+        std::filesystem::path path = SegmentPath(builder.first_row(), end_row);
+        std::filesystem::path tmp = path;
+        tmp += ".tmp";
+        if (!builder.Write(tmp, end_row, error) || !Install(tmp, path, error)) return false;
+        while (segments_.size() >= JOB_TEXT_MERGE_FACTOR) {
+            size_t tier = Tier(segments_.back()->end_row() - segments_.back()->first_row());
+            size_t count = 0;
+            while (count < segments_.size() && Tier(segments_[segments_.size() - 1 - count]->end_row() - segments_[segments_.size() - 1 - count]->first_row()) <= tier) {
+                ++count;
+            }
+            if (count < JOB_TEXT_MERGE_FACTOR) break;
+            if (!MergeLast(count, error)) return false;
+            if (stats) stats->merges++;
+        }
+        return true;
+    }
+
+    // Rows (job id - 1) whose text contains every term, ascending. With a catalog, jobs it
+    // has past the index are extracted and matched too.
+    std::vector<uint64_t> Search(const std::vector<JobTextTerm>& query, const JobCatalog* catalog = nullptr,
+                                 JobTextSearchStats* stats = nullptr) const {
+        std::vector<uint64_t> matches;
+        if (query.empty()) return matches;
+        for (const auto& segment : segments_) {
+            if (stats) stats->segments++;
+            SearchSegment(*segment, query, matches, stats);
+        }
+        if (catalog) {
+            std::vector<std::string> terms;
+            for (uint64_t row = covered(); row < catalog->rows(); ++row) {
+                if (stats) stats->unindexed++;
+                if (!ReadJobTerms(dir_, catalog->record(row), terms)) continue;
+                bool all = std::all_of(query.begin(), query.end(), [&terms](const JobTextTerm& q) {
+                    auto it = std::lower_bound(terms.begin(), terms.end(), q.term);
+                    return it != terms.end() && JobTextTermMatches(q, *it);
+                });
+                if (all) matches.push_back(row);
+            }
+        }
+        return matches;
+    }
+
+private:
+    std::filesystem::path SegmentPath(uint64_t first, uint64_t end) const {
+        return dir_ / (JOB_TEXT_PREFIX + std::to_string(first) + "-" + std::to_string(end) + ".idx");
+    }
+
+    static size_t Tier(uint64_t rows) {
+        size_t tier = 0;
+        for (; rows >= JOB_TEXT_MERGE_FACTOR; rows /= JOB_TEXT_MERGE_FACTOR) ++tier;
+        return tier;
+    }
+
+    // Renames a written segment into place and appends it
+    bool Install(const std::filesystem::path& tmp, const std::filesystem::path& path, std::string& error) {
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec) {
+            error = "Cannot replace " + path.string() + ": " + ec.message();
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+        auto segment = std::make_unique<JobTextSegment>();
+        if (!segment->Open(path, error)) return false;
+        segments_.push_back(std::move(segment));
+        return true;
+    }
+
+    // Merges the last count segments into one; their rows are consecutive, so each term's
+    // postings are the inputs' postings one after the other
+    bool MergeLast(size_t count, std::string& error) {
+        size_t from = segments_.size() - count;
+        uint64_t first = segments_[from]->first_row(), end = segments_.back()->end_row();
+        std::filesystem::path path = SegmentPath(first, end);
+        std::filesystem::path tmp = path;
+        tmp += ".tmp";
+        JobTextSegmentWriter writer;
+        if (!writer.Open(tmp, first, error)) return false;
+        std::vector<uint32_t> cursor(count, 0);
+        std::vector<uint32_t> rows;
+        for (;;) {
+            std::string_view least;
+            bool any = false;
+            for (size_t k = 0; k < count; ++k) {
+                const JobTextSegment& segment = *segments_[from + k];
+                if (cursor[k] < segment.terms() && (!any || segment.term(cursor[k]) < least)) {
+                    least = segment.term(cursor[k]);
+                    any = true;
+                }
+            }
+            if (!any) break;
+            rows.clear();
+            for (size_t k = 0; k < count; ++k) {
+                const JobTextSegment& segment = *segments_[from + k];
+                if (cursor[k] >= segment.terms() || segment.term(cursor[k]) != least) continue;
+                size_t before = rows.size();
+                segment.Decode(cursor[k], rows);
+                uint32_t offset = (uint32_t)(segment.first_row() - first);
+                for (size_t i = before; i < rows.size(); ++i) rows[i] += offset;
+                ++cursor[k];
+            }
+            writer.Add(least, rows);
+        }
+        if (!writer.Close(end, error)) return false;
+
+        std::vector<std::filesystem::path> inputs;
+        for (size_t k = from; k < segments_.size(); ++k) {
+            inputs.push_back(segments_[k]->path());
+            segments_[k]->Close(); // Windows cannot remove a mapped file
+        }
+        segments_.resize(from);
+        if (!Install(tmp, path, error)) return false;
+        for (const auto& input : inputs) {
+            std::error_code ec;
+            std::filesystem::remove(input, ec);
+        }
+        return true;
+    }
+
+    void SearchSegment(const JobTextSegment& segment, const std::vector<JobTextTerm>& query, std::vector<uint64_t>& matches,
+                       JobTextSearchStats* stats) const {
+        struct Match {
+            std::vector<uint32_t> entries; // Dictionary entries of the term (several for a prefix)
+            uint64_t jobs = 0;
+        };
+        std::vector<Match> terms(query.size());
+        for (size_t q = 0; q < query.size(); ++q) {
+            for (uint32_t i = segment.LowerBound(query[q].term); i < segment.terms() && JobTextTermMatches(query[q], segment.term(i)); ++i) {
+                terms[q].entries.push_back(i);
+                terms[q].jobs += segment.jobs(i);
+                if (!query[q].prefix) break;
+            }
+            if (terms[q].entries.empty()) return;
+        }
+        std::sort(terms.begin(), terms.end(), [](const Match& a, const Match& b) { return a.jobs < b.jobs; });
+
+        auto decode = [&](const Match& match, std::vector<uint32_t>& rows) {
+            rows.clear();
+            for (uint32_t i : match.entries) segment.Decode(i, rows);
+            if (match.entries.size() > 1) {
+                std::sort(rows.begin(), rows.end());
+                rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+            }
+            if (stats) stats->postings += rows.size();
+        };
+        std::vector<uint32_t> candidates, rows, kept;
+        decode(terms[0], candidates);
+        for (size_t q = 1; q < terms.size() && !candidates.empty(); ++q) {
+            kept.clear();
+            if (terms[q].entries.size() == 1 && terms[q].jobs > candidates.size() * JOB_TEXT_PROBE_RATIO) {
+                JobTextSegment::Probe probe(segment, terms[q].entries[0]);
+                for (uint32_t row : candidates) {
+                    if (probe.Contains(row)) kept.push_back(row);
+                }
+                if (stats) stats->probes += probe.decoded();
+            } else {
+                decode(terms[q], rows);
+                std::set_intersection(candidates.begin(), candidates.end(), rows.begin(), rows.end(), std::back_inserter(kept));
+            }
+            candidates.swap(kept);
+        }
+        for (uint32_t row : candidates) matches.push_back(segment.first_row() + row);
+    }
+
+    std::filesystem::path dir_;
+    std::vector<std::unique_ptr<JobTextSegment>> segments_;
+    std::vector<std::filesystem::path> superseded_;
+};
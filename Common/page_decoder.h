@@ -0,0 +1,272 @@
+#pragma once
+
+// Shared ground of the decoders for printer languages other than ESC/POS (label printers'
+// ZPL and EPL, office printers' PCL, Star's raster mode): each turns a client -> printer
+// stream, fed in pieces of any size, into the row surface ESC/POS decoding produces, rows
+// of width() dots, 8 per byte, MSB = leftmost dot, 1 = black, so labels and pages go
+// through the same tiles, zoom levels, thumbnails and image writers as receipts.
+//
+// A decoder draws each label or page on a PageCanvas at the coordinates the language
+// gives and stacks the finished ones on its page with a dashed line between them, like a
+// cut in the emulator; cuts() has the byte offset past each line, so labels are stepped
+// through like receipts. What the labels print as text (field data, barcode contents) is
+// kept as UTF-8 lines for the text index; set_text_only() skips the drawing for that.
+//
+// Snapshot() shows the page as if the stream ended here: it finishes a copy of the
+// decoder, so a stream that is still growing decodes exactly as the whole file would.
+// The copy leaves out the finished labels and the text, which Finish() cannot change, so
+// a snapshot costs the open label and one copy of the page, not two.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "receipt_font.h"
+#include "escpos_emulator.h" // EscPosBarcode
+#include "qr_code.h"
+
+constexpr int PAGE_CANVAS_MAX_WIDTH = 8192;     // Dots; wider pages are clipped
+constexpr int PAGE_CANVAS_MAX_ROWS = 1 << 16;   // Per label or page; coordinates past it are clipped
+constexpr size_t PAGE_TEXT_MAX_BYTES = 1 << 20; // Text kept per stream, as for ESC/POS
+
+// Rounded up to whole bytes and clamped, as page widths are
+inline int PageWidth(int64_t dots) {
+    return (int)std::clamp<int64_t>((dots + 7) / 8 * 8, 8, PAGE_CANVAS_MAX_WIDTH);
+}
+
+// One label or page at its own coordinates; rows are added as drawing reaches them
+class PageCanvas {
+public:
+    // A width of 0 makes a canvas that draws nothing (text-only decoding)
+    void Reset(int width, int height = 0) {
+        width_ = width > 0 ? PageWidth(width) : 0;
+        row_bytes_ = (size_t)width_ / 8;
+        bits_.clear();
+        if (width_ > 0 && height > 0) Grow(std::min(height, PAGE_CANVAS_MAX_ROWS));
+    }
+
+    int width() const { return width_; }
+    int rows() const { return row_bytes_ ? (int)(bits_.size() / row_bytes_) : 0; }
+    size_t row_bytes() const { return row_bytes_; }
+    const std::vector<uint8_t>& bits() const { return bits_; }
+
+    void FillRect(int x, int y, int w, int h) {
+        int x0 = std::max(x, 0), x1 = (int)std::clamp<int64_t>((int64_t)x + w, 0, width_);
+        int y0 = std::max(y, 0), y1 = (int)std::clamp<int64_t>((int64_t)y + h, 0, PAGE_CANVAS_MAX_ROWS);
+        if (x0 >= x1 || y0 >= y1) return;
+        Grow(y1);
+        for (int r = y0; r < y1; ++r) FillDots(bits_.data() + (size_t)r * row_bytes_, (size_t)x0, (size_t)x1);
+    }
+
+    // Dots [x0, x1) of a row set
+    static void FillDots(uint8_t* row, size_t x0, size_t x1) {
+        size_t first = x0 / 8, last = (x1 - 1) / 8; // Bytes touched; the end ones in part
+        uint8_t head = (uint8_t)(0xFF >> (x0 % 8)), tail = (uint8_t)(0xFF << (7 - (x1 - 1) % 8));
+        if (first == last) {
+            row[first] |= head & tail;
+            return;
+        }
+        row[first] |= head;
+        for (size_t b = first + 1; b < last; ++b) row[b] = 0xFF; // Mostly a few bytes: bars, modules, box edges
+        row[last] |= tail;
+    }
+
+    // Dots [0, count) of src (MSB = first dot) ORed into row y from dot x on
+    void OrRow(int x, int y, const uint8_t* src, int count) {
+        if (y < 0 || y >= PAGE_CANVAS_MAX_ROWS || count <= 0 || width_ == 0) return;
+        if (x < 0) { // Clipped on the left, rare enough to go dot by dot
+            for (int d = -x; d < count && x + d < width_; ++d) {
+                if ((src[d / 8] >> (7 - d % 8)) & 1) SetDot(x + d, y);
+            }
+            return;
+        }
+        count = std::min(count, width_ - x);
+        if (count <= 0) return;
+        Grow(y + 1);
+        OrDots(bits_.data() + (size_t)y * row_bytes_, (size_t)x, src, (size_t)count);
+    }
+
+    // Pads or crops to rows, for labels of a set length
+    void SetRows(int rows) {
+        if (width_ > 0) bits_.resize((size_t)std::clamp(rows, 0, PAGE_CANVAS_MAX_ROWS) * row_bytes_, 0);
+    }
+
+    void SetDot(int x, int y) {
+        if (x < 0 || x >= width_ || y < 0 || y >= PAGE_CANVAS_MAX_ROWS) return;
+        Grow(y + 1);
+        bits_[(size_t)y * row_bytes_ + (size_t)x / 8] |= (uint8_t)(0x80 >> (x % 8));
+    }
+
+    // Text with its top left at (x, y); returns its width
+    int DrawText(int x, int y, std::string_view text, const GlyphSet& glyphs) {
+        int pen = x;
+        for (char c : text) {
+            if (width_ > 0 && pen < width_) {
+                const uint8_t* glyph = glyphs.glyph((uint8_t)c);
+                for (int r = 0; r < glyphs.rows(); ++r) OrRow(pen, y + r, glyph + (size_t)r * glyphs.row_bytes(), glyphs.width());
+            }
+            pen += glyphs.width();
+        }
+        return pen - x;
+    }
+
+    // Bars of height rows with their top left at (x, y); returns the width
+    int DrawBarcode(int x, int y, const EscPosBarcode& barcode, int height) {
+        int position = x;
+        for (size_t i = 0; i < barcode.runs.size(); ++i) {
+            if (i % 2 == 0) FillRect(position, y, barcode.runs[i], height);
+            position += barcode.runs[i];
+        }
+        return position - x;
+    }
+
+    // Each row of modules is laid out once and ORed in module times
+    void DrawQrCode(int x, int y, const QrCode& code, int module) {
+        int dots = code.size() * module;
+        std::vector<uint8_t> row(((size_t)dots + 7) / 8);
+        for (int my = 0; my < code.size(); ++my) {
+            std::fill(row.begin(), row.end(), 0);
+            for (int mx = 0; mx < code.size();) {
+                if (!code.module(mx, my)) {
+                    ++mx;
+                    continue;
+                }
+                int run = 1;
+                while (mx + run < code.size() && code.module(mx + run, my)) ++run;
+                FillDots(row.data(), (size_t)mx * module, (size_t)(mx + run) * module);
+                mx += run;
+            }
+            for (int k = 0; k < module; ++k) OrRow(x, y + my * module + k, row.data(), dots);
+        }
+    }
+
+private:
+    void Grow(int rows) {
+        if (width_ > 0 && (size_t)rows * row_bytes_ > bits_.size()) bits_.resize((size_t)rows * row_bytes_, 0);
+    }
+
+    int width_ = 0;
+    size_t row_bytes_ = 0;
+    std::vector<uint8_t> bits_;
+};
+
+// CODE128 for plain data, as label languages take it: code set C for an even run of
+// digits, else B with '{' escaped for EncodeCode128
+inline bool EncodeCode128Data(const std::string& data, int module, EscPosBarcode& out) {
+    out = EscPosBarcode();
+    bool digits = data.size() >= 4 && data.size() % 2 == 0 && std::all_of(data.begin(), data.end(), [](char c) { return c >= '0' && c <= '9'; });
+    std::string epson = digits ? "{C" : "{B";
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (digits) {
+            epson += (char)((data[i] - '0') * 10 + (data[i + 1] - '0'));
+            ++i;
+        } else {
+            epson += data[i];
+            if (data[i] == '{') epson += '{';
+        }
+    }
+    return EncodeCode128(epson, module, out);
+}
+
+// The font closest to a character cell of about width x height dots
+inline const GlyphSet& GlyphsForCell(int width, int height) {
+    ReceiptFontStyle style;
+    style.font_b = height < (FONT_A_HEIGHT + FONT_B_HEIGHT) / 2;
+    int base_width = style.font_b ? FONT_B_WIDTH : FONT_A_WIDTH, base_height = style.font_b ? FONT_B_HEIGHT : FONT_A_HEIGHT;
+    style.height_scale = (uint8_t)std::clamp((height + base_height / 2) / base_height, 1, FONT_MAX_SCALE);
+    style.width_scale = (uint8_t)std::clamp((width + base_width / 2) / base_width, 1, FONT_MAX_SCALE);
+    return ReceiptGlyphCache::Shared().Get(style);
+}
+
+class PageDecoder {
+public:
+    virtual ~PageDecoder() = default;
+
+    virtual void Feed(const uint8_t* p, size_t n) = 0;
+    // The stream has ended: a command cut short is dropped, an open label or page is printed
+    virtual void Finish() = 0;
+    // A copy to finish for Snapshot(): the decoding state without the finished pages
+    virtual std::unique_ptr<PageDecoder> Clone() const = 0;
+
+    // Keep the text only; the page stays empty
+    void set_text_only(bool text_only) { text_only_ = text_only; }
+
+    // The page as if the stream ended here, with the cuts it would have
+    void Snapshot(std::vector<uint8_t>& out, std::vector<uint64_t>& cuts) const {
+        std::unique_ptr<PageDecoder> copy = Clone();
+        copy->Finish();
+        out.clear();
+        out.reserve(page_.size() + copy->page_.size());
+        out.insert(out.end(), page_.begin(), page_.end());
+        out.insert(out.end(), copy->page_.begin(), copy->page_.end());
+        cuts = cuts_;
+        cuts.insert(cuts.end(), copy->cuts_.begin(), copy->cuts_.end());
+    }
+
+    std::vector<uint8_t> TakePage() { return std::move(page_); }
+    const std::vector<uint8_t>& page() const { return page_; }
+    int width() const { return width_ > 0 ? width_ : default_width_; }
+    const std::vector<uint64_t>& cuts() const { return cuts_; } // Byte offset past each label's dashed line
+    uint64_t pages() const { return pages_; }
+    uint64_t image_bytes() const { return image_bytes_; }      // Stream bytes that were graphics data
+    std::string TakeText() { return std::move(text_); }
+
+protected:
+    explicit PageDecoder(int default_width) : default_width_(PageWidth(default_width)) {}
+
+    // For Clone(): the copy's pages go after this decoder's
+    PageDecoder(const PageDecoder& other)
+        : text_only_(other.text_only_), image_bytes_(other.image_bytes_), default_width_(other.default_width_), width_(other.width_),
+          page_base_(other.page_base_ + other.page_.size()), pages_(other.pages_) {}
+    PageDecoder& operator=(const PageDecoder&) = delete;
+
+    // A label or page is done: stacked under the previous ones at the page width, which
+    // the first one decides
+    void EmitPage(const PageCanvas& canvas) {
+        pages_++;
+        if (text_only_) return;
+        if (width_ == 0) width_ = canvas.width() > 0 ? canvas.width() : default_width_;
+        size_t row_bytes = (size_t)width_ / 8;
+        if (page_base_ + page_.size() > 0) {
+            size_t line = page_.size();
+            page_.resize(line + row_bytes, 0xF0);
+            cuts_.push_back(page_base_ + page_.size());
+        }
+        size_t first = page_.size();
+        page_.resize(first + (size_t)canvas.rows() * row_bytes, 0);
+        size_t copy = std::min(row_bytes, canvas.row_bytes());
+        for (int r = 0; r < canvas.rows(); ++r) {
+            std::memcpy(page_.data() + first + (size_t)r * row_bytes, canvas.bits().data() + (size_t)r * canvas.row_bytes(), copy);
+        }
+    }
+
+    void PutTextLine(std::string_view line) {
+        size_t end = line.find_last_not_of(" \t\r\n");
+        if (end == std::string_view::npos || text_.size() >= PAGE_TEXT_MAX_BYTES) return;
+        for (size_t i = 0; i <= end; ++i) {
+            uint8_t c = (uint8_t)line[i];
+            text_ += c < 0x20 || c == 0x7F ? ' ' : (char)c; // UTF-8 passes through
+        }
+        text_ += '\n';
+    }
+
+    // Labels draw on canvases made here, which draw nothing when only the text is kept
+    void ResetCanvas(PageCanvas& canvas, int width, int height = 0) const { canvas.Reset(text_only_ ? 0 : width, height); }
+
+    bool text_only_ = false;
+    uint64_t image_bytes_ = 0;
+
+private:
+    int default_width_;
+    int width_ = 0;
+    uint64_t page_base_ = 0; // A copy's: bytes of the page it was copied from
+    std::vector<uint8_t> page_;
+    std::vector<uint64_t> cuts_;
+    uint64_t pages_ = 0;
+    std::string text_;
+};
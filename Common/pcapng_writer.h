@@ -0,0 +1,375 @@
+#pragma once
+
+// Streaming pcapng writer that turns relayed chunks into synthetic TCP/IP packets so
+// sessions can be opened in Wireshark/tshark. Packets use LINKTYPE_RAW (bare IPv4/IPv6),
+// microsecond timestamps and correct IP/TCP checksums. Memory use is one output buffer
+// plus a few bytes of sequence state per flow, whatever the size of the input.
+
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "byte_order.h"
+
+constexpr size_t PCAPNG_WRITE_BUFFER_SIZE = 1024 * 1024;
+constexpr size_t PCAPNG_MAX_SEGMENT = 65535 - 60 - 20; // Fits IPv4 total length with room for options
+constexpr uint16_t PCAPNG_LINKTYPE_RAW = 101;
+const std::string PCAPNG_EXTENSION = ".pcapng";
+
+// An IPv4/IPv6 endpoint parsed from the "ip:port" strings produced by GetAddressString()
+struct PcapngEndpoint {
+    bool is_v6 = false;
+    uint8_t addr[16] = {};
+    uint16_t port = 0;
+};
+
+inline bool ParseIPv4(const std::string& text, uint8_t out[4]) {
+    int part = 0;
+    unsigned value = 0;
+    bool have_digit = false;
+    for (char c : text) {
+        if (c >= '0' && c <= '9') {
+            value = value * 10 + (c - '0');
+            if (value > 255) return false;
+            have_digit = true;
+        } else if (c == '.' && have_digit && part < 3) {
+            out[part++] = (uint8_t)value;
+            value = 0;
+            have_digit = false;
+        } else {
+            return false;
+        }
+    }
+    if (part != 3 || !have_digit) return false;
+    out[3] = (uint8_t)value;
+    return true;
+}
+
+inline bool ParseIPv6(const std::string& text, uint8_t out[16]) {
+    uint16_t groups[8] = {};
+    int count = 0, gap = -1;
+    size_t i = 0;
+    if (text.compare(0, 2, "::") == 0) { gap = 0; i = 2; }
+    while (i < text.size()) {
+        size_t end = text.find(':', i);
+        std::string token = text.substr(i, end == std::string::npos ? std::string::npos : end - i);
+        if (token.find('.') != std::string::npos) { // Embedded IPv4 (e.g. ::ffff:1.2.3.4)
+            uint8_t v4[4];
+            if (count > 6 || !ParseIPv4(token, v4)) return false;
+            groups[count++] = (uint16_t)((v4[0] << 8) | v4[1]);
+            groups[count++] = (uint16_t)((v4[2] << 8) | v4[3]);
+            break;
+        }
+        if (token.empty() || token.size() > 4 || count >= 8) return false;
+        groups[count++] = (uint16_t)std::stoul(token, nullptr, 16);
+        if (end == std::string::npos) break;
+        i = end + 1;
+        if (i < text.size() && text[i] == ':') {
+            if (gap >= 0) return false;
+            gap = count;
+            ++i;
+        }
+    }
+    if (gap < 0 && count != 8) return false;
+    uint16_t full[8] = {};
+    int tail = gap < 0 ? 0 : count - gap;
+    for (int g = 0; g < (gap < 0 ? count : gap); ++g) full[g] = groups[g];
+    for (int g = 0; g < tail; ++g) full[8 - tail + g] = groups[gap + g];
+    for (int g = 0; g < 8; ++g) { out[2 * g] = (uint8_t)(full[g] >> 8); out[2 * g + 1] = (uint8_t)full[g]; }
+    return true;
+}
+
+// Accepts "1.2.3.4:9100", "[::1]:9100" and the unbracketed "::1:9100" form
+inline bool ParseEndpoint(const std::string& text, PcapngEndpoint& endpoint) {
+    size_t colon = text.rfind(':');
+    if (colon == std::string::npos || colon + 1 >= text.size()) return false;
+    try {
+        unsigned long port = std::stoul(text.substr(colon + 1));
+        if (port > 65535) return false;
+        endpoint.port = (uint16_t)port;
+    } catch (const std::exception&) {
+        return false;
+    }
+    std::string host = text.substr(0, colon);
+    if (host.size() >= 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
+    std::memset(endpoint.addr, 0, sizeof(endpoint.addr));
+    if (ParseIPv4(host, endpoint.addr)) {
+        endpoint.is_v6 = false;
+        return true;
+    }
+    try {
+        endpoint.is_v6 = ParseIPv6(host, endpoint.addr);
+    } catch (const std::exception&) {
+        endpoint.is_v6 = false;
+    }
+    return endpoint.is_v6;
+}
+
+// Placeholder endpoints for captures that do not record one side (e.g. raw .bin files)
+inline PcapngEndpoint DefaultEndpoint(uint8_t last_octet, uint16_t port) {
+    PcapngEndpoint endpoint;
+    endpoint.addr[0] = 10;
+    endpoint.addr[3] = last_octet;
+    endpoint.port = port;
+    return endpoint;
+}
+
+
+class PcapngWriter {
+public:
+    struct Flow {
+        PcapngEndpoint client;
+        PcapngEndpoint server;
+        uint32_t client_seq = 0;
+        uint32_t server_seq = 0;
+        bool open = false;
+    };
+
+    PcapngWriter() = default;
+    PcapngWriter(const PcapngWriter&) = delete;
+    PcapngWriter& operator=(const PcapngWriter&) = delete;
+    ~PcapngWriter() { Close(); }
+
+    bool Open(const std::string& filename) {
+        file_.open(filename, std::ios::binary | std::ios::trunc);
+        if (!file_.is_open()) return false;
+        buffer_.clear();
+        buffer_.reserve(PCAPNG_WRITE_BUFFER_SIZE);
+        WriteSectionHeader();
+        WriteInterfaceDescription();
+        return Good();
+    }
+
+    // Emits the three-way handshake and returns the flow state for the session; the writes
+    // succeeded if is_open() still holds
+    Flow BeginFlow(const PcapngEndpoint& client, const PcapngEndpoint& server, uint64_t time_us) {
+        Flow flow;
+        flow.client = client;
+        flow.server = server;
+        if (client.is_v6 != server.is_v6) { // Both ends of a packet share a family; map the IPv4 side
+            MapToIPv6(client.is_v6 ? flow.server : flow.client);
+        }
+        flow.client_seq = InitialSequence(client, time_us);
+        flow.server_seq = InitialSequence(server, time_us ^ 0x5bd1e995u);
+        flow.open = true;
+
+        WriteSegment(flow, true, time_us, TCP_SYN, nullptr, 0, false);
+        flow.client_seq++;
+        WriteSegment(flow, false, time_us, TCP_SYN | TCP_ACK, nullptr, 0, false);
+        flow.server_seq++;
+        WriteSegment(flow, true, time_us, TCP_ACK, nullptr, 0, true);
+        return flow;
+    }
+
+    // Returns false once the file is (or just became) unusable, as do EndFlow() and Flush()
+    bool WriteData(Flow& flow, bool from_client, uint64_t time_us, const uint8_t* data, size_t len) {
+        while (len > 0) {
+            size_t chunk = len < PCAPNG_MAX_SEGMENT ? len : PCAPNG_MAX_SEGMENT;
+            if (!WriteSegment(flow, from_client, time_us, TCP_PSH | TCP_ACK, data, chunk, true)) return false;
+            (from_client ? flow.client_seq : flow.server_seq) += (uint32_t)chunk;
+            data += chunk;
+            len -= chunk;
+        }
+        return is_open();
+    }
+
+    // Emits FIN/ACK from both sides and the final ACK
+    bool EndFlow(Flow& flow, uint64_t time_us) {
+        if (!flow.open) return is_open();
+        flow.open = false;
+        bool ok = WriteSegment(flow, true, time_us, TCP_FIN | TCP_ACK, nullptr, 0, true);
+        flow.client_seq++;
+        ok = ok && WriteSegment(flow, false, time_us, TCP_FIN | TCP_ACK, nullptr, 0, true);
+        flow.server_seq++;
+        return ok && WriteSegment(flow, true, time_us, TCP_ACK, nullptr, 0, true);
+    }
+
+    // Writes the buffered blocks through to the file, so a packet tool watching it sees them
+    bool Flush() {
+        if (!file_.is_open()) return false;
+        if (!buffer_.empty()) {
+            file_.write(reinterpret_cast<const char*>(buffer_.data()), (std::streamsize)buffer_.size());
+            buffer_.clear();
+        }
+        file_.flush();
+        return Good();
+    }
+
+    bool Close() {
+        if (!file_.is_open()) return false;
+        bool ok = Flush();
+        file_.close();
+        return ok;
+    }
+
+    bool is_open() const { return file_.is_open(); }
+    bool buffered() const { return !buffer_.empty(); }
+    uint64_t packets_written() const { return packets_; }
+
+private:
+    static constexpr uint8_t TCP_FIN = 0x01;
+    static constexpr uint8_t TCP_SYN = 0x02;
+    static constexpr uint8_t TCP_PSH = 0x08;
+    static constexpr uint8_t TCP_ACK = 0x10;
+
+    static void MapToIPv6(PcapngEndpoint& endpoint) {
+        uint8_t v4[4];
+        std::memcpy(v4, endpoint.addr, 4);
+        std::memset(endpoint.addr, 0, sizeof(endpoint.addr));
+        endpoint.addr[10] = endpoint.addr[11] = 0xFF;
+        std::memcpy(endpoint.addr + 12, v4, 4);
+        endpoint.is_v6 = true;
+    }
+
+    static uint32_t InitialSequence(const PcapngEndpoint& endpoint, uint64_t seed) {
+        uint64_t h = 0xcbf29ce484222325ull ^ seed;
+        for (uint8_t b : endpoint.addr) h = (h ^ b) * 0x100000001b3ull;
+        h = (h ^ endpoint.port) * 0x100000001b3ull;
+        return (uint32_t)(h ^ (h >> 32));
+    }
+
+    // Ones' complement sum, folded by the caller
+    static uint64_t ChecksumAdd(uint64_t sum, const uint8_t* data, size_t len) {
+        size_t i = 0;
+        for (; i + 1 < len; i += 2) sum += (uint32_t)((data[i] << 8) | data[i + 1]);
+        if (i < len) sum += (uint32_t)(data[i] << 8);
+        return sum;
+    }
+
+    static uint16_t ChecksumFold(uint64_t sum) {
+        while (sum >> 16) sum = (sum & 0xFFFF) + (sum >> 16);
+        return (uint16_t)~sum;
+    }
+
+    bool WriteSegment(const Flow& flow, bool from_client, uint64_t time_us, uint8_t flags,
+                      const uint8_t* payload, size_t payload_len, bool with_ack) {
+        const PcapngEndpoint& src = from_client ? flow.client : flow.server;
+        const PcapngEndpoint& dst = from_client ? flow.server : flow.client;
+        const bool v6 = flow.client.is_v6;
+        const size_t ip_len = v6 ? 40 : 20;
+        const size_t packet_len = ip_len + 20 + payload_len;
+
+        uint8_t hdr[60] = {};
+        uint8_t* tcp = hdr + ip_len;
+        if (v6) {
+            hdr[0] = 0x60;
+            PutBE16(hdr + 4, (uint16_t)(20 + payload_len));
+            hdr[6] = 6;  // TCP
+            hdr[7] = 64; // Hop limit
+            std::memcpy(hdr + 8, src.addr, 16);
+            std::memcpy(hdr + 24, dst.addr, 16);
+        } else {
+            hdr[0] = 0x45;
+            PutBE16(hdr + 2, (uint16_t)packet_len);
+            PutBE16(hdr + 4, (uint16_t)packets_); // Identification
+            hdr[6] = 0x40; // Don't fragment
+            hdr[8] = 64;   // TTL
+            hdr[9] = 6;    // TCP
+            std::memcpy(hdr + 12, src.addr, 4);
+            std::memcpy(hdr + 16, dst.addr, 4);
+            PutBE16(hdr + 10, ChecksumFold(ChecksumAdd(0, hdr, 20)));
+        }
+
+        PutBE16(tcp + 0, src.port);
+        PutBE16(tcp + 2, dst.port);
+        PutBE32(tcp + 4, from_client ? flow.client_seq : flow.server_seq);
+        PutBE32(tcp + 8, with_ack ? (from_client ? flow.server_seq : flow.client_seq) : 0);
+        tcp[12] = 5 << 4; // Data offset: 20 bytes
+        tcp[13] = flags;
+        PutBE16(tcp + 14, 65535); // Window
+
+        // Pseudo-header + TCP header + payload
+        uint64_t sum = 0;
+        sum = ChecksumAdd(sum, v6 ? hdr + 8 : hdr + 12, v6 ? 32 : 8);
+        sum += 6 + (uint32_t)(20 + payload_len);
+        sum = ChecksumAdd(sum, tcp, 20);
+        if (payload_len) sum = ChecksumAdd(sum, payload, payload_len);
+        PutBE16(tcp + 16, ChecksumFold(sum));
+
+        // Enhanced Packet Block
+        const size_t padded = (packet_len + 3) & ~(size_t)3;
+        const uint32_t block_len = (uint32_t)(28 + padded + 4);
+        uint8_t epb[28];
+        PutLE32(epb + 0, 0x00000006);
+        PutLE32(epb + 4, block_len);
+        PutLE32(epb + 8, 0); // Interface 0
+        PutLE32(epb + 12, (uint32_t)(time_us >> 32));
+        PutLE32(epb + 16, (uint32_t)time_us);
+        PutLE32(epb + 20, (uint32_t)packet_len);
+        PutLE32(epb + 24, (uint32_t)packet_len);
+        static const uint8_t zeros[4] = {};
+        uint8_t trailer[4];
+        PutLE32(trailer, block_len);
+        if (!Append(epb, sizeof(epb)) || !Append(hdr, ip_len + 20) || !Append(payload, payload_len) ||
+            !Append(zeros, padded - packet_len) || !Append(trailer, 4)) {
+            return false;
+        }
+        packets_++;
+        return true;
+    }
+
+    void WriteSectionHeader() {
+        static const char app[] = "Printer_Relay_Logger";
+        const size_t app_len = sizeof(app) - 1;
+        const size_t app_padded = (app_len + 3) & ~(size_t)3;
+        const uint32_t block_len = (uint32_t)(24 + 4 + app_padded + 4 + 4);
+        uint8_t shb[24];
+        PutLE32(shb + 0, 0x0A0D0D0A);
+        PutLE32(shb + 4, block_len);
+        PutLE32(shb + 8, 0x1A2B3C4D); // Byte-order magic
+        shb[12] = 1; shb[13] = 0;     // Major version 1
+        shb[14] = 0; shb[15] = 0;     // Minor version 0
+        std::memset(shb + 16, 0xFF, 8); // Section length unknown (streaming)
+        Append(shb, sizeof(shb));
+        uint8_t opt[4];
+        PutLE16(opt, 4); // shb_userappl
+        PutLE16(opt + 2, (uint16_t)app_len);
+        Append(opt, 4);
+        Append(reinterpret_cast<const uint8_t*>(app), app_len);
+        static const uint8_t zeros[4] = {};
+        Append(zeros, app_padded - app_len);
+        std::memset(opt, 0, 4); // opt_endofopt
+        Append(opt, 4);
+        uint8_t trailer[4];
+        PutLE32(trailer, block_len);
+        Append(trailer, 4);
+    }
+
+    void WriteInterfaceDescription() {
+        uint8_t idb[20];
+        PutLE32(idb + 0, 0x00000001);
+        PutLE32(idb + 4, sizeof(idb));
+        PutLE16(idb + 8, PCAPNG_LINKTYPE_RAW);
+        PutLE16(idb + 10, 0);
+        PutLE32(idb + 12, 0); // No snap length limit; default microsecond resolution
+        PutLE32(idb + 16, sizeof(idb));
+        Append(idb, sizeof(idb));
+    }
+
+    // Returns false and closes the file once a write fails
+    bool Append(const uint8_t* data, size_t len) {
+        if (!file_.is_open()) return false;
+        if (len == 0) return true;
+        if (buffer_.size() + len > PCAPNG_WRITE_BUFFER_SIZE && !Flush()) return false;
+        if (len >= PCAPNG_WRITE_BUFFER_SIZE) {
+            file_.write(reinterpret_cast<const char*>(data), (std::streamsize)len);
+            return Good();
+        }
+        buffer_.insert(buffer_.end(), data, data + len);
+        return true;
+    }
+
+    bool Good() {
+        if (file_.is_open() && file_) return true;
+        file_.close();
+        return false;
+    }
+
+
+    std::ofstream file_;
+    std::vector<uint8_t> buffer_;
+    uint64_t packets_ = 0;
+};
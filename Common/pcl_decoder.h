@@ -0,0 +1,292 @@
+#pragma once
+
+// PCL 5 raster graphics, what office printer drivers send for bitmap pages, for
+// page_decoder.h.
+//
+// An escape sequence is ESC, a parameterized character (! to /) and a group character,
+// then value and parameter pairs: a lowercase parameter continues the sequence, an
+// uppercase one ends it (ESC * r 1 A, ESC * b 2 m 120 W). A sequence ending in W, and
+// ESC & p X, carries as many data bytes as its value. Drawn: raster rows (ESC * b # W, with
+// the planes of ESC * b # V ORed in) in compression 0 (unencoded), 1 (run-length), 2 (TIFF
+// PackBits) or 3 (delta row), as wide as ESC * r # S or else the first row, one below the
+// other, with ESC * b # Y skipping rows. A form feed, or ESC E after printed rows, ends the
+// page. Rows are placed at the left edge whatever the cursor position, and other
+// compression modes are not drawn. Text outside escape sequences is kept for the text
+// index but not drawn, PJL lines and HP-GL/2 excepted.
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "page_decoder.h"
+
+constexpr int PCL_DEFAULT_WIDTH = 2400;    // 8 inches at 300 dpi, until a raster width is known
+constexpr uint8_t PCL_ESC = 0x1B;
+
+class PclDecoder : public PageDecoder {
+public:
+    PclDecoder() : PageDecoder(PCL_DEFAULT_WIDTH) {}
+
+    void Feed(const uint8_t* p, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            uint8_t c = p[i];
+            switch (state_) {
+                case State::Text:
+                    if (c == PCL_ESC) state_ = State::Escape;
+                    else Text(c);
+                    break;
+                case State::Escape:
+                    if (c >= 0x21 && c <= 0x2F) {
+                        parameterized_ = c;
+                        group_ = 0;
+                        state_ = State::Group;
+                    } else {
+                        if (c == 'E') Reset();
+                        state_ = State::Text;
+                    }
+                    break;
+                case State::Group:
+                    state_ = State::Value;
+                    StartValue();
+                    if (c >= 0x60 && c <= 0x7E) group_ = c;
+                    else Value(c);
+                    break;
+                case State::Value:
+                    Value(c);
+                    break;
+                case State::Data: {
+                    size_t take = std::min<size_t>(data_left_, n - i);
+                    if (data_is_row_) data_.insert(data_.end(), p + i, p + i + take);
+                    data_left_ -= take;
+                    i += take - 1;
+                    if (data_left_ == 0) EndData();
+                } break;
+            }
+        }
+    }
+
+    void Finish() override {
+        if (state_ == State::Data) EndData(); // A row cut short is drawn as far as it came
+        state_ = State::Text;
+        EndTextLine();
+        EndPage();
+    }
+
+    std::unique_ptr<PageDecoder> Clone() const override { return std::make_unique<PclDecoder>(*this); }
+
+private:
+    enum class State { Text, Escape, Group, Value, Data };
+
+    void StartValue() {
+        value_ = 0;
+        negative_ = false;
+        fraction_ = false;
+    }
+
+    void Value(uint8_t c) {
+        if (c >= '0' && c <= '9') {
+            if (!fraction_ && value_ < (1 << 30)) value_ = value_ * 10 + (c - '0');
+        } else if (c == '-' || c == '+') {
+            negative_ = c == '-';
+        } else if (c == '.') {
+            fraction_ = true;
+        } else if (c >= 0x40 && c <= 0x7E) {
+            bool last = c < 0x60;
+            Parameter((uint8_t)(last ? c : c - 0x20), negative_ ? -value_ : value_);
+            if (state_ == State::Data) return;
+            if (last) state_ = State::Text;
+            else StartValue();
+        } else {
+            state_ = State::Text; // Not a sequence after all
+        }
+    }
+
+    void Parameter(uint8_t parameter, int64_t value) {
+        int key = parameterized_ << 16 | group_ << 8 | parameter;
+        switch (key) {
+            case '*' << 16 | 'r' << 8 | 'S':
+                if (value > 0) raster_width_ = (int)std::min<int64_t>(value, PAGE_CANVAS_MAX_WIDTH);
+                break;
+            case '*' << 16 | 'r' << 8 | 'A':
+            case '*' << 16 | 'r' << 8 | 'B':
+            case '*' << 16 | 'r' << 8 | 'C':
+                seeds_.clear();
+                break;
+            case '*' << 16 | 'b' << 8 | 'M':
+                compression_ = (int)value;
+                break;
+            case '*' << 16 | 'b' << 8 | 'Y':
+                y_ += (int)std::clamp<int64_t>(value, 0, PAGE_CANVAS_MAX_ROWS);
+                seeds_.clear();
+                break;
+            case '*' << 16 | 'b' << 8 | 'V':
+            case '*' << 16 | 'b' << 8 | 'W':
+                StartData(value, true, parameter == 'W');
+                break;
+            case '&' << 16 | 'p' << 8 | 'X':
+                StartData(value, false, false);
+                break;
+            case '%' << 16 | 0 << 8 | 'B': // HP-GL/2 until ESC % A or the next job
+                hpgl_ = true;
+                break;
+            case '%' << 16 | 0 << 8 | 'A':
+            case '%' << 16 | 0 << 8 | 'X':
+                hpgl_ = false;
+                break;
+            default:
+                if (parameter == 'W') StartData(value, false, false); // Fonts, patterns, configuration
+                break;
+        }
+    }
+
+    void StartData(int64_t size, bool row, bool row_end) {
+        data_left_ = (size_t)std::max<int64_t>(size, 0);
+        data_is_row_ = row;
+        row_end_ = row_end;
+        data_.clear();
+        state_ = State::Data;
+        if (data_left_ == 0) EndData();
+    }
+
+    void EndData() {
+        state_ = State::Text;
+        data_left_ = 0;
+        if (!data_is_row_) return;
+        image_bytes_ += data_.size();
+        if (!text_only_) Plane();
+        if (row_end_) {
+            if (!text_only_) DrawRow();
+            plane_ = 0;
+        } else {
+            plane_++;
+        }
+    }
+
+    // The plane's data decompressed against its seed row, ORed into the row
+    void Plane() {
+        if (seeds_.size() <= plane_) seeds_.resize(plane_ + 1);
+        std::vector<uint8_t>& seed = seeds_[plane_];
+        size_t limit = (size_t)(raster_width_ > 0 ? (raster_width_ + 7) / 8 : PAGE_CANVAS_MAX_WIDTH / 8);
+        const uint8_t* p = data_.data();
+        size_t n = data_.size();
+        switch (compression_) {
+            case 0:
+                seed.assign(p, p + std::min(n, limit));
+                break;
+            case 1:
+                seed.clear();
+                for (size_t i = 0; i + 1 < n && seed.size() < limit; i += 2) seed.insert(seed.end(), std::min<size_t>((size_t)p[i] + 1, limit - seed.size()), p[i + 1]);
+                break;
+            case 2:
+                seed.clear();
+                for (size_t i = 0; i < n && seed.size() < limit;) {
+                    int8_t control = (int8_t)p[i++];
+                    if (control >= 0) {
+                        size_t count = std::min<size_t>({ (size_t)control + 1, n - i, limit - seed.size() });
+                        seed.insert(seed.end(), p + i, p + i + count);
+                        i += (size_t)control + 1;
+                    } else if (control != -128 && i < n) {
+                        seed.insert(seed.end(), std::min<size_t>((size_t)(1 - control), limit - seed.size()), p[i++]);
+                    }
+                }
+                break;
+            case 3: { // Replacements at offsets from the end of the previous one
+                size_t position = 0;
+                for (size_t i = 0; i < n;) {
+                    uint8_t command = p[i++];
+                    size_t count = (size_t)(command >> 5) + 1, offset = command & 0x1F;
+                    if (offset == 31) {
+                        while (i < n) {
+                            offset += p[i];
+                            if (p[i++] != 255) break;
+                        }
+                    }
+                    position += offset;
+                    for (size_t k = 0; k < count && i < n; ++k, ++i, ++position) {
+                        if (position >= limit) continue;
+                        if (seed.size() <= position) seed.resize(position + 1, 0);
+                        seed[position] = p[i];
+                    }
+                }
+            } break;
+            default: // Adaptive and replacement delta row are not drawn
+                return;
+        }
+        if (row_.size() < seed.size()) row_.resize(seed.size(), 0);
+        for (size_t k = 0; k < seed.size(); ++k) row_[k] |= seed[k];
+    }
+
+    void DrawRow() {
+        if (!page_started_) {
+            ResetCanvas(canvas_, raster_width_ > 0 ? raster_width_ : std::max<int>((int)row_.size() * 8, 8));
+            page_started_ = true;
+        }
+        if (!row_.empty()) canvas_.OrRow(0, y_, row_.data(), (int)std::min<size_t>(row_.size() * 8, PAGE_CANVAS_MAX_WIDTH));
+        y_++;
+        std::fill(row_.begin(), row_.end(), 0);
+    }
+
+    void Text(uint8_t c) {
+        if (c == '\r' || c == '\n') {
+            EndTextLine();
+        } else if (c == 0x0C) {
+            EndTextLine();
+            EndPage();
+        } else if ((c >= 0x20 || c == '\t') && !hpgl_ && text_line_.size() < PAGE_TEXT_MAX_BYTES) {
+            text_line_ += (char)c;
+        }
+    }
+
+    void EndTextLine() {
+        if (text_line_.compare(0, 4, "@PJL") != 0) PutTextLine(text_line_);
+        text_line_.clear();
+    }
+
+    // ESC E: back to the defaults, ending a page that has rows
+    void Reset() {
+        EndTextLine();
+        EndPage();
+        compression_ = 0;
+        raster_width_ = 0;
+        hpgl_ = false;
+    }
+
+    void EndPage() {
+        if (!page_started_ && y_ == 0) return;
+        if (!page_started_) ResetCanvas(canvas_, raster_width_ > 0 ? raster_width_ : PCL_DEFAULT_WIDTH);
+        canvas_.SetRows(y_);
+        EmitPage(canvas_);
+        canvas_ = PageCanvas();
+        page_started_ = false;
+        y_ = 0;
+        seeds_.clear();
+    }
+
+    State state_ = State::Text;
+    uint8_t parameterized_ = 0;
+    uint8_t group_ = 0;
+    int64_t value_ = 0;
+    bool negative_ = false;
+    bool fraction_ = false;
+
+    size_t data_left_ = 0;
+    bool data_is_row_ = false; // Else skipped
+    bool row_end_ = false;     // W: the row's last plane
+    std::vector<uint8_t> data_;
+
+    int raster_width_ = 0;
+    int compression_ = 0;
+    size_t plane_ = 0;
+    std::vector<std::vector<uint8_t>> seeds_; // Last row of each plane, for delta rows
+    std::vector<uint8_t> row_;
+
+    bool page_started_ = false;
+    int y_ = 0;
+    PageCanvas canvas_;
+
+    bool hpgl_ = false;
+    std::string text_line_;
+};
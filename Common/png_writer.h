@@ -0,0 +1,273 @@
+#pragma once
+
+// Streaming PNG writer for receipt images: 1-bit grayscale, written row by row from the
+// packed raster (PackReceiptRows), so exporting a long roll holds one band of rows and
+// the compressor's window rather than a 32-bit bitmap of the whole image. Needs nothing
+// beyond the standard library, so the viewer and the command-line tools share it. Small
+// palettes (1, 2 or 4 bits per pixel) are written the same way, for receipt_diff.h.
+//
+// Rows are written with filter None unless asked otherwise. At one bit per pixel a byte's
+// neighbours hold unrelated dots, so the predictive filters (and Adaptive, the usual
+// per-row choice by smallest sum of absolute filtered bytes) only make the output larger
+// on receipts, as bench png shows; repeated rows are left to the compressor's matches.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "byte_order.h"
+#include "deflate.h"
+#include "receipt_decoder.h"
+
+constexpr size_t PNG_IDAT_SIZE = 256 * 1024;  // Compressed bytes per IDAT chunk
+constexpr int PNG_BAND_ROWS = 256;            // Rows packed per WriteRows call by WriteReceiptPng
+const std::string PNG_EXTENSION = ".png";
+
+// PNG filter types; Adaptive chooses among the others row by row
+enum class PngFilter { None = 0, Sub = 1, Up = 2, Average = 3, Paeth = 4, Adaptive = 5 };
+
+// CRC-32 (ISO 3309, as used by PNG and zlib) - not the CRC32C of crc32c.h
+inline uint32_t Crc32Update(uint32_t crc, const uint8_t* data, size_t len) {
+    static const auto table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0xEDB88320u & (0u - (c & 1)));
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) crc = (crc >> 8) ^ table[(crc ^ data[i]) & 0xFF];
+    return ~crc;
+}
+
+class PngWriter {
+public:
+    PngWriter() = default;
+    PngWriter(const PngWriter&) = delete;
+    PngWriter& operator=(const PngWriter&) = delete;
+    ~PngWriter() { Close(); }
+
+    // Starts a width x height 1-bit grayscale image
+    bool Open(const std::filesystem::path& path, int width, int height, PngFilter filter = PngFilter::None) {
+        return Start(path, width, height, 1, {}, filter);
+    }
+
+    // Starts a width x height image of bit_depth (1, 2 or 4) bits per pixel, each an index
+    // into palette (0xRRGGBB entries, at most 1 << bit_depth)
+    bool OpenIndexed(const std::filesystem::path& path, int width, int height, int bit_depth, const std::vector<uint32_t>& palette,
+                     PngFilter filter = PngFilter::None) {
+        if ((bit_depth != 1 && bit_depth != 2 && bit_depth != 4) || palette.empty() || palette.size() > (1u << bit_depth)) return false;
+        return Start(path, width, height, bit_depth, palette, filter);
+    }
+
+    // Appends count rows of row_bytes() bytes each, stride apart: 8 dots per byte, leftmost
+    // in the top bit, 1 = white as PNG grayscale has it (PackReceiptRows with invert set).
+    // Indexed images have 8 / bit_depth pixels per byte, leftmost in the top bits.
+    // Rows past the height given to Open are ignored.
+    bool WriteRows(const uint8_t* rows, size_t stride, int count) {
+        if (!file_.is_open() || !deflate_) return false;
+        count = std::min(count, height_ - rows_written_);
+        for (int r = 0; r < count; ++r) {
+            std::memcpy(current_.data(), rows + (size_t)r * stride, row_bytes_);
+            const std::vector<uint8_t>& out = FilterRow();
+            deflate_->Write(out.data(), out.size());
+            current_.swap(previous_);
+        }
+        rows_written_ += count;
+        return Good();
+    }
+
+    // Ends the image; false if rows are missing or writing failed at any point
+    bool Close() {
+        if (!file_.is_open()) return false;
+        bool complete = rows_written_ == height_;
+        deflate_->Finish();
+        FlushIdat();
+        WriteChunk("IEND", nullptr, 0);
+        deflate_.reset();
+        bool ok = Good();
+        file_.close();
+        return ok && complete;
+    }
+
+    bool is_open() const { return file_.is_open(); }
+    size_t row_bytes() const { return row_bytes_; }
+    int rows_written() const { return rows_written_; }
+    uint64_t bytes_written() const { return bytes_written_; }
+
+private:
+    bool Start(const std::filesystem::path& path, int width, int height, int bit_depth, const std::vector<uint32_t>& palette,
+               PngFilter filter) {
+        if (width <= 0 || height <= 0) return false;
+        file_.open(path, std::ios::binary | std::ios::trunc);
+        if (!file_.is_open()) return false;
+        width_ = width;
+        height_ = height;
+        rows_written_ = 0;
+        bytes_written_ = 0;
+        filter_ = filter;
+        row_bytes_ = ((size_t)width * bit_depth + 7) / 8;
+        previous_.assign(row_bytes_, 0);
+        current_.assign(row_bytes_, 0);
+        for (std::vector<uint8_t>& row : filtered_) row.assign(row_bytes_ + 1, 0);
+        idat_.clear();
+        idat_.reserve(PNG_IDAT_SIZE);
+        deflate_ = std::make_unique<DeflateWriter>([this](const uint8_t* data, size_t len) {
+            idat_.insert(idat_.end(), data, data + len);
+            if (idat_.size() >= PNG_IDAT_SIZE) FlushIdat();
+        });
+
+        static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        file_.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+        bytes_written_ += sizeof(signature);
+        uint8_t ihdr[13];
+        PutBE32(ihdr, (uint32_t)width);
+        PutBE32(ihdr + 4, (uint32_t)height);
+        ihdr[8] = (uint8_t)bit_depth;
+        ihdr[9] = palette.empty() ? 0 : 3;  // Grayscale or palette
+        ihdr[10] = 0;  // Deflate
+        ihdr[11] = 0;  // Filter method 0: a filter type byte per row
+        ihdr[12] = 0;  // Not interlaced
+        WriteChunk("IHDR", ihdr, sizeof(ihdr));
+        if (!palette.empty()) {
+            std::vector<uint8_t> plte;
+            for (uint32_t color : palette) {
+                plte.push_back((uint8_t)(color >> 16));
+                plte.push_back((uint8_t)(color >> 8));
+                plte.push_back((uint8_t)color);
+            }
+            WriteChunk("PLTE", plte.data(), plte.size());
+        }
+        return Good();
+    }
+
+    // Filters current_ against previous_ (zeros above the first row)
+    const std::vector<uint8_t>& FilterRow() {
+        if (filter_ != PngFilter::Adaptive) {
+            std::vector<uint8_t>& out = filtered_[(int)filter_];
+            ApplyFilter(filter_, out);
+            return out;
+        }
+        int best = 0;
+        uint64_t best_sum = UINT64_MAX;
+        for (int f = 0; f < 5; ++f) {
+            std::vector<uint8_t>& out = filtered_[f];
+            ApplyFilter((PngFilter)f, out);
+            uint64_t sum = 0;
+            for (size_t k = 1; k < out.size(); ++k) sum += (uint64_t)std::abs((int)(int8_t)out[k]);
+            if (sum < best_sum) {
+                best_sum = sum;
+                best = f;
+            }
+        }
+        return filtered_[best];
+    }
+
+    // At 1 bit per pixel the "pixel to the left" is the previous byte
+    void ApplyFilter(PngFilter filter, std::vector<uint8_t>& out) const {
+        const uint8_t* x = current_.data();
+        const uint8_t* b = previous_.data();
+        uint8_t* o = out.data() + 1;
+        out[0] = (uint8_t)filter;
+        switch (filter) {
+            case PngFilter::Sub:
+                o[0] = x[0];
+                for (size_t k = 1; k < row_bytes_; ++k) o[k] = (uint8_t)(x[k] - x[k - 1]);
+                break;
+            case PngFilter::Up:
+                for (size_t k = 0; k < row_bytes_; ++k) o[k] = (uint8_t)(x[k] - b[k]);
+                break;
+            case PngFilter::Average:
+                for (size_t k = 0; k < row_bytes_; ++k) {
+                    int a = k > 0 ? x[k - 1] : 0;
+                    o[k] = (uint8_t)(x[k] - ((a + b[k]) >> 1));
+                }
+                break;
+            case PngFilter::Paeth:
+                for (size_t k = 0; k < row_bytes_; ++k) {
+                    int a = k > 0 ? x[k - 1] : 0, c = k > 0 ? b[k - 1] : 0;
+                    int p = a + b[k] - c, pa = std::abs(p - a), pb = std::abs(p - b[k]), pc = std::abs(p - c);
+                    int predictor = pa <= pb && pa <= pc ? a : pb <= pc ? b[k] : c;
+                    o[k] = (uint8_t)(x[k] - predictor);
+                }
+                break;
+            default:
+                std::memcpy(o, x, row_bytes_);
+                break;
+        }
+    }
+
+    void FlushIdat() {
+        if (idat_.empty()) return;
+        WriteChunk("IDAT", idat_.data(), idat_.size());
+        idat_.clear();
+    }
+
+    void WriteChunk(const char type[4], const uint8_t* data, size_t len) {
+        uint8_t header[8];
+        PutBE32(header, (uint32_t)len);
+        std::memcpy(header + 4, type, 4);
+        uint32_t crc = Crc32Update(0, header + 4, 4);
+        if (len) crc = Crc32Update(crc, data, len);
+        uint8_t trailer[4];
+        PutBE32(trailer, crc);
+        file_.write(reinterpret_cast<const char*>(header), sizeof(header));
+        if (len) file_.write(reinterpret_cast<const char*>(data), (std::streamsize)len);
+        file_.write(reinterpret_cast<const char*>(trailer), sizeof(trailer));
+        bytes_written_ += len + 12;
+    }
+
+    bool Good() {
+        if (file_) return true;
+        file_.close();
+        return false;
+    }
+
+    std::ofstream file_;
+    std::unique_ptr<DeflateWriter> deflate_;
+    int width_ = 0;
+    int height_ = 0;
+    int rows_written_ = 0;
+    uint64_t bytes_written_ = 0;
+    size_t row_bytes_ = 0;
+    PngFilter filter_ = PngFilter::None;
+    std::vector<uint8_t> previous_, current_;
+    std::vector<uint8_t> filtered_[5];  // Filter byte + row, per filter type
+    std::vector<uint8_t> idat_;
+};
+
+// Writes a decoded receipt laid out at width as a PNG, a band of rows at a time.
+// invert as for RenderReceiptRows: false draws printed dots black.
+inline bool WriteReceiptPng(const std::filesystem::path& path, const ReceiptBits& bits, int width, bool msb_first,
+                            bool invert, std::string& error, PngFilter filter = PngFilter::None) {
+    int rows = bits.rows(width);
+    if (rows <= 0) {
+        error = "No complete row at width " + std::to_string(width) + ".";
+        return false;
+    }
+    PngWriter png;
+    if (!png.Open(path, width, rows, filter)) {
+        error = "Cannot create the PNG file.";
+        return false;
+    }
+    std::vector<uint8_t> band(png.row_bytes() * PNG_BAND_ROWS);
+    for (int row = 0; row < rows; row += PNG_BAND_ROWS) {
+        int count = std::min(PNG_BAND_ROWS, rows - row);
+        PackReceiptRows(bits, width, msb_first, !invert, row, count, band.data(), png.row_bytes());
+        if (!png.WriteRows(band.data(), png.row_bytes(), count)) break;
+    }
+    if (!png.Close()) {
+        error = "Cannot write the PNG file.";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+// Which printer language a capture speaks, and the decoder for it.
+//
+// kPrintLanguages is the registry: each language has a sniffer that scores the first
+// PRINT_SNIFF_BYTES of the client -> printer stream and a factory for its PageDecoder.
+// The highest score wins and ESC/POS, which scores nothing, is what is left: it keeps the
+// decoding of receipt_decoder.h (emulator, GS v 0 raster, header and pattern fallback).
+// A language whose factory is null is recognized but not decoded (PCL XL), so a capture
+// of it is reported as such rather than shown as noise.
+//
+// Sniffers look for what only their language starts with: a ZPL prefix and ^XA, EPL
+// command lines, PCL's UEL/PJL wrapper, ESC E reset or ESC * b raster rows, Star's
+// ESC * r raster mode (no valid ESC/POS command), and the PCL XL stream header.
+
+#include <cstdint>
+#include <cstddef>
+#include <cctype>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "capture_reader.h"
+#include "page_decoder.h"
+#include "zpl_decoder.h"
+#include "epl_decoder.h"
+#include "pcl_decoder.h"
+#include "star_decoder.h"
+
+constexpr size_t PRINT_SNIFF_BYTES = 512;
+
+enum class PrintLanguage : uint8_t { EscPos, Star, Zpl, Epl, Pcl, PclXl };
+
+struct PrintLanguageSpec {
+    PrintLanguage language;
+    const char* name;
+    int (*sniff)(std::string_view head);       // 0: not this language; higher: more certain
+    std::unique_ptr<PageDecoder> (*create)();  // Null: not a PageDecoder language
+};
+
+inline std::string_view SkipBlank(std::string_view head) {
+    size_t start = 0;
+    while (start < head.size() && (head[start] == ' ' || head[start] == '\t' || head[start] == '\r' || head[start] == '\n' || head[start] == 0)) ++start;
+    return head.substr(start);
+}
+
+inline bool ContainsNoCase(std::string_view text, std::string_view needle) {
+    for (size_t i = 0; i + needle.size() <= text.size(); ++i) {
+        size_t k = 0;
+        while (k < needle.size() && std::toupper((unsigned char)text[i + k]) == needle[k]) ++k;
+        if (k == needle.size()) return true;
+    }
+    return false;
+}
+
+inline int SniffZpl(std::string_view head) {
+    std::string_view start = SkipBlank(head);
+    if (start.size() < 3 || (start[0] != '^' && start[0] != '~') || !std::isalpha((unsigned char)start[1])) return 0;
+    return ContainsNoCase(head, "^XA") ? 90 : 60; // ~DG downloads may fill the head
+}
+
+// EPL commands are lines of a letter or two and parameters: N, q832, Q1218,24, A50,0,0,...
+inline bool IsEplLine(std::string_view line) {
+    static const char* const kTwoLetterNames[] = { "LO", "LE", "LW", "GW", "ZB", "ZT", "JF", "JB", "OD", "UN", "US" };
+    if (line == "N" || line == "P" || line == "O" || line == "ZB" || line == "ZT" || line == "JF" || line == "JB") return true;
+    for (const char* two : kTwoLetterNames) {
+        if (line.size() > 2 && line.compare(0, 2, two) == 0) return std::isdigit((unsigned char)line[2]) || line[2] == ',';
+    }
+    if (line.size() < 2) return false;
+    bool numeric = std::isdigit((unsigned char)line[1]) != 0;
+    switch (line[0]) {
+        case 'q': case 'Q': case 'S': case 'D': case 'P': case 'R': case 'A': case 'B': case 'b': case 'X':
+            return numeric;
+        case 'I':
+            return line.size() >= 3 && line[1] == '8' && line[2] == ',';
+        case 'O':
+            return std::isupper((unsigned char)line[1]) != 0;
+        default:
+            return false;
+    }
+}
+
+inline int SniffEpl(std::string_view head) {
+    int matched = 0;
+    bool label = false; // N, A, B or P: something that makes a label
+    size_t start = 0;
+    while (start < head.size() && matched < 4) {
+        size_t end = head.find('\n', start);
+        if (end == std::string_view::npos) break; // A cut-off line decides nothing
+        std::string_view line = head.substr(start, end - start);
+        start = end + 1;
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ')) line.remove_suffix(1);
+        if (line.empty()) continue;
+        if (!IsEplLine(line)) return 0;
+        if (line.compare(0, 2, "GW") == 0) return matched > 0 ? 80 : 0; // Binary data follows
+        label = label || line[0] == 'N' || line[0] == 'A' || line[0] == 'B' || line[0] == 'P';
+        ++matched;
+    }
+    return matched >= 2 && label ? 80 : 0;
+}
+
+inline int SniffPclXl(std::string_view head) {
+    return head.find(") HP-PCL XL;") != std::string_view::npos ? 100 : 0;
+}
+
+inline int SniffPcl(std::string_view head) {
+    if (head.compare(0, 9, "\x1B%-12345X") == 0 || head.compare(0, 4, "@PJL") == 0) {
+        if (ContainsNoCase(head, "ENTER LANGUAGE")) return ContainsNoCase(head, "LANGUAGE=PCL") || ContainsNoCase(head, "LANGUAGE = PCL") ? 90 : 0;
+        return head.find("\x1B" "E") != std::string_view::npos ? 80 : 0;
+    }
+    if (head.compare(0, 3, "\x1B" "E" "\x1B") == 0) return 80;
+    // Raster rows: ESC * b <digits> (ESC/POS has no ESC * b)
+    for (size_t at = head.find("\x1B*b"); at != std::string_view::npos; at = head.find("\x1B*b", at + 1)) {
+        if (at + 3 < head.size() && std::isdigit((unsigned char)head[at + 3])) return 70;
+    }
+    return 0;
+}
+
+inline int SniffStar(std::string_view head) {
+    // ESC * r and a letter; PCL puts a value before the letter
+    for (size_t at = head.find("\x1B*r"); at != std::string_view::npos; at = head.find("\x1B*r", at + 1)) {
+        if (at + 3 < head.size() && std::strchr("RAQPETFm", head[at + 3]) && head[at + 3] != 0) return 75;
+    }
+    return 0;
+}
+
+template <typename Decoder>
+std::unique_ptr<PageDecoder> CreatePageDecoder() {
+    return std::make_unique<Decoder>();
+}
+
+const PrintLanguageSpec kPrintLanguages[] = {
+    { PrintLanguage::EscPos, "ESC/POS", nullptr, nullptr },
+    { PrintLanguage::Star, "Star", SniffStar, CreatePageDecoder<StarDecoder> },
+    { PrintLanguage::Zpl, "ZPL", SniffZpl, CreatePageDecoder<ZplDecoder> },
+    { PrintLanguage::Epl, "EPL", SniffEpl, CreatePageDecoder<EplDecoder> },
+    { PrintLanguage::Pcl, "PCL", SniffPcl, CreatePageDecoder<PclDecoder> },
+    { PrintLanguage::PclXl, "PCL XL", SniffPclXl, nullptr },
+};
+
+inline const PrintLanguageSpec& PrintLanguageInfo(PrintLanguage language) {
+    for (const PrintLanguageSpec& spec : kPrintLanguages) {
+        if (spec.language == language) return spec;
+    }
+    return kPrintLanguages[0];
+}
+
+// The language of a stream starting with head
+inline const PrintLanguageSpec& SniffPrintLanguage(std::string_view head) {
+    const PrintLanguageSpec* best = &kPrintLanguages[0];
+    int best_score = 0;
+    for (const PrintLanguageSpec& spec : kPrintLanguages) {
+        int score = spec.sniff ? spec.sniff(head) : 0;
+        if (score > best_score) {
+            best = &spec;
+            best_score = score;
+        }
+    }
+    return *best;
+}
+
+inline const PrintLanguageSpec& SniffPrintLanguage(const ByteSpanList& stream) {
+    uint8_t head[PRINT_SNIFF_BYTES];
+    size_t size = stream.CopyPrefix(head, sizeof(head));
+    return SniffPrintLanguage(std::string_view(reinterpret_cast<const char*>(head), size));
+}
@@ -0,0 +1,422 @@
+#pragma once
+
+// QR Code symbol encoder (ISO/IEC 18004) for printing GS ( k QR commands in the ESC/POS
+// emulator.
+//
+// Data is encoded in byte mode into the smallest version (1 .. 40) that holds it at the
+// requested error correction level, Reed-Solomon coded over GF(256) and interleaved per
+// the block tables of the standard, and placed with the mask that scores the lowest
+// penalty. The symbol has no quiet zone; the printer leaves that to the paper around it.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+enum class QrEcc : uint8_t { Low, Medium, Quartile, High };
+
+constexpr int QR_MIN_VERSION = 1;
+constexpr int QR_MAX_VERSION = 40;
+
+// Per error correction level and version (index 0 unused)
+const int8_t kQrEccCodewordsPerBlock[4][41] = {
+    { -1, 7, 10, 15, 20, 26, 18, 20, 24, 30, 18, 20, 24, 26, 30, 22, 24, 28, 30, 28, 28, 28, 28, 30, 30, 26, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30 },
+    { -1, 10, 16, 26, 18, 24, 16, 18, 22, 22, 26, 30, 22, 22, 24, 24, 28, 28, 26, 26, 26, 26, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28 },
+    { -1, 13, 22, 18, 26, 18, 24, 18, 22, 20, 24, 28, 26, 24, 20, 30, 24, 28, 28, 26, 30, 28, 30, 30, 30, 30, 28, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30 },
+    { -1, 17, 28, 22, 16, 22, 28, 26, 26, 24, 28, 24, 28, 22, 24, 24, 30, 28, 28, 26, 28, 30, 24, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30, 30 },
+};
+const int8_t kQrErrorCorrectionBlocks[4][41] = {
+    { -1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 4, 4, 4, 4, 4, 6, 6, 6, 6, 7, 8, 8, 9, 9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25 },
+    { -1, 1, 1, 1, 2, 2, 4, 4, 4, 5, 5, 5, 8, 9, 9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49 },
+    { -1, 1, 1, 2, 2, 4, 4, 6, 6, 8, 8, 8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68 },
+    { -1, 1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81 },
+};
+
+class QrCode {
+public:
+    // False if the data does not fit a version 40 symbol at this level
+    bool Encode(const uint8_t* data, size_t size, QrEcc ecc) {
+        int level = (int)ecc;
+        version_ = 0;
+        for (int v = QR_MIN_VERSION; v <= QR_MAX_VERSION; ++v) {
+            size_t count_bits = v < 10 ? 8 : 16;
+            if (size < ((size_t)1 << count_bits) && 4 + count_bits + size * 8 <= (size_t)DataCodewords(v, level) * 8) {
+                version_ = v;
+                break;
+            }
+        }
+        if (version_ == 0) return false;
+        size_ = version_ * 4 + 17;
+        modules_.assign((size_t)size_ * size_, 0);
+        function_.assign((size_t)size_ * size_, 0);
+
+        // Mode, count, data, terminator, then alternating pad bytes
+        std::vector<uint8_t> codewords;
+        uint32_t accumulator = 0;
+        int pending = 0;
+        auto put = [&](uint32_t value, int bits) {
+            for (int i = bits - 1; i >= 0; --i) {
+                accumulator = accumulator << 1 | ((value >> i) & 1);
+                if (++pending == 8) {
+                    codewords.push_back((uint8_t)accumulator);
+                    accumulator = 0;
+                    pending = 0;
+                }
+            }
+        };
+        size_t capacity = (size_t)DataCodewords(version_, level);
+        put(0x4, 4);
+        put((uint32_t)size, version_ < 10 ? 8 : 16);
+        for (size_t i = 0; i < size; ++i) put(data[i], 8);
+        put(0, (int)std::min<size_t>(4, capacity * 8 - (codewords.size() * 8 + pending)));
+        if (pending > 0) put(0, 8 - pending);
+        for (uint8_t pad = 0xEC; codewords.size() < capacity; pad ^= 0xEC ^ 0x11) codewords.push_back(pad);
+
+        DrawFunctionPatterns(level);
+        DrawCodewords(AddErrorCorrection(codewords, level));
+        ComputeMasks();
+
+        // The mask with the lowest penalty; format bits are part of what is scored
+        int best = 0;
+        long best_penalty = -1;
+        for (int mask = 0; mask < 8; ++mask) {
+            ApplyMask(mask);
+            DrawFormatBits(level, mask);
+            long penalty = Penalty();
+            if (best_penalty < 0 || penalty < best_penalty) {
+                best = mask;
+                best_penalty = penalty;
+            }
+            ApplyMask(mask);
+        }
+        ApplyMask(best);
+        DrawFormatBits(level, best);
+        return true;
+    }
+
+    int version() const { return version_; }
+    int size() const { return size_; }
+    bool module(int x, int y) const { return modules_[(size_t)y * size_ + x] != 0; }
+
+    static int DataCodewords(int version, int level) {
+        return RawDataModules(version) / 8 - kQrEccCodewordsPerBlock[level][version] * kQrErrorCorrectionBlocks[level][version];
+    }
+
+private:
+    static int RawDataModules(int version) {
+        int result = (16 * version + 128) * version + 64;
+        if (version >= 2) {
+            int alignments = version / 7 + 2;
+            result -= (25 * alignments - 10) * alignments - 55;
+            if (version >= 7) result -= 36;
+        }
+        return result;
+    }
+
+    std::vector<int> AlignmentPositions() const {
+        std::vector<int> positions;
+        if (version_ == 1) return positions;
+        int count = version_ / 7 + 2;
+        int step = (version_ * 8 + count * 3 + 5) / (count * 4 - 4) * 2;
+        for (int i = 0, pos = size_ - 7; i < count - 1; ++i, pos -= step) positions.insert(positions.begin(), pos);
+        positions.insert(positions.begin(), 6);
+        return positions;
+    }
+
+    void Set(int x, int y, bool dark) {
+        modules_[(size_t)y * size_ + x] = dark ? 1 : 0;
+        function_[(size_t)y * size_ + x] = 1;
+    }
+
+    void DrawFunctionPatterns(int level) {
+        for (int i = 0; i < size_; ++i) {
+            Set(6, i, i % 2 == 0);
+            Set(i, 6, i % 2 == 0);
+        }
+        for (const auto& corner : { std::pair<int, int>(3, 3), std::pair<int, int>(size_ - 4, 3), std::pair<int, int>(3, size_ - 4) }) {
+            for (int dy = -4; dy <= 4; ++dy) {
+                for (int dx = -4; dx <= 4; ++dx) {
+                    int x = corner.first + dx, y = corner.second + dy;
+                    int distance = std::max(std::abs(dx), std::abs(dy));
+                    if (x >= 0 && x < size_ && y >= 0 && y < size_) Set(x, y, distance != 2 && distance != 4);
+                }
+            }
+        }
+        std::vector<int> positions = AlignmentPositions();
+        size_t n = positions.size();
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < n; ++j) {
+                if ((i == 0 && j == 0) || (i == 0 && j == n - 1) || (i == n - 1 && j == 0)) continue; // Finder corners
+                for (int dy = -2; dy <= 2; ++dy) {
+                    for (int dx = -2; dx <= 2; ++dx) Set(positions[i] + dx, positions[j] + dy, std::max(std::abs(dx), std::abs(dy)) != 1);
+                }
+            }
+        }
+        DrawFormatBits(level, 0); // Reserves the format areas
+        if (version_ >= 7) {
+            uint32_t remainder = (uint32_t)version_;
+            for (int i = 0; i < 12; ++i) remainder = (remainder << 1) ^ ((remainder >> 11) * 0x1F25);
+            uint32_t bits = (uint32_t)version_ << 12 | remainder;
+            for (int i = 0; i < 18; ++i) {
+                bool dark = (bits >> i) & 1;
+                int a = size_ - 11 + i % 3, b = i / 3;
+                Set(a, b, dark);
+                Set(b, a, dark);
+            }
+        }
+    }
+
+    void DrawFormatBits(int level, int mask) {
+        static const int kLevelBits[4] = { 1, 0, 3, 2 };
+        uint32_t data = (uint32_t)kLevelBits[level] << 3 | (uint32_t)mask;
+        uint32_t remainder = data;
+        for (int i = 0; i < 10; ++i) remainder = (remainder << 1) ^ ((remainder >> 9) * 0x537);
+        uint32_t bits = (data << 10 | remainder) ^ 0x5412;
+        auto bit = [&](int i) { return ((bits >> i) & 1) != 0; };
+        for (int i = 0; i <= 5; ++i) Set(8, i, bit(i));
+        Set(8, 7, bit(6));
+        Set(8, 8, bit(7));
+        Set(7, 8, bit(8));
+        for (int i = 9; i < 15; ++i) Set(14 - i, 8, bit(i));
+        for (int i = 0; i < 8; ++i) Set(size_ - 1 - i, 8, bit(i));
+        for (int i = 8; i < 15; ++i) Set(8, size_ - 15 + i, bit(i));
+        Set(8, size_ - 8, true);
+    }
+
+    struct GfTables {
+        uint8_t exp[512];
+        uint8_t log[256];
+        GfTables() {
+            uint32_t x = 1;
+            for (int i = 0; i < 255; ++i) {
+                exp[i] = exp[i + 255] = (uint8_t)x;
+                log[x] = (uint8_t)i;
+                x <<= 1;
+                if (x & 0x100) x ^= 0x11D;
+            }
+            exp[510] = exp[511] = 0;
+            log[0] = 0;
+        }
+    };
+
+    static uint8_t GfMultiply(uint8_t a, uint8_t b) {
+        static const GfTables tables;
+        return a == 0 || b == 0 ? 0 : tables.exp[tables.log[a] + tables.log[b]];
+    }
+
+    // Splits the data codewords into blocks, appends each block's Reed-Solomon codewords and
+    // interleaves the result
+    std::vector<uint8_t> AddErrorCorrection(const std::vector<uint8_t>& data, int level) const {
+        int blocks = kQrErrorCorrectionBlocks[level][version_];
+        int ecc_length = kQrEccCodewordsPerBlock[level][version_];
+        int raw = RawDataModules(version_) / 8;
+        int short_blocks = blocks - raw % blocks;
+        int short_length = raw / blocks - ecc_length; // Data codewords of a short block
+
+        std::vector<uint8_t> divisor((size_t)ecc_length, 0); // Generator polynomial, leading 1 implied
+        divisor.back() = 1;
+        uint8_t root = 1;
+        for (int i = 0; i < ecc_length; ++i) {
+            for (size_t j = 0; j < divisor.size(); ++j) {
+                divisor[j] = GfMultiply(divisor[j], root);
+                if (j + 1 < divisor.size()) divisor[j] ^= divisor[j + 1];
+            }
+            root = GfMultiply(root, 0x02);
+        }
+
+        std::vector<std::vector<uint8_t>> data_blocks, ecc_blocks;
+        size_t offset = 0;
+        for (int b = 0; b < blocks; ++b) {
+            size_t length = (size_t)short_length + (b < short_blocks ? 0 : 1);
+            data_blocks.emplace_back(data.begin() + offset, data.begin() + offset + length);
+            offset += length;
+            std::vector<uint8_t> remainder((size_t)ecc_length, 0);
+            for (uint8_t value : data_blocks.back()) {
+                uint8_t factor = value ^ remainder[0];
+                remainder.erase(remainder.begin());
+                remainder.push_back(0);
+                for (size_t j = 0; j < remainder.size(); ++j) remainder[j] ^= GfMultiply(divisor[j], factor);
+            }
+            ecc_blocks.push_back(remainder);
+        }
+
+        std::vector<uint8_t> result;
+        result.reserve((size_t)raw);
+        for (int i = 0; i <= short_length; ++i) {
+            for (int b = 0; b < blocks; ++b) {
+                if (i < (int)data_blocks[b].size()) result.push_back(data_blocks[b][i]);
+            }
+        }
+        for (int i = 0; i < ecc_length; ++i) {
+            for (int b = 0; b < blocks; ++b) result.push_back(ecc_blocks[b][i]);
+        }
+        return result;
+    }
+
+    // Zigzags up and down two-module columns from the right, skipping the timing column
+    void DrawCodewords(const std::vector<uint8_t>& codewords) {
+        size_t i = 0, total = codewords.size() * 8;
+        for (int right = size_ - 1; right >= 1; right -= 2) {
+            if (right == 6) right = 5;
+            for (int vertical = 0; vertical < size_; ++vertical) {
+                for (int j = 0; j < 2; ++j) {
+                    int x = right - j;
+                    bool upward = ((right + 1) & 2) == 0;
+                    int y = upward ? size_ - 1 - vertical : vertical;
+                    size_t index = (size_t)y * size_ + x;
+                    if (!function_[index] && i < total) {
+                        modules_[index] = (codewords[i >> 3] >> (7 - (i & 7))) & 1;
+                        ++i;
+                    }
+                }
+            }
+        }
+    }
+
+    // For each data module, bit k set if mask k inverts it
+    void ComputeMasks() {
+        masks_.assign(modules_.size(), 0);
+        for (int y = 0; y < size_; ++y) {
+            int y2 = y % 2, y3 = y % 3, half = y / 2 % 2;
+            for (int x = 0, x3 = 0, third = 0; x < size_; ++x) {
+                size_t index = (size_t)y * size_ + x;
+                if (!function_[index]) {
+                    int x2 = x % 2, product3 = x3 * y3 % 3, sum3 = (x3 + y3) % 3;
+                    int product = (x2 & y2) + product3; // x * y % 2 + x * y % 3
+                    uint8_t bits = 0;
+                    bits |= (uint8_t)((x2 == y2) << 0);
+                    bits |= (uint8_t)((y2 == 0) << 1);
+                    bits |= (uint8_t)((x3 == 0) << 2);
+                    bits |= (uint8_t)((sum3 == 0) << 3);
+                    bits |= (uint8_t)(((third + half) % 2 == 0) << 4);
+                    bits |= (uint8_t)((product == 0) << 5);
+                    bits |= (uint8_t)((product % 2 == 0) << 6);
+                    bits |= (uint8_t)((((x2 ^ y2) + product3) % 2 == 0) << 7);
+                    masks_[index] = bits;
+                }
+                if (++x3 == 3) {
+                    x3 = 0;
+                    third ^= 1;
+                }
+            }
+        }
+    }
+
+    // XORs the mask pattern into the data modules; applying it twice undoes it
+    void ApplyMask(int mask) {
+        size_t i = 0, n = modules_.size();
+        for (; i + 8 <= n; i += 8) { // Bit mask of 8 mask bytes lands in the low bit of each
+            uint64_t m, k;
+            std::memcpy(&m, modules_.data() + i, 8);
+            std::memcpy(&k, masks_.data() + i, 8);
+            m ^= (k >> mask) & 0x0101010101010101ULL;
+            std::memcpy(modules_.data() + i, &m, 8);
+        }
+        for (; i < n; ++i) modules_[i] ^= (masks_[i] >> mask) & 1;
+    }
+
+    static int Popcount(uint64_t v) {
+        v = v - ((v >> 1) & 0x5555555555555555ULL);
+        v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+        v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (int)((v * 0x0101010101010101ULL) >> 56);
+    }
+
+    // 8x8 bits, bit 8r + c moved to 8c + r
+    static uint64_t Transpose8x8(uint64_t x) {
+        x = (x & 0xAA55AA55AA55AA55ULL) | ((x & 0x00AA00AA00AA00AAULL) << 7) | ((x >> 7) & 0x00AA00AA00AA00AAULL);
+        x = (x & 0xCCCC3333CCCC3333ULL) | ((x & 0x0000CCCC0000CCCCULL) << 14) | ((x >> 14) & 0x0000CCCC0000CCCCULL);
+        return (x & 0xF0F0F0F00F0F0F0FULL) | ((x & 0x00000000F0F0F0F0ULL) << 28) | ((x >> 28) & 0x00000000F0F0F0F0ULL);
+    }
+
+    // Runs of five or more, 2x2 blocks, finder-like 1:1:3:1:1 patterns and dark/light balance
+    long Penalty() {
+        int words = (size_ + 63) / 64;
+        return words == 1 ? PenaltyOf<1>() : words == 2 ? PenaltyOf<2>() : PenaltyOf<3>();
+    }
+
+    // Penalty() with the rows and columns packed into W words each, module i of a line in
+    // bit i % 64 of word i / 64. Lines are scored as bits: later[t] holds the module t
+    // places back at each position, so a run of five is five equal later[] and a finder
+    // pattern eleven that match it.
+    template <int W>
+    long PenaltyOf() {
+        int n = size_;
+        lines_.assign(2 * (size_t)n * W, 0);
+        uint64_t* rows = lines_.data();
+        uint64_t* columns = rows + (size_t)n * W;
+        for (int y = 0; y < n; ++y) {
+            const uint8_t* row = modules_.data() + (size_t)y * n;
+            uint64_t* line = rows + (size_t)y * W;
+            int x = 0;
+            for (; x + 8 <= n; x += 8) { // 8 modules of 0 or 1 into the top byte, first module lowest
+                uint64_t eight;
+                std::memcpy(&eight, row + x, 8);
+                line[x / 64] |= ((eight * 0x0102040810204080ULL) >> 56) << (x % 64);
+            }
+            for (; x < n; ++x) line[x / 64] |= (uint64_t)row[x] << (x % 64);
+        }
+        for (int y = 0; y < n; y += 8) { // Columns from the rows, 8x8 modules at a time
+            for (int x = 0; x < n; x += 8) {
+                uint64_t block = 0;
+                for (int j = 0; j < 8 && y + j < n; ++j) block |= ((rows[(size_t)(y + j) * W + x / 64] >> (x % 64)) & 0xFF) << (8 * j);
+                block = Transpose8x8(block);
+                for (int c = 0; c < 8 && x + c < n; ++c) columns[(size_t)(x + c) * W + y / 64] |= ((block >> (8 * c)) & 0xFF) << (y % 64);
+            }
+        }
+
+        const uint64_t last_word = (1ULL << (n % 64)) - 1; // Modules of the line in its last word; n is odd
+        long penalty = 0;
+        for (int l = 0; l < 2 * n; ++l) {
+            const uint64_t* line = rows + (size_t)l * W;
+            uint64_t later[11][W];
+            for (int t = 0; t < 11; ++t) {
+                for (int w = 0; w < W; ++w) later[t][w] = t == 0 ? line[w] : line[w] << t | (w > 0 ? line[w - 1] >> (64 - t) : 0);
+            }
+            uint64_t carry = 0;
+            for (int w = 0; w < W; ++w) {
+                uint64_t valid = w + 1 == W ? last_word : ~0ULL;
+                // Windows of five equal modules ending here; one that the previous position
+                // does not also end starts a run, scoring 3 for its first five and 1 for each more
+                uint64_t run = ~((later[0][w] ^ later[1][w]) | (later[1][w] ^ later[2][w]) | (later[2][w] ^ later[3][w]) |
+                                 (later[3][w] ^ later[4][w])) & valid & (w == 0 ? ~0xFULL : ~0ULL);
+                uint64_t previous = run << 1 | carry;
+                carry = run >> 63;
+                penalty += Popcount(run) + 2 * Popcount(run & ~previous);
+                // 10111010000 and 00001011101, oldest first
+                uint64_t s[11];
+                for (int t = 0; t < 11; ++t) s[t] = later[t][w];
+                uint64_t light_after = ~(s[0] | s[1] | s[2] | s[3]), light_before = ~(s[7] | s[8] | s[9] | s[10]);
+                uint64_t dark_first = s[10] & ~s[9] & s[8] & s[7] & s[6] & ~s[5] & s[4] & light_after;
+                uint64_t light_first = light_before & s[6] & ~s[5] & s[4] & s[3] & s[2] & ~s[1] & s[0];
+                penalty += 40 * Popcount((dark_first | light_first) & valid); // Never both
+            }
+        }
+        long dark = 0;
+        for (int y = 0; y < n; ++y) {
+            const uint64_t* row = rows + (size_t)y * W;
+            for (int w = 0; w < W; ++w) dark += Popcount(row[w]);
+            if (y + 1 == n) break;
+            const uint64_t* below = row + W;
+            for (int w = 0; w < W; ++w) { // Blocks with their top left module here
+                uint64_t right = row[w] >> 1 | (w + 1 < W ? row[w + 1] << 63 : 0);
+                uint64_t below_right = below[w] >> 1 | (w + 1 < W ? below[w + 1] << 63 : 0);
+                uint64_t valid = w + 1 == W ? last_word >> 1 : ~0ULL;
+                uint64_t same = ~((row[w] ^ right) | (row[w] ^ below[w]) | (row[w] ^ below_right)) & valid;
+                penalty += 3 * Popcount(same);
+            }
+        }
+        long total = (long)n * (long)n;
+        long k = (std::labs(dark * 20 - total * 10) + total - 1) / total - 1;
+        return penalty + std::max(0L, k) * 10;
+    }
+
+    int version_ = 0;
+    int size_ = 0;
+    std::vector<uint8_t> modules_;
+    std::vector<uint8_t> function_;
+    std::vector<uint8_t> masks_;
+    std::vector<uint64_t> lines_; // Penalty's packed rows and columns
+};
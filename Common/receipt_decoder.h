@@ -0,0 +1,205 @@
+#pragma once
+
+// Print data -> image decoding shared by the C++ viewer and capture_tool.
+//
+// ExtractReceiptBits() reduces a capture's client -> printer stream to the bit stream the
+// viewers lay out. Streams in another printer language (print_language.h: ZPL, EPL, PCL,
+// Star) become the labels or pages their decoder draws; ESC/POS gives the page the
+// emulator prints for streams with text, else the payload of the GS v 0 raster commands,
+// or, for data without them, everything after the job header minus the filter patterns.
+// RenderReceiptRows() expands any range of rows of that bit stream, wrapped at a given
+// width, straight into the caller's row storage (locked bitmap scanlines, a tile, a file
+// buffer), so no full-size intermediate pixel buffer is ever needed. PackReceiptRows()
+// does the same for 1-bit image files. Where the paper was cut is kept with the bits, so
+// a session of many receipts can be stepped through without another pass over the stream.
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <new>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <memory>
+
+#include "capture_reader.h"
+#include "escpos_parser.h"
+#include "escpos_emulator.h"
+#include "byte_filter.h"
+#include "bit_unpack.h"
+#include "print_language.h"
+
+// Skipped before the filter patterns are removed (ESC @, ESC a 1, ESC J 24, GS v 0 header)
+constexpr size_t RECEIPT_HEADER_SIZE = 16;
+
+// Raster block headers removed when a stream has no GS v 0 commands to parse
+const char* const DEFAULT_RECEIPT_PATTERNS[] = {
+    "1B 4A 18 1D 76 30 00 48 00 18 00",
+    "1B 4A 18 1D 76 30 00 48 00 10 00",
+};
+
+inline std::vector<BytePattern> DefaultReceiptPatterns() {
+    std::vector<BytePattern> patterns;
+    for (const char* text : DEFAULT_RECEIPT_PATTERNS) {
+        BytePattern pattern;
+        if (ParseHexPattern(text, pattern)) patterns.push_back(pattern);
+    }
+    return patterns;
+}
+
+struct ReceiptBits {
+    std::vector<uint8_t> bytes;  // The bit stream, 8 dots per byte
+    uint64_t removed = 0;        // Stream bytes that are not image data
+    EscPosRasterInfo raster;     // raster.blocks == 0: header/pattern fallback was used
+    int page_width = 0;          // > 0: an emulated text page or decoded labels, rows of this many dots
+    PrintLanguage language = PrintLanguage::EscPos;
+    std::vector<uint64_t> cuts;  // Offsets in bytes where the paper was cut, ascending
+
+    uint64_t total_bits() const { return (uint64_t)bytes.size() * 8; }
+    // Complete rows at this width; a partial last row is not shown
+    int rows(int width) const { return width > 0 ? (int)std::min<uint64_t>(total_bits() / (uint64_t)width, INT32_MAX) : 0; }
+
+    // Where each receipt of the bit stream starts: 0, then every cut with dots after it
+    std::vector<uint64_t> receipt_starts() const {
+        std::vector<uint64_t> starts(1, 0);
+        for (uint64_t cut : cuts) {
+            if (cut > starts.back() && cut < bytes.size()) starts.push_back(cut);
+        }
+        if (starts.size() > 1 && std::all_of(bytes.begin() + (ptrdiff_t)starts.back(), bytes.end(), [](uint8_t b) { return b == 0; })) {
+            starts.pop_back(); // Only feeds after the last cut
+        }
+        return starts;
+    }
+};
+
+// Emulated cuts as offsets past their dashed line. As in ReceiptSplitter, a cut with
+// nothing printed since the previous one (or since the start) ends no receipt of its own.
+inline std::vector<uint64_t> EmulatedCutOffsets(const std::vector<int>& cut_rows, const std::vector<uint8_t>& page, int page_width) {
+    size_t row_bytes = (size_t)page_width / 8;
+    std::vector<uint64_t> cuts;
+    size_t begin = 0; // Of the part since the last cut
+    for (int row : cut_rows) {
+        size_t line = (size_t)row * row_bytes;
+        if (line + row_bytes > page.size()) break;
+        bool blank = std::all_of(page.begin() + begin, page.begin() + line, [](uint8_t b) { return b == 0; });
+        if (!blank) cuts.push_back(line + row_bytes);
+        else if (!cuts.empty()) cuts.back() = line + row_bytes;
+        begin = line + row_bytes;
+    }
+    return cuts;
+}
+
+// Returns false with error set when the stream cannot hold an image
+inline bool ExtractReceiptBits(const ByteSpanList& stream, const BytePatternFilter& filter, ReceiptBits& out, std::string& error) {
+    out = ReceiptBits();
+    try {
+        const PrintLanguageSpec& language = SniffPrintLanguage(stream);
+        out.language = language.language;
+        if (language.language != PrintLanguage::EscPos) {
+            if (!language.create) {
+                error = std::string(language.name) + " print data cannot be decoded.";
+                return false;
+            }
+            std::unique_ptr<PageDecoder> decoder = language.create();
+            for (const ByteSpan& segment : stream.segments) decoder->Feed(segment.data, segment.size);
+            decoder->Finish();
+            out.bytes = decoder->TakePage();
+            out.page_width = decoder->width();
+            out.cuts = decoder->cuts();
+            out.removed = stream.size - decoder->image_bytes();
+            return true;
+        }
+        out.raster = ForEachEscPosRaster(stream, [&](const uint8_t* data, size_t size) {
+            out.bytes.insert(out.bytes.end(), data, data + size);
+        });
+        if (EscPosLooksLikeText(out.raster)) {
+            EscPosEmulator emulator;
+            for (const ByteSpan& segment : stream.segments) emulator.Feed(segment.data, segment.size);
+            emulator.Finish();
+            out.bytes = emulator.TakePage();
+            out.page_width = emulator.width();
+            out.cuts = EmulatedCutOffsets(emulator.cuts(), out.bytes, out.page_width);
+            out.removed = stream.size - out.raster.bytes;
+            return true;
+        }
+        if (out.raster.blocks > 0) {
+            out.cuts = out.raster.cuts;
+            out.removed = stream.size - out.raster.bytes;
+            out.bytes.shrink_to_fit();
+            return true;
+        }
+
+        if (stream.size < RECEIPT_HEADER_SIZE) {
+            error = "File is smaller than header size.";
+            return false;
+        }
+        ByteSpanList pixel_stream = stream.Skip(RECEIPT_HEADER_SIZE);
+        out.bytes.clear();
+        out.bytes.reserve((size_t)pixel_stream.size);
+        for (const ByteSpan& segment : pixel_stream.segments) out.bytes.insert(out.bytes.end(), segment.begin(), segment.end());
+    } catch (const std::bad_alloc&) {
+        error = "Failed to allocate memory for pixel data.";
+        return false;
+    }
+    size_t kept = filter.Remove(out.bytes.data(), out.bytes.size());
+    out.removed = out.bytes.size() - kept;
+    out.bytes.resize(kept);
+    return true;
+}
+
+// Writes rows [first_row, first_row + row_count) at the given width as 32-bit ARGB;
+// row r goes to dst + r * stride (stride in bytes, may be negative for bottom-up DIBs).
+// Rows past bits.rows(width) are not written.
+inline void RenderReceiptRows(const ReceiptBits& bits, int width, bool msb_first, bool invert,
+                              int first_row, int row_count, uint8_t* dst, ptrdiff_t stride) {
+    row_count = std::max(0, std::min(row_count, bits.rows(width) - first_row));
+    UnpackKernel kernel = UnpackSelectedKernel();
+    for (int r = 0; r < row_count; ++r) {
+        uint64_t bit_offset = (uint64_t)(first_row + r) * (uint64_t)width;
+        UnpackBits(msb_first, invert, bits.bytes.data(), bit_offset, (size_t)width, reinterpret_cast<uint32_t*>(dst + r * stride), kernel);
+    }
+}
+
+// Writes rows [first_row, first_row + row_count) at the given width as packed 1-bit rows,
+// leftmost dot in the top bit and 1 = printed dot (PBM; invert for PNG grayscale), each
+// padded with zero bits to a whole byte; row r goes to dst + r * stride. Rows past
+// bits.rows(width) are not written.
+inline void PackReceiptRows(const ReceiptBits& bits, int width, bool msb_first, bool invert,
+                            int first_row, int row_count, uint8_t* dst, size_t stride) {
+    static const auto reversed = [] {
+        std::array<uint8_t, 256> table{};
+        for (int b = 0; b < 256; ++b) {
+            for (int i = 0; i < 8; ++i) table[b] |= (uint8_t)(((b >> i) & 1) << (7 - i));
+        }
+        return table;
+    }();
+    row_count = std::max(0, std::min(row_count, bits.rows(width) - first_row));
+    const uint8_t* src = bits.bytes.data();
+    size_t src_size = bits.bytes.size();
+    size_t row_bytes = ((size_t)width + 7) / 8;
+    uint8_t flip = invert ? 0xFF : 0x00;
+    uint8_t last_mask = (uint8_t)(0xFF << ((8 - width % 8) % 8));
+    auto byte_at = [&](size_t i) -> uint8_t { // In MSB-first order; zero past the end
+        if (i >= src_size) return 0;
+        return msb_first ? src[i] : reversed[src[i]];
+    };
+    for (int r = 0; r < row_count; ++r) {
+        uint64_t bit_offset = (uint64_t)(first_row + r) * (uint64_t)width;
+        size_t byte = (size_t)(bit_offset / 8);
+        unsigned shift = (unsigned)(bit_offset % 8);
+        uint8_t* out = dst + (size_t)r * stride;
+        if (shift == 0 && msb_first) {
+            std::memcpy(out, src + byte, row_bytes);
+            if (flip) for (size_t k = 0; k < row_bytes; ++k) out[k] ^= flip;
+        } else {
+            uint8_t current = byte_at(byte);
+            for (size_t k = 0; k < row_bytes; ++k) {
+                uint8_t next = byte_at(byte + k + 1);
+                out[k] = (uint8_t)(((current << shift) | (shift ? next >> (8 - shift) : 0)) ^ flip);
+                current = next;
+            }
+        }
+        out[row_bytes - 1] &= last_mask;
+    }
+}
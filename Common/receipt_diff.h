@@ -0,0 +1,376 @@
+#pragma once
+
+// Visual comparison of two decoded receipts, such as the same job printed before and after
+// a driver update.
+//
+// Each receipt is packed into whole rows (PackReceiptRows) at its own width, both padded
+// with blank paper to the same row size, so whatever their widths and bit orders a row of
+// one is compared with a row of the other by AND, AND NOT and population counts: 32 bytes
+// at a time with AVX2 (a nibble table looked up with a byte shuffle) where available, else
+// 8 with a 64-bit SWAR count. Rows are padded to a multiple of 32 bytes so neither kernel
+// has a tail.
+//
+// The second receipt may start lower or higher on the paper than the first (a longer
+// header, a logo added or removed). FindReceiptShift looks for that vertical shift within
+// a limit: the rows' dot counts, which a horizontal move leaves alone, are compared at
+// every shift (a pass over two arrays of counts, 8 rows at a time with AVX2), and the few
+// best shifts are then compared dot by dot. Rows only one of the receipts has count as changed.
+//
+// The result counts dots printed by both, by the first only (removed) and by the second
+// only (added); the similarity is the share of printed dots that both printed, 1 for
+// identical receipts. WriteReceiptDiffPng draws the comparison as a 2-bit palette PNG:
+// dots both printed in gray, removed ones in red and added ones in blue.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+#include "bit_unpack.h"
+#include "png_writer.h"
+#include "receipt_decoder.h"
+
+constexpr size_t DIFF_ROW_ALIGN = 32;        // Packed rows are a multiple of this many bytes
+constexpr int DIFF_SHIFT_CANDIDATES = 4;     // Best shifts by dot counts that are compared dot by dot
+constexpr int DIFF_BAND_GAP = 16;            // Changed rows closer than this form one band
+constexpr int DIFF_PNG_BAND_ROWS = 256;
+
+// Diff image palette: neither, removed, added, both
+const std::vector<uint32_t> kDiffPalette = { 0xFFFFFF, 0xE00000, 0x0050FF, 0xA0A0A0 };
+
+// A receipt's rows packed for comparison: leftmost dot in the top bit, 1 = printed, zero
+// padded to row_bytes
+struct PackedReceipt {
+    int width = 0;
+    int rows = 0;
+    size_t row_bytes = 0;
+    std::vector<uint8_t> data;
+
+    const uint8_t* row(int r) const { return data.data() + (size_t)r * row_bytes; }
+};
+
+// Row bytes that hold either of two widths
+inline size_t DiffRowBytes(int width_a, int width_b) {
+    size_t bytes = ((size_t)std::max(width_a, width_b) + 7) / 8;
+    return (bytes + DIFF_ROW_ALIGN - 1) / DIFF_ROW_ALIGN * DIFF_ROW_ALIGN;
+}
+
+inline PackedReceipt PackReceipt(const ReceiptBits& bits, int width, bool msb_first, size_t row_bytes) {
+    PackedReceipt packed;
+    packed.width = width;
+    packed.rows = bits.rows(width);
+    packed.row_bytes = row_bytes;
+    packed.data.assign((size_t)packed.rows * row_bytes, 0);
+    if (packed.rows > 0) PackReceiptRows(bits, width, msb_first, false, 0, packed.rows, packed.data.data(), row_bytes);
+    return packed;
+}
+
+struct DiffCounts {
+    uint64_t both = 0;     // Dots printed by both receipts
+    uint64_t removed = 0;  // By the first only
+    uint64_t added = 0;    // By the second only
+
+    uint64_t changed() const { return removed + added; }
+    DiffCounts& operator+=(const DiffCounts& other) {
+        both += other.both;
+        removed += other.removed;
+        added += other.added;
+        return *this;
+    }
+};
+
+// --- Row kernels: counts of a row pair, bytes a multiple of DIFF_ROW_ALIGN ---
+
+inline uint64_t DiffPopcount64(uint64_t v) {
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (v * 0x0101010101010101ULL) >> 56;
+}
+
+inline DiffCounts DiffRowScalar(const uint8_t* a, const uint8_t* b, size_t bytes) {
+    DiffCounts counts;
+    for (size_t i = 0; i < bytes; i += 8) {
+        uint64_t x, y;
+        std::memcpy(&x, a + i, 8);
+        std::memcpy(&y, b + i, 8);
+        if ((x | y) == 0) continue; // Blank paper, most of a receipt
+        counts.both += DiffPopcount64(x & y);
+        counts.removed += DiffPopcount64(x & ~y);
+        counts.added += DiffPopcount64(y & ~x);
+    }
+    return counts;
+}
+
+// Sum of |x[i] - z[i]|: the distance of two runs of row dot counts
+inline uint64_t DiffProfileScalar(const int32_t* x, const int32_t* z, size_t n) {
+    uint64_t distance = 0;
+    for (size_t i = 0; i < n; ++i) distance += (uint32_t)std::abs(x[i] - z[i]);
+    return distance;
+}
+
+#if defined(BIT_UNPACK_X86)
+// Set bits of each byte of v
+BIT_UNPACK_TARGET_AVX2 inline __m256i DiffPopcountBytesAvx2(__m256i v) {
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    __m256i lo = _mm256_shuffle_epi8(table, _mm256_and_si256(v, low));
+    __m256i hi = _mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(v, 4), low));
+    return _mm256_add_epi8(lo, hi);
+}
+
+BIT_UNPACK_TARGET_AVX2 inline uint64_t DiffSumAvx2(__m256i v) {
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+BIT_UNPACK_TARGET_AVX2 inline DiffCounts DiffRowAvx2(const uint8_t* a, const uint8_t* b, size_t bytes) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i both = zero, removed = zero, added = zero; // 64-bit lane sums
+    for (size_t i = 0; i < bytes;) {
+        // Byte counts reach at most 8 per block, so 31 blocks fit in a byte before summing
+        __m256i both8 = zero, removed8 = zero, added8 = zero;
+        size_t end = std::min(bytes, i + 31 * DIFF_ROW_ALIGN);
+        for (; i < end; i += DIFF_ROW_ALIGN) {
+            __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            both8 = _mm256_add_epi8(both8, DiffPopcountBytesAvx2(_mm256_and_si256(x, y)));
+            removed8 = _mm256_add_epi8(removed8, DiffPopcountBytesAvx2(_mm256_andnot_si256(y, x)));
+            added8 = _mm256_add_epi8(added8, DiffPopcountBytesAvx2(_mm256_andnot_si256(x, y)));
+        }
+        both = _mm256_add_epi64(both, _mm256_sad_epu8(both8, zero));
+        removed = _mm256_add_epi64(removed, _mm256_sad_epu8(removed8, zero));
+        added = _mm256_add_epi64(added, _mm256_sad_epu8(added8, zero));
+    }
+    DiffCounts counts;
+    counts.both = DiffSumAvx2(both);
+    counts.removed = DiffSumAvx2(removed);
+    counts.added = DiffSumAvx2(added);
+    return counts;
+}
+
+BIT_UNPACK_TARGET_AVX2 inline uint64_t DiffProfileAvx2(const int32_t* x, const int32_t* z, size_t n) {
+    __m256i sum = _mm256_setzero_si256(); // 64-bit lanes
+    size_t i = 0;
+    while (i + 8 <= n) {
+        // A row holds at most 65535 dots, so 32-bit lanes take 32768 of them before widening
+        __m256i sum32 = _mm256_setzero_si256();
+        size_t end = std::min(n & ~(size_t)7, i + 8 * 32768);
+        for (; i < end; i += 8) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(z + i));
+            sum32 = _mm256_add_epi32(sum32, _mm256_abs_epi32(_mm256_sub_epi32(a, b)));
+        }
+        sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(sum32)));
+        sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(sum32, 1)));
+    }
+    return DiffSumAvx2(sum) + DiffProfileScalar(x + i, z + i, n - i);
+}
+#endif
+
+enum class DiffKernel { Scalar, Avx2 };
+
+inline const char* DiffKernelName(DiffKernel kernel) {
+    return kernel == DiffKernel::Avx2 ? "avx2" : "scalar";
+}
+
+inline bool DiffKernelSupported(DiffKernel kernel) {
+#if defined(BIT_UNPACK_X86)
+    if (kernel == DiffKernel::Avx2) return UnpackAvx2Supported();
+#else
+    if (kernel != DiffKernel::Scalar) return false;
+#endif
+    return true;
+}
+
+inline DiffKernel DiffSelectedKernel() {
+    static const DiffKernel selected = DiffKernelSupported(DiffKernel::Avx2) ? DiffKernel::Avx2 : DiffKernel::Scalar;
+    return selected;
+}
+
+inline DiffCounts DiffRow(DiffKernel kernel, const uint8_t* a, const uint8_t* b, size_t bytes) {
+#if defined(BIT_UNPACK_X86)
+    if (kernel == DiffKernel::Avx2) return DiffRowAvx2(a, b, bytes);
+#endif
+    return DiffRowScalar(a, b, bytes);
+}
+
+inline uint64_t DiffProfile(DiffKernel kernel, const int32_t* x, const int32_t* z, size_t n) {
+#if defined(BIT_UNPACK_X86)
+    if (kernel == DiffKernel::Avx2) return DiffProfileAvx2(x, z, n);
+#endif
+    return DiffProfileScalar(x, z, n);
+}
+
+// --- Comparison ---
+
+struct ReceiptDiff {
+    int shift = 0;             // Rows the second receipt is moved down to line up with the first
+    int width = 0;             // The wider receipt's
+    int rows = 0;              // Spanned by both receipts once lined up
+    int top = 0;               // The first receipt's row at comparison row 0: min(0, shift)
+    DiffCounts total;
+    std::vector<DiffCounts> row_counts; // Per comparison row
+    int changed_rows = 0;
+    std::vector<std::pair<int, int>> bands; // Comparison rows [first, end) with changes, DIFF_BAND_GAP apart at least
+
+    // Share of the printed dots that both receipts printed; 1 when neither printed anything
+    double similarity() const {
+        uint64_t printed = total.both + total.changed();
+        return printed > 0 ? (double)total.both / (double)printed : 1.0;
+    }
+    // The receipts' rows at a comparison row; out of range where that receipt has none
+    int row_a(int y) const { return y + top; }
+    int row_b(int y) const { return y + top - shift; }
+};
+
+// Compares a with b moved down by shift rows (a and b with the same row_bytes)
+inline ReceiptDiff DiffPackedReceipts(const PackedReceipt& a, const PackedReceipt& b, int shift, DiffKernel kernel = DiffSelectedKernel()) {
+    ReceiptDiff diff;
+    diff.shift = shift;
+    diff.width = std::max(a.width, b.width);
+    diff.top = std::min(0, shift);
+    diff.rows = std::max(a.rows, b.rows + shift) - diff.top;
+    diff.row_counts.resize((size_t)std::max(diff.rows, 0));
+    const std::vector<uint8_t> blank(a.row_bytes, 0);
+    for (int y = 0; y < diff.rows; ++y) {
+        int ra = diff.row_a(y), rb = diff.row_b(y);
+        const uint8_t* pa = ra >= 0 && ra < a.rows ? a.row(ra) : blank.data();
+        const uint8_t* pb = rb >= 0 && rb < b.rows ? b.row(rb) : blank.data();
+        DiffCounts counts = DiffRow(kernel, pa, pb, a.row_bytes);
+        diff.row_counts[(size_t)y] = counts;
+        diff.total += counts;
+        if (counts.changed() == 0) continue;
+        diff.changed_rows++;
+        if (!diff.bands.empty() && y - diff.bands.back().second < DIFF_BAND_GAP) diff.bands.back().second = y + 1;
+        else diff.bands.push_back({ y, y + 1 });
+    }
+    return diff;
+}
+
+// Changed dots of a against b moved down by shift, stopping once past limit
+inline uint64_t DiffChangedDots(const PackedReceipt& a, const PackedReceipt& b, int shift, uint64_t limit, DiffKernel kernel) {
+    const std::vector<uint8_t> blank(a.row_bytes, 0);
+    int top = std::min(0, shift), end = std::max(a.rows, b.rows + shift);
+    uint64_t changed = 0;
+    for (int y = top; y < end && changed <= limit; ++y) {
+        int rb = y - shift;
+        const uint8_t* pa = y >= 0 && y < a.rows ? a.row(y) : blank.data();
+        const uint8_t* pb = rb >= 0 && rb < b.rows ? b.row(rb) : blank.data();
+        changed += DiffRow(kernel, pa, pb, a.row_bytes).changed();
+    }
+    return changed;
+}
+
+// The shift in [-max_shift, max_shift] that lines b up with a best (0 on a tie)
+inline int FindReceiptShift(const PackedReceipt& a, const PackedReceipt& b, int max_shift, DiffKernel kernel = DiffSelectedKernel()) {
+    if (max_shift <= 0 || a.rows == 0 || b.rows == 0) return 0;
+    max_shift = std::min(max_shift, std::max(a.rows, b.rows));
+    const std::vector<uint8_t> blank(a.row_bytes, 0);
+    std::vector<int32_t> ink_a((size_t)a.rows), ink_b((size_t)b.rows);
+    std::vector<uint64_t> sum_a((size_t)a.rows + 1, 0), sum_b((size_t)b.rows + 1, 0); // Dots of the rows before each
+    for (int r = 0; r < a.rows; ++r) {
+        ink_a[(size_t)r] = (int32_t)DiffRow(kernel, a.row(r), blank.data(), a.row_bytes).removed;
+        sum_a[(size_t)r + 1] = sum_a[(size_t)r] + (uint64_t)ink_a[(size_t)r];
+    }
+    for (int r = 0; r < b.rows; ++r) {
+        ink_b[(size_t)r] = (int32_t)DiffRow(kernel, b.row(r), blank.data(), b.row_bytes).removed;
+        sum_b[(size_t)r + 1] = sum_b[(size_t)r] + (uint64_t)ink_b[(size_t)r];
+    }
+
+    // Profile distance at each shift: rows both have, plus the dots of rows only one has
+    std::vector<std::pair<uint64_t, int>> costs;
+    costs.reserve((size_t)max_shift * 2 + 1);
+    for (int shift = -max_shift; shift <= max_shift; ++shift) {
+        int first = std::max(0, shift), last = std::min(a.rows, b.rows + shift); // Rows of a that meet rows of b
+        uint64_t cost = sum_a[(size_t)a.rows] + sum_b[(size_t)b.rows];
+        if (first < last) {
+            uint64_t distance = DiffProfile(kernel, ink_a.data() + first, ink_b.data() + (first - shift), (size_t)(last - first));
+            cost += distance - (sum_a[(size_t)last] - sum_a[(size_t)first]) - (sum_b[(size_t)(last - shift)] - sum_b[(size_t)(first - shift)]);
+        }
+        costs.push_back({ cost, shift });
+    }
+    size_t candidates = std::min<size_t>(DIFF_SHIFT_CANDIDATES, costs.size());
+    std::partial_sort(costs.begin(), costs.begin() + (ptrdiff_t)candidates, costs.end(), [](const auto& x, const auto& y) {
+        return x.first != y.first ? x.first < y.first : std::abs(x.second) < std::abs(y.second);
+    });
+
+    // Dot by dot for the candidates, best first so the others stop early, and no shift at all
+    std::vector<int> shifts;
+    for (size_t i = 0; i < candidates; ++i) shifts.push_back(costs[i].second);
+    if (std::find(shifts.begin(), shifts.end(), 0) == shifts.end()) shifts.push_back(0);
+    int best = 0;
+    uint64_t best_changed = UINT64_MAX;
+    for (int shift : shifts) {
+        uint64_t changed = DiffChangedDots(a, b, shift, best_changed, kernel);
+        if (changed < best_changed || (changed == best_changed && std::abs(shift) < std::abs(best))) {
+            best = shift;
+            best_changed = changed;
+        }
+        if (best_changed == 0) break;
+    }
+    return best;
+}
+
+// Packs both receipts, finds the shift (within max_shift; 0: none) and compares them
+inline ReceiptDiff CompareReceipts(const ReceiptBits& a, int width_a, const ReceiptBits& b, int width_b, bool msb_first, int max_shift,
+                                   DiffKernel kernel = DiffSelectedKernel()) {
+    size_t row_bytes = DiffRowBytes(width_a, width_b);
+    PackedReceipt packed_a = PackReceipt(a, width_a, msb_first, row_bytes);
+    PackedReceipt packed_b = PackReceipt(b, width_b, msb_first, row_bytes);
+    return DiffPackedReceipts(packed_a, packed_b, FindReceiptShift(packed_a, packed_b, max_shift, kernel), kernel);
+}
+
+// Writes the comparison of a and b as a 2-bit image with kDiffPalette, a band of rows at a time
+inline bool WriteReceiptDiffPng(const std::filesystem::path& path, const PackedReceipt& a, const PackedReceipt& b, const ReceiptDiff& diff,
+                                std::string& error) {
+    if (diff.rows <= 0 || diff.width <= 0) {
+        error = "Nothing to compare.";
+        return false;
+    }
+    static const auto spread = [] { // Bit i of a byte to bit 2i: a dot to the low bit of its 2-bit pixel
+        std::vector<uint16_t> table(256, 0);
+        for (int v = 0; v < 256; ++v) {
+            for (int i = 0; i < 8; ++i) table[(size_t)v] |= (uint16_t)(((v >> i) & 1) << (2 * i));
+        }
+        return table;
+    }();
+    PngWriter png;
+    if (!png.OpenIndexed(path, diff.width, diff.rows, 2, kDiffPalette)) {
+        error = "Cannot create the PNG file.";
+        return false;
+    }
+    const size_t out_bytes = png.row_bytes();
+    const size_t in_bytes = (out_bytes + 1) / 2;
+    const std::vector<uint8_t> blank(a.row_bytes, 0);
+    std::vector<uint8_t> band(out_bytes * DIFF_PNG_BAND_ROWS + 1);
+    for (int first = 0; first < diff.rows; first += DIFF_PNG_BAND_ROWS) {
+        int count = std::min(DIFF_PNG_BAND_ROWS, diff.rows - first);
+        for (int r = 0; r < count; ++r) {
+            int y = first + r, ra = diff.row_a(y), rb = diff.row_b(y);
+            const uint8_t* pa = ra >= 0 && ra < a.rows ? a.row(ra) : blank.data();
+            const uint8_t* pb = rb >= 0 && rb < b.rows ? b.row(rb) : blank.data();
+            uint8_t* out = band.data() + (size_t)r * out_bytes;
+            for (size_t k = 0; k < in_bytes; ++k) {
+                uint16_t pixels = (uint16_t)(spread[pa[k]] | spread[pb[k]] << 1); // Index: removed 1, added 2, both 3
+                out[2 * k] = (uint8_t)(pixels >> 8);
+                out[2 * k + 1] = (uint8_t)pixels; // Past the row when the width ends in its first half; the next row overwrites it
+            }
+        }
+        if (!png.WriteRows(band.data(), out_bytes, count)) {
+            error = "Failed to write the PNG file.";
+            return false;
+        }
+    }
+    if (!png.Close()) {
+        error = "Failed to write the PNG file.";
+        return false;
+    }
+    return true;
+}
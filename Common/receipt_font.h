@@ -0,0 +1,243 @@
+#pragma once
+
+// Built-in printer font for the ESC/POS emulator, pre-rendered per character style.
+//
+// The glyphs are the public domain 8x8 PC font (printable ASCII; bit 0 = leftmost dot), so
+// no font files or GDI are needed. They are scaled to the cells of the printer's two
+// fonts, Font A 12x24 and Font B 9x17 dots, and then to the style: emphasis (each dot also
+// printed one dot to the right), underline, reverse and the width/height multipliers of
+// GS !. A GlyphSet holds all characters of one style as ready-to-blit 1-bit rows;
+// ReceiptGlyphCache builds each style once per process, on first use, and is shared by all
+// threads without locking. Characters outside printable ASCII print as '?'.
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+constexpr int FONT_FIRST_CHAR = 0x20;
+constexpr int FONT_CHAR_COUNT = 95;        // 0x20 .. 0x7E
+constexpr int FONT_FALLBACK_CHAR = '?';
+constexpr int FONT_MAX_SCALE = 8;          // GS ! multipliers
+constexpr int FONT_A_WIDTH = 12, FONT_A_HEIGHT = 24;
+constexpr int FONT_B_WIDTH = 9, FONT_B_HEIGHT = 17;
+
+const uint8_t kFont8x8[FONT_CHAR_COUNT][8] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ' '
+    { 0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00 }, // '!'
+    { 0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '"'
+    { 0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00 }, // '#'
+    { 0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00 }, // '$'
+    { 0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00 }, // '%'
+    { 0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00 }, // '&'
+    { 0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '''
+    { 0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00 }, // '('
+    { 0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00 }, // ')'
+    { 0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00 }, // '*'
+    { 0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00 }, // '+'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ','
+    { 0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00 }, // '-'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // '.'
+    { 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00 }, // '/'
+    { 0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00 }, // '0'
+    { 0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00 }, // '1'
+    { 0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00 }, // '2'
+    { 0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00 }, // '3'
+    { 0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00 }, // '4'
+    { 0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00 }, // '5'
+    { 0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00 }, // '6'
+    { 0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00 }, // '7'
+    { 0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00 }, // '8'
+    { 0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00 }, // '9'
+    { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // ':'
+    { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ';'
+    { 0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00 }, // '<'
+    { 0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00 }, // '='
+    { 0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00 }, // '>'
+    { 0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00 }, // '?'
+    { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00 }, // '@'
+    { 0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00 }, // 'A'
+    { 0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00 }, // 'B'
+    { 0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00 }, // 'C'
+    { 0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00 }, // 'D'
+    { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00 }, // 'E'
+    { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00 }, // 'F'
+    { 0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00 }, // 'G'
+    { 0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00 }, // 'H'
+    { 0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'I'
+    { 0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00 }, // 'J'
+    { 0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00 }, // 'K'
+    { 0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00 }, // 'L'
+    { 0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00 }, // 'M'
+    { 0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00 }, // 'N'
+    { 0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00 }, // 'O'
+    { 0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00 }, // 'P'
+    { 0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00 }, // 'Q'
+    { 0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00 }, // 'R'
+    { 0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00 }, // 'S'
+    { 0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'T'
+    { 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00 }, // 'U'
+    { 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // 'V'
+    { 0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00 }, // 'W'
+    { 0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00 }, // 'X'
+    { 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00 }, // 'Y'
+    { 0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00 }, // 'Z'
+    { 0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00 }, // '['
+    { 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00 }, // '\'
+    { 0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00 }, // ']'
+    { 0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00 }, // '^'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF }, // '_'
+    { 0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '`'
+    { 0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00 }, // 'a'
+    { 0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00 }, // 'b'
+    { 0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00 }, // 'c'
+    { 0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00 }, // 'd'
+    { 0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00 }, // 'e'
+    { 0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00 }, // 'f'
+    { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // 'g'
+    { 0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00 }, // 'h'
+    { 0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'i'
+    { 0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E }, // 'j'
+    { 0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00 }, // 'k'
+    { 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // 'l'
+    { 0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00 }, // 'm'
+    { 0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00 }, // 'n'
+    { 0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00 }, // 'o'
+    { 0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F }, // 'p'
+    { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78 }, // 'q'
+    { 0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00 }, // 'r'
+    { 0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00 }, // 's'
+    { 0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00 }, // 't'
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00 }, // 'u'
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // 'v'
+    { 0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00 }, // 'w'
+    { 0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00 }, // 'x'
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // 'y'
+    { 0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00 }, // 'z'
+    { 0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00 }, // '{'
+    { 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00 }, // '|'
+    { 0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00 }, // '}'
+    { 0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '~'
+};
+
+// ORs dots [0, count) of src (MSB = first dot) into dst from dot x on. Bytes of dst past the
+// last dot written are not touched.
+inline void OrDots(uint8_t* dst, size_t x, const uint8_t* src, size_t count) {
+    if (count == 0) return;
+    uint8_t* d = dst + x / 8;
+    unsigned shift = (unsigned)(x % 8);
+    size_t bytes = (count + 7) / 8;
+    uint8_t last_mask = (uint8_t)(0xFF << ((8 - count % 8) % 8));
+    for (size_t k = 0; k < bytes; ++k) {
+        uint8_t b = k + 1 == bytes ? (uint8_t)(src[k] & last_mask) : src[k];
+        d[k] |= (uint8_t)(b >> shift);
+        if (shift != 0) {
+            if (uint8_t spill = (uint8_t)(b << (8 - shift))) d[k + 1] |= spill;
+        }
+    }
+}
+
+struct ReceiptFontStyle {
+    bool font_b = false;
+    bool emphasized = false;
+    uint8_t underline = 0;     // Dots, 0 .. 2
+    bool reverse = false;
+    uint8_t width_scale = 1;   // 1 .. FONT_MAX_SCALE
+    uint8_t height_scale = 1;
+
+    static constexpr size_t COUNT = 2 * 2 * 3 * 2 * FONT_MAX_SCALE * FONT_MAX_SCALE;
+
+    size_t index() const {
+        size_t i = font_b ? 1 : 0;
+        i = i * 2 + (emphasized ? 1 : 0);
+        i = i * 3 + std::min<uint8_t>(underline, 2);
+        i = i * 2 + (reverse ? 1 : 0);
+        i = i * FONT_MAX_SCALE + (size_t)(std::clamp<int>(width_scale, 1, FONT_MAX_SCALE) - 1);
+        return i * FONT_MAX_SCALE + (size_t)(std::clamp<int>(height_scale, 1, FONT_MAX_SCALE) - 1);
+    }
+    int cell_width() const { return (font_b ? FONT_B_WIDTH : FONT_A_WIDTH) * width_scale; }
+    int cell_height() const { return (font_b ? FONT_B_HEIGHT : FONT_A_HEIGHT) * height_scale; }
+};
+
+// All characters of one style: glyph c is rows() rows of row_bytes() bytes at glyph(c)
+class GlyphSet {
+public:
+    explicit GlyphSet(const ReceiptFontStyle& style) : width_(style.cell_width()), height_(style.cell_height()) {
+        row_bytes_ = ((size_t)width_ + 7) / 8;
+        bits_.assign(FONT_CHAR_COUNT * glyph_size(), 0);
+        int base_width = style.font_b ? FONT_B_WIDTH : FONT_A_WIDTH;
+        int base_height = style.font_b ? FONT_B_HEIGHT : FONT_A_HEIGHT;
+        std::vector<uint8_t> cell((size_t)base_width * base_height);
+        for (int c = 0; c < FONT_CHAR_COUNT; ++c) {
+            // The 8x8 glyph stretched to the base cell, then emphasis and underline
+            for (int y = 0; y < base_height; ++y) {
+                uint8_t source = kFont8x8[c][y * 8 / base_height];
+                for (int x = 0; x < base_width; ++x) cell[(size_t)y * base_width + x] = (source >> (x * 8 / base_width)) & 1;
+            }
+            if (style.emphasized) {
+                for (int y = 0; y < base_height; ++y) {
+                    for (int x = base_width - 1; x > 0; --x) cell[(size_t)y * base_width + x] |= cell[(size_t)y * base_width + x - 1];
+                }
+            }
+            for (int y = base_height - std::min<int>(style.underline, 2); y < base_height; ++y) {
+                std::fill(cell.begin() + (size_t)y * base_width, cell.begin() + (size_t)(y + 1) * base_width, 1);
+            }
+
+            uint8_t* out = bits_.data() + (size_t)c * glyph_size();
+            for (int y = 0; y < height_; ++y) {
+                const uint8_t* source = cell.data() + (size_t)(y / style.height_scale) * base_width;
+                uint8_t* row = out + (size_t)y * row_bytes_;
+                for (int x = 0; x < width_; ++x) {
+                    if (source[x / style.width_scale] != (style.reverse ? 1 : 0)) row[x / 8] |= (uint8_t)(0x80 >> (x % 8));
+                }
+            }
+        }
+    }
+
+    const uint8_t* glyph(uint8_t c) const {
+        int index = c >= FONT_FIRST_CHAR && c < FONT_FIRST_CHAR + FONT_CHAR_COUNT ? c - FONT_FIRST_CHAR : FONT_FALLBACK_CHAR - FONT_FIRST_CHAR;
+        return bits_.data() + (size_t)index * glyph_size();
+    }
+    int width() const { return width_; }
+    int rows() const { return height_; }
+    size_t row_bytes() const { return row_bytes_; }
+
+private:
+    size_t glyph_size() const { return row_bytes_ * (size_t)height_; }
+
+    int width_;
+    int height_;
+    size_t row_bytes_;
+    std::vector<uint8_t> bits_;
+};
+
+class ReceiptGlyphCache {
+public:
+    static ReceiptGlyphCache& Shared() {
+        static ReceiptGlyphCache cache;
+        return cache;
+    }
+
+    // Built on first use; threads racing on a new style each build it and one copy is kept
+    const GlyphSet& Get(const ReceiptFontStyle& style) {
+        std::atomic<const GlyphSet*>& slot = sets_[style.index()];
+        if (const GlyphSet* set = slot.load(std::memory_order_acquire)) return *set;
+        auto built = std::make_unique<GlyphSet>(style);
+        const GlyphSet* expected = nullptr;
+        if (slot.compare_exchange_strong(expected, built.get(), std::memory_order_acq_rel)) return *built.release();
+        return *expected;
+    }
+
+    ~ReceiptGlyphCache() {
+        for (auto& slot : sets_) delete slot.load();
+    }
+
+private:
+    ReceiptGlyphCache() {
+        for (auto& slot : sets_) slot.store(nullptr);
+    }
+
+    std::atomic<const GlyphSet*> sets_[ReceiptFontStyle::COUNT];
+};
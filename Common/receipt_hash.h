@@ -0,0 +1,427 @@
+#pragma once
+
+// Perceptual hashes of decoded receipts, and finding receipts whose hashes are close.
+//
+// A receipt's hash is a block-mean hash of its printed area: the rows and columns between
+// the first and last printed dot are divided into a RECEIPT_HASH_GRID x RECEIPT_HASH_GRID
+// grid, and a cell's bit is set when its share of printed dots is above the median cell's.
+// Blank paper fed before or after a receipt and a margin moving it sideways leave the hash
+// alone; a reprint hashes the same, a receipt from the same template differs in the cells
+// where the items differ, and unrelated receipts differ in about half the bits. Cells are
+// counted from the rows packed a band at a time, 64 dots per popcount.
+//
+// Distances are Hamming distances between hashes: 4 hashes at a time with AVX2 (the byte
+// population count of receipt_diff.h), else 64 bits at a time with SWAR.
+//
+// ReceiptHashTable finds every hash within a distance of a query with a multi-index hash
+// table: the 256 bits are cut into RECEIPT_HASH_CHUNKS chunks of 16 bits, one per grid
+// row, and each chunk value has its bucket of hashes. Two hashes within distance d agree
+// to within d / RECEIPT_HASH_CHUNKS bits in at least one chunk, so probing the buckets of
+// every chunk value that close to the query's finds all of them; the candidates are then
+// checked with the distance kernel. Past RECEIPT_HASH_PROBE_RADIUS bits per chunk the
+// probes would cost more than a scan, and all hashes are scanned instead.
+//
+// ClusterReceiptHashes groups hashes into clusters of near-duplicates: identical hashes are
+// merged first, each distinct hash is looked up in the table (on several threads), and every
+// pair within the distance joins its clusters, so a cluster is a chain of close receipts.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "receipt_decoder.h"
+#include "receipt_diff.h" // DiffKernel, DiffPopcount64, DiffPopcountBytesAvx2
+
+constexpr int RECEIPT_HASH_GRID = 16;
+constexpr int RECEIPT_HASH_BITS = RECEIPT_HASH_GRID * RECEIPT_HASH_GRID;
+constexpr int RECEIPT_HASH_WORDS = RECEIPT_HASH_BITS / 64;
+constexpr int RECEIPT_HASH_CHUNKS = 16;        // 16-bit chunks, the multi-index tables
+constexpr int RECEIPT_HASH_PROBE_RADIUS = 2;   // Most bits per chunk probed before scanning instead
+constexpr int RECEIPT_HASH_BAND_ROWS = 1024;   // Rows packed at a time while hashing
+
+// Bit i is grid cell i: row i / RECEIPT_HASH_GRID, column i % RECEIPT_HASH_GRID
+struct ReceiptHash {
+    uint64_t words[RECEIPT_HASH_WORDS] = {};
+
+    uint32_t chunk(int k) const { return (uint32_t)(words[k / 4] >> (16 * (k % 4))) & 0xFFFF; }
+    bool operator==(const ReceiptHash& other) const { return std::memcmp(words, other.words, sizeof(words)) == 0; }
+    bool operator!=(const ReceiptHash& other) const { return !(*this == other); }
+    bool operator<(const ReceiptHash& other) const {
+        return std::lexicographical_compare(words, words + RECEIPT_HASH_WORDS, other.words, other.words + RECEIPT_HASH_WORDS);
+    }
+};
+
+// Hexadecimal, first grid row first
+inline std::string FormatReceiptHash(const ReceiptHash& hash) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string text;
+    for (int k = 0; k < RECEIPT_HASH_CHUNKS; ++k) {
+        uint32_t chunk = hash.chunk(k);
+        for (int shift = 12; shift >= 0; shift -= 4) text += kDigits[(chunk >> shift) & 0xF];
+    }
+    return text;
+}
+
+// --- Hashing ---
+
+// Printed dots of each cell of the printed area. Returns false when nothing is printed.
+inline bool ComputeReceiptHash(const ReceiptBits& bits, int width, bool msb_first, ReceiptHash& hash) {
+    hash = ReceiptHash();
+    int rows = bits.rows(width);
+    if (rows <= 0) return false;
+    size_t words = ((size_t)width + 63) / 64;
+    size_t row_bytes = words * 8;
+    std::vector<uint8_t> band((size_t)std::min(rows, RECEIPT_HASH_BAND_ROWS) * row_bytes);
+    std::vector<uint64_t> row(words);
+    auto for_each_row = [&](int first, int end, auto&& visit) {
+        for (int y = first; y < end; y += RECEIPT_HASH_BAND_ROWS) {
+            int count = std::min(RECEIPT_HASH_BAND_ROWS, end - y);
+            std::fill(band.begin(), band.end(), 0);
+            PackReceiptRows(bits, width, msb_first, false, y, count, band.data(), row_bytes);
+            for (int r = 0; r < count; ++r) {
+                const uint8_t* p = band.data() + (size_t)r * row_bytes;
+                for (size_t k = 0; k < words; ++k) row[k] = (uint64_t)GetBE32(p + 8 * k) << 32 | GetBE32(p + 8 * k + 4);
+                visit(y + r);
+            }
+        }
+    };
+
+    // The printed area: rows with a dot, and the columns of all of them ORed
+    int top = rows, bottom = -1;
+    std::vector<uint64_t> columns(words, 0);
+    for_each_row(0, rows, [&](int y) {
+        uint64_t any = 0;
+        for (size_t k = 0; k < words; ++k) {
+            columns[k] |= row[k];
+            any |= row[k];
+        }
+        if (any == 0) return;
+        top = std::min(top, y);
+        bottom = y;
+    });
+    if (bottom < 0) return false;
+    int left = 0, right = 0;
+    for (size_t k = 0; k < words; ++k) {
+        if (columns[k] == 0) continue;
+        int last = (int)(k * 64) + 63;
+        for (uint64_t v = columns[k]; (v & 1) == 0; v >>= 1) --last;
+        right = last + 1;
+    }
+    for (size_t k = 0; k < words; ++k) {
+        if (columns[k] == 0) continue;
+        left = (int)(k * 64);
+        for (uint64_t v = columns[k]; (v >> 63) == 0; v <<= 1) ++left;
+        break;
+    }
+
+    // Cell columns [cell_x[c], cell_x[c + 1]); row y is in cell row (y - top) * grid / area_rows
+    const int grid = RECEIPT_HASH_GRID;
+    int area_width = right - left, area_rows = bottom + 1 - top;
+    int cell_x[RECEIPT_HASH_GRID + 1];
+    for (int c = 0; c <= grid; ++c) cell_x[c] = left + (int)((int64_t)c * area_width / grid);
+    std::vector<uint64_t> counts((size_t)RECEIPT_HASH_BITS, 0);
+    for_each_row(top, bottom + 1, [&](int y) {
+        uint64_t* cells = counts.data() + (size_t)((int64_t)(y - top) * grid / area_rows) * grid;
+        int c = 0;
+        for (size_t k = (size_t)left / 64; k < words && (int)(k * 64) < right; ++k) {
+            uint64_t v = row[k];
+            if (v == 0) continue;
+            int from = (int)(k * 64), to = from + 64;
+            while (c < grid && cell_x[c + 1] <= from) ++c;
+            for (int cell = c; cell < grid && cell_x[cell] < to; ++cell) {
+                int lo = std::max(cell_x[cell], from) - from, hi = std::min(cell_x[cell + 1], to) - from;
+                if (hi <= lo) continue;
+                uint64_t mask = (hi - lo == 64 ? ~0ull : ((1ull << (hi - lo)) - 1) << (64 - hi)); // Dot 0 is the top bit
+                cells[cell] += DiffPopcount64(v & mask);
+            }
+        }
+    });
+
+    // Densities compared exactly, count / area cross-multiplied, against the median cell's
+    std::vector<std::pair<uint64_t, uint64_t>> density((size_t)RECEIPT_HASH_BITS); // Count, area
+    for (int i = 0; i < RECEIPT_HASH_BITS; ++i) {
+        int cy = i / grid, cx = i % grid;
+        int64_t cell_rows = ((int64_t)(cy + 1) * area_rows + grid - 1) / grid - ((int64_t)cy * area_rows + grid - 1) / grid;
+        // A cell of no dots (an area narrower than the grid) counts as blank
+        density[(size_t)i] = { counts[(size_t)i], (uint64_t)std::max<int64_t>(1, cell_rows * (cell_x[cx + 1] - cell_x[cx])) };
+    }
+    auto less = [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) {
+        return a.first * b.second < b.first * a.second;
+    };
+    std::vector<std::pair<uint64_t, uint64_t>> sorted = density;
+    std::nth_element(sorted.begin(), sorted.begin() + RECEIPT_HASH_BITS / 2, sorted.end(), less);
+    const std::pair<uint64_t, uint64_t> median = sorted[(size_t)RECEIPT_HASH_BITS / 2];
+    for (int i = 0; i < RECEIPT_HASH_BITS; ++i) {
+        if (less(median, density[(size_t)i])) hash.words[i / 64] |= 1ull << (i % 64);
+    }
+    return true;
+}
+
+// --- Distance kernels: out[i] = distance of query to hashes[ids ? ids[i] : i] ---
+
+inline int ReceiptHashDistance(const ReceiptHash& a, const ReceiptHash& b) {
+    uint64_t distance = 0;
+    for (int k = 0; k < RECEIPT_HASH_WORDS; ++k) distance += DiffPopcount64(a.words[k] ^ b.words[k]);
+    return (int)distance;
+}
+
+inline void HashDistancesScalar(const ReceiptHash& query, const ReceiptHash* hashes, const uint32_t* ids, size_t n, uint16_t* out) {
+    for (size_t i = 0; i < n; ++i) out[i] = (uint16_t)ReceiptHashDistance(query, hashes[ids ? ids[i] : i]);
+}
+
+#if defined(BIT_UNPACK_X86)
+BIT_UNPACK_TARGET_AVX2 inline void HashDistancesAvx2(const ReceiptHash& query, const ReceiptHash* hashes, const uint32_t* ids, size_t n, uint16_t* out) {
+    static_assert(sizeof(ReceiptHash) == 32, "a hash is one AVX2 register");
+    const __m256i q = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(query.words));
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i sums[4]; // 64-bit lanes of at most 64 each
+        for (size_t k = 0; k < 4; ++k) {
+            const ReceiptHash& hash = hashes[ids ? ids[i + k] : i + k];
+            __m256i x = _mm256_xor_si256(q, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(hash.words)));
+            sums[k] = _mm256_sad_epu8(DiffPopcountBytesAvx2(x), zero);
+        }
+        // Each hash's lanes in its own 16 bits, so one sum of the lanes adds all four
+        __m256i packed = _mm256_or_si256(_mm256_or_si256(sums[0], _mm256_slli_epi64(sums[1], 16)),
+                                         _mm256_or_si256(_mm256_slli_epi64(sums[2], 32), _mm256_slli_epi64(sums[3], 48)));
+        uint64_t total = DiffSumAvx2(packed);
+        for (size_t k = 0; k < 4; ++k) out[i + k] = (uint16_t)(total >> (16 * k));
+    }
+    if (ids) HashDistancesScalar(query, hashes, ids + i, n - i, out + i);
+    else HashDistancesScalar(query, hashes + i, nullptr, n - i, out + i);
+}
+#endif
+
+inline void HashDistances(DiffKernel kernel, const ReceiptHash& query, const ReceiptHash* hashes, const uint32_t* ids, size_t n, uint16_t* out) {
+#if defined(BIT_UNPACK_X86)
+    if (kernel == DiffKernel::Avx2) {
+        HashDistancesAvx2(query, hashes, ids, n, out);
+        return;
+    }
+#endif
+    HashDistancesScalar(query, hashes, ids, n, out);
+}
+
+// --- Multi-index table ---
+
+struct ReceiptHashMatch {
+    uint32_t id;
+    int distance;
+};
+
+struct ReceiptHashQueryStats {
+    uint64_t probes = 0;      // Buckets looked up
+    uint64_t candidates = 0;  // Distinct hashes whose distance was computed
+    uint64_t scans = 0;       // Queries that scanned every hash
+};
+
+// Per-thread working memory of ReceiptHashTable::Query
+struct ReceiptHashScratch {
+    std::vector<uint32_t> seen; // Query stamp per id
+    uint32_t stamp = 0;
+    std::vector<uint32_t> candidates;
+    std::vector<uint16_t> distances;
+};
+
+class ReceiptHashTable {
+public:
+    // Indexes hashes[id] for the given ids, ascending (all of them when ids is null)
+    void Build(std::vector<ReceiptHash> hashes, const std::vector<uint32_t>* ids = nullptr, DiffKernel kernel = DiffSelectedKernel()) {
+        hashes_ = std::move(hashes);
+        kernel_ = kernel;
+        if (ids) {
+            ids_ = *ids;
+        } else {
+            ids_.resize(hashes_.size());
+            std::iota(ids_.begin(), ids_.end(), 0u);
+        }
+        // Counting sort of the ids by each chunk's value
+        for (int k = 0; k < RECEIPT_HASH_CHUNKS; ++k) {
+            std::vector<uint32_t>& offsets = offsets_[k];
+            offsets.assign((size_t)65536 + 1, 0);
+            for (uint32_t id : ids_) offsets[hashes_[id].chunk(k) + 1]++;
+            for (size_t v = 1; v < offsets.size(); ++v) offsets[v] += offsets[v - 1];
+            std::vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+            buckets_[k].resize(ids_.size());
+            for (uint32_t id : ids_) buckets_[k][next[hashes_[id].chunk(k)]++] = id;
+        }
+    }
+
+    size_t size() const { return ids_.size(); }
+    const ReceiptHash& hash(uint32_t id) const { return hashes_[id]; }
+
+    // Ids from first_id on within distance of query (itself included if indexed), in no
+    // particular order
+    void Query(const ReceiptHash& query, int distance, std::vector<ReceiptHashMatch>& matches, ReceiptHashScratch& scratch,
+               ReceiptHashQueryStats* stats = nullptr, uint32_t first_id = 0) const {
+        matches.clear();
+        int chunk_radius = std::max(0, distance) / RECEIPT_HASH_CHUNKS;
+        std::vector<uint32_t>& candidates = scratch.candidates;
+        candidates.clear();
+        if (chunk_radius > RECEIPT_HASH_PROBE_RADIUS) {
+            candidates.assign(std::lower_bound(ids_.begin(), ids_.end(), first_id), ids_.end());
+            if (stats) stats->scans++;
+        } else {
+            if (scratch.seen.size() != hashes_.size() || ++scratch.stamp == 0) {
+                scratch.seen.assign(hashes_.size(), 0);
+                scratch.stamp = 1;
+            }
+            const std::vector<uint32_t>& flips = ChunkFlips(chunk_radius);
+            for (int k = 0; k < RECEIPT_HASH_CHUNKS; ++k) {
+                uint32_t value = query.chunk(k);
+                for (uint32_t flip : flips) {
+                    uint32_t key = value ^ flip;
+                    const uint32_t* end = buckets_[k].data() + offsets_[k][key + 1];
+                    const uint32_t* b = buckets_[k].data() + offsets_[k][key];
+                    if (first_id > 0) b = std::lower_bound(b, end, first_id);
+                    for (; b < end; ++b) {
+                        uint32_t id = *b;
+                        if (scratch.seen[id] == scratch.stamp) continue;
+                        scratch.seen[id] = scratch.stamp;
+                        candidates.push_back(id);
+                    }
+                }
+                if (stats) stats->probes += flips.size();
+            }
+        }
+        scratch.distances.resize(candidates.size());
+        HashDistances(kernel_, query, hashes_.data(), candidates.data(), candidates.size(), scratch.distances.data());
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            if (scratch.distances[i] <= distance) matches.push_back({ candidates[i], scratch.distances[i] });
+        }
+        if (stats) stats->candidates += candidates.size();
+    }
+
+private:
+    // The 16-bit values with at most radius bits set
+    static const std::vector<uint32_t>& ChunkFlips(int radius) {
+        static const auto flips = [] {
+            std::vector<std::vector<uint32_t>> by_radius(RECEIPT_HASH_PROBE_RADIUS + 1);
+            for (uint32_t v = 0; v < 65536; ++v) {
+                int bits = (int)DiffPopcount64(v);
+                for (int r = bits; r <= RECEIPT_HASH_PROBE_RADIUS; ++r) by_radius[(size_t)r].push_back(v);
+            }
+            return by_radius;
+        }();
+        return flips[(size_t)radius];
+    }
+
+    std::vector<ReceiptHash> hashes_;
+    std::vector<uint32_t> ids_;
+    std::vector<uint32_t> offsets_[RECEIPT_HASH_CHUNKS]; // Per chunk: bucket of value v is [offsets[v], offsets[v + 1])
+    std::vector<uint32_t> buckets_[RECEIPT_HASH_CHUNKS]; // Ids, ascending within each bucket
+    DiffKernel kernel_ = DiffKernel::Scalar;
+};
+
+// --- Clustering ---
+
+struct ReceiptHashClusters {
+    std::vector<std::vector<uint32_t>> clusters; // Ids of each cluster of 2 or more, largest first, ids ascending
+    uint64_t distinct = 0;                       // Distinct hashes among the ids
+    uint64_t pairs = 0;                          // Pairs of distinct hashes within the distance
+    ReceiptHashQueryStats queries;
+};
+
+// Clusters hashes[id] for the given ids: ids whose hashes are within distance of each
+// other, directly or through other ids, form one cluster
+inline ReceiptHashClusters ClusterReceiptHashes(const std::vector<ReceiptHash>& hashes, const std::vector<uint32_t>& ids, int distance,
+                                                unsigned threads, DiffKernel kernel = DiffSelectedKernel()) {
+    ReceiptHashClusters result;
+    // Identical hashes first: the reprints, which may be most of a busy till's jobs
+    std::vector<uint32_t> order(ids);
+    std::sort(order.begin(), order.end(), [&hashes](uint32_t a, uint32_t b) {
+        return hashes[a] != hashes[b] ? hashes[a] < hashes[b] : a < b;
+    });
+    std::vector<ReceiptHash> distinct;
+    std::vector<uint32_t> group_start; // In order, per distinct hash
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (i > 0 && hashes[order[i]] == distinct.back()) continue;
+        distinct.push_back(hashes[order[i]]);
+        group_start.push_back((uint32_t)i);
+    }
+    group_start.push_back((uint32_t)order.size());
+    result.distinct = distinct.size();
+
+    ReceiptHashTable table;
+    table.Build(distinct, nullptr, kernel);
+    // Union-find shared by the threads: a root is linked under a smaller root by
+    // compare-and-swap, so links only point down the ids and never form a cycle
+    std::vector<std::atomic<uint32_t>> parent(distinct.size());
+    for (uint32_t d = 0; d < distinct.size(); ++d) parent[d].store(d, std::memory_order_relaxed);
+    auto find = [&parent](uint32_t x) {
+        for (;;) {
+            uint32_t up = parent[x].load(std::memory_order_relaxed);
+            if (up == x) return x;
+            uint32_t grand = parent[up].load(std::memory_order_relaxed);
+            if (grand != up) parent[x].compare_exchange_weak(up, grand, std::memory_order_relaxed); // Halve the path
+            x = grand;
+        }
+    };
+    auto unite = [&parent, &find](uint32_t a, uint32_t b) {
+        for (;;) {
+            a = find(a);
+            b = find(b);
+            if (a == b) return;
+            if (a < b) std::swap(a, b);
+            uint32_t root = a;
+            if (parent[a].compare_exchange_strong(root, b, std::memory_order_relaxed)) return;
+        }
+    };
+
+    // Each distinct hash looks for the later ones close to it
+    threads = std::max(1u, std::min<unsigned>(threads, (unsigned)std::max<size_t>(1, distinct.size() / 1024)));
+    std::atomic<uint32_t> next(0);
+    std::vector<ReceiptHashQueryStats> stats(threads);
+    std::vector<uint64_t> pairs(threads, 0);
+    const uint32_t block = 256;
+    auto work = [&](unsigned t) {
+        ReceiptHashScratch scratch;
+        std::vector<ReceiptHashMatch> matches;
+        for (uint32_t first; (first = next.fetch_add(block)) < distinct.size();) {
+            uint32_t end = (uint32_t)std::min<size_t>(distinct.size(), (size_t)first + block);
+            for (uint32_t i = first; i < end; ++i) {
+                table.Query(distinct[i], distance, matches, scratch, &stats[t], i + 1);
+                for (const ReceiptHashMatch& match : matches) unite(i, match.id);
+                pairs[t] += matches.size();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < threads; ++t) workers.emplace_back(work, t);
+    work(0);
+    for (std::thread& worker : workers) worker.join();
+    for (unsigned t = 0; t < threads; ++t) {
+        result.pairs += pairs[t];
+        result.queries.probes += stats[t].probes;
+        result.queries.candidates += stats[t].candidates;
+        result.queries.scans += stats[t].scans;
+    }
+
+    // Clusters by root, each distinct hash contributing its group of ids
+    std::vector<uint32_t> cluster_of(distinct.size(), UINT32_MAX);
+    for (uint32_t d = 0; d < distinct.size(); ++d) {
+        uint32_t root = find(d);
+        if (cluster_of[root] == UINT32_MAX) {
+            cluster_of[root] = (uint32_t)result.clusters.size();
+            result.clusters.emplace_back();
+        }
+        std::vector<uint32_t>& cluster = result.clusters[cluster_of[root]];
+        cluster.insert(cluster.end(), order.begin() + group_start[d], order.begin() + group_start[d + 1]);
+    }
+    result.clusters.erase(std::remove_if(result.clusters.begin(), result.clusters.end(),
+                                         [](const std::vector<uint32_t>& cluster) { return cluster.size() < 2; }),
+                          result.clusters.end());
+    for (std::vector<uint32_t>& cluster : result.clusters) std::sort(cluster.begin(), cluster.end());
+    std::sort(result.clusters.begin(), result.clusters.end(), [](const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+        return a.size() != b.size() ? a.size() > b.size() : a.front() < b.front();
+    });
+    return result;
+}
@@ -0,0 +1,501 @@
+#pragma once
+
+// Receipt decoding and tile rendering on worker threads, so a viewer's UI thread never
+// waits for a large capture.
+//
+// Work belongs to a generation. Starting one (Decode for another file, Relayout for
+// another width or bit option) drops everything still queued for older generations, and
+// running work stops at its next check, so only the latest request publishes results.
+// Results are handed to the Publish callback on a worker thread; a window posts them to
+// itself and, since a generation may end between publishing and handling, also ignores
+// any that are no longer current. Nothing here touches a window, so the whole pipeline
+// runs headless (capture_tool bench pipeline).
+//
+// Prefetch decodes files the viewer expects to open next (the captures either side of the
+// open one) into the decoded-file cache on a thread of its own. It waits while a file is
+// being opened for display and never delays tile rendering; opening a file it is still
+// decoding waits for that decode instead of starting another.
+//
+// Follow watches a capture that is still being written, polling it every FOLLOW_POLL_MS on
+// a thread of its own. Each poll decodes only what was appended (ReceiptTail) and publishes
+// the longer bits as a Grown update, which also becomes the bits of the current layout, so
+// tiles of the unchanged rows stay valid. Following survives relayouts and ends with the
+// next Decode, Follow, Cancel or Unfollow.
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+
+#include "receipt_tail.h"
+#include "receipt_tiles.h"
+#include "width_detect.h"
+
+constexpr size_t PREFETCH_MAX_SHARE = 4; // Files over 1/4 of the decoded-file cache are not prefetched
+constexpr int FOLLOW_POLL_MS = 100;      // How often a followed capture is checked for new data
+
+// Decoded files, most recently used first, so opening one again skips mapping, parsing and
+// filtering it. An entry is only used while the file keeps its size and modification time,
+// so a capture that is still being written is decoded afresh. Shared by all workers.
+class ReceiptBitsCache {
+public:
+    explicit ReceiptBitsCache(size_t budget_bytes = 256 * 1024 * 1024) : budget_bytes_(budget_bytes) {}
+
+    struct Stamp {
+        uintmax_t size = 0;
+        std::filesystem::file_time_type modified;
+    };
+
+    // False if the file cannot be examined
+    static bool StampOf(const std::filesystem::path& path, Stamp& stamp) {
+        std::error_code ec;
+        stamp.size = std::filesystem::file_size(path, ec);
+        if (ec) return false;
+        stamp.modified = std::filesystem::last_write_time(path, ec);
+        return !ec;
+    }
+
+    std::shared_ptr<const ReceiptBits> Find(const std::filesystem::path& path, const Stamp& stamp) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+            if (it->path != path) continue;
+            if (it->stamp.size != stamp.size || it->stamp.modified != stamp.modified) {
+                entries_.erase(it);
+                return nullptr;
+            }
+            entries_.splice(entries_.begin(), entries_, it);
+            return entries_.front().bits;
+        }
+        return nullptr;
+    }
+
+    // Keeps the newest entry even when it alone exceeds the budget
+    void Insert(const std::filesystem::path& path, const Stamp& stamp, std::shared_ptr<const ReceiptBits> bits) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.remove_if([&](const Entry& entry) { return entry.path == path; });
+        entries_.push_front({ path, stamp, std::move(bits) });
+        size_t total = 0;
+        for (auto it = entries_.begin(); it != entries_.end();) {
+            total += it->bits->bytes.size();
+            if (it != entries_.begin() && total > budget_bytes_) it = entries_.erase(it);
+            else ++it;
+        }
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size();
+    }
+    size_t budget_bytes() const { return budget_bytes_; }
+
+private:
+    struct Entry {
+        std::filesystem::path path;
+        Stamp stamp;
+        std::shared_ptr<const ReceiptBits> bits;
+    };
+
+    mutable std::mutex mutex_;
+    std::list<Entry> entries_;
+    size_t budget_bytes_;
+};
+
+struct ReceiptUpdate {
+    enum class Kind { Decoded, Failed, Tile, Grown };
+
+    Kind kind = Kind::Failed;
+    uint64_t generation = 0;
+    std::shared_ptr<const ReceiptBits> bits; // Decoded, Grown: the followed capture's bits so far
+    bool cached = false;                     // Decoded: taken from the decoded-file cache
+    WidthDetection detection;                // Decoded
+    std::string error;                       // Failed
+    ReceiptTileCache::Tile tile;             // Tile
+};
+
+class ReceiptPipeline {
+public:
+    using Publish = std::function<void(ReceiptUpdate&&)>;
+
+    // threads = 0: one per core but one, at most four
+    explicit ReceiptPipeline(Publish publish, unsigned threads = 0) : publish_(std::move(publish)) {
+        if (threads == 0) threads = std::clamp(std::thread::hardware_concurrency(), 2u, 5u) - 1;
+        for (unsigned i = 0; i < threads; ++i) workers_.emplace_back([this] { Work(); });
+        prefetcher_ = std::thread([this] { PrefetchWork(); });
+        follower_ = std::thread([this] { FollowWork(); });
+    }
+
+    // Queued work is dropped; running work finishes its current step
+    ~ReceiptPipeline() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            queue_.clear();
+            prefetch_.clear();
+            follow_.reset();
+            generation_++;
+        }
+        wake_.notify_all();
+        prefetch_wake_.notify_all();
+        follow_wake_.notify_all();
+        for (std::thread& worker : workers_) worker.join();
+        prefetcher_.join();
+        follower_.join();
+    }
+
+    ReceiptPipeline(const ReceiptPipeline&) = delete;
+    ReceiptPipeline& operator=(const ReceiptPipeline&) = delete;
+
+    // New generation: maps and decodes a capture (or takes it from the decoded-file cache),
+    // then detects its width in [min_width, max_width]. The filter must outlive the
+    // pipeline and stay the same for its whole life, as cached files were filtered with it.
+    uint64_t Decode(const std::filesystem::path& path, const BytePatternFilter& filter, int min_width, int max_width) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t generation = Start(nullptr, 0, true, false);
+        follow_.reset();
+        const BytePatternFilter* filter_ptr = &filter;
+        queue_.push_back({ generation, [this, generation, path, filter_ptr, min_width, max_width] {
+            ReceiptUpdate update;
+            update.generation = generation;
+            ReceiptBitsCache::Stamp stamp;
+            bool stamped = ReceiptBitsCache::StampOf(path, stamp);
+            std::shared_ptr<const ReceiptBits> cached = stamped ? decoded_.Find(path, stamp) : nullptr;
+            if (!cached && stamped) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (prefetching_ == path) {
+                    prefetched_.wait(lock, [&] { return prefetching_ != path; });
+                    lock.unlock();
+                    cached = decoded_.Find(path, stamp);
+                }
+            }
+            update.cached = cached != nullptr;
+            if (!cached) {
+                CaptureFile capture;
+                auto bits = std::make_shared<ReceiptBits>();
+                if (!capture.Open(path, update.error)) {
+                    Deliver(std::move(update));
+                    return;
+                }
+                if (!IsCurrent(generation)) return;
+                if (!ExtractReceiptBits(capture.client_stream(), *filter_ptr, *bits, update.error)) {
+                    Deliver(std::move(update));
+                    return;
+                }
+                if (bits->bytes.empty()) {
+                    update.error = "No pixel data remaining after sequence removal.";
+                    Deliver(std::move(update));
+                    return;
+                }
+                cached = std::move(bits);
+                if (stamped) decoded_.Insert(path, stamp, cached);
+            }
+            if (!IsCurrent(generation)) return;
+            update.detection = DetectReceiptWidth(*cached, min_width, max_width);
+            update.kind = ReceiptUpdate::Kind::Decoded;
+            update.bits = std::move(cached);
+            Deliver(std::move(update));
+        }, true });
+        wake_.notify_one();
+        return generation;
+    }
+
+    // Replaces the files to prefetch: decoded in the order given into the decoded-file cache,
+    // once no file is being opened, skipping those already cached and those too large to
+    // keep next to the one on display. Publishes nothing. The filter is Decode's.
+    void Prefetch(const std::vector<std::filesystem::path>& paths, const BytePatternFilter& filter) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            prefetch_.assign(paths.begin(), paths.end());
+            prefetch_filter_ = &filter;
+        }
+        prefetch_wake_.notify_one();
+    }
+
+    // Files waiting to be prefetched, and the one being prefetched
+    size_t prefetch_pending() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return prefetch_.size() + (prefetching_.empty() ? 0 : 1);
+    }
+
+    // New generation: follows a capture that is still being written. Once it holds image
+    // data it is published like Decode's result (read from the start, never from the
+    // decoded-file cache); later data is published as Grown updates. A file that cannot be
+    // read publishes Failed and ends following. The filter is Decode's.
+    uint64_t Follow(const std::filesystem::path& path, const BytePatternFilter& filter, int min_width, int max_width) {
+        uint64_t generation;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            generation = Start(nullptr, 0, true, false);
+            follow_ = std::make_shared<FollowSession>(path, filter, generation, min_width, max_width);
+        }
+        follow_wake_.notify_one();
+        return generation;
+    }
+
+    // Stops following; the bits published so far stay laid out
+    void Unfollow() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        follow_.reset();
+    }
+
+    bool following() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return follow_ != nullptr;
+    }
+
+    // New generation: lays out decoded bits; tiles are then rendered on request. While
+    // following, a layout of bits the capture has since outgrown uses the latest bits instead
+    // and publishes them as Grown for the new generation.
+    uint64_t Relayout(std::shared_ptr<const ReceiptBits> bits, int width, bool msb_first, bool invert) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool outgrown = follow_ && follow_->bits && bits && bits != follow_->bits;
+        uint64_t generation = Start(outgrown ? follow_->bits : std::move(bits), width, msb_first, invert);
+        if (outgrown) {
+            ReceiptUpdate update;
+            update.kind = ReceiptUpdate::Kind::Grown;
+            update.generation = generation;
+            update.bits = bits_;
+            Deliver(std::move(update));
+        }
+        return generation;
+    }
+
+    // New generation with nothing to do
+    uint64_t Cancel() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        follow_.reset();
+        return Start(nullptr, 0, true, false);
+    }
+
+    // Queues tiles of a level (ReceiptTileCache) of the generation's layout, in the order
+    // given, skipping tiles already queued or rendering. Ignored once the generation has ended.
+    void RenderTiles(uint64_t generation, const std::vector<int>& indices, int level = 0) {
+        size_t added = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (generation != generation_ || !bits_ || level < 0 || level > ReceiptTileCache::MAX_LEVEL) return;
+            int level_rows = ReceiptTileCache::LevelSize(bits_->rows(width_), level);
+            for (int index : indices) {
+                if (index < 0 || index * (int64_t)ReceiptTileCache::TILE_ROWS >= level_rows) continue;
+                int64_t key = (int64_t)level << 32 | (uint32_t)index;
+                if (!pending_.insert(key).second) continue;
+                std::shared_ptr<const ReceiptBits> bits = bits_;
+                int width = width_;
+                bool msb_first = msb_first_, invert = invert_;
+                queue_.push_back({ generation, [this, generation, bits, width, msb_first, invert, index, level, key] {
+                    ReceiptUpdate update;
+                    update.kind = ReceiptUpdate::Kind::Tile;
+                    update.generation = generation;
+                    update.tile = ReceiptTileCache::Render(*bits, width, msb_first, invert, index, level);
+                    {
+                        std::lock_guard<std::mutex> lock(mutex_);
+                        if (generation == generation_) pending_.erase(key);
+                    }
+                    Deliver(std::move(update));
+                } });
+                added++;
+            }
+        }
+        if (added == 1) wake_.notify_one();
+        else if (added > 1) wake_.notify_all();
+    }
+
+    uint64_t generation() const { return generation_; }
+    const ReceiptBitsCache& decoded_files() const { return decoded_; }
+    bool IsCurrent(uint64_t generation) const { return generation == generation_; }
+
+private:
+    struct FollowSession {
+        FollowSession(const std::filesystem::path& path, const BytePatternFilter& filter, uint64_t generation, int min_width, int max_width)
+            : tail(path, filter), generation(generation), min_width(min_width), max_width(max_width) {}
+
+        ReceiptTail tail;
+        uint64_t generation; // Of Follow, for the first result
+        int min_width, max_width;
+        uint64_t version = 0;                     // tail.version() when bits were taken
+        std::shared_ptr<const ReceiptBits> bits; // Published so far; null until the capture holds image data
+    };
+
+    struct Task {
+        uint64_t generation;
+        std::function<void()> run;
+        bool decode = false; // Opens a file: prefetching waits for it
+    };
+
+    // Caller holds mutex_
+    uint64_t Start(std::shared_ptr<const ReceiptBits> bits, int width, bool msb_first, bool invert) {
+        uint64_t generation = ++generation_;
+        queue_.clear();
+        pending_.clear();
+        bits_ = std::move(bits);
+        width_ = width;
+        msb_first_ = msb_first;
+        invert_ = invert;
+        return generation;
+    }
+
+    void Deliver(ReceiptUpdate&& update) {
+        if (IsCurrent(update.generation)) publish_(std::move(update));
+    }
+
+    void Work() {
+        for (;;) {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (stopping_) return;
+                task = std::move(queue_.front());
+                queue_.pop_front();
+                if (task.decode) decoding_++;
+            }
+            if (IsCurrent(task.generation)) task.run();
+            if (task.decode) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    decoding_--;
+                }
+                prefetch_wake_.notify_one();
+            }
+        }
+    }
+
+    // Caller holds mutex_
+    bool Opening() const {
+        return decoding_ > 0 || std::any_of(queue_.begin(), queue_.end(), [](const Task& task) { return task.decode; });
+    }
+
+    void PrefetchWork() {
+        for (;;) {
+            std::filesystem::path path;
+            const BytePatternFilter* filter;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                prefetch_wake_.wait(lock, [this] { return stopping_ || (!prefetch_.empty() && !Opening()); });
+                if (stopping_) return;
+                path = std::move(prefetch_.front());
+                prefetch_.pop_front();
+                filter = prefetch_filter_;
+                prefetching_ = path;
+            }
+            ReceiptBitsCache::Stamp stamp;
+            if (ReceiptBitsCache::StampOf(path, stamp) && stamp.size <= decoded_.budget_bytes() / PREFETCH_MAX_SHARE &&
+                !decoded_.Find(path, stamp)) {
+                CaptureFile capture;
+                auto bits = std::make_shared<ReceiptBits>();
+                std::string error;
+                if (capture.Open(path, error) && ExtractReceiptBits(capture.client_stream(), *filter, *bits, error) &&
+                    !bits->bytes.empty()) {
+                    decoded_.Insert(path, stamp, std::move(bits));
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                prefetching_.clear();
+            }
+            prefetched_.notify_all();
+        }
+    }
+
+    void FollowWork() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for (;;) {
+            follow_wake_.wait(lock, [this] { return stopping_ || follow_; });
+            if (stopping_) return;
+            std::shared_ptr<FollowSession> session = follow_;
+            lock.unlock();
+
+            // Only the session's own thread touches its tail, so it is polled unlocked
+            std::string error;
+            bool ok = session->tail.Poll(error);
+            std::shared_ptr<const ReceiptBits> bits;
+            WidthDetection detection;
+            if (ok && session->tail.version() != session->version && !session->tail.empty()) {
+                session->version = session->tail.version();
+                bits = session->tail.Snapshot();
+                if (!session->bits) detection = DetectReceiptWidth(*bits, session->min_width, session->max_width);
+            }
+
+            lock.lock();
+            if (session != follow_) continue;
+            if (!ok) {
+                ReceiptUpdate update;
+                update.generation = session->bits ? generation_.load() : session->generation;
+                update.error = error;
+                follow_.reset();
+                Deliver(std::move(update));
+                continue;
+            }
+            if (bits) {
+                ReceiptUpdate update;
+                update.bits = bits;
+                if (!session->bits) {
+                    update.kind = ReceiptUpdate::Kind::Decoded;
+                    update.generation = session->generation;
+                    update.detection = detection;
+                } else {
+                    update.kind = ReceiptUpdate::Kind::Grown;
+                    update.generation = generation_;
+                    if (bits_) Extend(bits);
+                }
+                session->bits = std::move(bits);
+                Deliver(std::move(update));
+            }
+            follow_wake_.wait_for(lock, std::chrono::milliseconds(FOLLOW_POLL_MS), [&] { return stopping_ || follow_ != session; });
+        }
+    }
+
+    // The followed capture grew: the current layout takes the longer bits, and tiles its new
+    // rows change may be asked for again. Caller holds mutex_.
+    void Extend(std::shared_ptr<const ReceiptBits> bits) {
+        int old_rows = bits_->rows(width_);
+        bits_ = std::move(bits);
+        for (auto it = pending_.begin(); it != pending_.end();) {
+            int level = (int)(*it >> 32), index = (int)(uint32_t)*it;
+            if ((int64_t)(index + 1) * ReceiptTileCache::TILE_ROWS << level > old_rows) it = pending_.erase(it);
+            else ++it;
+        }
+    }
+
+    Publish publish_;
+    ReceiptBitsCache decoded_;
+    std::atomic<uint64_t> generation_{ 0 };
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<Task> queue_;
+    std::unordered_set<int64_t> pending_; // Tiles (level << 32 | index) queued or rendering for this generation
+    bool stopping_ = false;
+    int decoding_ = 0; // Decode tasks running
+
+    // Prefetching
+    std::condition_variable prefetch_wake_;
+    std::condition_variable prefetched_; // prefetching_ done
+    std::deque<std::filesystem::path> prefetch_;
+    std::filesystem::path prefetching_;
+    const BytePatternFilter* prefetch_filter_ = nullptr;
+
+    // Following
+    std::condition_variable follow_wake_;
+    std::shared_ptr<FollowSession> follow_;
+
+    // Layout of the current generation
+    std::shared_ptr<const ReceiptBits> bits_;
+    int width_ = 0;
+    bool msb_first_ = true;
+    bool invert_ = false;
+
+    std::vector<std::thread> workers_;
+    std::thread prefetcher_;
+    std::thread follower_;
+};
@@ -0,0 +1,247 @@
+#pragma once
+
+// Receipt boundaries within one capture. Drivers that keep a connection open send a whole
+// shift of tickets in one session, and each ticket ends where the paper was cut.
+//
+// ReceiptSplitter runs the client -> printer stream through the ESC/POS parser, fed in
+// pieces of any size, so the relay can split a session while it records it. A receipt ends
+// just past a cut command (GS V, ESC i, ESC m); cut bytes inside raster, barcode or other
+// payloads are data and split nothing. A part that put nothing on the paper (feeds,
+// settings, a second cut) is no receipt of its own: it joins the receipt before it, or the
+// first receipt when it leads the stream, and is dropped when it trails.
+//
+// Receipts are ranges of the client stream, the bytes ExtractReceiptBits decodes; in a
+// framed capture they are not file offsets. A capture's ranges are kept next to it in
+// <capture>.receipts, written by the relay when the session ends and by capture_tool
+// split for older captures:
+//
+//   RECEIPT_INDEX_HEADER_SIZE byte header (magic, version, receipt count, closed count,
+//   capture file size, stream bytes scanned)
+//   count x (u64 start, u64 end)
+//
+// The first `closed` receipts ended with a cut. An index recorded at another capture size
+// is stale; UpdateReceiptIndex then scans on from the end of the last closed receipt, so a
+// capture that grew is only scanned where it is new.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "byte_order.h"
+#include "capture_reader.h"
+#include "escpos_parser.h"
+
+const std::string RECEIPT_INDEX_EXTENSION = ".receipts";
+constexpr char RECEIPT_INDEX_MAGIC[8] = { 'P', 'R', 'L', 'R', 'C', 'X', '\r', '\n' };
+constexpr uint16_t RECEIPT_INDEX_VERSION = 1;
+constexpr size_t RECEIPT_INDEX_HEADER_SIZE = 48;
+constexpr size_t RECEIPT_INDEX_ENTRY_SIZE = 16;
+
+struct ReceiptRange {
+    uint64_t start = 0;
+    uint64_t end = 0; // Exclusive
+
+    uint64_t size() const { return end - start; }
+};
+
+struct ReceiptIndex {
+    uint64_t capture_size = 0; // Capture file size when it was scanned
+    uint64_t scanned = 0;      // Client stream bytes scanned
+    size_t closed = 0;         // Leading receipts that ended with a cut
+    std::vector<ReceiptRange> receipts;
+};
+
+class ReceiptSplitter {
+public:
+    ReceiptSplitter() = default;
+
+    // Resumes after the closed receipts of an earlier scan; the stream is fed from their end
+    explicit ReceiptSplitter(std::vector<ReceiptRange> closed)
+        : closed_(std::move(closed)), base_(closed_.empty() ? 0 : closed_.back().end), start_(base_), scanned_(base_) {}
+
+    void Feed(const uint8_t* p, size_t n) {
+        parser_.Feed(p, n, [this](const EscPosEvent& e) { OnEvent(e); });
+        scanned_ += n;
+    }
+
+    void Feed(const ByteSpanList& stream) {
+        for (const ByteSpan& segment : stream.segments) Feed(segment.data, segment.size);
+    }
+
+    void Finish() {
+        parser_.Finish([this](const EscPosEvent& e) { OnEvent(e); });
+    }
+
+    uint64_t scanned() const { return scanned_; }
+
+    // The closed receipts, then the open one if it printed anything
+    ReceiptIndex Index(uint64_t capture_size) const {
+        ReceiptIndex index;
+        index.capture_size = capture_size;
+        index.scanned = scanned_;
+        index.closed = closed_.size();
+        index.receipts = closed_;
+        if (inked_) index.receipts.push_back({ start_, scanned_ });
+        return index;
+    }
+
+private:
+    void OnEvent(const EscPosEvent& e) {
+        switch (e.type) {
+            case EscPosEventType::Text:
+            case EscPosEventType::Raster:
+            case EscPosEventType::BitImage:
+                inked_ = true;
+                break;
+            case EscPosEventType::Command:
+                if (e.prefix == ESCPOS_GS && (e.function == 'k' || (e.function == '(' && (e.mode == 'k' || e.mode == 'L')))) inked_ = true;
+                break;
+            case EscPosEventType::Cut: {
+                uint64_t end = base_ + e.offset + 2 + e.param_count;
+                if (inked_) {
+                    closed_.push_back({ start_, end });
+                    start_ = end;
+                } else if (!closed_.empty() && closed_.back().end == start_) {
+                    closed_.back().end = end;
+                    start_ = end;
+                }
+                inked_ = false;
+            } break;
+            default:
+                break;
+        }
+    }
+
+    EscPosParser parser_;
+    std::vector<ReceiptRange> closed_;
+    uint64_t base_ = 0;    // Stream offset of the parser's first byte
+    uint64_t start_ = 0;   // Of the open receipt
+    uint64_t scanned_ = 0;
+    bool inked_ = false;   // The open receipt printed something
+};
+
+inline ReceiptIndex SplitReceipts(const ByteSpanList& stream, uint64_t capture_size) {
+    ReceiptSplitter splitter;
+    splitter.Feed(stream);
+    splitter.Finish();
+    return splitter.Index(capture_size);
+}
+
+// --- Sidecar file ---
+
+inline std::filesystem::path ReceiptIndexPath(const std::filesystem::path& capture) {
+    std::filesystem::path path = capture;
+    path += RECEIPT_INDEX_EXTENSION;
+    return path;
+}
+
+// False if the capture has no index or it cannot be used
+inline bool ReadReceiptIndex(const std::filesystem::path& capture, ReceiptIndex& out) {
+    out = ReceiptIndex();
+    std::ifstream file(ReceiptIndexPath(capture), std::ios::binary);
+    uint8_t header[RECEIPT_INDEX_HEADER_SIZE];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) ||
+        std::memcmp(header, RECEIPT_INDEX_MAGIC, sizeof(RECEIPT_INDEX_MAGIC)) != 0 || GetLE16(header + 8) != RECEIPT_INDEX_VERSION) {
+        return false;
+    }
+    uint64_t count = GetLE64(header + 16);
+    uint64_t closed = GetLE64(header + 24);
+    if (closed > count || count > (1u << 30)) return false;
+    std::vector<uint8_t> entries((size_t)count * RECEIPT_INDEX_ENTRY_SIZE);
+    if (!entries.empty() && !file.read(reinterpret_cast<char*>(entries.data()), (std::streamsize)entries.size())) return false;
+    ReceiptIndex index;
+    index.capture_size = GetLE64(header + 32);
+    index.scanned = GetLE64(header + 40);
+    index.closed = (size_t)closed;
+    index.receipts.resize((size_t)count);
+    uint64_t previous = 0;
+    for (size_t i = 0; i < index.receipts.size(); ++i) {
+        ReceiptRange& r = index.receipts[i];
+        r.start = GetLE64(entries.data() + i * RECEIPT_INDEX_ENTRY_SIZE);
+        r.end = GetLE64(entries.data() + i * RECEIPT_INDEX_ENTRY_SIZE + 8);
+        if (r.start < previous || r.end <= r.start || r.end > index.scanned) return false;
+        previous = r.end;
+    }
+    out = std::move(index);
+    return true;
+}
+
+// Replaces the index by rename, so readers see the old one or the new one
+inline bool WriteReceiptIndex(const std::filesystem::path& capture, const ReceiptIndex& index, std::string& error) {
+    std::vector<uint8_t> out(RECEIPT_INDEX_HEADER_SIZE + index.receipts.size() * RECEIPT_INDEX_ENTRY_SIZE, 0);
+    std::memcpy(out.data(), RECEIPT_INDEX_MAGIC, sizeof(RECEIPT_INDEX_MAGIC));
+    PutLE16(out.data() + 8, RECEIPT_INDEX_VERSION);
+    PutLE64(out.data() + 16, index.receipts.size());
+    PutLE64(out.data() + 24, index.closed);
+    PutLE64(out.data() + 32, index.capture_size);
+    PutLE64(out.data() + 40, index.scanned);
+    uint8_t* p = out.data() + RECEIPT_INDEX_HEADER_SIZE;
+    for (const ReceiptRange& r : index.receipts) {
+        PutLE64(p, r.start);
+        PutLE64(p + 8, r.end);
+        p += RECEIPT_INDEX_ENTRY_SIZE;
+    }
+
+    std::filesystem::path path = ReceiptIndexPath(capture);
+    std::filesystem::path tmp = path;
+    tmp += ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(out.data()), (std::streamsize)out.size());
+        if (!file) {
+            error = "Cannot write " + tmp.string();
+            return false;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        error = "Cannot replace " + path.string() + ": " + ec.message();
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+struct ReceiptIndexUpdate {
+    bool written = false;     // The index was (re)written
+    uint64_t bytes_scanned = 0;
+};
+
+// Brings the capture's index up to date: read as is when it matches the capture size,
+// otherwise scanned on from its last closed receipt (from the start without one) and
+// rewritten. False with error set if the capture cannot be read.
+inline bool UpdateReceiptIndex(const std::filesystem::path& capture, ReceiptIndex& index, ReceiptIndexUpdate& update,
+                               std::string& error) {
+    update = ReceiptIndexUpdate();
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(capture, ec);
+    if (ec) {
+        error = "Cannot read the size of " + capture.string();
+        return false;
+    }
+    bool found = ReadReceiptIndex(capture, index);
+    if (found && index.capture_size == size) return true;
+
+    CaptureFile file;
+    if (!file.Open(capture, error)) return false;
+    const ByteSpanList& stream = file.client_stream();
+    std::vector<ReceiptRange> closed;
+    if (found && index.scanned <= stream.size && index.capture_size < size) {
+        closed.assign(index.receipts.begin(), index.receipts.begin() + (ptrdiff_t)index.closed);
+    }
+    ReceiptSplitter splitter(closed);
+    ByteSpanList rest = stream.Skip(closed.empty() ? 0 : closed.back().end);
+    splitter.Feed(rest);
+    splitter.Finish();
+    index = splitter.Index(size);
+    update.bytes_scanned = rest.size;
+    if (!WriteReceiptIndex(capture, index, error)) return false;
+    update.written = true;
+    return true;
+}
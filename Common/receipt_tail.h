@@ -0,0 +1,312 @@
+#pragma once
+
+// Incremental decoding of a capture that is still being written, for following a job while
+// it prints.
+//
+// ReceiptTail reads a capture from where its last Poll stopped and decodes only the bytes
+// appended since: frames of a framed capture are parsed as they complete, the first
+// PRINT_SNIFF_BYTES of the print stream choose its language, a PageDecoder takes the rest
+// of a stream in another language, an ESC/POS stream goes through the resumable parser
+// and printer emulator, and a stream without raster commands is pattern-filtered with a
+// hold-back of one byte less than the longest pattern, so a pattern split between two
+// polls is still removed. Snapshot() therefore always equals what ExtractReceiptBits makes
+// of the file as read so far, and but for the one replay below, no byte is decoded twice.
+//
+// The emulator only runs while the stream may still be taken for text: once raster blocks
+// or unknown commands outweigh it, its page is dropped. Should enough text follow to tip
+// the heuristic back, the file is read again from the start with the emulator running
+// throughout; that happens at most once per tail.
+//
+// Snapshots are separate objects: renderers may still be reading the previous one while
+// the next is taken. Taking one copies the bit stream (it does not decode anything).
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <algorithm>
+
+#include "capture_format.h"
+#include "capture_reader.h"
+#include "receipt_decoder.h"
+
+constexpr size_t TAIL_READ_SIZE = 1024 * 1024; // Bytes read per step when catching up with a file
+
+class ReceiptTail {
+public:
+    // The filter must outlive the tail
+    ReceiptTail(std::filesystem::path path, const BytePatternFilter& filter) : path_(std::move(path)), filter_(&filter) {
+        for (const BytePattern& pattern : filter.patterns()) hold_back_ = std::max(hold_back_, pattern.size() - 1);
+    }
+
+    ReceiptTail(const ReceiptTail&) = delete;
+    ReceiptTail& operator=(const ReceiptTail&) = delete;
+
+    // Decodes what the file gained since the last call. False with error set if it cannot be
+    // read, is a framed capture of another version, or got shorter (it was replaced, so what
+    // was decoded is no longer a prefix of it).
+    bool Poll(std::string& error) {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(path_, ec);
+        if (ec) {
+            error = "Cannot read the file size.";
+            return false;
+        }
+        if (size < read_) {
+            error = "The file got shorter; it was replaced.";
+            return false;
+        }
+        if (size == read_) return true;
+        if (!file_.is_open()) {
+            file_.open(path_, std::ios::binary);
+            if (!file_.is_open()) {
+                error = "Failed to open file.";
+                return false;
+            }
+        }
+        file_.clear(); // EOF of the last poll
+        file_.seekg((std::streamoff)read_);
+        chunk_.resize(TAIL_READ_SIZE);
+        while (read_ < size) {
+            size_t want = (size_t)std::min<uint64_t>(TAIL_READ_SIZE, size - read_);
+            file_.read(reinterpret_cast<char*>(chunk_.data()), (std::streamsize)want);
+            size_t got = (size_t)file_.gcount();
+            if (got == 0) break;
+            read_ += got;
+            if (!FeedFile(chunk_.data(), got, error)) return false;
+            if (replay_) {
+                Restart();
+                file_.clear();
+                file_.seekg(0);
+            }
+        }
+        return true;
+    }
+
+    // The bits decoded so far
+    std::shared_ptr<const ReceiptBits> Snapshot() const {
+        auto bits = std::make_shared<ReceiptBits>();
+        if (!language_) { // Too little to tell; decoded as a whole, it is that short
+            ByteSpanList head;
+            head.Append(ByteSpan(head_.data(), head_.size()));
+            std::string error;
+            ExtractReceiptBits(head, *filter_, *bits, error);
+            return bits;
+        }
+        bits->language = language_->language;
+        if (language_->language != PrintLanguage::EscPos) {
+            if (decoder_) {
+                decoder_->Snapshot(bits->bytes, bits->cuts);
+                bits->page_width = decoder_->width();
+                bits->removed = stream_bytes_ - decoder_->image_bytes();
+            }
+            return bits;
+        }
+        bits->raster = raster_.info();
+        if (EscPosLooksLikeText(bits->raster)) {
+            emulator_.Snapshot(bits->bytes);
+            bits->page_width = emulator_.width();
+            bits->cuts = EmulatedCutOffsets(emulator_.cuts(), bits->bytes, bits->page_width);
+            bits->removed = stream_bytes_ - bits->raster.bytes;
+        } else if (bits->raster.blocks > 0) {
+            bits->bytes = raster_bytes_;
+            bits->cuts = bits->raster.cuts;
+            bits->removed = stream_bytes_ - bits->raster.bytes;
+        } else if (stream_bytes_ >= RECEIPT_HEADER_SIZE) {
+            bits->bytes.reserve(kept_.size() + unfiltered_.size());
+            bits->bytes = kept_;
+            bits->bytes.insert(bits->bytes.end(), unfiltered_.begin(), unfiltered_.end()); // Holds no complete pattern
+            bits->removed = stream_bytes_ - RECEIPT_HEADER_SIZE - bits->bytes.size();
+        }
+        return bits;
+    }
+
+    // Changes whenever the bits do, so callers can skip taking an unchanged snapshot
+    uint64_t version() const { return version_; }
+    bool empty() const {
+        if (!language_) return head_.empty();
+        if (language_->language != PrintLanguage::EscPos) return !decoder_ || (decoder_->page().empty() && decoder_->pages() == 0);
+        if (EscPosLooksLikeText(raster_.info())) return emulator_.empty();
+        return raster_.info().blocks > 0 ? raster_bytes_.empty() : kept_.empty() && unfiltered_.empty();
+    }
+    uint64_t file_bytes() const { return read_; }
+    uint64_t stream_bytes() const { return stream_bytes_; }
+    bool framed() const { return container_ == Container::Framed; }
+    const std::filesystem::path& path() const { return path_; }
+
+private:
+    enum class Container { Unknown, Raw, Framed };
+
+    // Bytes of the file as read: the raw stream, or the framed capture's header and frames
+    bool FeedFile(const uint8_t* p, size_t n, std::string& error) {
+        if (container_ == Container::Raw) {
+            FeedStream(p, n);
+            return true;
+        }
+        pending_.insert(pending_.end(), p, p + n); // Header or frames not complete yet
+        size_t offset = 0;
+        if (container_ == Container::Unknown) {
+            size_t compared = std::min(pending_.size(), sizeof(CAPTURE_MAGIC));
+            if (std::memcmp(pending_.data(), CAPTURE_MAGIC, compared) != 0) {
+                container_ = Container::Raw;
+                std::vector<uint8_t> stream;
+                stream.swap(pending_);
+                FeedStream(stream.data(), stream.size());
+                return true;
+            }
+            if (pending_.size() < CAPTURE_FILE_HEADER_SIZE) return true;
+            CaptureFileHeader header;
+            if (!DecodeCaptureFileHeader(pending_.data(), pending_.size(), header)) {
+                error = "Unsupported framed capture version.";
+                return false;
+            }
+            if (pending_.size() < header.header_size) return true;
+            container_ = Container::Framed;
+            offset = header.header_size;
+        }
+        CaptureFrame frame;
+        ByteSpan payload;
+        while (size_t used = ParseCaptureFrame(pending_.data() + offset, pending_.size() - offset, time_us_, frame, payload)) {
+            if (frame.kind == CaptureFrameKind::ClientToPrinter) FeedStream(payload.data, payload.size);
+            offset += used;
+        }
+        pending_.erase(pending_.begin(), pending_.begin() + offset);
+        return true;
+    }
+
+    // Client -> printer bytes: held until there are enough to sniff the language
+    void FeedStream(const uint8_t* p, size_t n) {
+        if (n == 0 || replay_) return;
+        if (!language_) {
+            stream_bytes_ += n;
+            version_++;
+            head_.insert(head_.end(), p, p + n);
+            if (head_.size() >= PRINT_SNIFF_BYTES) DecideLanguage();
+            return;
+        }
+        if (language_->language != PrintLanguage::EscPos) {
+            stream_bytes_ += n;
+            version_++;
+            if (decoder_) decoder_->Feed(p, n);
+            return;
+        }
+        FeedEscPos(p, n);
+    }
+
+    void DecideLanguage() {
+        language_ = &SniffPrintLanguage(std::string_view(reinterpret_cast<const char*>(head_.data()), PRINT_SNIFF_BYTES));
+        std::vector<uint8_t> head;
+        head.swap(head_);
+        if (language_->language != PrintLanguage::EscPos) {
+            if (language_->create) decoder_ = language_->create();
+            if (decoder_) decoder_->Feed(head.data(), head.size());
+            return; // Without a decoder the stream is not decoded
+        }
+        stream_bytes_ -= head.size();
+        FeedEscPos(head.data(), head.size());
+    }
+
+    void FeedEscPos(const uint8_t* p, size_t n) {
+        uint64_t offset = stream_bytes_;
+        stream_bytes_ += n;
+        version_++;
+        raster_.Feed(p, n, [this](const uint8_t* data, size_t size) { raster_bytes_.insert(raster_bytes_.end(), data, data + size); });
+        const EscPosRasterInfo& info = raster_.info();
+        if (emulate_all_ || EscPosLooksLikeText(info) || (info.text_bytes == 0 && info.unknown_bytes == 0 && info.blocks == 0)) {
+            if (emulator_stale_) { // Text after all, but the emulator missed part of the stream
+                replay_ = true;
+                return;
+            }
+            emulator_.Feed(p, n);
+        } else if (!emulator_stale_) {
+            emulator_ = EscPosEmulator();
+            emulator_stale_ = true;
+        }
+        if (raster_.info().blocks > 0) {
+            if (!kept_.empty() || !unfiltered_.empty()) { // Raster commands decide it; the fallback is not needed
+                std::vector<uint8_t>().swap(kept_);
+                std::vector<uint8_t>().swap(unfiltered_);
+            }
+            return;
+        }
+
+        // No raster command yet: keep the stream after the job header, filtered, in case none follows
+        size_t skip = offset < RECEIPT_HEADER_SIZE ? (size_t)std::min<uint64_t>(RECEIPT_HEADER_SIZE - offset, n) : 0;
+        unfiltered_.insert(unfiltered_.end(), p + skip, p + n);
+        if (filter_->empty()) {
+            kept_.insert(kept_.end(), unfiltered_.begin(), unfiltered_.end());
+            unfiltered_.clear();
+            return;
+        }
+
+        // Matches are final once found; bytes after the last one may still begin a pattern
+        // completed by the next poll, so up to hold_back_ of them wait. Scanning resumes
+        // from the held bytes as if from a fresh start, which finds the same matches: none
+        // can have started before them.
+        matches_.clear();
+        filter_->ForEachMatch(unfiltered_.data(), unfiltered_.size(), [&](size_t match, size_t index) {
+            matches_.push_back({ match, match + filter_->patterns()[index].size() });
+        });
+        size_t last_end = matches_.empty() ? 0 : matches_.back().second;
+        size_t commit = std::max(last_end, unfiltered_.size() - std::min(hold_back_, unfiltered_.size()));
+        size_t read = 0;
+        for (const auto& match : matches_) {
+            kept_.insert(kept_.end(), unfiltered_.begin() + read, unfiltered_.begin() + match.first);
+            read = match.second;
+        }
+        kept_.insert(kept_.end(), unfiltered_.begin() + read, unfiltered_.begin() + commit);
+        unfiltered_.erase(unfiltered_.begin(), unfiltered_.begin() + commit);
+    }
+
+    // Forgets what was decoded, to read the file again with the emulator running throughout
+    void Restart() {
+        read_ = 0;
+        version_++;
+        container_ = Container::Unknown;
+        pending_.clear();
+        time_us_ = 0;
+        stream_bytes_ = 0;
+        head_.clear();
+        language_ = nullptr;
+        decoder_.reset();
+        raster_ = EscPosRasterReader();
+        raster_bytes_.clear();
+        emulator_ = EscPosEmulator();
+        emulator_stale_ = false;
+        emulate_all_ = true;
+        replay_ = false;
+        kept_.clear();
+        unfiltered_.clear();
+    }
+
+    std::filesystem::path path_;
+    const BytePatternFilter* filter_;
+    size_t hold_back_ = 0;
+    std::ifstream file_;
+    std::vector<uint8_t> chunk_;
+    uint64_t read_ = 0; // File bytes consumed
+    uint64_t version_ = 0;
+
+    Container container_ = Container::Unknown;
+    std::vector<uint8_t> pending_; // Framed: bytes of the header or an incomplete frame
+    uint64_t time_us_ = 0;
+
+    uint64_t stream_bytes_ = 0;
+    std::vector<uint8_t> head_;                    // Until the language is known
+    const PrintLanguageSpec* language_ = nullptr;
+    std::unique_ptr<PageDecoder> decoder_;         // Not ESC/POS
+    EscPosRasterReader raster_;
+    std::vector<uint8_t> raster_bytes_;
+    EscPosEmulator emulator_;
+    bool emulator_stale_ = false; // The emulator was dropped and has missed part of the stream
+    bool emulate_all_ = false;    // Read again: the emulator is never dropped
+    bool replay_ = false;         // Read the file again before decoding any further
+    std::vector<uint8_t> kept_;       // No raster commands: filtered stream after the job header
+    std::vector<uint8_t> unfiltered_; // ... followed by these bytes, not yet filtered
+    std::vector<std::pair<size_t, size_t>> matches_;
+};
@@ -0,0 +1,286 @@
+#pragma once
+
+// Text of a print job for searching: what an ESC/POS stream prints, as UTF-8 lines.
+//
+// ReceiptTextExtractor sits on EscPosParser like the emulator but keeps only characters:
+// text bytes decoded through the code table (ESC t) and international character set
+// (ESC R) in effect, LF, FF, feeds and cuts ending the line and HT kept as a tab. The
+// human-readable text of GS k barcodes and the data of printed QR codes go on lines of
+// their own, since order and ticket numbers are often printed only there. Raster images
+// carry no text, and ESC/POS streams that are not text (headerless raster data) give none:
+// see looks_like_text(). Other printer languages (print_language.h) are left to their
+// decoders.
+//
+// ForEachReceiptTerm splits text into search terms: runs of letters and digits,
+// lower-cased (ASCII, Latin-1, Latin Extended-A, Greek and Cyrillic). Runs joined by
+// . , - / : such as 12.50, 2024-05-01 or A-123 also form one compound term, so both the
+// whole and its parts can be searched.
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "escpos_parser.h"
+#include "escpos_emulator.h" // EncodeEscPosBarcode, ESCPOS_SYMBOL_MAX, ESCPOS_TEXT_UNKNOWN_RATIO
+#include "code_pages.h"
+#include "print_language.h"
+
+constexpr size_t RECEIPT_TEXT_MAX_BYTES = 1 << 20;  // Per job; the rest of a huge stream is not searched
+constexpr size_t RECEIPT_TERM_MAX_BYTES = 64;       // Longer runs (hex dumps, base64) are not terms
+
+class ReceiptTextExtractor {
+public:
+    void Feed(const uint8_t* p, size_t n) {
+        parser_.Feed(p, n, [this](const EscPosEvent& e) { OnEvent(e); });
+    }
+
+    void Feed(const ByteSpanList& stream) {
+        for (const ByteSpan& segment : stream.segments) Feed(segment.data, segment.size);
+    }
+
+    void Finish() {
+        parser_.Finish([this](const EscPosEvent& e) { OnEvent(e); });
+        EndLine();
+    }
+
+    // Mostly text and few unrecognized bytes, by the same measure the viewer uses to
+    // choose between emulating and showing raw rows
+    bool looks_like_text() const {
+        return text_bytes_ > 0 && unknown_bytes_ * ESCPOS_TEXT_UNKNOWN_RATIO <= text_bytes_;
+    }
+
+    // The printed lines, empty if the stream does not look like text
+    std::string TakeText() {
+        std::string text;
+        if (looks_like_text()) text.swap(text_);
+        text_.clear();
+        return text;
+    }
+
+private:
+    enum class Payload { None, Barcode, Symbol };
+
+    void OnEvent(const EscPosEvent& e) {
+        if (e.type == EscPosEventType::Data) {
+            OnData(e);
+            return;
+        }
+        payload_ = Payload::None;
+        switch (e.type) {
+            case EscPosEventType::Text:
+                text_bytes_ += e.data.size;
+                for (size_t i = 0; i < e.data.size; ++i) PutChar(map_[e.data.data[i]]);
+                break;
+            case EscPosEventType::LineFeed:
+            case EscPosEventType::FormFeed:
+            case EscPosEventType::FeedDots:
+            case EscPosEventType::FeedLines:
+            case EscPosEventType::Cut:
+                EndLine();
+                break;
+            case EscPosEventType::Tab:
+                PutChar('\t');
+                break;
+            case EscPosEventType::Initialize:
+                code_page_ = 0;
+                international_ = 0;
+                map_.Select(0, 0);
+                break;
+            case EscPosEventType::Command:
+                OnCommand(e);
+                break;
+            case EscPosEventType::Unknown:
+                unknown_bytes_ += std::max<size_t>(e.data.size, 1);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void OnCommand(const EscPosEvent& e) {
+        uint8_t n = e.param_count > 0 ? e.params[0] : 0;
+        switch (e.prefix << 8 | e.function) {
+            case ESCPOS_ESC << 8 | 't':
+                code_page_ = n;
+                map_.Select(code_page_, international_);
+                break;
+            case ESCPOS_ESC << 8 | 'R':
+                international_ = n;
+                map_.Select(code_page_, international_);
+                break;
+            case ESCPOS_GS << 8 | 'k':
+                payload_ = Payload::Barcode;
+                payload_mode_ = e.mode;
+                payload_data_.clear();
+                break;
+            case ESCPOS_GS << 8 | '(':
+                if (e.mode == 'k') {
+                    payload_ = Payload::Symbol;
+                    payload_data_.clear();
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void OnData(const EscPosEvent& e) {
+        if (payload_ == Payload::None) return;
+        size_t take = std::min(e.data.size, ESCPOS_SYMBOL_MAX - std::min(ESCPOS_SYMBOL_MAX, payload_data_.size()));
+        payload_data_.append(reinterpret_cast<const char*>(e.data.data), take);
+        if (e.data_length > 0) return;
+        Payload kind = payload_;
+        payload_ = Payload::None;
+        if (kind == Payload::Barcode) {
+            EscPosBarcode barcode;
+            PutLine(EncodeEscPosBarcode(payload_mode_, payload_data_, 1, barcode) ? barcode.text : payload_data_);
+        } else if (payload_data_.size() >= 2 && (uint8_t)payload_data_[0] == 49) { // QR code
+            uint8_t fn = (uint8_t)payload_data_[1];
+            if (fn == 80) qr_data_ = payload_data_.substr(std::min<size_t>(3, payload_data_.size()));
+            if (fn == 81) PutLine(qr_data_);
+        }
+    }
+
+    // Symbol data is usually ASCII or UTF-8; anything else goes through the code table
+    void PutLine(const std::string& data) {
+        EndLine();
+        bool utf8 = true;
+        for (size_t i = 0; i < data.size() && utf8;) utf8 = NextUtf8(data, i) != ESCPOS_REPLACEMENT_CHAR;
+        for (size_t i = 0; i < data.size();) {
+            char32_t c = utf8 ? NextUtf8(data, i) : map_[(uint8_t)data[i++]];
+            PutChar(c < 0x20 ? ' ' : c);
+        }
+        EndLine();
+    }
+
+    void PutChar(char32_t c) {
+        if (c == 0x7F || text_.size() >= RECEIPT_TEXT_MAX_BYTES) return;
+        AppendUtf8(text_, c);
+    }
+
+    void EndLine() {
+        if (!text_.empty() && text_.back() != '\n' && text_.size() < RECEIPT_TEXT_MAX_BYTES) text_ += '\n';
+    }
+
+    EscPosParser parser_;
+    EscPosCharMap map_;
+    uint8_t code_page_ = 0;
+    uint8_t international_ = 0;
+    std::string text_;
+    uint64_t text_bytes_ = 0;
+    uint64_t unknown_bytes_ = 0;
+    Payload payload_ = Payload::None;
+    uint8_t payload_mode_ = 0;
+    std::string payload_data_;
+    std::string qr_data_;
+};
+
+// Streams in another printer language take their decoder's text: label fields, barcode
+// data and PCL text lines
+inline std::string ExtractReceiptText(const ByteSpanList& stream) {
+    const PrintLanguageSpec& language = SniffPrintLanguage(stream);
+    if (language.language != PrintLanguage::EscPos) {
+        if (!language.create) return std::string();
+        std::unique_ptr<PageDecoder> decoder = language.create();
+        decoder->set_text_only(true);
+        for (const ByteSpan& segment : stream.segments) decoder->Feed(segment.data, segment.size);
+        decoder->Finish();
+        return decoder->TakeText();
+    }
+    ReceiptTextExtractor extractor;
+    extractor.Feed(stream);
+    extractor.Finish();
+    return extractor.TakeText();
+}
+
+// --- Terms ---
+
+inline bool IsTermChar(char32_t c) {
+    if (c < 0x80) return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    if (c < 0xC0) return c == 0xAA || c == 0xB5 || c == 0xBA;
+    if (c == 0xD7 || c == 0xF7 || c == ESCPOS_REPLACEMENT_CHAR) return false;
+    return c < 0x2000 || c >= 0x3000; // Not punctuation, currency, arrows, box drawing or blocks
+}
+
+inline bool IsTermJoiner(char32_t c) {
+    return c == '.' || c == ',' || c == '-' || c == '/' || c == ':';
+}
+
+inline char32_t FoldTermChar(char32_t c) {
+    if (c >= 'A' && c <= 'Z') return c + 0x20;
+    if (c < 0xC0) return c;
+    if (c <= 0xDE) return c == 0xD7 ? c : c + 0x20;
+    if (c >= 0x100 && c <= 0x17F) {
+        bool odd_upper = (c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E);
+        if (c == 0x130 || c == 0x131 || c == 0x138 || c == 0x149 || c == 0x17F) return c;
+        return (c % 2 == 1) == odd_upper ? c + 1 : c;
+    }
+    if (c >= 0x391 && c <= 0x3AB && c != 0x3A2) return c + 0x20; // Greek
+    if (c >= 0x410 && c <= 0x42F) return c + 0x20;                // Cyrillic
+    if (c >= 0x400 && c <= 0x40F) return c + 0x50;
+    return c;
+}
+
+// Calls f(const std::string& term) for each term of text. Indexing (with_parts) yields every
+// run and, for runs joined by . , - / :, the compound as well; queries (!with_parts) yield
+// only the compounds, so "12.50" must match as a whole. Terms may repeat.
+template <typename F>
+inline void ForEachReceiptTerm(const std::string& text, bool with_parts, F f) {
+    std::string word, compound;
+    int words = 0;        // Runs in compound
+    char32_t joiner = 0;  // Pending between the last run and the next
+    auto end_word = [&]() {
+        if (word.empty()) return;
+        if (with_parts && word.size() <= RECEIPT_TERM_MAX_BYTES) f(word);
+        word.clear();
+        ++words;
+    };
+    auto end_compound = [&]() {
+        end_word();
+        if ((words > 1 || (!with_parts && words == 1)) && compound.size() <= RECEIPT_TERM_MAX_BYTES) f(compound);
+        compound.clear();
+        words = 0;
+        joiner = 0;
+    };
+    for (size_t i = 0; i < text.size();) {
+        char32_t c = (uint8_t)text[i] < 0x80 ? (uint8_t)text[i++] : NextUtf8(text, i);
+        if (IsTermChar(c)) {
+            if (joiner != 0) compound += (char)joiner; // Joiners are ASCII
+            joiner = 0;
+            c = FoldTermChar(c);
+            if (c < 0x80) {
+                word += (char)c;
+                compound += (char)c;
+            } else {
+                AppendUtf8(word, c);
+                AppendUtf8(compound, c);
+            }
+        } else if (IsTermJoiner(c) && !word.empty()) {
+            end_word();
+            joiner = c;
+        } else {
+            end_compound();
+        }
+    }
+    end_compound();
+}
+
+// Distinct terms of text, sorted
+inline std::vector<std::string> ReceiptTerms(const std::string& text) {
+    std::string all; // Sorted as views into one buffer; moving strings around costs more
+    std::vector<std::pair<uint32_t, uint32_t>> spans;
+    ForEachReceiptTerm(text, true, [&](const std::string& term) {
+        spans.emplace_back((uint32_t)all.size(), (uint32_t)term.size());
+        all += term;
+    });
+    std::vector<std::string_view> views;
+    views.reserve(spans.size());
+    for (const auto& span : spans) views.emplace_back(all.data() + span.first, span.second);
+    std::sort(views.begin(), views.end());
+    views.erase(std::unique(views.begin(), views.end()), views.end());
+    return std::vector<std::string>(views.begin(), views.end());
+}
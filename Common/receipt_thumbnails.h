@@ -0,0 +1,437 @@
+#pragma once
+
+// Small previews of captures for browsing a directory without opening each one.
+//
+// A thumbnail shows the first preview_rows rows of a capture, laid out at its detected
+// (or a given) width and box-filtered down to thumb_width pixels, as 8-bit gray. Only the
+// start of the client stream is decoded, so a preview costs about the same for a 50 KB
+// receipt as for a 200 MB roll.
+//
+// thumbnails.cache, kept next to the captures like the job catalog, stores them across
+// runs. It is an append-only log:
+//
+//   THUMBNAIL_CACHE_HEADER_SIZE byte header (magic, version)
+//   records: u32 size, u64 key, u16 name length, u16 width, u16 height, u16 source width,
+//            u8 width source, u8 reserved, u32 source rows, name (UTF-8), pixels at
+//            4 bits each (high nibble first), u32 CRC32C of the preceding record bytes
+//
+// The key hashes the capture's file name, size and modification time with the render
+// parameters, so a capture that changes or a different layout simply misses. Opening
+// reads only the record headers into a key -> offset map; a lookup is one map probe and
+// one read. A record torn by a crash is cut off at the next Open. One process should
+// write a cache at a time.
+//
+// ThumbnailGenerator renders requested captures on a pool of worker threads, serving
+// them from the cache when it can, and publishes each result as it is ready.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+
+#include "byte_order.h"
+#include "crc32c.h"
+#include "receipt_decoder.h"
+#include "width_detect.h"
+
+const std::string THUMBNAIL_CACHE_FILENAME = "thumbnails.cache";
+constexpr char THUMBNAIL_CACHE_MAGIC[8] = { 'P', 'R', 'L', 'T', 'H', 'M', '\r', '\n' };
+constexpr uint16_t THUMBNAIL_CACHE_VERSION = 3;  // 2: text captures are emulated, 3: other printer languages
+constexpr size_t THUMBNAIL_CACHE_HEADER_SIZE = 32;
+constexpr size_t THUMBNAIL_RECORD_FIXED_SIZE = 26;  // Up to the name
+constexpr uint32_t THUMBNAIL_RECORD_MAX_SIZE = 16 * 1024 * 1024;
+
+constexpr int THUMBNAIL_WIDTH = 128;          // Pixels
+constexpr int THUMBNAIL_PREVIEW_ROWS = 768;   // Source rows shown (about 10 cm of paper at 8 dots/mm)
+constexpr int THUMBNAIL_MIN_WIDTH = 64;       // Width detection range, as in the viewer
+constexpr int THUMBNAIL_MAX_WIDTH = 1200;
+constexpr int THUMBNAIL_FALLBACK_WIDTH = 576; // When no width is detected
+constexpr int THUMBNAIL_SETTLE_SECONDS = 10;  // Captures modified more recently may still be growing; not cached
+
+struct ThumbnailParams {
+    int width = 0;  // Dots per row; 0: detected per capture
+    bool msb_first = true;
+    bool invert = false;
+    int thumb_width = THUMBNAIL_WIDTH;
+    int preview_rows = THUMBNAIL_PREVIEW_ROWS;
+};
+
+struct Thumbnail {
+    int width = 0;
+    int height = 0;
+    int source_width = 0;  // Dots per row the capture was laid out at
+    WidthSource width_source = WidthSource::None;
+    int source_rows = 0;          // Rows of the capture shown
+    std::vector<uint8_t> pixels;  // width x height gray, top-down, 255 = paper
+};
+
+// --- Rendering ---
+
+// Box-filters rows [0, min(rows, preview_rows)) of bits laid out at width
+inline bool MakeThumbnail(const ReceiptBits& bits, int width, const ThumbnailParams& params, Thumbnail& out, std::string& error) {
+    out = Thumbnail();
+    int rows = width > 0 ? std::min(bits.rows(width), params.preview_rows) : 0;
+    if (rows <= 0) {
+        error = "No complete row at width " + std::to_string(width) + ".";
+        return false;
+    }
+    int tw = std::max(1, std::min(params.thumb_width, width));
+    int th = std::max(1, (int)(((int64_t)rows * tw + width / 2) / width));
+    out.width = tw;
+    out.height = th;
+    out.source_width = width;
+    out.source_rows = rows;
+    out.pixels.resize((size_t)tw * th);
+
+    std::vector<int> column(width);  // Dot column -> thumbnail column
+    std::vector<int> column_dots(tw, 0);
+    for (int x = 0; x < width; ++x) {
+        column[x] = (int)((int64_t)x * tw / width);
+        column_dots[column[x]]++;
+    }
+    size_t row_bytes = ((size_t)width + 7) / 8;
+    std::vector<uint8_t> band;
+    std::vector<int> dark(tw);
+    for (int ty = 0; ty < th; ++ty) {
+        int first = (int)((int64_t)ty * rows / th), end = (int)((int64_t)(ty + 1) * rows / th);
+        band.resize(row_bytes * (size_t)(end - first));
+        PackReceiptRows(bits, width, params.msb_first, params.invert, first, end - first, band.data(), row_bytes);
+        std::fill(dark.begin(), dark.end(), 0);
+        for (int r = 0; r < end - first; ++r) {
+            const uint8_t* row = band.data() + (size_t)r * row_bytes;
+            for (int x = 0; x < width; ++x) dark[column[x]] += (row[x >> 3] >> (7 - (x & 7))) & 1;
+        }
+        uint8_t* out_row = out.pixels.data() + (size_t)ty * tw;
+        for (int tx = 0; tx < tw; ++tx) {
+            int area = column_dots[tx] * (end - first);
+            out_row[tx] = (uint8_t)(255 - (area ? dark[tx] * 255 / area : 0));
+        }
+    }
+    return true;
+}
+
+// Decodes the start of a capture and renders its thumbnail
+inline bool RenderCaptureThumbnail(const std::filesystem::path& path, const BytePatternFilter& filter,
+                                   const ThumbnailParams& params, Thumbnail& out, std::string& error) {
+    CaptureFile capture;
+    if (!capture.Open(path, error)) return false;
+    // The preview rows at the widest width, twice over for raster command overhead
+    uint64_t prefix = (uint64_t)params.preview_rows * THUMBNAIL_MAX_WIDTH / 8 * 2 + 4096;
+    ReceiptBits bits;
+    if (!ExtractReceiptBits(capture.client_stream().Take(prefix), filter, bits, error)) return false;
+    int width = params.width;
+    WidthSource source = WidthSource::None;
+    if (width == 0) {
+        WidthDetection detection = DetectReceiptWidth(bits, THUMBNAIL_MIN_WIDTH, THUMBNAIL_MAX_WIDTH);
+        width = detection.width > 0 ? detection.width : THUMBNAIL_FALLBACK_WIDTH;
+        source = detection.source;
+    }
+    if (!MakeThumbnail(bits, width, params, out, error)) return false;
+    out.width_source = source;
+    return true;
+}
+
+// --- Persistent cache ---
+
+class ThumbnailCache {
+public:
+    ThumbnailCache() = default;
+    ThumbnailCache(const ThumbnailCache&) = delete;
+    ThumbnailCache& operator=(const ThumbnailCache&) = delete;
+
+    // Key of a capture as it is now on disk; false if it cannot be examined
+    static bool KeyOf(const std::filesystem::path& path, const ThumbnailParams& params, uint64_t& key) {
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(path, ec);
+        if (ec) return false;
+        auto modified = std::filesystem::last_write_time(path, ec);
+        if (ec) return false;
+        uint64_t h = 0xcbf29ce484222325ull;  // FNV-1a
+        auto mix = [&h](const void* data, size_t len) {
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            for (size_t i = 0; i < len; ++i) h = (h ^ p[i]) * 0x100000001b3ull;
+        };
+        std::string name = path.filename().u8string();
+        mix(name.data(), name.size() + 1);
+        int64_t stamp = (int64_t)modified.time_since_epoch().count();
+        int32_t values[] = { params.width, params.msb_first, params.invert, params.thumb_width, params.preview_rows,
+                             THUMBNAIL_CACHE_VERSION };
+        mix(&size, sizeof(size));
+        mix(&stamp, sizeof(stamp));
+        mix(values, sizeof(values));
+        key = h;
+        return true;
+    }
+
+    // Opens dir/thumbnails.cache, creating it if needed, and indexes its records
+    bool Open(const std::filesystem::path& dir, std::string& error) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        path_ = dir / THUMBNAIL_CACHE_FILENAME;
+        index_.clear();
+        file_.close();
+        std::error_code ec;
+        uint64_t file_size = std::filesystem::exists(path_, ec) ? std::filesystem::file_size(path_, ec) : 0;
+        if (ec) file_size = 0;
+
+        uint8_t header[THUMBNAIL_CACHE_HEADER_SIZE] = {};
+        bool valid = false;
+        if (file_size >= THUMBNAIL_CACHE_HEADER_SIZE) {
+            std::ifstream in(path_, std::ios::binary);
+            valid = in.read(reinterpret_cast<char*>(header), sizeof(header)) &&
+                    std::memcmp(header, THUMBNAIL_CACHE_MAGIC, 8) == 0 && GetLE16(header + 8) == THUMBNAIL_CACHE_VERSION;
+            end_ = THUMBNAIL_CACHE_HEADER_SIZE;
+            uint8_t fixed[12];
+            while (valid && end_ + 12 <= file_size) {
+                in.seekg((std::streamoff)end_);
+                if (!in.read(reinterpret_cast<char*>(fixed), sizeof(fixed))) break;
+                uint32_t size = GetLE32(fixed);
+                if (size < THUMBNAIL_RECORD_FIXED_SIZE + 4 || size > THUMBNAIL_RECORD_MAX_SIZE || end_ + size > file_size) break;
+                index_[GetLE64(fixed + 4)] = end_;
+                end_ += size;
+            }
+        }
+        if (!valid) {  // Missing, from another version or damaged: start over
+            std::ofstream out(path_, std::ios::binary | std::ios::trunc);
+            std::memset(header, 0, sizeof(header));
+            std::memcpy(header, THUMBNAIL_CACHE_MAGIC, 8);
+            PutLE16(header + 8, THUMBNAIL_CACHE_VERSION);
+            if (!out.write(reinterpret_cast<const char*>(header), sizeof(header))) {
+                error = "Cannot create " + path_.u8string();
+                return false;
+            }
+            end_ = THUMBNAIL_CACHE_HEADER_SIZE;
+        } else if (end_ < file_size) {
+            std::filesystem::resize_file(path_, end_, ec);  // Torn last record
+        }
+        file_.open(path_, std::ios::binary | std::ios::in | std::ios::out);
+        if (!file_.is_open()) {
+            error = "Cannot open " + path_.u8string();
+            index_.clear();
+            return false;
+        }
+        return true;
+    }
+
+    // The cached thumbnail of the capture named name (file name only) with this key
+    bool Find(uint64_t key, const std::string& name, Thumbnail& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(key);
+        if (found == index_.end() || !file_.is_open()) return false;
+        uint8_t fixed[4];
+        file_.clear();
+        file_.seekg((std::streamoff)found->second);
+        if (!file_.read(reinterpret_cast<char*>(fixed), 4)) return false;
+        std::vector<uint8_t> record(GetLE32(fixed));
+        std::memcpy(record.data(), fixed, 4);
+        if (!file_.read(reinterpret_cast<char*>(record.data() + 4), (std::streamsize)record.size() - 4)) return false;
+        return Decode(record, name, out);
+    }
+
+    bool Insert(uint64_t key, const std::string& name, const Thumbnail& thumbnail) {
+        std::vector<uint8_t> record = Encode(key, name, thumbnail);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_.is_open()) return false;
+        file_.clear();
+        file_.seekp((std::streamoff)end_);
+        if (!file_.write(reinterpret_cast<const char*>(record.data()), (std::streamsize)record.size()) || !file_.flush()) {
+            file_.clear();
+            return false;
+        }
+        index_[key] = end_;
+        end_ += record.size();
+        return true;
+    }
+
+    bool is_open() const { return file_.is_open(); }
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return index_.size();
+    }
+    uint64_t file_bytes() const { return end_; }
+    const std::filesystem::path& path() const { return path_; }
+
+private:
+    static std::vector<uint8_t> Encode(uint64_t key, const std::string& name, const Thumbnail& t) {
+        size_t name_size = std::min<size_t>(name.size(), 0xFFFF);
+        size_t pixel_bytes = (t.pixels.size() + 1) / 2;
+        std::vector<uint8_t> record(THUMBNAIL_RECORD_FIXED_SIZE + name_size + pixel_bytes + 4, 0);
+        uint8_t* p = record.data();
+        PutLE32(p, (uint32_t)record.size());
+        PutLE64(p + 4, key);
+        PutLE16(p + 12, (uint16_t)name_size);
+        PutLE16(p + 14, (uint16_t)t.width);
+        PutLE16(p + 16, (uint16_t)t.height);
+        PutLE16(p + 18, (uint16_t)t.source_width);
+        p[20] = (uint8_t)t.width_source;
+        PutLE32(p + 22, (uint32_t)t.source_rows);
+        std::memcpy(p + THUMBNAIL_RECORD_FIXED_SIZE, name.data(), name_size);
+        uint8_t* pixels = p + THUMBNAIL_RECORD_FIXED_SIZE + name_size;
+        for (size_t i = 0; i < t.pixels.size(); ++i) pixels[i / 2] |= (uint8_t)((t.pixels[i] >> 4) << (i % 2 ? 0 : 4));
+        PutLE32(p + record.size() - 4, Crc32cUpdate(0, p, record.size() - 4));
+        return record;
+    }
+
+    static bool Decode(const std::vector<uint8_t>& record, const std::string& name, Thumbnail& out) {
+        const uint8_t* p = record.data();
+        size_t size = record.size();
+        if (size < THUMBNAIL_RECORD_FIXED_SIZE + 4 || GetLE32(p + size - 4) != Crc32cUpdate(0, p, size - 4)) return false;
+        size_t name_size = GetLE16(p + 12);
+        Thumbnail t;
+        t.width = GetLE16(p + 14);
+        t.height = GetLE16(p + 16);
+        t.source_width = GetLE16(p + 18);
+        t.width_source = (WidthSource)std::min<uint8_t>(p[20], (uint8_t)WidthSource::Emulated);
+        t.source_rows = (int)GetLE32(p + 22);
+        size_t count = (size_t)t.width * t.height;
+        if (THUMBNAIL_RECORD_FIXED_SIZE + name_size + (count + 1) / 2 + 4 != size) return false;
+        if (name.compare(0, std::string::npos, reinterpret_cast<const char*>(p + THUMBNAIL_RECORD_FIXED_SIZE), name_size) != 0) return false;
+        const uint8_t* pixels = p + THUMBNAIL_RECORD_FIXED_SIZE + name_size;
+        t.pixels.resize(count);
+        for (size_t i = 0; i < count; ++i) t.pixels[i] = (uint8_t)(((pixels[i / 2] >> (i % 2 ? 0 : 4)) & 0x0F) * 17);
+        out = std::move(t);
+        return true;
+    }
+
+    mutable std::mutex mutex_;
+    std::filesystem::path path_;
+    std::fstream file_;
+    std::unordered_map<uint64_t, uint64_t> index_;  // Key -> record offset; the last record of a key wins
+    uint64_t end_ = 0;
+};
+
+// --- Background generation ---
+
+struct ThumbnailUpdate {
+    uint64_t generation = 0;
+    std::filesystem::path path;
+    bool ok = false;
+    bool cached = false;  // Read from the thumbnail cache
+    Thumbnail thumbnail;
+    std::string error;
+};
+
+class ThumbnailGenerator {
+public:
+    using Publish = std::function<void(ThumbnailUpdate&&)>;
+
+    // cache may be null (nothing persisted); it and the filter must outlive the generator.
+    // threads = 0: one per core but one, at most four.
+    ThumbnailGenerator(const BytePatternFilter& filter, const ThumbnailParams& params, ThumbnailCache* cache,
+                       Publish publish, unsigned threads = 0)
+        : filter_(filter), params_(params), cache_(cache), publish_(std::move(publish)) {
+        if (threads == 0) threads = std::clamp(std::thread::hardware_concurrency(), 2u, 5u) - 1;
+        for (unsigned i = 0; i < threads; ++i) workers_.emplace_back([this] { Work(); });
+    }
+
+    ~ThumbnailGenerator() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            queue_.clear();
+            generation_++;
+        }
+        wake_.notify_all();
+        for (std::thread& worker : workers_) worker.join();
+    }
+
+    ThumbnailGenerator(const ThumbnailGenerator&) = delete;
+    ThumbnailGenerator& operator=(const ThumbnailGenerator&) = delete;
+
+    // Queues captures in the order given, ahead of everything already queued if urgent;
+    // a capture already queued is moved rather than added twice
+    void Request(const std::vector<std::filesystem::path>& paths, bool urgent) {
+        if (paths.empty()) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (urgent) {
+                for (const std::filesystem::path& path : paths) queued_.erase(path.native());
+                queue_.erase(std::remove_if(queue_.begin(), queue_.end(),
+                                            [&](const std::filesystem::path& queued) { return !queued_.count(queued.native()); }),
+                             queue_.end());
+                for (const std::filesystem::path& path : paths) queued_.insert(path.native());
+                queue_.insert(queue_.begin(), paths.begin(), paths.end());
+            } else {
+                for (const std::filesystem::path& path : paths) {
+                    if (queued_.insert(path.native()).second) queue_.push_back(path);
+                }
+            }
+        }
+        wake_.notify_all();
+    }
+
+    // Drops everything queued; thumbnails already rendering are not published
+    uint64_t Cancel() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.clear();
+        queued_.clear();
+        return ++generation_;
+    }
+
+    uint64_t generation() const { return generation_; }
+    size_t queued() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return queue_.size();
+    }
+
+private:
+    void Work() {
+        for (;;) {
+            std::filesystem::path path;
+            uint64_t generation;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+                if (stopping_) return;
+                path = std::move(queue_.front());
+                queue_.pop_front();
+                queued_.erase(path.native());
+                generation = generation_;
+            }
+            ThumbnailUpdate update;
+            update.generation = generation;
+            update.path = path;
+            uint64_t key = 0;
+            bool keyed = ThumbnailCache::KeyOf(path, params_, key);
+            std::string name = path.filename().u8string();
+            if (keyed && cache_ && cache_->Find(key, name, update.thumbnail)) {
+                update.ok = update.cached = true;
+            } else {
+                update.ok = RenderCaptureThumbnail(path, filter_, params_, update.thumbnail, update.error);
+                if (update.ok && keyed && cache_ && Settled(path)) cache_->Insert(key, name, update.thumbnail);
+            }
+            if (generation == generation_) publish_(std::move(update));
+        }
+    }
+
+    static bool Settled(const std::filesystem::path& path) {
+        std::error_code ec;
+        auto modified = std::filesystem::last_write_time(path, ec);
+        return !ec && std::filesystem::file_time_type::clock::now() - modified > std::chrono::seconds(THUMBNAIL_SETTLE_SECONDS);
+    }
+
+    const BytePatternFilter& filter_;
+    ThumbnailParams params_;
+    ThumbnailCache* cache_;
+    Publish publish_;
+    std::atomic<uint64_t> generation_{ 0 };
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::filesystem::path> queue_;
+    std::unordered_set<std::filesystem::path::string_type> queued_;
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,292 @@
+#pragma once
+
+// Row-band tiles of a decoded receipt for viewers that scroll through very long rolls.
+//
+// ReceiptTileCache renders TILE_ROWS-row bands of the image on demand (RenderReceiptRows)
+// and keeps the most recently used ones within a memory budget, so drawing a viewport
+// costs a few tiles however long the capture is. Row r starts at bit r * width of the
+// receipt's bit stream, so a tile is located without any per-row index.
+//
+// Zooming out uses a pyramid of levels: level L shows the receipt at 1 : 2^L, each pixel
+// the share of paper in its 2^L x 2^L square of dots, as 8-bit gray. Tiles of a level are
+// rendered on demand like the full-size ones, straight from the packed dots by counting
+// set bits a 64-bit word at a time, so the whole of a roll hundreds of thousands of rows
+// long is drawn from a few tiles and no level is ever built in full.
+
+#include <cstdint>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+#include "receipt_decoder.h"
+
+class ReceiptTileCache {
+public:
+    static constexpr int TILE_ROWS = 256;
+    static constexpr size_t MIN_TILES = 16; // A full-screen viewport plus prefetch
+    static constexpr int MAX_LEVEL = 6;     // 1:64
+
+    struct Tile {
+        int index = 0;
+        int level = 0;     // Rows and width are of the receipt at 1 : 1 << level
+        int first_row = 0;
+        int rows = 0;
+        int width = 0;
+        int source_rows = 0;          // Of the receipt it was rendered from; see Extend
+        std::vector<uint32_t> pixels; // Level 0: rows x width ARGB, top-down
+        std::vector<uint8_t> gray;    // Other levels: rows of stride bytes, top-down, 255 = paper
+        int stride = 0;               // Of gray rows: width rounded up to 4 bytes, as DIBs need
+
+        size_t bytes() const { return pixels.size() * 4 + gray.size(); }
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    explicit ReceiptTileCache(size_t budget_bytes = 64 * 1024 * 1024) : budget_bytes_(budget_bytes) {}
+
+    // Drops all tiles; later calls render from bits at the given layout
+    void Reset(std::shared_ptr<const ReceiptBits> bits, int width, bool msb_first, bool invert) {
+        tiles_.clear();
+        lookup_.clear();
+        bytes_ = 0;
+        bits_ = std::move(bits);
+        width_ = width;
+        msb_first_ = msb_first;
+        invert_ = invert;
+        rows_ = bits_ ? bits_->rows(width) : 0;
+    }
+
+    // Takes a longer version of the same bit stream (a capture being followed while it is
+    // written), keeping the tiles the added rows leave unchanged
+    void Extend(std::shared_ptr<const ReceiptBits> bits) {
+        bits_ = std::move(bits);
+        rows_ = bits_ ? bits_->rows(width_) : 0;
+        for (auto it = tiles_.begin(); it != tiles_.end();) {
+            if (Current(*it)) {
+                ++it;
+                continue;
+            }
+            bytes_ -= it->bytes();
+            lookup_.erase(Key(it->index, it->level));
+            it = tiles_.erase(it);
+        }
+    }
+
+    // Whether a tile shows what the current bits would: tiles rendered from a shorter
+    // version of the stream differ in the rows it lacked
+    bool Current(const Tile& tile) const {
+        int64_t end = (int64_t)(tile.first_row + TILE_ROWS) << tile.level; // Receipt rows the tile spans
+        return std::min<int64_t>(tile.source_rows, end) == std::min<int64_t>(rows_, end);
+    }
+
+    void SetBudget(size_t budget_bytes) {
+        budget_bytes_ = budget_bytes;
+        Trim(0);
+    }
+
+    // Size of a dimension at 1 : 1 << level
+    static int LevelSize(int size, int level) { return (int)(((int64_t)size + (1 << level) - 1) >> level); }
+
+    const ReceiptBits* bits() const { return bits_.get(); }
+    int rows() const { return rows_; }
+    int rows(int level) const { return LevelSize(rows_, level); }
+    int width() const { return width_; }
+    bool msb_first() const { return msb_first_; }
+    bool invert() const { return invert_; }
+    size_t tile_count() const { return tiles_.size(); }
+    size_t memory_bytes() const { return bytes_; }
+    const Stats& stats() const { return stats_; }
+
+    // Full-size tiles the budget holds
+    size_t capacity() const {
+        size_t tile_bytes = (size_t)TILE_ROWS * (size_t)std::max(width_, 1) * 4;
+        return std::max(MIN_TILES, budget_bytes_ / tile_bytes);
+    }
+
+    // Renders one tile of bits laid out at width; the cache itself is not involved, so this
+    // may run on any thread
+    static Tile Render(const ReceiptBits& bits, int width, bool msb_first, bool invert, int index, int level = 0) {
+        if (level > 0) return RenderLevel(bits, width, msb_first, invert, index, level);
+        Tile tile;
+        tile.index = index;
+        tile.first_row = index * TILE_ROWS;
+        tile.rows = std::max(0, std::min(TILE_ROWS, bits.rows(width) - tile.first_row));
+        tile.width = width;
+        tile.source_rows = bits.rows(width);
+        tile.pixels.resize((size_t)tile.rows * (size_t)width);
+        RenderReceiptRows(bits, width, msb_first, invert, tile.first_row, tile.rows,
+                          reinterpret_cast<uint8_t*>(tile.pixels.data()), (ptrdiff_t)width * 4);
+        return tile;
+    }
+
+    // A tile of level > 0: output row y, column x is the share of dots not set (of those set
+    // if invert) among rows [y, y + 1) << level and columns [x, x + 1) << level of the receipt
+    static Tile RenderLevel(const ReceiptBits& bits, int width, bool msb_first, bool invert, int index, int level) {
+        const int scale = 1 << level;
+        const int source_rows = bits.rows(width);
+        Tile tile;
+        tile.index = index;
+        tile.level = level;
+        tile.first_row = index * TILE_ROWS;
+        tile.rows = std::max(0, std::min(TILE_ROWS, LevelSize(source_rows, level) - tile.first_row));
+        tile.width = LevelSize(width, level);
+        tile.source_rows = source_rows;
+        tile.stride = (tile.width + 3) & ~3;
+        tile.gray.assign((size_t)tile.rows * tile.stride, invert ? 0 : 255);
+        if (tile.rows == 0) return tile;
+
+        // Rows padded to whole words; the padding stays zero and counts as paper
+        const size_t words = ((size_t)width + 63) / 64;
+        const size_t band_stride = words * 8;
+        const int groups = 64 >> level;  // Output columns per word
+        std::vector<uint8_t> band(band_stride * scale, 0);
+        std::vector<uint32_t> dark(words * groups);
+        for (int y = 0; y < tile.rows; ++y) {
+            int first = (tile.first_row + y) * scale;
+            int count = std::min(scale, source_rows - first);
+            PackReceiptRows(bits, width, msb_first, false, first, count, band.data(), band_stride);
+            std::fill(dark.begin(), dark.end(), 0);
+            for (int r = 0; r < count; ++r) {
+                const uint8_t* row = band.data() + (size_t)r * band_stride;
+                for (size_t w = 0; w < words; ++w) {
+                    uint64_t v = 0;
+                    for (int k = 0; k < 8; ++k) v = v << 8 | row[w * 8 + k];
+                    AddGroupCounts(v, level, dark.data() + w * groups);
+                }
+            }
+            uint8_t* out = tile.gray.data() + (size_t)y * tile.stride;
+            for (int x = 0; x < tile.width; ++x) {
+                int area = std::min(scale, width - x * scale) * count;
+                int share = (int)(((int64_t)dark[x] * 255 + area / 2) / area);
+                out[x] = (uint8_t)(invert ? share : 255 - share);
+            }
+        }
+        return tile;
+    }
+
+    // Adds the set bits of each 1 << level bit group of v, the first group in the top bits, to
+    // out[0], out[1], ...: the partial sums of a SWAR popcount, stopped at the group width
+    static void AddGroupCounts(uint64_t v, int level, uint32_t* out) {
+        if (v == 0) return; // Blank paper, most of a receipt
+        v = v - ((v >> 1) & 0x5555555555555555ULL);
+        if (level >= 2) v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+        if (level >= 3) v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        if (level >= 4) v = (v + (v >> 8)) & 0x00FF00FF00FF00FFULL;
+        if (level >= 5) v = (v + (v >> 16)) & 0x0000FFFF0000FFFFULL;
+        if (level >= 6) {
+            out[0] += (uint32_t)((v + (v >> 32)) & 0xFFFFFFFFULL);
+            return;
+        }
+        const int group_bits = 1 << level, groups = 64 >> level;
+        const uint64_t mask = (1ULL << group_bits) - 1;
+        for (int g = 0; g < groups; ++g) out[g] += (uint32_t)((v >> (64 - group_bits * (g + 1))) & mask);
+    }
+
+    // The tile holding rows [index * TILE_ROWS, ...) of the level, rendered if needed. Null
+    // past the end. The pointer stays valid until the next call that renders a tile.
+    const Tile* Get(int index, int level = 0) {
+        if (!bits_ || index < 0 || level < 0 || level > MAX_LEVEL || index * (int64_t)TILE_ROWS >= rows(level)) return nullptr;
+        if (const Tile* tile = Find(index, level)) return tile;
+        Insert(Render(*bits_, width_, msb_first_, invert_, index, level));
+        return &tiles_.front();
+    }
+
+    // The cached tile, or null; never renders
+    const Tile* Find(int index, int level = 0) {
+        auto found = lookup_.find(Key(index, level));
+        if (found == lookup_.end()) {
+            stats_.misses++;
+            return nullptr;
+        }
+        stats_.hits++;
+        tiles_.splice(tiles_.begin(), tiles_, found->second);
+        return &tiles_.front();
+    }
+
+    // Adds a tile rendered elsewhere (Render) for the current layout; one rendered before the
+    // bits were extended may be out of date and is dropped
+    void Insert(Tile tile) {
+        if (!Current(tile)) return;
+        auto found = lookup_.find(Key(tile.index, tile.level));
+        if (found != lookup_.end()) {
+            bytes_ -= found->second->bytes();
+            tiles_.erase(found->second);
+            lookup_.erase(found);
+        }
+        Trim(tile.bytes());
+        int64_t key = Key(tile.index, tile.level);
+        bytes_ += tile.bytes();
+        tiles_.push_front(std::move(tile));
+        lookup_[key] = tiles_.begin();
+    }
+
+    // Calls f(const Tile&) for each tile intersecting rows [first_row, end_row), top to bottom
+    template <typename F>
+    void ForEachTile(int first_row, int end_row, F f) {
+        first_row = std::max(first_row, 0);
+        end_row = std::min(end_row, rows_);
+        for (int index = first_row / TILE_ROWS; index * TILE_ROWS < end_row; ++index) {
+            if (const Tile* tile = Get(index)) f(*tile);
+        }
+    }
+
+    // Tiles of rows [first_row, end_row) of the level and of margin_rows around them that are
+    // not cached: the viewport's from the top, then the margin's nearest first
+    std::vector<int> Missing(int first_row, int end_row, int margin_rows, int level = 0) const {
+        std::vector<int> missing;
+        const int level_rows = rows(level);
+        if (level_rows == 0) return missing;
+        first_row = std::clamp(first_row, 0, level_rows - 1);
+        end_row = std::clamp(end_row, first_row + 1, level_rows);
+        int top = first_row / TILE_ROWS;
+        int bottom = (end_row - 1) / TILE_ROWS;
+        int above = std::max(first_row - margin_rows, 0) / TILE_ROWS;
+        int below = (std::min(end_row + margin_rows, level_rows) - 1) / TILE_ROWS;
+        auto add = [&](int index) {
+            if (lookup_.find(Key(index, level)) == lookup_.end()) missing.push_back(index);
+        };
+        for (int index = top; index <= bottom; ++index) add(index);
+        for (int step = 1; top - step >= above || bottom + step <= below; ++step) {
+            if (bottom + step <= below) add(bottom + step);
+            if (top - step >= above) add(top - step);
+        }
+        return missing;
+    }
+
+    // Renders the tiles around a viewport ahead of time, nearest first
+    void Prefetch(int first_row, int end_row, int margin_rows) {
+        for (int index : Missing(first_row, end_row, margin_rows)) Get(index);
+    }
+
+private:
+    static int64_t Key(int index, int level) { return (int64_t)level << 32 | (uint32_t)index; }
+
+    // Evicts the least recently used tiles until incoming_bytes more fit the budget, always
+    // keeping MIN_TILES
+    void Trim(size_t incoming_bytes) {
+        while (tiles_.size() >= MIN_TILES && bytes_ + incoming_bytes > budget_bytes_) {
+            bytes_ -= tiles_.back().bytes();
+            lookup_.erase(Key(tiles_.back().index, tiles_.back().level));
+            tiles_.pop_back();
+            stats_.evictions++;
+        }
+    }
+
+    std::shared_ptr<const ReceiptBits> bits_;
+    int width_ = 0;
+    bool msb_first_ = true;
+    bool invert_ = false;
+    int rows_ = 0;
+    size_t budget_bytes_;
+    size_t bytes_ = 0;      // Of the cached tiles
+    std::list<Tile> tiles_; // Most recently used first
+    std::unordered_map<int64_t, std::list<Tile>::iterator> lookup_; // Key(index, level)
+    Stats stats_;
+};
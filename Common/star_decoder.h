@@ -0,0 +1,234 @@
+#pragma once
+
+// Star receipt printers' own command set (Star Line Mode, StarPRNT and Star raster mode),
+// which shares ESC with ESC/POS but little else, for page_decoder.h.
+//
+// Star drivers print in raster mode: ESC * r A enters it, b n1 n2 rows follow (n1 + n2 *
+// 256 bytes each), ESC * r Y n NUL feeds n dots and ESC * r B leaves it, which ends the
+// ticket; a form feed does too. StarPRNT images (ESC GS S 1 xL xH yL yH n, x bytes by y
+// rows) print in place. Text in line mode is drawn a line at a time in the built-in font
+// with the ESC GS a alignment, and ESC d cuts. Character styles and sizes, barcodes and
+// other symbols are not drawn; their commands are skipped by their lengths.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "page_decoder.h"
+
+constexpr int STAR_DEFAULT_WIDTH = 576;       // 80 mm paper at 203 dpi
+constexpr size_t STAR_COMMAND_MAX = 256;      // Longer commands are dropped
+constexpr uint8_t STAR_ESC = 0x1B, STAR_GS = 0x1D, STAR_RS = 0x1E;
+
+class StarDecoder : public PageDecoder {
+public:
+    StarDecoder() : PageDecoder(STAR_DEFAULT_WIDTH) {}
+
+    void Feed(const uint8_t* p, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            uint8_t c = p[i];
+            if (data_left_ > 0) { // Raster row or image data
+                size_t take = std::min<size_t>(data_left_, n - i);
+                data_.insert(data_.end(), p + i, p + i + take);
+                data_left_ -= take;
+                i += take - 1;
+                if (data_left_ == 0) EndData();
+                continue;
+            }
+            if (!command_.empty()) {
+                command_.push_back(c);
+                if (CommandComplete()) RunCommand();
+                else if (command_.size() >= STAR_COMMAND_MAX) command_.clear();
+                continue;
+            }
+            if (c == STAR_ESC || (raster_ && (c == 'b' || c == 'k'))) {
+                command_.push_back(c);
+            } else if (c == 0x0C) {
+                PrintLine();
+                EndPage();
+            } else if (raster_) {
+                // Nothing else prints in raster mode
+            } else if (c == '\n') {
+                PrintLine(true);
+            } else if (c >= 0x20 && c != 0x7F && line_.size() < PAGE_TEXT_MAX_BYTES) {
+                line_ += (char)c;
+            }
+        }
+    }
+
+    void Finish() override {
+        if (data_left_ > 0) {
+            data_left_ = 0;
+            EndData();
+        }
+        command_.clear();
+        PrintLine();
+        EndPage();
+    }
+
+    std::unique_ptr<PageDecoder> Clone() const override { return std::make_unique<StarDecoder>(*this); }
+
+private:
+    // Whether command_ holds a whole command, by its first bytes
+    bool CommandComplete() const {
+        size_t size = command_.size();
+        if (command_[0] != STAR_ESC) return size == 3; // b / k n1 n2
+        uint8_t c = command_[1];
+        switch (c) {
+            case '*':
+                if (size < 3) return false;
+                if (command_[2] != 'r') return size == 3;
+                if (size < 4) return false;
+                switch (command_[3]) {
+                    case 'R': case 'A': case 'B': case 'C': return true;
+                    default: return size >= 5 && command_.back() == 0; // Parameters end with NUL
+                }
+            case STAR_GS:
+                if (size < 3) return false;
+                return command_[2] == 'S' ? size == 9 : size == 4;
+            case STAR_RS:
+            case 'i':
+                return size == 4;
+            case 'b': // Barcode: ESC b n1 n2 n3 n4 data RS
+                return size > 6 && command_.back() == STAR_RS;
+            case '-': case '_': case 'd': case 'a': case 'J': case 'z': case 'A': case 'W': case 'h':
+            case 'R': case 'l': case 'Q': case 'C': case 'N': case 'I': case '/': case 'V': case 'e': case 'U': case 'k':
+                return size == 3;
+            default:
+                return size == 2;
+        }
+    }
+
+    void RunCommand() {
+        std::vector<uint8_t> command;
+        command.swap(command_);
+        if (command[0] != STAR_ESC) { // Raster row
+            StartData((size_t)command[1] | (size_t)command[2] << 8, 0);
+            return;
+        }
+        switch (command[1]) {
+            case '*':
+                if (command.size() < 4 || command[2] != 'r') break;
+                if (command[3] == 'A') {
+                    PrintLine();
+                    raster_ = true;
+                } else if (command[3] == 'B') {
+                    raster_ = false;
+                    EndPage();
+                } else if (command[3] == 'Y') {
+                    Advance(std::atoi(reinterpret_cast<const char*>(command.data() + 4)));
+                }
+                break;
+            case STAR_GS:
+                if (command[2] == 'a') align_ = command[3] % 3;
+                if (command[2] == 'S') { // ESC GS S m xL xH yL yH n
+                    image_row_bytes_ = (size_t)command[4] | (size_t)command[5] << 8;
+                    StartData(image_row_bytes_ * ((size_t)command[6] | (size_t)command[7] << 8), image_row_bytes_);
+                }
+                break;
+            case 'd':
+                PrintLine();
+                EndPage();
+                break;
+            case 'a':
+                PrintLine();
+                Advance(command[2] * ESCPOS_LINE_SPACING);
+                break;
+            case 'J':
+                PrintLine();
+                Advance(command[2]);
+                break;
+            case '@':
+                align_ = 0;
+                raster_ = false;
+                break;
+            default:
+                break;
+        }
+    }
+
+    void StartData(size_t size, size_t row_bytes) {
+        data_.clear();
+        data_left_ = size;
+        data_row_bytes_ = row_bytes;
+        if (size == 0) EndData();
+    }
+
+    // A raster row (row_bytes 0: one row of all of it) or an image's rows
+    void EndData() {
+        image_bytes_ += data_.size();
+        size_t row_bytes = data_row_bytes_ ? data_row_bytes_ : data_.size();
+        if (row_bytes == 0) {
+            Advance(1);
+            return;
+        }
+        for (size_t r = 0; r * row_bytes < data_.size(); ++r) {
+            if (!text_only_) {
+                int dots = (int)std::min<size_t>(std::min(row_bytes, data_.size() - r * row_bytes) * 8, PAGE_CANVAS_MAX_WIDTH);
+                Canvas(dots).OrRow(0, y_, data_.data() + r * row_bytes, dots);
+            }
+            Advance(1);
+        }
+        data_.clear();
+    }
+
+    PageCanvas& Canvas(int min_width = STAR_DEFAULT_WIDTH) {
+        if (!page_started_) {
+            ResetCanvas(canvas_, std::max(min_width, STAR_DEFAULT_WIDTH));
+            page_started_ = true;
+        }
+        return canvas_;
+    }
+
+    void Advance(int rows) {
+        if (rows > 0) {
+            Canvas();
+            y_ = std::min(y_ + rows, PAGE_CANVAS_MAX_ROWS);
+        }
+    }
+
+    // The line of text, if any (or the feed for an empty one)
+    void PrintLine(bool feed_empty = false) {
+        if (line_.empty()) {
+            if (feed_empty) Advance(ESCPOS_LINE_SPACING);
+            return;
+        }
+        PutTextLine(line_);
+        if (!text_only_) {
+            const GlyphSet& glyphs = GlyphsForCell(FONT_A_WIDTH, FONT_A_HEIGHT);
+            PageCanvas& canvas = Canvas();
+            int width = (int)line_.size() * glyphs.width();
+            int x = align_ == 1 ? (canvas.width() - width) / 2 : align_ == 2 ? canvas.width() - width : 0;
+            canvas.DrawText(std::max(0, x), y_, line_, glyphs);
+        }
+        line_.clear();
+        Advance(ESCPOS_LINE_SPACING);
+    }
+
+    void EndPage() {
+        if (!page_started_) return;
+        canvas_.SetRows(y_);
+        EmitPage(canvas_);
+        canvas_ = PageCanvas();
+        page_started_ = false;
+        y_ = 0;
+    }
+
+    std::vector<uint8_t> command_;
+    size_t data_left_ = 0;
+    size_t data_row_bytes_ = 0;
+    size_t image_row_bytes_ = 0;
+    std::vector<uint8_t> data_;
+
+    bool raster_ = false;
+    int align_ = 0;
+    std::string line_;
+
+    bool page_started_ = false;
+    int y_ = 0;
+    PageCanvas canvas_;
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+// Raster width detection for decoded receipts, so the viewers open a capture at the
+// right width instead of leaving the user to find it with the slider.
+//
+// Streams with GS v 0 raster commands state their width (xL xH bytes per row), and that
+// is used as is. Otherwise the bit stream is compared with itself shifted by each
+// candidate width: at the true width every bit lines up with the dot below it, and
+// printed rows resemble their neighbours far more than unrelated stretches of the stream,
+// so the shift with the fewest differing bits is the row period. Half the width lines a
+// row up with its own other half; twice the width skips a row and can come close, so
+// near ties go to the fraction.
+// The comparison runs 64 bits at a time over a few evenly spaced samples of the stream,
+// which keeps it to milliseconds whatever the capture size.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "receipt_decoder.h"
+
+enum class WidthSource { None, RasterHeader, Autocorrelation, Emulated };
+
+struct WidthCandidate {
+    int width = 0;
+    double score = 0;  // 1 - differing bits / median over all shifts; higher is better
+};
+
+struct WidthDetection {
+    int width = 0;  // 0: no estimate
+    WidthSource source = WidthSource::None;
+    std::vector<WidthCandidate> candidates;  // Best first
+};
+
+inline const char* WidthSourceName(WidthSource source) {
+    switch (source) {
+        case WidthSource::None: return "none";
+        case WidthSource::RasterHeader: return "GS v 0 header";
+        case WidthSource::Autocorrelation: return "autocorrelation";
+        case WidthSource::Emulated: return "emulated page";
+    }
+    return "?";
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__i386__) || defined(__x86_64__))
+#define WIDTH_DETECT_TARGET_POPCNT __attribute__((target("popcnt")))
+#endif
+
+// Differing bits between words [0, n) and the same stream shift bits further on
+template <typename Popcount>
+inline uint64_t WidthShiftDifferences(const uint64_t* w, size_t n, int shift, Popcount popcount) {
+    size_t q = (size_t)shift / 64;
+    unsigned r = (unsigned)shift % 64;
+    uint64_t d = 0;
+    if (r == 0) {
+        for (size_t j = 0; j < n; ++j) d += popcount(w[j] ^ w[j + q]);
+    } else {
+        for (size_t j = 0; j < n; ++j) d += popcount(w[j] ^ (w[j + q] << r | w[j + q + 1] >> (64 - r)));
+    }
+    return d;
+}
+
+// Adds the differences for every shift in [min_shift, max_shift] to out[shift - min_shift],
+// with the POPCNT instruction where the compiler would otherwise emit a bit-twiddling loop
+#if defined(WIDTH_DETECT_TARGET_POPCNT)
+WIDTH_DETECT_TARGET_POPCNT inline void WidthAddDifferencesPopcnt(const uint64_t* w, size_t n, int min_shift, int max_shift, uint64_t* out) {
+    auto popcount = [](uint64_t v) { return (uint64_t)__builtin_popcountll(v); };
+    for (int s = min_shift; s <= max_shift; ++s) out[s - min_shift] += WidthShiftDifferences(w, n, s, popcount);
+}
+#endif
+
+inline void WidthAddDifferences(const uint64_t* w, size_t n, int min_shift, int max_shift, uint64_t* out) {
+#if defined(WIDTH_DETECT_TARGET_POPCNT)
+    static const bool popcnt = __builtin_cpu_supports("popcnt");
+    if (popcnt) return WidthAddDifferencesPopcnt(w, n, min_shift, max_shift, out);
+    auto popcount = [](uint64_t v) { return (uint64_t)__builtin_popcountll(v); };
+#elif defined(_MSC_VER) && defined(_M_X64)
+    auto popcount = [](uint64_t v) { return (uint64_t)__popcnt64(v); }; // Every x64 CPU Windows still runs on has POPCNT
+#else
+    auto popcount = [](uint64_t v) {
+        v = v - ((v >> 1) & 0x5555555555555555ULL);
+        v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+        return (((v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL) * 0x0101010101010101ULL) >> 56;
+    };
+#endif
+    for (int s = min_shift; s <= max_shift; ++s) out[s - min_shift] += WidthShiftDifferences(w, n, s, popcount);
+}
+
+constexpr size_t WIDTH_SAMPLE_COUNT = 8;
+constexpr double WIDTH_MIN_SCORE = 0.1;  // Below this the stream shows no row period (noise, compressed data)
+constexpr size_t WIDTH_SAMPLE_WORDS = 512;  // 4 KB of the stream per sample
+
+// The stream as 64-bit words, the first dot in the top bit (MSB-first, as the printer
+// reads it; LSB-first data only reorders dots within bytes, which barely moves the minimum)
+inline std::vector<uint64_t> WidthSampleWords(const uint8_t* data, size_t words) {
+    std::vector<uint64_t> out(words);
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t v = 0;
+        for (int k = 0; k < 8; ++k) v = v << 8 | data[i * 8 + k];
+        out[i] = v;
+    }
+    return out;
+}
+
+// Ranks widths in [min_width, max_width]; keeps up to max_candidates local optima
+inline WidthDetection DetectReceiptWidth(const ReceiptBits& bits, int min_width, int max_width, size_t max_candidates = 5) {
+    WidthDetection result;
+    min_width = std::max(min_width, 8);
+    if (max_width < min_width) return result;
+
+    if (bits.page_width > 0) {
+        result.width = bits.page_width;
+        result.source = WidthSource::Emulated;
+        result.candidates.push_back({ bits.page_width, 1.0 });
+        return result;
+    }
+    if (bits.raster.blocks > 0 && bits.raster.width_bytes > 0) {
+        int width = (int)std::min<uint64_t>((uint64_t)bits.raster.width_bytes * 8, INT32_MAX);
+        if (width >= min_width && width <= max_width) {
+            result.width = width;
+            result.source = WidthSource::RasterHeader;
+            result.candidates.push_back({ width, 1.0 });
+            return result;
+        }
+    }
+
+    // Every shift must see at least a few full rows
+    uint64_t total_words = bits.bytes.size() / 8;
+    max_width = (int)std::min<uint64_t>((uint64_t)max_width, total_words * 64 / 4);
+    if (max_width < min_width) return result;
+    size_t reach = (size_t)max_width / 64 + 1;  // Extra words each sample reads past its end
+    if (total_words < reach + 4) return result;
+
+    // Short streams are compared whole
+    uint64_t usable = total_words - reach;
+    size_t samples = usable > WIDTH_SAMPLE_COUNT * WIDTH_SAMPLE_WORDS ? WIDTH_SAMPLE_COUNT : 1;
+    size_t sample_words = samples > 1 ? WIDTH_SAMPLE_WORDS : (size_t)usable;
+    std::vector<uint64_t> differences((size_t)(max_width - min_width + 1), 0);
+    for (size_t k = 0; k < samples; ++k) {
+        // Evenly spaced from the start of the stream to its end
+        uint64_t span = usable - sample_words;
+        uint64_t start = samples > 1 ? span * k / (samples - 1) : span / 2;
+        std::vector<uint64_t> words = WidthSampleWords(bits.bytes.data() + start * 8, sample_words + reach);
+        WidthAddDifferences(words.data(), sample_words, min_width, max_width, differences.data());
+    }
+
+    std::vector<uint64_t> sorted = differences;
+    std::nth_element(sorted.begin(), sorted.begin() + sorted.size() / 2, sorted.end());
+    double median = (double)sorted[sorted.size() / 2];
+    if (median == 0) return result;  // Blank or uniform data has no row period
+
+    // Local minima, best first; a neighbour of a better minimum is the same row seen askew
+    std::vector<WidthCandidate> minima;
+    for (size_t i = 0; i < differences.size(); ++i) {
+        bool left = i == 0 || differences[i] <= differences[i - 1];
+        bool right = i + 1 == differences.size() || differences[i] < differences[i + 1];
+        if (left && right) minima.push_back({ min_width + (int)i, 1.0 - (double)differences[i] / median });
+    }
+    std::sort(minima.begin(), minima.end(), [](const WidthCandidate& a, const WidthCandidate& b) {
+        return a.score != b.score ? a.score > b.score : a.width < b.width;
+    });
+    for (const WidthCandidate& candidate : minima) {
+        if (result.candidates.size() >= max_candidates) break;
+        bool adjacent = false;
+        for (const WidthCandidate& kept : result.candidates) adjacent = adjacent || std::abs(kept.width - candidate.width) <= 2;
+        if (!adjacent) result.candidates.push_back(candidate);
+    }
+    if (result.candidates.empty() || result.candidates[0].score < WIDTH_MIN_SCORE) return result;
+
+    // Two rows apart can match nearly as well as one, chiefly on narrow receipts where text
+    // lines span many rows; a fraction of the best width that scores close to it wins
+    WidthCandidate best = result.candidates[0];
+    for (const WidthCandidate& candidate : result.candidates) {
+        for (int k = 2; k <= 4; ++k) {
+            if (std::abs(candidate.width * k - best.width) <= k && candidate.score >= best.score * 0.9 && candidate.width < best.width) {
+                best = candidate;
+            }
+        }
+    }
+    std::stable_partition(result.candidates.begin(), result.candidates.end(),
+                          [&](const WidthCandidate& candidate) { return candidate.width == best.width; });
+    result.width = best.width;
+    result.source = WidthSource::Autocorrelation;
+    return result;
+}
@@ -0,0 +1,574 @@
+#pragma once
+
+// ZPL II, the language of Zebra label printers, for page_decoder.h.
+//
+// A command is a prefix (^, or ~ for control commands) and a two-letter name, followed by
+// comma-separated parameters up to the next prefix; line breaks between commands are
+// ignored. Each ^XA ... ^XZ format prints one label. Drawn: fields placed with ^FO or ^FT
+// (relative to ^LH), ^FD/^FV text in the built-in font at the size of ^A or ^CF, wrapped
+// and justified in a ^FB block, ^FH hex escapes, ^GB boxes and lines, ^GF graphics (ASCII
+// hex with ZPL compression, :B64:, or binary), graphics stored with ~DG and recalled with
+// ^XG/^IM, and ^BC, ^B3, ^BE, ^BU, ^B2 and ^BQ barcodes with the ^BY module width and
+// height. ^PW sets the label width and ^LL its length; ^CC/~CC and ^CT/~CT change the
+// prefixes. Rotated fields are drawn unrotated, reverse (^FR) and white boxes are not
+// drawn, :Z64: graphics are skipped, and ^PQ copies print once.
+
+#include <cstdint>
+#include <cstddef>
+#include <cctype>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "page_decoder.h"
+
+constexpr int ZPL_DEFAULT_WIDTH = 832;           // 4-inch printhead at 203 dpi
+constexpr int ZPL_DEFAULT_FONT_HEIGHT = 9;       // Font A
+constexpr int ZPL_DEFAULT_FONT_WIDTH = 5;
+constexpr int ZPL_DEFAULT_BARCODE_HEIGHT = 10;   // ^BY
+constexpr size_t ZPL_COMMAND_MAX = 16 << 20;     // Bytes kept of one command; graphics past it are cut
+
+// Bitmap fonts at magnification 1 (height, width); others are taken as scalable like font 0
+struct ZplFont {
+    char name;
+    int height, width;
+};
+
+const ZplFont kZplFonts[] = {
+    { 'A', 9, 5 }, { 'B', 11, 7 }, { 'C', 18, 10 }, { 'D', 18, 10 }, { 'E', 28, 15 },
+    { 'F', 26, 13 }, { 'G', 60, 40 }, { 'H', 21, 13 }, { 'P', 20, 18 }, { 'Q', 28, 24 },
+    { 'R', 35, 31 }, { 'S', 40, 35 }, { 'T', 48, 42 }, { 'U', 59, 53 }, { 'V', 80, 71 },
+};
+
+// ASCII hex graphic data with ZPL compression into rows of row_bytes: G-Y repeat the next
+// digit 1-19 times and g-z 20-400 times (counts add up), ',' fills the row with 0, '!'
+// with 1, and ':' repeats the previous row
+inline void DecodeZplHex(std::string_view data, size_t row_bytes, std::vector<uint8_t>& out) {
+    if (row_bytes == 0) return;
+    size_t nibbles = row_bytes * 2, position = 0, repeat = 0;
+    std::vector<uint8_t> row(row_bytes, 0);
+    auto end_row = [&]() {
+        out.insert(out.end(), row.begin(), row.end());
+        std::fill(row.begin(), row.end(), 0);
+        position = 0;
+    };
+    auto put = [&](int nibble, size_t count) {
+        for (size_t k = 0; k < count; ++k) {
+            row[position / 2] |= (uint8_t)(position % 2 ? nibble : nibble << 4);
+            if (++position == nibbles) end_row();
+        }
+    };
+    for (char c : data) {
+        if (c >= 'G' && c <= 'Y') {
+            repeat += (size_t)(c - 'F');
+        } else if (c >= 'g' && c <= 'z') {
+            repeat += (size_t)(c - 'f') * 20;
+        } else if (std::isxdigit((unsigned char)c)) {
+            int nibble = c <= '9' ? c - '0' : (std::toupper((unsigned char)c) - 'A' + 10);
+            put(nibble, repeat ? repeat : 1);
+            repeat = 0;
+        } else if (c == ',' || c == '!') {
+            put(c == '!' ? 0xF : 0, nibbles - position);
+            repeat = 0;
+        } else if (c == ':') {
+            if (position == 0 && out.size() >= row_bytes) {
+                out.insert(out.end(), out.end() - (ptrdiff_t)row_bytes, out.end());
+            }
+            repeat = 0;
+        }
+    }
+    if (position > 0) end_row();
+}
+
+inline void DecodeBase64(std::string_view data, std::vector<uint8_t>& out) {
+    uint32_t bits = 0;
+    int count = 0;
+    for (char c : data) {
+        int v = c >= 'A' && c <= 'Z' ? c - 'A' : c >= 'a' && c <= 'z' ? c - 'a' + 26 : c >= '0' && c <= '9' ? c - '0' + 52
+              : c == '+' ? 62 : c == '/' ? 63 : -1;
+        if (v < 0) continue;
+        bits = bits << 6 | (uint32_t)v;
+        if ((count += 6) >= 8) {
+            count -= 8;
+            out.push_back((uint8_t)(bits >> count));
+        }
+    }
+}
+
+class ZplDecoder : public PageDecoder {
+public:
+    ZplDecoder() : PageDecoder(ZPL_DEFAULT_WIDTH) {}
+
+    void Feed(const uint8_t* p, size_t n) override {
+        for (size_t i = 0; i < n; ++i) {
+            uint8_t c = p[i];
+            if (binary_left_ > 0) { // ^GFB data, which may hold anything
+                size_t take = std::min<size_t>(binary_left_, n - i);
+                if (command_.size() + take <= ZPL_COMMAND_MAX) command_.append(reinterpret_cast<const char*>(p + i), take);
+                binary_left_ -= take;
+                i += take - 1;
+                if (binary_left_ == 0) RunCommand();
+                continue;
+            }
+            if ((c == (uint8_t)caret_ || (c == (uint8_t)tilde_ && !InFieldData())) && !command_.empty()) RunCommand();
+            if (c == '\r' || c == '\n') continue;
+            if (command_.size() < ZPL_COMMAND_MAX) command_ += (char)c;
+            if (c == ',' && IsBinaryGraphic()) binary_left_ = BinaryGraphicSize();
+        }
+    }
+
+    void Finish() override {
+        binary_left_ = 0;
+        if (!command_.empty()) RunCommand();
+        if (in_label_) EndLabel();
+    }
+
+    std::unique_ptr<PageDecoder> Clone() const override { return std::make_unique<ZplDecoder>(*this); }
+
+private:
+    struct Field {
+        int x = 0, y = 0;
+        bool typeset = false;         // ^FT: y is the baseline
+        char font = 0;                // 0: the ^CF font
+        int font_height = 0, font_width = 0;
+        int block_width = 0, block_lines = 1;
+        char justify = 'L';
+        char hex = 0;                 // ^FH indicator
+        std::string barcode;          // Command name, empty for text
+        std::vector<std::string> barcode_params;
+        std::string data;
+        bool has_data = false;
+    };
+
+    bool InFieldData() const {
+        return command_.size() >= 3 && command_[0] == caret_ && std::toupper((unsigned char)command_[1]) == 'F' &&
+               (std::toupper((unsigned char)command_[2]) == 'D' || std::toupper((unsigned char)command_[2]) == 'V');
+    }
+
+    // ^GFB,<bytes>,<total>,<row bytes>, with the data next
+    bool IsBinaryGraphic() const {
+        if (command_.size() < 5 || command_[0] != caret_ || std::toupper((unsigned char)command_[1]) != 'G' ||
+            std::toupper((unsigned char)command_[2]) != 'F' || std::toupper((unsigned char)command_[3]) != 'B') {
+            return false;
+        }
+        return std::count(command_.begin(), command_.end(), ',') == 4;
+    }
+
+    size_t BinaryGraphicSize() const {
+        std::vector<std::string> params = Split(std::string_view(command_).substr(3));
+        return params.size() > 1 ? (size_t)std::strtoull(params[1].c_str(), nullptr, 10) : 0;
+    }
+
+    static std::vector<std::string> Split(std::string_view text, size_t max_fields = SIZE_MAX) {
+        std::vector<std::string> fields;
+        size_t start = 0;
+        while (fields.size() + 1 < max_fields) {
+            size_t comma = text.find(',', start);
+            if (comma == std::string_view::npos) break;
+            fields.emplace_back(text.substr(start, comma - start));
+            start = comma + 1;
+        }
+        fields.emplace_back(text.substr(start));
+        return fields;
+    }
+
+    static int Int(const std::vector<std::string>& params, size_t i, int fallback) {
+        if (i >= params.size() || params[i].empty()) return fallback;
+        char* end = nullptr;
+        long value = std::strtol(params[i].c_str(), &end, 10);
+        return end == params[i].c_str() ? fallback : (int)std::clamp<long>(value, -PAGE_CANVAS_MAX_ROWS, PAGE_CANVAS_MAX_ROWS);
+    }
+
+    static char Char(const std::vector<std::string>& params, size_t i, char fallback) {
+        return i < params.size() && !params[i].empty() ? (char)std::toupper((unsigned char)params[i][0]) : fallback;
+    }
+
+    static std::string GraphicName(std::string name) {
+        for (char& c : name) c = (char)std::toupper((unsigned char)c);
+        if (name.size() > 2 && name[1] == ':') name.erase(0, 2);
+        size_t dot = name.find('.');
+        return dot == std::string::npos ? name : name.substr(0, dot);
+    }
+
+    void RunCommand() {
+        running_.swap(command_); // Both keep their buffers from command to command
+        command_.clear();
+        const std::string& command = running_;
+        if (command.size() < 3) return;
+        bool control = command[0] == tilde_;
+        std::string name = { (char)std::toupper((unsigned char)command[1]), (char)std::toupper((unsigned char)command[2]) };
+        std::string_view rest = std::string_view(command).substr(3);
+        if (control) {
+            RunControl(name, rest);
+            return;
+        }
+        if (name[0] == 'A') { // ^Af o,h,w: the font is the command's second letter
+            field_.font = name[1] == '@' ? '0' : name[1];
+            std::vector<std::string> params = Split(rest);
+            field_.font_height = Int(params, 1, 0);
+            field_.font_width = Int(params, 2, 0);
+            return;
+        }
+        if (name == "FD" || name == "FV") {
+            field_.data.assign(rest.data(), rest.size());
+            field_.has_data = true;
+            return;
+        }
+        std::vector<std::string> params = Split(rest);
+        if (name == "XA") {
+            StartLabel();
+        } else if (name == "XZ") {
+            if (in_label_) EndLabel();
+        } else if (name == "PW") {
+            if (params[0].size() > 0) width_setting_ = std::max(1, Int(params, 0, ZPL_DEFAULT_WIDTH));
+        } else if (name == "LL") {
+            length_setting_ = std::max(0, Int(params, 0, 0));
+        } else if (name == "LH") {
+            home_x_ = Int(params, 0, 0);
+            home_y_ = Int(params, 1, 0);
+        } else if (name == "FO" || name == "FT") {
+            field_.x = home_x_ + Int(params, 0, 0);
+            field_.y = home_y_ + Int(params, 1, 0);
+            field_.typeset = name == "FT";
+        } else if (name == "FS") {
+            EndField();
+        } else if (name == "FH") {
+            field_.hex = rest.empty() ? '_' : rest[0];
+        } else if (name == "FB") {
+            field_.block_width = std::max(0, Int(params, 0, 0));
+            field_.block_lines = std::clamp(Int(params, 1, 1), 1, 9999);
+            field_.justify = Char(params, 3, 'L');
+        } else if (name == "CF") {
+            if (!params[0].empty()) font_ = (char)std::toupper((unsigned char)params[0][0]);
+            font_height_ = Int(params, 1, font_height_);
+            font_width_ = Int(params, 2, params.size() > 1 && !params[1].empty() ? 0 : font_width_); // 0: from the height
+        } else if (name == "BY") {
+            module_ = std::clamp(Int(params, 0, module_), 1, 10);
+            barcode_height_ = std::max(1, Int(params, 2, barcode_height_));
+        } else if (name == "BC" || name == "B3" || name == "BE" || name == "BU" || name == "B2" || name == "BQ") {
+            field_.barcode = name;
+            field_.barcode_params = params;
+        } else if (name == "GB") {
+            DrawBox(params);
+        } else if (name == "GF") {
+            DrawGraphicField(rest);
+        } else if (name == "XG" || name == "IM") {
+            RecallGraphic(params, name == "XG");
+        } else if (name == "CC" || name == "CT") {
+            SetPrefix(name, rest);
+        }
+    }
+
+    void RunControl(const std::string& name, std::string_view rest) {
+        if (name == "DG") {
+            std::vector<std::string> params = Split(rest, 4);
+            if (params.size() < 4) return;
+            Graphic graphic;
+            graphic.row_bytes = (size_t)std::max(0, Int(params, 2, 0));
+            DecodeGraphicData(params[3], graphic.row_bytes, graphic.bits);
+            graphics_[GraphicName(params[0])] = std::move(graphic);
+        } else if (name == "CC" || name == "CT") {
+            SetPrefix(name, rest);
+        }
+    }
+
+    void SetPrefix(const std::string& name, std::string_view rest) {
+        if (rest.empty()) return;
+        (name == "CC" ? caret_ : tilde_) = rest[0];
+    }
+
+    void StartLabel() {
+        if (in_label_) EndLabel();
+        in_label_ = true;
+        canvas_ready_ = false;
+        field_ = Field();
+    }
+
+    void EndLabel() {
+        EndField();
+        Canvas(); // An empty label still takes its length
+        if (length_setting_ > 0) canvas_.SetRows(length_setting_);
+        EmitPage(canvas_);
+        in_label_ = false;
+        canvas_ready_ = false;
+    }
+
+    // The label's canvas, made at the first drawing so ^PW after ^XA still applies
+    PageCanvas& Canvas() {
+        if (!in_label_) StartLabel();
+        if (!canvas_ready_) {
+            ResetCanvas(canvas_, width_setting_ > 0 ? width_setting_ : ZPL_DEFAULT_WIDTH);
+            canvas_ready_ = true;
+        }
+        return canvas_;
+    }
+
+    const GlyphSet& FieldGlyphs() const {
+        char font = field_.font ? field_.font : font_;
+        int height = field_.font ? field_.font_height : font_height_;
+        int width = field_.font ? field_.font_width : font_width_;
+        for (const ZplFont& bitmap : kZplFonts) {
+            if (bitmap.name != font) continue;
+            if (height <= 0) height = bitmap.height;
+            if (width <= 0) width = height * bitmap.width / bitmap.height;
+            return GlyphsForCell(width, height);
+        }
+        if (height <= 0) height = ZPL_DEFAULT_FONT_HEIGHT;
+        if (width <= 0) width = height;
+        return GlyphsForCell(width / 2, height); // Font 0 is proportional, about half as wide as its size
+    }
+
+    // The field data with ^FH escapes decoded, in decoded_ when there are any
+    const std::string& FieldText() {
+        if (!field_.hex || field_.data.find(field_.hex) == std::string::npos) return field_.data;
+        decoded_.clear();
+        for (size_t i = 0; i < field_.data.size(); ++i) {
+            if (field_.data[i] == field_.hex && i + 2 < field_.data.size() && std::isxdigit((unsigned char)field_.data[i + 1]) &&
+                std::isxdigit((unsigned char)field_.data[i + 2])) {
+                auto nibble = [](char c) { return c <= '9' ? c - '0' : (std::toupper((unsigned char)c) - 'A' + 10); };
+                decoded_ += (char)(nibble(field_.data[i + 1]) << 4 | nibble(field_.data[i + 2]));
+                i += 2;
+            } else {
+                decoded_ += field_.data[i];
+            }
+        }
+        return decoded_;
+    }
+
+    void EndField() {
+        if (field_.has_data) {
+            const std::string& text = FieldText();
+            if (field_.barcode.empty()) DrawTextField(text);
+            else DrawBarcodeField(text);
+        }
+        ResetField();
+    }
+
+    // Starts the next field; the data's buffer is kept for it
+    void ResetField() {
+        std::string data;
+        data.swap(field_.data);
+        field_ = Field();
+        data.clear();
+        field_.data.swap(data);
+    }
+
+    void DrawTextField(std::string_view text) {
+        // ^FB breaks lines at \& and wraps at the block width; without it the field is one line
+        lines_.clear();
+        const GlyphSet& glyphs = FieldGlyphs();
+        if (field_.block_width > 0) {
+            size_t fit = std::max<size_t>(1, (size_t)field_.block_width / (size_t)glyphs.width());
+            size_t start = 0;
+            while (start <= text.size() && (int)lines_.size() < field_.block_lines) {
+                size_t brk = text.find("\\&", start);
+                std::string_view part = text.substr(start, brk == std::string_view::npos ? std::string_view::npos : brk - start);
+                while (part.size() > fit && (int)lines_.size() + 1 < field_.block_lines) {
+                    size_t space = part.rfind(' ', fit);
+                    size_t cut = space == std::string_view::npos || space == 0 ? fit : space;
+                    lines_.push_back(part.substr(0, cut));
+                    part.remove_prefix(cut + (cut == space ? 1 : 0));
+                }
+                lines_.push_back(part.substr(0, fit));
+                if (brk == std::string_view::npos) break;
+                start = brk + 2;
+            }
+        } else {
+            lines_.push_back(text);
+        }
+        for (std::string_view line : lines_) PutTextLine(line);
+        if (text_only_) return;
+        PageCanvas& canvas = Canvas();
+        int top = field_.typeset ? field_.y - glyphs.rows() : field_.y;
+        for (size_t i = 0; i < lines_.size(); ++i) {
+            int x = field_.x;
+            int line_width = (int)lines_[i].size() * glyphs.width();
+            if (field_.block_width > 0 && field_.justify == 'C') x += (field_.block_width - line_width) / 2;
+            if (field_.block_width > 0 && field_.justify == 'R') x += field_.block_width - line_width;
+            canvas.DrawText(x, top + (int)i * glyphs.rows(), lines_[i], glyphs);
+        }
+    }
+
+    void DrawBarcodeField(const std::string& text) {
+        const std::vector<std::string>& params = field_.barcode_params;
+        if (field_.barcode == "BQ") {
+            DrawQrField(text);
+            return;
+        }
+        // Height, then whether the interpretation line prints and above the bars
+        size_t height_param = field_.barcode == "B3" ? 2 : 1;
+        int height = std::max(1, Int(params, height_param, barcode_height_));
+        bool interpretation = Char(params, height_param + 1, 'Y') == 'Y';
+        bool above = Char(params, height_param + 2, 'N') == 'Y';
+        std::string data = text;
+        EscPosBarcode barcode;
+        bool encoded = false;
+        if (field_.barcode == "BC") {
+            std::string plain; // Subset invocations (>: >; >5 ...) are chosen anew
+            for (size_t i = 0; i < data.size(); ++i) {
+                if (data[i] == '>' && i + 1 < data.size()) {
+                    char code = data[++i];
+                    if (code == '<') plain += '<';
+                    else if (code == '0') plain += '>';
+                    continue;
+                }
+                plain += data[i];
+            }
+            data = plain;
+            encoded = EncodeCode128Data(data, module_, barcode);
+        } else if (field_.barcode == "B3") {
+            encoded = EncodeEscPosBarcode(69, data, module_, barcode);
+        } else if (field_.barcode == "BE") {
+            encoded = EncodeEscPosBarcode(67, data, module_, barcode);
+        } else if (field_.barcode == "BU") {
+            encoded = EncodeEscPosBarcode(65, data, module_, barcode);
+        } else if (field_.barcode == "B2") {
+            encoded = EncodeEscPosBarcode(70, data, module_, barcode);
+        }
+        PutTextLine(encoded ? barcode.text : data);
+        if (!encoded || text_only_) return;
+        PageCanvas& canvas = Canvas();
+        const GlyphSet& glyphs = GlyphsForCell(FONT_B_WIDTH, FONT_B_HEIGHT);
+        int top = field_.typeset ? field_.y - height : field_.y;
+        int bars_top = interpretation && above ? top + glyphs.rows() : top;
+        int width = canvas.DrawBarcode(field_.x, bars_top, barcode, height);
+        if (interpretation) {
+            int text_width = (int)barcode.text.size() * glyphs.width();
+            canvas.DrawText(field_.x + (width - text_width) / 2, above ? top : bars_top + height, barcode.text, glyphs);
+        }
+    }
+
+    // ^FD data of a QR code: error correction level, input mode, comma, then the data
+    void DrawQrField(const std::string& text) {
+        int module = std::clamp(Int(field_.barcode_params, 2, 2), 1, 10);
+        QrEcc ecc = QrEcc::Medium;
+        std::string data = text;
+        size_t comma = text.find(',');
+        if (comma != std::string::npos && comma <= 3) {
+            switch (comma > 0 ? std::toupper((unsigned char)text[0]) : 'M') {
+                case 'H': ecc = QrEcc::High; break;
+                case 'Q': ecc = QrEcc::Quartile; break;
+                case 'L': ecc = QrEcc::Low; break;
+                default: break;
+            }
+            data = text.substr(comma + 1);
+            if (comma >= 2 && std::toupper((unsigned char)text[1]) == 'M' && !data.empty()) data.erase(0, 1); // Manual: the mode character
+        }
+        PutTextLine(data);
+        QrCode code;
+        if (text_only_ || data.empty() || !code.Encode(reinterpret_cast<const uint8_t*>(data.data()), data.size(), ecc)) return;
+        int dots = code.size() * module;
+        Canvas().DrawQrCode(field_.x, field_.typeset ? field_.y - dots : field_.y, code, module);
+    }
+
+    // ^GB w,h,t,c,r: a filled box when the border meets itself
+    void DrawBox(const std::vector<std::string>& params) {
+        int thickness = std::max(1, Int(params, 2, 1));
+        int width = std::max(thickness, Int(params, 0, thickness));
+        int height = std::max(thickness, Int(params, 1, thickness));
+        if (Char(params, 3, 'B') == 'W' || text_only_) return;
+        PageCanvas& canvas = Canvas();
+        int x = field_.x, y = field_.typeset ? field_.y - height : field_.y;
+        if (thickness * 2 >= width || thickness * 2 >= height) {
+            canvas.FillRect(x, y, width, height);
+        } else {
+            canvas.FillRect(x, y, width, thickness);
+            canvas.FillRect(x, y + height - thickness, width, thickness);
+            canvas.FillRect(x, y, thickness, height);
+            canvas.FillRect(x + width - thickness, y, thickness, height);
+        }
+        field_ = Field();
+    }
+
+    void DecodeGraphicData(std::string_view data, size_t row_bytes, std::vector<uint8_t>& bits) {
+        image_bytes_ += data.size();
+        if (data.size() >= 5 && (data.substr(0, 5) == ":B64:" || data.substr(0, 5) == ":Z64:")) {
+            if (data.substr(0, 5) == ":B64:") {
+                size_t end = data.find(':', 5);
+                DecodeBase64(data.substr(5, end == std::string_view::npos ? std::string_view::npos : end - 5), bits);
+            }
+            return; // :Z64: is deflated and not drawn
+        }
+        DecodeZplHex(data, row_bytes, bits);
+    }
+
+    // ^GF a,b,c,d,data: format (A hex, B binary), data bytes, total bytes, bytes per row
+    void DrawGraphicField(std::string_view rest) {
+        std::vector<std::string> params = Split(rest, 5);
+        if (params.size() < 5) return;
+        size_t row_bytes = (size_t)std::max(0, Int(params, 3, 0));
+        std::vector<uint8_t> bits;
+        char format = Char(params, 0, 'A');
+        if (format == 'B') {
+            image_bytes_ += params[4].size();
+            bits.assign(params[4].begin(), params[4].end());
+        } else if (format == 'A') {
+            DecodeGraphicData(params[4], row_bytes, bits);
+        }
+        DrawBits(bits, row_bytes, 1, 1);
+        field_ = Field();
+    }
+
+    void RecallGraphic(const std::vector<std::string>& params, bool magnify) {
+        auto found = graphics_.find(GraphicName(params[0]));
+        if (found == graphics_.end()) return;
+        int mx = magnify ? std::clamp(Int(params, 1, 1), 1, 10) : 1;
+        int my = magnify ? std::clamp(Int(params, 2, 1), 1, 10) : 1;
+        DrawBits(found->second.bits, found->second.row_bytes, mx, my);
+        field_ = Field();
+    }
+
+    void DrawBits(const std::vector<uint8_t>& bits, size_t row_bytes, int mx, int my) {
+        if (row_bytes == 0 || text_only_) return;
+        PageCanvas& canvas = Canvas();
+        size_t rows = bits.size() / row_bytes;
+        std::vector<uint8_t> wide;
+        for (size_t r = 0; r < rows; ++r) {
+            const uint8_t* row = bits.data() + r * row_bytes;
+            int dots = (int)std::min<size_t>(row_bytes * 8, PAGE_CANVAS_MAX_WIDTH);
+            if (mx > 1) {
+                wide.assign(((size_t)dots * mx + 7) / 8, 0);
+                for (int d = 0; d < dots; ++d) {
+                    if (!((row[d / 8] >> (7 - d % 8)) & 1)) continue;
+                    for (int k = d * mx; k < (d + 1) * mx; ++k) wide[(size_t)k / 8] |= (uint8_t)(0x80 >> (k % 8));
+                }
+                row = wide.data();
+                dots *= mx;
+            }
+            for (int k = 0; k < my; ++k) canvas.OrRow(field_.x, field_.y + (int)r * my + k, row, dots);
+        }
+    }
+
+    struct Graphic {
+        size_t row_bytes = 0;
+        std::vector<uint8_t> bits;
+    };
+
+    std::string command_;       // The command being read, prefix first
+    std::string running_;       // The command being run
+    size_t binary_left_ = 0;    // ^GFB data bytes still to come
+    char caret_ = '^';
+    char tilde_ = '~';
+
+    // Settings that carry over from label to label
+    int width_setting_ = 0;
+    int length_setting_ = 0;
+    int home_x_ = 0, home_y_ = 0;
+    char font_ = 'A';           // ^CF
+    int font_height_ = ZPL_DEFAULT_FONT_HEIGHT;
+    int font_width_ = ZPL_DEFAULT_FONT_WIDTH;
+    int module_ = 2;
+    int barcode_height_ = ZPL_DEFAULT_BARCODE_HEIGHT;
+    std::map<std::string, Graphic> graphics_;
+
+    bool in_label_ = false;
+    bool canvas_ready_ = false;
+    PageCanvas canvas_;
+    Field field_;
+    std::string decoded_;                 // FieldText() with ^FH escapes
+    std::vector<std::string_view> lines_; // DrawTextField's lines, into the field text
+};
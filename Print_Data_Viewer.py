@@ -2,6 +2,7 @@ import tkinter as tk
 from tkinter import filedialog, ttk, messagebox
 from PIL import Image, ImageTk
 import os
+import mmap
 
 # --- Configuration ---
 HEADER_SIZE = 16
@@ -26,6 +27,122 @@ except ValueError:
     SEQUENCE_TO_REMOVE2 = None # Disable removal if invalid
 
 # --- Core Logic (Modified load_and_process_bitmap) ---
+CAPTURE_MAGIC = b'PRLCAP\r\n'
+CAPTURE_VERSION = 1
+
+def read_varint(buf, pos):
+    """Decodes a LEB128 varint, returns (value, next_pos) or (None, pos) if truncated."""
+    value = 0
+    for i in range(10):
+        if pos + i >= len(buf): return None, pos
+        b = buf[pos + i]
+        value |= (b & 0x7F) << (7 * i)
+        if not b & 0x80: return value, pos + i + 1
+    return None, pos
+
+def read_client_stream(filename):
+    """
+    Returns the client -> printer bytes of a capture. Raw .bin captures are returned as a
+    slice of a read-only mapping; framed .cap captures have their data frames joined.
+    """
+    with open(filename, 'rb') as f:
+        if os.fstat(f.fileno()).st_size == 0: return b''
+        mapped = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    view = memoryview(mapped)
+    if len(view) < 32 or view[:8] != CAPTURE_MAGIC:
+        return view
+    if int.from_bytes(view[8:10], 'little') != CAPTURE_VERSION:
+        raise ValueError("Unsupported framed capture version.")
+    pos = int.from_bytes(view[10:12], 'little')
+    chunks = []
+    while pos < len(view):
+        tag, next_pos = read_varint(view, pos)
+        if tag is None: break
+        delta, next_pos = read_varint(view, next_pos)
+        if delta is None or next_pos + (tag >> 2) > len(view): break # Truncated capture
+        if tag & 3 == 0: chunks.append(view[next_pos:next_pos + (tag >> 2)])
+        pos = next_pos + (tag >> 2)
+    return b''.join(chunks)
+
+# --- Printer language (as Common/print_language.h sniffs it) ---
+# Only ESC/POS raster is decoded here; captures in the other languages are recognized by
+# their first PRINT_SNIFF_BYTES and reported, so they are not shown as noise.
+PRINT_SNIFF_BYTES = 512
+EPL_TWO_LETTER_NAMES = (b'LO', b'LE', b'LW', b'GW', b'ZB', b'ZT', b'JF', b'JB', b'OD', b'UN', b'US')
+
+def sniff_zpl(head):
+    start = head.lstrip(b' \t\r\n\0')
+    if len(start) < 3 or start[:1] not in (b'^', b'~') or not start[1:2].isalpha(): return 0
+    return 90 if b'^XA' in head.upper() else 60 # ~DG downloads may fill the head
+
+def is_epl_line(line):
+    if line in (b'N', b'P', b'O', b'ZB', b'ZT', b'JF', b'JB'): return True
+    for two in EPL_TWO_LETTER_NAMES:
+        if len(line) > 2 and line.startswith(two): return line[2:3].isdigit() or line[2:3] == b','
+    if len(line) < 2: return False
+    first = line[:1]
+    if first in (b'q', b'Q', b'S', b'D', b'P', b'R', b'A', b'B', b'b', b'X'): return line[1:2].isdigit()
+    if first == b'I': return line[1:3] == b'8,'
+    if first == b'O': return line[1:2].isupper()
+    return False
+
+def sniff_epl(head):
+    matched, label = 0, False # N, A, B or P: something that makes a label
+    lines = head.split(b'\n')[:-1] # A cut-off line decides nothing
+    for line in lines:
+        if matched >= 4: break
+        line = line.rstrip(b'\r ')
+        if not line: continue
+        if not is_epl_line(line): return 0
+        if line.startswith(b'GW'): return 80 if matched > 0 else 0 # Binary data follows
+        label = label or line[:1] in (b'N', b'A', b'B', b'P')
+        matched += 1
+    return 80 if matched >= 2 and label else 0
+
+def sniff_pcl_xl(head):
+    return 100 if b') HP-PCL XL;' in head else 0
+
+def sniff_pcl(head):
+    if head.startswith(b'\x1b%-12345X') or head.startswith(b'@PJL'):
+        upper = head.upper()
+        if b'ENTER LANGUAGE' in upper: return 90 if b'LANGUAGE=PCL' in upper or b'LANGUAGE = PCL' in upper else 0
+        return 80 if b'\x1bE' in head else 0
+    if head.startswith(b'\x1bE\x1b'): return 80
+    at = head.find(b'\x1b*b') # Raster rows: ESC * b <digits> (ESC/POS has no ESC * b)
+    while at >= 0:
+        if head[at + 3:at + 4].isdigit(): return 70
+        at = head.find(b'\x1b*b', at + 1)
+    return 0
+
+def sniff_star(head):
+    at = head.find(b'\x1b*r') # ESC * r and a letter; PCL puts a value before the letter
+    while at >= 0:
+        if head[at + 3:at + 4] and head[at + 3:at + 4] in b'RAQPETFm': return 75
+        at = head.find(b'\x1b*r', at + 1)
+    return 0
+
+PRINT_LANGUAGE_SNIFFERS = (('Star', sniff_star), ('ZPL', sniff_zpl), ('EPL', sniff_epl), ('PCL', sniff_pcl), ('PCL XL', sniff_pcl_xl))
+
+def sniff_print_language(stream):
+    """The printer language of a client -> printer stream: 'ESC/POS' unless another one scores."""
+    head = bytes(stream[:PRINT_SNIFF_BYTES])
+    best, best_score = 'ESC/POS', 0
+    for name, sniff in PRINT_LANGUAGE_SNIFFERS:
+        score = sniff(head)
+        if score > best_score: best, best_score = name, score
+    return best
+
+_unpack_tables = {}
+
+def unpack_table(msb_first, invert_polarity):
+    """256 entries of 8 grayscale pixels (0 = black, 255 = white), one per byte value."""
+    key = (msb_first, invert_polarity)
+    if key not in _unpack_tables:
+        bit_range = range(7, -1, -1) if msb_first else range(8)
+        black, white = (255, 0) if invert_polarity else (0, 255)
+        _unpack_tables[key] = [bytes(black if (byte >> i) & 1 else white for i in bit_range) for byte in range(256)]
+    return _unpack_tables[key]
+
 def load_and_process_bitmap(filename, width, msb_first=True, invert_polarity=False):
     """
     Reads bitmap, REMOVES specific sequence, processes bits, returns PIL Image.
@@ -39,12 +156,17 @@ def load_and_process_bitmap(filename, width, msb_first=True, invert_polarity=Fal
     bytes_removed_count = 0 # Track removed bytes
 
     try:
-        with open(filename, 'rb') as f:
-            header_data = f.read(HEADER_SIZE)
-            if len(header_data) < HEADER_SIZE: messagebox.showerror("Error", f"Header too short."); return None, 0, 0
-
-            # Read the raw pixel data
-            pixel_data_raw = f.read()
+        stream = read_client_stream(filename)
+        language = sniff_print_language(stream)
+        if language != 'ESC/POS':
+            messagebox.showerror("Error", f"This is {language} print data; this viewer only decodes ESC/POS raster. "
+                                          "Open it in the C++ viewer or render it with capture_tool render.")
+            return None, 0, 0, 0
+        header_data = stream[:HEADER_SIZE]
+        if len(header_data) < HEADER_SIZE: messagebox.showerror("Error", f"Header too short."); return None, 0, 0
+
+        # The pixel data is copied once out of the mapping; replace() needs a bytes object
+        pixel_data_raw = bytes(stream[HEADER_SIZE:])
 
         if not pixel_data_raw:
             messagebox.showwarning("Warning", "No pixel data found after the header.")
@@ -79,14 +201,10 @@ def load_and_process_bitmap(filename, width, msb_first=True, invert_polarity=Fal
             messagebox.showwarning("Warning", "No pixel data remaining after sequence removal.")
             return None, width, 0
 
-        pixels, total_bits = [], 0
-        for byte in pixel_data: # Iterate through the MODIFIED data
-            bit_range = range(7, -1, -1) if msb_first else range(8)
-            for i in bit_range:
-                bit = (byte >> i) & 1
-                pixel_value = (255 if bit == 1 else 0) if invert_polarity else (0 if bit == 1 else 255)
-                pixels.append(pixel_value)
-                total_bits += 1
+        # Bytes are expanded through a table of 8 grayscale pixels each, then joined once
+        table = unpack_table(msb_first, invert_polarity)
+        pixels = b''.join(map(table.__getitem__, pixel_data))
+        total_bits = len(pixels)
 
         if width == 0: messagebox.showerror("Error", "Width zero."); return None, 0, 0
 
@@ -103,8 +221,7 @@ def load_and_process_bitmap(filename, width, msb_first=True, invert_polarity=Fal
                  messagebox.showwarning("Warning", f"Calculated image size is zero (W:{width}, H:{height}) with {total_bits} bits available. Try adjusting width.")
              return None, width, height
 
-        img = Image.new('L', (width, height))
-        img.putdata(pixels[:num_pixels_to_use])
+        img = Image.frombytes('L', (width, height), pixels[:num_pixels_to_use].ljust(num_pixels_to_use, b'\x00'))
 
         # Pass back the count of removed bytes for status display maybe?
         return img, width, height, bytes_removed_count
@@ -170,7 +287,7 @@ class BitmapViewerApp:
     def select_file(self):
         filepath = filedialog.askopenfilename(
             initialdir=os.getcwd(), title="Select Printer Data File",
-            filetypes=(("Bitmap/Binary", "*.bmp;*.bin"), ("All files", "*.*"))
+            filetypes=(("Captures", "*.bin;*.cap;*.bmp"), ("All files", "*.*"))
         )
         if filepath:
             self.filepath = filepath
@@ -1,8 +1,8 @@
 @echo off
-echo Building printer_data_viewer (32-bit, C++17)...
+echo Building printer_data_viewer (64-bit, C++17)...
 
 REM Set up the environment for MSVC (you may need to adjust the path)
-call "C:\Program Files\Microsoft Visual Studio\2022\Community\VC\Auxiliary\Build\vcvars32.bat"
+call "C:\Program Files\Microsoft Visual Studio\2022\Community\VC\Auxiliary\Build\vcvars64.bat"
 
 REM Compile resources
 REM rc.exe resources.rc
@@ -6,6 +6,7 @@
 #include <objidl.h>
 #include <commctrl.h>
 #include <commdlg.h>
+#include <shlobj.h>
 #include <gdiplus.h>
 
 #include <vector>
@@ -21,20 +22,36 @@
 #include <limits>
 #include <cstddef>
 #include <new>
+#include <mutex>
+#include <deque>
+#include <unordered_map>
+
+#include "../Common/capture_reader.h"
+#include "../Common/capture_files.h"
+#include "../Common/receipt_pipeline.h"
+#include "../Common/png_writer.h"
+#include "../Common/receipt_thumbnails.h"
 
 #pragma comment(lib, "gdiplus.lib")
 #pragma comment(lib, "user32.lib")
 #pragma comment(lib, "gdi32.lib")
 #pragma comment(lib, "comdlg32.lib")
 #pragma comment(lib, "comctl32.lib")
+#pragma comment(lib, "shell32.lib")
+#pragma comment(lib, "ole32.lib")
 #pragma comment(linker,"/manifestdependency:\"type='win32' name='Microsoft.Windows.Common-Controls' version='6.0.0.0' processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 
-constexpr size_t HEADER_SIZE = 16;
 constexpr int DEFAULT_WIDTH = 576;
 constexpr int MIN_WIDTH = 1;
 constexpr int MAX_SLIDER_WIDTH = 1200;
+constexpr int MIN_DETECT_WIDTH = 64; // Narrower shifts match on glyph strokes, not rows
 constexpr UINT UPDATE_TIMER_ID = 1;
 constexpr UINT UPDATE_DELAY_MS = 150;
+constexpr UINT RESCAN_TIMER_ID = 2;
+constexpr UINT RESCAN_INTERVAL_MS = 2000; // Folder grid: how often new and growing captures are picked up
+constexpr int PREFETCH_NEIGHBOURS = 2;    // Captures decoded ahead on each side of the open one
+constexpr UINT FOLLOW_TIMER_ID = 3;
+constexpr UINT FOLLOW_RESCAN_MS = 1000;   // Following: how often the folder is checked for a newer capture
 
 constexpr int PADDING = 10;
 constexpr int CTRL_HEIGHT = 23;
@@ -42,254 +59,104 @@ constexpr int BTN_WIDTH = 120;
 constexpr int SHORT_LBL_WIDTH = 40;
 constexpr int EDIT_WIDTH = 50;
 constexpr int CHK_WIDTH = 100;
+constexpr int NAV_BTN_WIDTH = 80;
 constexpr int LBL_VERT_OFFSET = 5;
 
+constexpr int GRID_THUMB_HEIGHT = 192; // Longer previews are cut off
+constexpr int GRID_LABEL_HEIGHT = 18;
+constexpr int GRID_CELL_WIDTH = THUMBNAIL_WIDTH + PADDING * 2;
+constexpr int GRID_CELL_HEIGHT = GRID_THUMB_HEIGHT + GRID_LABEL_HEIGHT + PADDING * 2;
 
-const std::vector<std::byte> SEQUENCE_TO_REMOVE1 = {
-    std::byte{0x1B}, std::byte{0x4A}, std::byte{0x18}, std::byte{0x1D},
-    std::byte{0x76}, std::byte{0x30}, std::byte{0x00}, std::byte{0x48},
-    std::byte{0x00}, std::byte{0x18}, std::byte{0x00}
-};
-const std::vector<std::byte> SEQUENCE_TO_REMOVE2 = {
-    std::byte{0x1B}, std::byte{0x4A}, std::byte{0x18}, std::byte{0x1D},
-    std::byte{0x76}, std::byte{0x30}, std::byte{0x00}, std::byte{0x48},
-    std::byte{0x00}, std::byte{0x10}, std::byte{0x00}
-};
-
-
-int GetEncoderClsid(const WCHAR* format, CLSID* pClsid) {
-    UINT num = 0;
-    UINT size = 0;
-    Gdiplus::GetImageEncodersSize(&num, &size);
-    if (size == 0) return -1;
-
-    std::unique_ptr<Gdiplus::ImageCodecInfo[]> pImageCodecInfo(new Gdiplus::ImageCodecInfo[size]);
-    if (!pImageCodecInfo) return -1;
-
-    Gdiplus::GetImageEncoders(num, size, pImageCodecInfo.get());
-    for (UINT j = 0; j < num; ++j) {
-        if (wcscmp(pImageCodecInfo[j].MimeType, format) == 0) {
-            *pClsid = pImageCodecInfo[j].Clsid;
-            return j;
-        }
-    }
-    return -1;
-}
-
-struct ProcessedBitmapResult {
-    std::shared_ptr<Gdiplus::Bitmap> image = nullptr;
-    int actual_width = 0;
-    int actual_height = 0;
-    size_t bytes_removed_count = 0;
-    std::wstring error_message;
-};
-
-ProcessedBitmapResult load_and_process_bitmap(
-    const std::wstring& filename,
-    int width,
-    bool msb_first = true,
-    bool invert_polarity = false)
-{
-    ProcessedBitmapResult result;
-    result.actual_width = width;
 
-    if (filename.empty() || !std::filesystem::exists(filename)) {
-        result.error_message = L"File not found or not specified.";
-        return result;
-    }
-    if (width <= 0) {
-        result.error_message = L"Width must be positive.";
-        return result;
-    }
-
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
-    if (!file) {
-        result.error_message = L"Failed to open file.";
-        return result;
-    }
-    std::streamsize size = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    if (size < HEADER_SIZE) {
-        result.error_message = L"File is smaller than header size.";
-        return result;
-    }
-    std::vector<char> header_buffer(HEADER_SIZE);
-    if (!file.read(header_buffer.data(), HEADER_SIZE)) {
-        result.error_message = L"Failed to read header.";
-        return result;
-    }
-
-    std::streamsize pixel_data_size = size - HEADER_SIZE;
-    std::vector<std::byte> pixel_data;
-    if (pixel_data_size > 0) {
-        try {
-             pixel_data.resize(pixel_data_size);
-        } catch (const std::bad_alloc&) {
-             result.error_message = L"Failed to allocate memory for pixel data.";
-             return result;
-        }
-        if (!file.read(reinterpret_cast<char*>(pixel_data.data()), pixel_data_size)) {
-            pixel_data.resize(file.gcount());
-            OutputDebugStringW(L"Warning: Partial pixel data read.\n");
-        }
-    }
-    file.close();
-
-    if (pixel_data.empty() && pixel_data_size > 0) {
-         result.error_message = L"Failed to read pixel data (vector empty after read).";
-         return result;
-    }
-
-    size_t removed_in_pass1 = 0;
-    size_t removed_in_pass2 = 0;
-    if (!SEQUENCE_TO_REMOVE1.empty() && !pixel_data.empty()) {
-        auto it = pixel_data.begin();
-        while ((it = std::search(it, pixel_data.end(), SEQUENCE_TO_REMOVE1.begin(), SEQUENCE_TO_REMOVE1.end())) != pixel_data.end()) {
-            it = pixel_data.erase(it, it + SEQUENCE_TO_REMOVE1.size());
-            removed_in_pass1 += SEQUENCE_TO_REMOVE1.size();
-        }
-    }
-    if (!SEQUENCE_TO_REMOVE2.empty() && !pixel_data.empty()) {
-        auto it = pixel_data.begin();
-        while ((it = std::search(it, pixel_data.end(), SEQUENCE_TO_REMOVE2.begin(), SEQUENCE_TO_REMOVE2.end())) != pixel_data.end()) {
-            it = pixel_data.erase(it, it + SEQUENCE_TO_REMOVE2.size());
-             removed_in_pass2 += SEQUENCE_TO_REMOVE2.size();
+#define IDC_BTN_SELECT      1001
+#define IDC_BTN_SAVE        1002
+#define IDC_LBL_FILE        1003
+#define IDC_LBL_FILENAME    1004
+#define IDC_LBL_WIDTH       1005
+#define IDC_EDIT_WIDTH      1006
+#define IDC_SLIDER_WIDTH    1007
+#define IDC_CHK_MSB         1008
+#define IDC_CHK_INVERT      1009
+#define IDC_CANVAS          1010
+#define IDC_STATUS          1011
+#define IDC_BTN_BROWSE      1012
+#define IDC_BTN_PREV        1013
+#define IDC_BTN_NEXT        1014
+#define IDC_ZOOM_IN         1015 // Keyboard only
+#define IDC_ZOOM_OUT        1016
+#define IDC_CHK_FOLLOW      1017
+#define IDC_RECEIPT_PREV    1018 // Keyboard only
+#define IDC_RECEIPT_NEXT    1019
+
+#define WM_APP_RECEIPT_UPDATE (WM_APP + 1)
+#define WM_APP_THUMBNAIL_UPDATE (WM_APP + 2)
+
+
+// A filter_patterns.txt next to the executable replaces DEFAULT_RECEIPT_PATTERNS (one hex
+// pattern per line)
+const wchar_t* const FILTER_PATTERNS_FILE = L"filter_patterns.txt";
+
+
+const BytePatternFilter& get_pattern_filter() {
+    static const BytePatternFilter filter = [] {
+        std::vector<BytePattern> patterns;
+        WCHAR module_path[MAX_PATH] = { 0 };
+        GetModuleFileNameW(NULL, module_path, MAX_PATH);
+        std::filesystem::path file = std::filesystem::path(module_path).parent_path() / FILTER_PATTERNS_FILE;
+        std::string error;
+        if (std::filesystem::exists(file) && LoadBytePatterns(file, patterns, error)) {
+            std::wstringstream ss;
+            ss << L"Debug: Loaded " << patterns.size() << L" filter patterns from " << file.wstring() << L".\n";
+            OutputDebugStringW(ss.str().c_str());
+            return BytePatternFilter(patterns);
         }
-    }
-    result.bytes_removed_count = removed_in_pass1 + removed_in_pass2;
-    if (result.bytes_removed_count > 0) {
-        std::wstringstream ss;
-        ss << L"Debug: Removed " << result.bytes_removed_count << L" bytes matching sequences.\n";
-        OutputDebugStringW(ss.str().c_str());
-    }
-
-    if (pixel_data.empty()) {
-        result.error_message = L"No pixel data remaining after sequence removal.";
-        return result;
-    }
-
-    std::vector<UINT32> pixels;
-    try {
-         pixels.reserve(pixel_data.size() * 8);
-    } catch (const std::bad_alloc&) {
-        result.error_message = L"Failed to allocate memory for pixel array.";
-        return result;
-    }
-
-    UINT64 total_bits = 0;
-    const UINT32 black = 0xFF000000;
-    const UINT32 white = 0xFFFFFFFF;
-
-    for (std::byte byte_val : pixel_data) {
-        unsigned char current_byte = static_cast<unsigned char>(byte_val);
-        if (msb_first) {
-            for (int i = 7; i >= 0; --i) {
-                bool bit = (current_byte >> i) & 1;
-                UINT32 pixel_value = (bit == 1) ? (invert_polarity ? white : black) : (invert_polarity ? black : white);
-                pixels.push_back(pixel_value);
-                total_bits++;
-            }
-        } else {
-            for (int i = 0; i < 8; ++i) {
-                bool bit = (current_byte >> i) & 1;
-                 UINT32 pixel_value = (bit == 1) ? (invert_polarity ? white : black) : (invert_polarity ? black : white);
-                pixels.push_back(pixel_value);
-                total_bits++;
-            }
+        if (!error.empty()) {
+            OutputDebugStringW((L"Warning: " + std::wstring(error.begin(), error.end()) + L". Using the built-in patterns.\n").c_str());
         }
-    }
-
-    if (width == 0) {
-        result.error_message = L"Internal Error: Width became zero.";
-        return result;
-    }
-    if (total_bits == 0) {
-         result.error_message = L"No bits found in processed data.";
-         return result;
-    }
-
-    result.actual_height = static_cast<int>(total_bits / width);
-    if (result.actual_height == 0 && total_bits > 0) {
-        result.actual_height = 1;
-    }
-
-    size_t num_pixels_to_use = static_cast<size_t>(width) * result.actual_height;
-
-    if (num_pixels_to_use == 0) {
-         result.error_message = L"Calculated image size is zero. Try adjusting width.";
-         return result;
-    }
-
-    if (num_pixels_to_use > pixels.size()) {
-         OutputDebugStringW(L"Warning: Truncating height due to insufficient processed pixel data.\n");
-         result.actual_height = pixels.size() / width;
-         num_pixels_to_use = static_cast<size_t>(width) * result.actual_height;
-         if (num_pixels_to_use == 0) {
-            result.error_message = L"Insufficient pixel data for even one row after truncation.";
-            return result;
-         }
-         pixels.resize(num_pixels_to_use);
-     } else if (num_pixels_to_use < pixels.size()) {
-         pixels.resize(num_pixels_to_use);
-     }
-
-    auto gdi_bitmap = std::make_shared<Gdiplus::Bitmap>(width, result.actual_height, PixelFormat32bppARGB);
-
-    if (gdi_bitmap == nullptr || gdi_bitmap->GetLastStatus() != Gdiplus::Ok) {
-        Gdiplus::Status status = (gdi_bitmap) ? gdi_bitmap->GetLastStatus() : Gdiplus::OutOfMemory;
-        std::wstringstream ssErr;
-        ssErr << L"Failed to create GDI+ bitmap object. Status: " << status;
-        result.error_message = ssErr.str();
-        result.image = nullptr;
-        return result;
-    }
-
-    Gdiplus::Rect rect(0, 0, width, result.actual_height);
-    Gdiplus::BitmapData bitmapData;
-    Gdiplus::Status lock_status = gdi_bitmap->LockBits(
-        &rect,
-        Gdiplus::ImageLockModeWrite,
-        PixelFormat32bppARGB,
-        &bitmapData);
-
-    if (lock_status != Gdiplus::Ok) {
-        std::wstringstream ssErr;
-        ssErr << L"Failed to lock bitmap bits for writing. Status: " << lock_status;
-        result.error_message = ssErr.str();
-        result.image = nullptr;
-        return result;
-    }
+        return BytePatternFilter(DefaultReceiptPatterns());
+    }();
+    return filter;
+}
 
-    BYTE* dest_scan0 = static_cast<BYTE*>(bitmapData.Scan0);
-    BYTE* src_pixels = reinterpret_cast<BYTE*>(pixels.data());
-    UINT bytes_per_row_src = width * sizeof(UINT32);
-    UINT stride_dest = bitmapData.Stride;
 
-    if (pixels.size() != num_pixels_to_use) {
-         gdi_bitmap->UnlockBits(&bitmapData);
-         result.error_message = L"Internal error: Mismatch between pixel count and vector size before copy.";
-         result.image = nullptr;
-         return result;
+// Debug output describing a decoded file
+void log_receipt_bits(const ReceiptBits& bits, const WidthDetection& detection) {
+    std::wstringstream ssDebug;
+    if (bits.page_width > 0 && bits.language != PrintLanguage::EscPos) {
+        std::string name = PrintLanguageInfo(bits.language).name;
+        ssDebug << L"Debug: Decoded " << std::wstring(name.begin(), name.end()) << L", " << bits.rows(bits.page_width) << L" rows of "
+                << bits.page_width << L" dots in " << bits.cuts.size() + 1 << L" labels or pages.\n";
+    } else if (bits.page_width > 0) {
+        ssDebug << L"Debug: Emulated ESC/POS text, " << bits.rows(bits.page_width) << L" rows of " << bits.page_width << L" dots";
+        if (bits.raster.blocks > 0) ssDebug << L" with " << bits.raster.blocks << L" raster blocks";
+        ssDebug << L".\n";
+    } else if (bits.raster.blocks > 0) {
+        ssDebug << L"Debug: " << bits.raster.blocks << L" raster blocks, " << bits.raster.rows << L" rows of "
+                << bits.raster.width_bytes * 8 << L" dots" << (bits.raster.uniform_width ? L"" : L" (mixed widths)") << L".\n";
+    } else {
+        ssDebug << L"Debug: Removed " << bits.removed << L" bytes matching sequences.\n";
     }
-
-    for (int y = 0; y < result.actual_height; ++y) {
-        memcpy(dest_scan0 + (static_cast<size_t>(y) * stride_dest),
-               src_pixels + (static_cast<size_t>(y) * bytes_per_row_src),
-               bytes_per_row_src);
+    if (detection.width > 0) {
+        ssDebug << L"Debug: Width " << detection.width << L" from " << WidthSourceName(detection.source) << L".\n";
     }
-
-    gdi_bitmap->UnlockBits(&bitmapData);
-    result.image = gdi_bitmap;
-    return result;
+    OutputDebugStringW(ssDebug.str().c_str());
 }
 
+// A capture in the folder grid
+struct BrowseItem {
+    enum class State { New, Queued, Urgent, Done, Failed };
+    std::filesystem::path path;
+    uint64_t key = 0; // ThumbnailCache::KeyOf when last scanned; changes as the capture grows
+    State state = State::New;
+    std::optional<Thumbnail> thumbnail;
+};
 
 struct AppState {
     HINSTANCE hInstance = nullptr;
     HWND hMainWnd = nullptr;
     HWND hBtnSelectFile = nullptr;
     HWND hBtnSavePng = nullptr;
+    HWND hBtnBrowse = nullptr;
     HWND hLblFile = nullptr;
     HWND hLblFileName = nullptr;
     HWND hLblWidth = nullptr;
@@ -297,35 +164,149 @@ struct AppState {
     HWND hSliderWidth = nullptr;
     HWND hChkMsbFirst = nullptr;
     HWND hChkInvert = nullptr;
+    HWND hBtnPrev = nullptr;
+    HWND hBtnNext = nullptr;
+    HWND hChkFollow = nullptr;
     HWND hCanvas = nullptr;
     HWND hStatus = nullptr;
 
     std::wstring currentFilePath;
+    std::vector<std::filesystem::path> siblings; // Captures in the folder of the open one, oldest first
+    size_t siblingIndex = SIZE_MAX;             // Of the open one; SIZE_MAX if it is not among them
     int currentWidth = DEFAULT_WIDTH;
     bool msbFirst = true;
     bool invertPolarity = false;
+    bool following = false; // Open captures are followed as they are written, and newer ones opened as they appear
+    UINT_PTR followTimer = 0;
 
-    std::shared_ptr<Gdiplus::Bitmap> currentBitmap = nullptr;
+    std::shared_ptr<const ReceiptBits> receiptBits; // Decoded once per file, laid out by the tile cache
+    std::wstring receiptBitsPath;
+    ReceiptTileCache tileCache;
+    int bitmapWidth = 0;
     int bitmapHeight = 0;
     size_t bytesRemoved = 0;
+    int detectedWidth = 0; // Width the file was opened at, 0 if none was found
+    WidthSource widthSource = WidthSource::None;
+    std::wstring loadingPath; // File the pipeline is decoding
+    uint64_t generation = 0;  // Pipeline results from other generations are stale
+
 
+    std::vector<int> receiptRows; // Laid-out row where each receipt of the capture starts, at the current zoom
 
+    int zoomLevel = 0; // Shown at 1 : 1 << zoomLevel; scroll positions are at that scale
     int scrollX = 0;
     int scrollY = 0;
     int canvasWidth = 0;
     int canvasHeight = 0;
 
     UINT_PTR updateTimer = 0;
+
+    bool browsing = false; // The canvas shows the folder grid instead of a receipt
+    std::filesystem::path browseDir;
+    std::vector<BrowseItem> browseItems; // Newest first
+    std::unordered_map<std::wstring, size_t> browseIndex; // Path -> browseItems index
+    ThumbnailCache thumbnailCache;
+    UINT_PTR rescanTimer = 0;
+
+    std::mutex updateMutex;
+    std::deque<ReceiptUpdate> updates; // Published by the pipeline, applied on WM_APP_RECEIPT_UPDATE
+    std::deque<ThumbnailUpdate> thumbnailUpdates; // Applied on WM_APP_THUMBNAIL_UPDATE
+    std::unique_ptr<ReceiptPipeline> pipeline; // Last, so its workers stop before the queue goes
+    std::unique_ptr<ThumbnailGenerator> thumbnails; // Likewise, and before the thumbnail cache
 };
 
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 LRESULT CALLBACK CanvasProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
 void RegisterCanvasClass(HINSTANCE hInstance);
 void UpdateImage(AppState* pState);
+void OpenCapture(AppState* pState, const std::wstring& path);
+void OpenAdjacentCapture(AppState* pState, int step);
+void FollowNewestCapture(AppState* pState);
+void PrefetchNeighbours(AppState* pState);
+void BrowseFolder(AppState* pState, const std::filesystem::path& dir);
+void RescanFolder(AppState* pState);
+void OnThumbnailUpdates(AppState* pState);
+void PaintThumbnailGrid(HDC hdc, Gdiplus::Graphics& graphics, AppState* pState, int clientHeight);
+void ApplyLayout(AppState* pState);
+void OnReceiptUpdates(AppState* pState);
 void UpdateScrollbars(AppState* pState);
 void ScheduleUpdate(AppState* pState);
 void OnPaintCanvas(HWND hWnd, AppState* pState);
 void OnScrollCanvas(HWND hWnd, AppState* pState, int bar, WPARAM wParam);
+void ZoomCanvas(AppState* pState, int level, int anchorX, int anchorY);
+void StepReceipt(AppState* pState, int step);
+
+
+int grid_columns(const AppState* pState) {
+    return std::max(1, pState->canvasWidth / GRID_CELL_WIDTH);
+}
+
+// Size of what the canvas scrolls over: the folder grid, or the laid-out receipt
+void get_content_size(const AppState* pState, int& width, int& height) {
+    if (pState->browsing) {
+        int columns = grid_columns(pState);
+        width = columns * GRID_CELL_WIDTH;
+        height = (int)((pState->browseItems.size() + columns - 1) / columns) * GRID_CELL_HEIGHT;
+    } else if (pState->bitmapHeight > 0) {
+        width = ReceiptTileCache::LevelSize(pState->bitmapWidth, pState->zoomLevel);
+        height = ReceiptTileCache::LevelSize(pState->bitmapHeight, pState->zoomLevel);
+    } else {
+        width = 0;
+        height = 0;
+    }
+}
+
+// BITMAPINFO with room for a palette, for 8-bit gray DIBs
+struct GrayBitmapInfo {
+    BITMAPINFOHEADER bmiHeader;
+    RGBQUAD bmiColors[256];
+};
+
+// Header and palette for 8-bit gray rows where 255 is paper; invert swaps black and white
+void init_gray_bitmap_info(GrayBitmapInfo& bmi, bool invert) {
+    bmi = { };
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 8;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    bmi.bmiHeader.biClrUsed = 256;
+    for (int i = 0; i < 256; ++i) {
+        BYTE level = (BYTE)(invert ? 255 - i : i);
+        bmi.bmiColors[i] = { level, level, level, 0 };
+    }
+}
+
+RECT grid_cell_rect(const AppState* pState, size_t index) {
+    int columns = grid_columns(pState);
+    int x = (int)(index % columns) * GRID_CELL_WIDTH - pState->scrollX;
+    int y = (int)(index / columns) * GRID_CELL_HEIGHT - pState->scrollY;
+    return { x, y, x + GRID_CELL_WIDTH, y + GRID_CELL_HEIGHT };
+}
+
+int CALLBACK browse_folder_callback(HWND hDlg, UINT message, LPARAM lParam, LPARAM data) {
+    UNREFERENCED_PARAMETER(lParam);
+    if (message == BFFM_INITIALIZED && data) SendMessageW(hDlg, BFFM_SETSELECTIONW, TRUE, data);
+    return 0;
+}
+
+// Folder picker starting at initial; false if cancelled
+bool pick_folder(HWND hWnd, const std::filesystem::path& initial, std::filesystem::path& dir) {
+    std::wstring start = initial.wstring();
+    BROWSEINFOW bi = { };
+    bi.hwndOwner = hWnd;
+    bi.lpszTitle = L"Folder of captures to browse:";
+    bi.ulFlags = BIF_RETURNONLYFSDIRS | BIF_NEWDIALOGSTYLE;
+    bi.lpfn = browse_folder_callback;
+    bi.lParam = start.empty() ? 0 : (LPARAM)start.c_str();
+    PIDLIST_ABSOLUTE pidl = SHBrowseForFolderW(&bi);
+    if (!pidl) return false;
+    WCHAR path[MAX_PATH] = { 0 };
+    BOOL ok = SHGetPathFromIDListW(pidl, path);
+    CoTaskMemFree(pidl);
+    if (!ok) return false;
+    dir = path;
+    return true;
+}
 
 
 int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
@@ -344,6 +325,7 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
          return 1;
     }
 
+    HRESULT hrCom = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED); // For the folder picker
     INITCOMMONCONTROLSEX icex;
     icex.dwSize = sizeof(INITCOMMONCONTROLSEX);
     icex.dwICC = ICC_STANDARD_CLASSES | ICC_BAR_CLASSES;
@@ -411,6 +393,24 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 
     MSG msg;
     while (GetMessage(&msg, nullptr, 0, 0)) {
+        // Ctrl+Page Up / Ctrl+Page Down step through the folder, Ctrl+Up / Ctrl+Down through
+        // the receipts of the open capture and Ctrl+Minus / Ctrl+Plus zoom, whichever control
+        // has focus
+        if (msg.message == WM_KEYDOWN && GetKeyState(VK_CONTROL) < 0) {
+            int command = 0;
+            switch (msg.wParam) {
+            case VK_PRIOR: command = IDC_BTN_PREV; break;
+            case VK_NEXT: command = IDC_BTN_NEXT; break;
+            case VK_UP: command = IDC_RECEIPT_PREV; break;
+            case VK_DOWN: command = IDC_RECEIPT_NEXT; break;
+            case VK_OEM_PLUS: case VK_ADD: command = IDC_ZOOM_IN; break;
+            case VK_OEM_MINUS: case VK_SUBTRACT: command = IDC_ZOOM_OUT; break;
+            }
+            if (command) {
+                SendMessage(hWnd, WM_COMMAND, MAKEWPARAM(command, BN_CLICKED), 0);
+                continue;
+            }
+        }
         if (!IsDialogMessage(hWnd, &msg)) {
             TranslateMessage(&msg);
             DispatchMessage(&msg);
@@ -418,6 +418,7 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     }
 
     delete pState;
+    if (SUCCEEDED(hrCom)) CoUninitialize();
     Gdiplus::GdiplusShutdown(gdiplusToken);
 
     return (int)msg.wParam;
@@ -439,18 +440,6 @@ void RegisterCanvasClass(HINSTANCE hInstance) {
     RegisterClassExW(&wcex);
 }
 
-#define IDC_BTN_SELECT      1001
-#define IDC_BTN_SAVE        1002
-#define IDC_LBL_FILE        1003
-#define IDC_LBL_FILENAME    1004
-#define IDC_LBL_WIDTH       1005
-#define IDC_EDIT_WIDTH      1006
-#define IDC_SLIDER_WIDTH    1007
-#define IDC_CHK_MSB         1008
-#define IDC_CHK_INVERT      1009
-#define IDC_CANVAS          1010
-#define IDC_STATUS          1011
-
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
     AppState* pState = nullptr;
 
@@ -469,6 +458,14 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 
     switch (message) {
     case WM_CREATE: {
+        pState->pipeline = std::make_unique<ReceiptPipeline>([pState, hWnd](ReceiptUpdate&& update) {
+            {
+                std::lock_guard<std::mutex> lock(pState->updateMutex);
+                pState->updates.push_back(std::move(update));
+            }
+            PostMessage(hWnd, WM_APP_RECEIPT_UPDATE, 0, 0);
+        });
+
         int ctrlY = PADDING;
 
         RECT clientRect;
@@ -485,7 +482,11 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             PADDING + BTN_WIDTH + PADDING, ctrlY, BTN_WIDTH, CTRL_HEIGHT, hWnd, (HMENU)IDC_BTN_SAVE, pState->hInstance, NULL);
         SendMessage(pState->hBtnSavePng, WM_SETFONT, (WPARAM)hFont, TRUE);
 
-        int fileLblX = PADDING + BTN_WIDTH * 2 + PADDING * 2;
+        pState->hBtnBrowse = CreateWindowW(L"BUTTON", L"Browse Folder...", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+            PADDING + (BTN_WIDTH + PADDING) * 2, ctrlY, BTN_WIDTH, CTRL_HEIGHT, hWnd, (HMENU)IDC_BTN_BROWSE, pState->hInstance, NULL);
+        SendMessage(pState->hBtnBrowse, WM_SETFONT, (WPARAM)hFont, TRUE);
+
+        int fileLblX = PADDING + BTN_WIDTH * 3 + PADDING * 3;
         pState->hLblFile = CreateWindowW(L"STATIC", L"File:", WS_VISIBLE | WS_CHILD | SS_RIGHT,
              fileLblX, ctrlY + LBL_VERT_OFFSET, SHORT_LBL_WIDTH, CTRL_HEIGHT, hWnd, (HMENU)IDC_LBL_FILE, pState->hInstance, NULL);
         SendMessage(pState->hLblFile, WM_SETFONT, (WPARAM)hFont, TRUE);
@@ -527,6 +528,20 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
         SendMessage(pState->hChkInvert, WM_SETFONT, (WPARAM)hFont, TRUE);
         Button_SetCheck(pState->hChkInvert, BST_UNCHECKED);
 
+        int navX = PADDING + CHK_WIDTH + PADDING + CHK_WIDTH + 20 + PADDING;
+        pState->hBtnPrev = CreateWindowW(L"BUTTON", L"< Previous", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON | WS_DISABLED,
+            navX, ctrlY, NAV_BTN_WIDTH, CTRL_HEIGHT, hWnd, (HMENU)IDC_BTN_PREV, pState->hInstance, NULL);
+        SendMessage(pState->hBtnPrev, WM_SETFONT, (WPARAM)hFont, TRUE);
+
+        pState->hBtnNext = CreateWindowW(L"BUTTON", L"Next >", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON | WS_DISABLED,
+            navX + NAV_BTN_WIDTH + PADDING, ctrlY, NAV_BTN_WIDTH, CTRL_HEIGHT, hWnd, (HMENU)IDC_BTN_NEXT, pState->hInstance, NULL);
+        SendMessage(pState->hBtnNext, WM_SETFONT, (WPARAM)hFont, TRUE);
+
+        pState->hChkFollow = CreateWindowW(L"BUTTON", L"Follow", WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_AUTOCHECKBOX,
+            navX + (NAV_BTN_WIDTH + PADDING) * 2, ctrlY, CHK_WIDTH, CTRL_HEIGHT, hWnd, (HMENU)IDC_CHK_FOLLOW, pState->hInstance, NULL);
+        SendMessage(pState->hChkFollow, WM_SETFONT, (WPARAM)hFont, TRUE);
+        Button_SetCheck(pState->hChkFollow, BST_UNCHECKED);
+
         ctrlY += CTRL_HEIGHT + PADDING;
 
         int statusHeight = 0;
@@ -594,38 +609,64 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                 ofn.lpstrFile = szFile;
                 ofn.nMaxFile = MAX_PATH;
 
-                ofn.lpstrFilter = L"Bitmap/Binary (*.bmp;*.bin)\0*.bmp;*.bin\0All Files (*.*)\0*.*\0";
+                ofn.lpstrFilter = L"Captures (*.bin;*.cap;*.bmp)\0*.bin;*.cap;*.bmp\0All Files (*.*)\0*.*\0";
                 ofn.nFilterIndex = 1;
                 ofn.lpstrInitialDir = NULL;
                 ofn.Flags = OFN_PATHMUSTEXIST | OFN_FILEMUSTEXIST | OFN_EXPLORER;
 
                 if (GetOpenFileNameW(&ofn) == TRUE) {
-                    pState->currentFilePath = szFile;
-
-
-                    pState->currentWidth = DEFAULT_WIDTH;
-                    pState->msbFirst = true;
-                    pState->invertPolarity = false;
-                    pState->scrollX = 0;
-                    pState->scrollY = 0;
+                    OpenCapture(pState, szFile);
+                }
+            }
+            break;
 
+        case IDC_ZOOM_IN:
+        case IDC_ZOOM_OUT:
+            ZoomCanvas(pState, pState->zoomLevel + (wmId == IDC_ZOOM_OUT ? 1 : -1), pState->canvasWidth / 2, pState->canvasHeight / 2);
+            break;
 
-                    SetWindowTextW(pState->hLblFileName, std::filesystem::path(pState->currentFilePath).filename().c_str());
-                    SetWindowTextW(pState->hEditWidth, std::to_wstring(DEFAULT_WIDTH).c_str());
-                    SendMessage(pState->hSliderWidth, TBM_SETPOS, (WPARAM)TRUE, (LPARAM)DEFAULT_WIDTH);
-                    Button_SetCheck(pState->hChkMsbFirst, BST_CHECKED);
-                    Button_SetCheck(pState->hChkInvert, BST_UNCHECKED);
+        case IDC_BTN_PREV:
+        case IDC_BTN_NEXT:
+            if (wmEvent == BN_CLICKED) OpenAdjacentCapture(pState, wmId == IDC_BTN_NEXT ? 1 : -1);
+            break;
 
+        case IDC_RECEIPT_PREV:
+        case IDC_RECEIPT_NEXT:
+            StepReceipt(pState, wmId == IDC_RECEIPT_NEXT ? 1 : -1);
+            break;
 
-                    if (pState->updateTimer) { KillTimer(hWnd, pState->updateTimer); pState->updateTimer = 0; }
-                    UpdateImage(pState);
+        case IDC_CHK_FOLLOW:
+            // Following decodes the open capture once more from the start, then only what is
+            // appended to it; turning it off keeps what has been shown
+            if (wmEvent == BN_CLICKED) {
+                pState->following = Button_GetCheck(pState->hChkFollow) == BST_CHECKED;
+                if (pState->following) {
+                    if (!pState->followTimer) pState->followTimer = SetTimer(hWnd, FOLLOW_TIMER_ID, FOLLOW_RESCAN_MS, NULL);
+                    if (!pState->browsing && !pState->currentFilePath.empty()) {
+                        pState->receiptBits = nullptr;
+                        pState->loadingPath.clear();
+                        UpdateImage(pState);
+                    }
+                } else {
+                    if (pState->followTimer) { KillTimer(hWnd, pState->followTimer); pState->followTimer = 0; }
+                    pState->pipeline->Unfollow();
+                    if (pState->receiptBits) ApplyLayout(pState);
                 }
             }
             break;
 
+        case IDC_BTN_BROWSE:
+            if (wmEvent == BN_CLICKED) {
+                std::filesystem::path initial = pState->browseDir;
+                if (initial.empty() && !pState->currentFilePath.empty()) initial = std::filesystem::path(pState->currentFilePath).parent_path();
+                std::filesystem::path dir;
+                if (pick_folder(hWnd, initial, dir)) BrowseFolder(pState, dir);
+            }
+            break;
+
         case IDC_BTN_SAVE:
              if (wmEvent == BN_CLICKED) {
-                if (pState->currentBitmap && !pState->currentFilePath.empty()) {
+                if (pState->receiptBits && pState->bitmapHeight > 0 && !pState->currentFilePath.empty()) {
                     WCHAR szFile[MAX_PATH] = { 0 };
                     std::filesystem::path srcPath(pState->currentFilePath);
 
@@ -643,22 +684,17 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                     ofn.Flags = OFN_OVERWRITEPROMPT | OFN_PATHMUSTEXIST | OFN_EXPLORER;
 
                     if (GetSaveFileNameW(&ofn) == TRUE) {
-                        CLSID pngClsid;
-
-                        int result = GetEncoderClsid(L"image/png", &pngClsid);
-                        if (result != -1) {
-
-                            Gdiplus::Status status = pState->currentBitmap->Save(szFile, &pngClsid, NULL);
-                            if (status == Gdiplus::Ok) {
-                                std::wstring msg = L"Saved: " + std::filesystem::path(szFile).filename().wstring();
-                                SetWindowTextW(pState->hStatus, msg.c_str());
-                            } else {
-                                MessageBoxW(hWnd, L"Failed to save PNG image.", L"Save Error", MB_ICONERROR);
-                                SetWindowTextW(pState->hStatus, L"Save failed.");
-                            }
+                        // 1-bit PNG written a band at a time, straight from the decoded bits
+                        SetWindowTextW(pState->hStatus, L"Saving...");
+                        std::string error;
+                        if (WriteReceiptPng(std::filesystem::path(szFile), *pState->receiptBits, pState->bitmapWidth,
+                                            pState->msbFirst, pState->invertPolarity, error)) {
+                            std::wstring msg = L"Saved: " + std::filesystem::path(szFile).filename().wstring();
+                            SetWindowTextW(pState->hStatus, msg.c_str());
                         } else {
-                            MessageBoxW(hWnd, L"PNG Image Encoder not found. Cannot save.", L"Save Error", MB_ICONERROR);
-                            SetWindowTextW(pState->hStatus, L"Save failed (no encoder).");
+                            std::wstring message = L"Failed to save PNG image: " + std::wstring(error.begin(), error.end());
+                            MessageBoxW(hWnd, message.c_str(), L"Save Error", MB_ICONERROR);
+                            SetWindowTextW(pState->hStatus, L"Save failed.");
                         }
                     }
                 } else {
@@ -756,6 +792,10 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
             KillTimer(hWnd, UPDATE_TIMER_ID);
             pState->updateTimer = 0;
             UpdateImage(pState);
+        } else if (wParam == RESCAN_TIMER_ID && pState->browsing) {
+            RescanFolder(pState);
+        } else if (wParam == FOLLOW_TIMER_ID && pState->following) {
+            FollowNewestCapture(pState);
         }
     } break;
 
@@ -844,9 +884,32 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
              KillTimer(hWnd, pState->updateTimer);
              pState->updateTimer = 0;
          }
+         if (pState && pState->rescanTimer) {
+             KillTimer(hWnd, pState->rescanTimer);
+             pState->rescanTimer = 0;
+         }
+         if (pState && pState->followTimer) {
+             KillTimer(hWnd, pState->followTimer);
+             pState->followTimer = 0;
+         }
+         if (pState) pState->pipeline.reset();
+         if (pState) pState->thumbnails.reset();
         PostQuitMessage(0);
         break;
 
+    case WM_APP_RECEIPT_UPDATE:
+        OnReceiptUpdates(pState);
+        break;
+
+    case WM_APP_THUMBNAIL_UPDATE:
+        OnThumbnailUpdates(pState);
+        break;
+
+    case WM_MOUSEWHEEL:
+        // Sent to the focused control, which passes it up here; the canvas acts on it
+        if (pState->hCanvas) return SendMessage(pState->hCanvas, message, wParam, lParam);
+        break;
+
     case WM_ERASEBKGND:
 
 
@@ -907,6 +970,31 @@ LRESULT CALLBACK CanvasProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
          OnScrollCanvas(hWnd, pState, SB_VERT, wParam);
         break;
 
+    case WM_MOUSEWHEEL: {
+         // The wheel scrolls; with Ctrl it zooms, out when turned towards the user, about the cursor
+         POINT pt = { GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam) };
+         ScreenToClient(hWnd, &pt);
+         int delta = GET_WHEEL_DELTA_WPARAM(wParam);
+         if (GET_KEYSTATE_WPARAM(wParam) & MK_CONTROL) {
+             ZoomCanvas(pState, pState->zoomLevel + (delta < 0 ? 1 : -1), pt.x, pt.y);
+         } else {
+             for (int line = 0; line < 3; ++line) OnScrollCanvas(hWnd, pState, SB_VERT, MAKEWPARAM(delta < 0 ? SB_LINEDOWN : SB_LINEUP, 0));
+         }
+    } break;
+
+    case WM_LBUTTONDOWN:
+         // Clicking a capture in the folder grid opens it
+         if (pState->browsing) {
+             int x = GET_X_LPARAM(lParam) + pState->scrollX;
+             int y = GET_Y_LPARAM(lParam) + pState->scrollY;
+             int columns = grid_columns(pState);
+             size_t index = (size_t)(y / GRID_CELL_HEIGHT) * columns + x / GRID_CELL_WIDTH;
+             if (x / GRID_CELL_WIDTH < columns && index < pState->browseItems.size()) {
+                 OpenCapture(pState, pState->browseItems[index].path.wstring());
+             }
+         }
+        break;
+
     default:
 
         return DefWindowProc(hWnd, message, wParam, lParam);
@@ -937,12 +1025,209 @@ void ScheduleUpdate(AppState* pState) {
 
 
 
+// Leaves the folder grid, if shown, and opens path at the default settings
+void OpenCapture(AppState* pState, const std::wstring& path) {
+    HWND hWnd = pState->hMainWnd;
+    if (pState->browsing) {
+        pState->browsing = false;
+        if (pState->rescanTimer) { KillTimer(hWnd, pState->rescanTimer); pState->rescanTimer = 0; }
+        if (pState->thumbnails) pState->thumbnails->Cancel();
+    }
+    pState->currentFilePath = path;
+    pState->receiptBits = nullptr; // Reopened even if picked again; unchanged files come from the pipeline's cache
+
+
+    pState->currentWidth = DEFAULT_WIDTH;
+    pState->msbFirst = true;
+    pState->invertPolarity = false;
+    pState->zoomLevel = 0;
+    pState->scrollX = 0;
+    pState->scrollY = 0;
+
+
+    SetWindowTextW(pState->hLblFileName, std::filesystem::path(pState->currentFilePath).filename().c_str());
+    SetWindowTextW(pState->hEditWidth, std::to_wstring(DEFAULT_WIDTH).c_str());
+    SendMessage(pState->hSliderWidth, TBM_SETPOS, (WPARAM)TRUE, (LPARAM)DEFAULT_WIDTH);
+    Button_SetCheck(pState->hChkMsbFirst, BST_CHECKED);
+    Button_SetCheck(pState->hChkInvert, BST_UNCHECKED);
+
+
+    if (pState->updateTimer) { KillTimer(hWnd, pState->updateTimer); pState->updateTimer = 0; }
+    UpdateImage(pState);
+    PrefetchNeighbours(pState);
+}
+
+// Lists the captures in the folder of the open one, in the order they were taken (the
+// timestamp in their names), and has the pipeline decode the nearest ones on each side
+// ahead of time, the next one first, so stepping through a shift's jobs is immediate
+void PrefetchNeighbours(AppState* pState) {
+    std::filesystem::path current(pState->currentFilePath);
+    pState->siblings.clear();
+    pState->siblingIndex = SIZE_MAX;
+    for (CaptureFileInfo& info : ListCaptureFiles(current.parent_path())) {
+        if (info.path.filename() == current.filename()) pState->siblingIndex = pState->siblings.size();
+        pState->siblings.push_back(std::move(info.path));
+    }
+    std::vector<std::filesystem::path> neighbours;
+    size_t index = pState->siblingIndex;
+    for (size_t step = 1; index != SIZE_MAX && step <= (size_t)PREFETCH_NEIGHBOURS; ++step) {
+        if (index + step < pState->siblings.size()) neighbours.push_back(pState->siblings[index + step]);
+        if (index >= step) neighbours.push_back(pState->siblings[index - step]);
+    }
+    if (pState->pipeline) pState->pipeline->Prefetch(neighbours, get_pattern_filter());
+    EnableWindow(pState->hBtnPrev, index != SIZE_MAX && index > 0);
+    EnableWindow(pState->hBtnNext, index != SIZE_MAX); // Captures may land after the last one
+}
+
+// Opens the capture taken before (step -1) or after (step 1) the open one
+void OpenAdjacentCapture(AppState* pState, int step) {
+    if (pState->browsing || pState->currentFilePath.empty()) return;
+    if (step > 0 && pState->siblingIndex + 1 >= pState->siblings.size()) PrefetchNeighbours(pState); // Any new ones
+    size_t index = pState->siblingIndex;
+    if (index == SIZE_MAX || (step < 0 && index == 0) || (step > 0 && index + 1 >= pState->siblings.size())) {
+        SetWindowTextW(pState->hStatus, step < 0 ? L"No earlier capture in this folder." : L"No later capture in this folder.");
+        return;
+    }
+    OpenCapture(pState, pState->siblings[step < 0 ? index - 1 : index + 1].wstring());
+}
+
+// Following: once the relay starts a capture after the followed one in its folder, that is
+// what the printer is receiving now, so it is opened (and followed) instead
+void FollowNewestCapture(AppState* pState) {
+    if (pState->browsing || pState->currentFilePath.empty()) return;
+    std::filesystem::path current(pState->currentFilePath);
+    std::vector<CaptureFileInfo> captures = ListCaptureFiles(current.parent_path());
+    auto found = std::find_if(captures.begin(), captures.end(), [&](const CaptureFileInfo& info) { return info.path.filename() == current.filename(); });
+    if (found == captures.end() || found + 1 == captures.end()) return;
+    OpenCapture(pState, captures.back().path.wstring());
+}
+
+// Shows the captures of dir as a grid of thumbnails, newest first. Thumbnails come from the
+// folder's thumbnails.cache or are rendered in the background, the visible ones first, and
+// the folder is rescanned every RESCAN_INTERVAL_MS for new and growing captures.
+void BrowseFolder(AppState* pState, const std::filesystem::path& dir) {
+    HWND hWnd = pState->hMainWnd;
+    pState->thumbnails.reset(); // Its workers may be using the cache about to be reopened
+    {
+        std::lock_guard<std::mutex> lock(pState->updateMutex);
+        pState->thumbnailUpdates.clear();
+    }
+    std::string error;
+    bool cached = pState->thumbnailCache.Open(dir, error);
+    if (!cached) {
+        OutputDebugStringW((L"Warning: " + std::wstring(error.begin(), error.end()) + L". Thumbnails are not kept.\n").c_str());
+    }
+    pState->thumbnails = std::make_unique<ThumbnailGenerator>(get_pattern_filter(), ThumbnailParams(),
+        cached ? &pState->thumbnailCache : nullptr, [pState, hWnd](ThumbnailUpdate&& update) {
+            {
+                std::lock_guard<std::mutex> lock(pState->updateMutex);
+                pState->thumbnailUpdates.push_back(std::move(update));
+            }
+            PostMessage(hWnd, WM_APP_THUMBNAIL_UPDATE, 0, 0);
+        });
+
+    // The receipt on display is let go; picking a capture from the grid decodes it again
+    pState->generation = pState->pipeline->Cancel();
+    pState->loadingPath.clear();
+    if (pState->updateTimer) { KillTimer(hWnd, pState->updateTimer); pState->updateTimer = 0; }
+    pState->browsing = true;
+    pState->browseDir = dir;
+    pState->browseItems.clear();
+    pState->browseIndex.clear();
+    pState->scrollX = 0;
+    pState->scrollY = 0;
+    EnableWindow(pState->hBtnSavePng, FALSE);
+    EnableWindow(pState->hBtnPrev, FALSE);
+    EnableWindow(pState->hBtnNext, FALSE);
+    SetWindowTextW(pState->hLblFileName, dir.c_str());
+    RescanFolder(pState);
+    if (!pState->rescanTimer) pState->rescanTimer = SetTimer(hWnd, RESCAN_TIMER_ID, RESCAN_INTERVAL_MS, NULL);
+}
+
+// Picks up captures added to, changed in or removed from the browsed folder. Captures whose
+// key is unchanged keep their thumbnail; new and changed ones are queued for the background,
+// and painting moves the visible ones to the front.
+void RescanFolder(AppState* pState) {
+    std::vector<CaptureFileInfo> files = ListCaptureFiles(pState->browseDir);
+    std::vector<BrowseItem> items;
+    std::unordered_map<std::wstring, size_t> index;
+    items.reserve(files.size());
+    bool changed = files.size() != pState->browseItems.size();
+    for (auto it = files.rbegin(); it != files.rend(); ++it) {
+        BrowseItem item;
+        item.path = it->path;
+        if (!ThumbnailCache::KeyOf(item.path, ThumbnailParams(), item.key)) continue; // Removed meanwhile
+        auto found = pState->browseIndex.find(item.path.wstring());
+        if (found != pState->browseIndex.end() && pState->browseItems[found->second].key == item.key) {
+            changed |= found->second != items.size();
+            item = std::move(pState->browseItems[found->second]);
+        } else {
+            changed = true;
+        }
+        index[item.path.wstring()] = items.size();
+        items.push_back(std::move(item));
+    }
+    pState->browseItems = std::move(items);
+    pState->browseIndex = std::move(index);
+
+    std::vector<std::filesystem::path> pending;
+    for (BrowseItem& item : pState->browseItems) {
+        if (item.state != BrowseItem::State::New) continue;
+        item.state = BrowseItem::State::Queued;
+        pending.push_back(item.path);
+    }
+    if (pState->thumbnails) pState->thumbnails->Request(pending, false);
+
+    std::wstringstream ssStatus;
+    ssStatus << pState->browseItems.size() << L" captures in " << pState->browseDir.filename().wstring()
+             << (pState->thumbnailCache.is_open() ? L"" : L" (thumbnail cache unavailable)");
+    SetWindowTextW(pState->hStatus, ssStatus.str().c_str());
+    if (changed) {
+        UpdateScrollbars(pState);
+        if (pState->hCanvas) InvalidateRect(pState->hCanvas, NULL, FALSE);
+    }
+}
+
+// Stores the thumbnails the generator published and repaints their cells
+void OnThumbnailUpdates(AppState* pState) {
+    std::deque<ThumbnailUpdate> updates;
+    {
+        std::lock_guard<std::mutex> lock(pState->updateMutex);
+        updates.swap(pState->thumbnailUpdates);
+    }
+    if (!pState->browsing) return;
+    for (ThumbnailUpdate& update : updates) {
+        auto found = pState->browseIndex.find(update.path.wstring());
+        if (found == pState->browseIndex.end()) continue;
+        BrowseItem& item = pState->browseItems[found->second];
+        if (update.ok) {
+            item.thumbnail = std::move(update.thumbnail);
+            item.state = BrowseItem::State::Done;
+        } else {
+            item.thumbnail.reset();
+            item.state = BrowseItem::State::Failed;
+            OutputDebugStringW((L"Debug: No thumbnail for " + update.path.wstring() + L": " +
+                                std::wstring(update.error.begin(), update.error.end()) + L"\n").c_str());
+        }
+        RECT rcCell = grid_cell_rect(pState, found->second);
+        if (pState->hCanvas) InvalidateRect(pState->hCanvas, &rcCell, FALSE);
+    }
+}
+
 void UpdateImage(AppState* pState) {
-    if (!pState || !pState->hMainWnd) return;
+    if (!pState || !pState->hMainWnd || !pState->pipeline) return;
+    if (pState->browsing) { // Only polarity shows on the grid; the rest applies to the next capture opened
+        if (pState->hCanvas) InvalidateRect(pState->hCanvas, NULL, FALSE);
+        return;
+    }
 
 
     if (pState->currentFilePath.empty()) {
-         pState->currentBitmap = nullptr;
+         pState->generation = pState->pipeline->Cancel();
+         pState->loadingPath.clear();
+         pState->receiptBits = nullptr;
+         pState->tileCache.Reset(nullptr, 0, true, false);
+         pState->bitmapWidth = 0;
          pState->bitmapHeight = 0;
          pState->bytesRemoved = 0;
          EnableWindow(pState->hBtnSavePng, FALSE);
@@ -955,43 +1240,107 @@ void UpdateImage(AppState* pState) {
         return;
     }
 
+    // The file is decoded once, on the pipeline; width and bit options only change the tile
+    // layout. Changes made while it decodes are picked up when it finishes.
+    if (!pState->receiptBits || pState->receiptBitsPath != pState->currentFilePath) {
+        if (pState->loadingPath != pState->currentFilePath) {
+            pState->loadingPath = pState->currentFilePath;
+            pState->generation = pState->following
+                ? pState->pipeline->Follow(pState->currentFilePath, get_pattern_filter(), MIN_DETECT_WIDTH, MAX_SLIDER_WIDTH)
+                : pState->pipeline->Decode(pState->currentFilePath, get_pattern_filter(), MIN_DETECT_WIDTH, MAX_SLIDER_WIDTH);
+            pState->receiptBits = nullptr;
+            pState->tileCache.Reset(nullptr, 0, true, false);
+            pState->bitmapWidth = 0;
+            pState->bitmapHeight = 0;
+            pState->bytesRemoved = 0;
+            EnableWindow(pState->hBtnSavePng, FALSE);
+            SetWindowTextW(pState->hStatus, pState->following ? L"Following: waiting for print data..." : L"Processing...");
+            pState->scrollX = 0;
+            pState->scrollY = 0;
+            UpdateScrollbars(pState);
+            if (pState->hCanvas) InvalidateRect(pState->hCanvas, NULL, TRUE);
+        }
+        return;
+    }
+    ApplyLayout(pState);
+}
 
-    SetWindowTextW(pState->hStatus, L"Processing...");
-    UpdateWindow(pState->hStatus);
+// Index into receiptRows of the receipt at the top of the view
+size_t current_receipt(const AppState* pState) {
+    auto it = std::upper_bound(pState->receiptRows.begin(), pState->receiptRows.end(), pState->scrollY);
+    return it == pState->receiptRows.begin() ? 0 : (size_t)(it - pState->receiptRows.begin() - 1);
+}
 
+// Status bar text of a laid-out receipt
+std::wstring layout_status(const AppState* pState) {
+    std::wstringstream ssStatus;
+    ssStatus << L"W:" << pState->bitmapWidth;
+    if (pState->detectedWidth > 0 && pState->bitmapWidth == pState->detectedWidth) {
+        ssStatus << (pState->widthSource == WidthSource::RasterHeader ? L" (from header)"
+                     : pState->widthSource == WidthSource::Emulated ? L" (text page)" : L" (detected)");
+    }
+    ssStatus << L" H:" << pState->bitmapHeight
+             << L" (" << (pState->msbFirst ? L"MSB" : L"LSB")
+             << (pState->invertPolarity ? L", INV" : L"") << L")";
+    if (pState->zoomLevel > 0) ssStatus << L" 1:" << (1 << pState->zoomLevel);
+    if (pState->receiptRows.size() > 1) {
+        ssStatus << L" Receipt " << current_receipt(pState) + 1 << L"/" << pState->receiptRows.size();
+    }
+    if (pState->bytesRemoved > 0) {
+        ssStatus << L" (" << pState->bytesRemoved << L" bytes removed)";
+    }
+    if (pState->following) ssStatus << L" - following";
+    return ssStatus.str();
+}
 
-    ProcessedBitmapResult result = load_and_process_bitmap(
-        pState->currentFilePath,
-        pState->currentWidth,
-        pState->msbFirst,
-        pState->invertPolarity);
+// Lays the decoded bits out at the current width and options. Tiles of older layouts still
+// being rendered are dropped; the canvas asks for the new ones as it paints. Tiles are kept
+// uninverted and polarity is applied when they are drawn, so toggling it reuses them.
+void ApplyLayout(AppState* pState) {
+    std::wstring error;
+    bool relayout = pState->tileCache.bits() != pState->receiptBits.get() ||
+                    pState->tileCache.width() != pState->currentWidth ||
+                    pState->tileCache.msb_first() != pState->msbFirst;
+    if (relayout) {
+        pState->generation = pState->pipeline->Relayout(pState->receiptBits, pState->currentWidth, pState->msbFirst, false);
+        pState->tileCache.Reset(pState->receiptBits, pState->currentWidth, pState->msbFirst, false);
+    }
+    pState->bitmapWidth = pState->currentWidth;
+    pState->bitmapHeight = pState->tileCache.rows();
+    if (pState->receiptBits && pState->bitmapHeight == 0) {
+        error = L"Insufficient pixel data for even one row. Try adjusting width.";
+    }
 
 
-    pState->currentBitmap = result.image;
-    pState->bitmapHeight = result.actual_height;
-    pState->bytesRemoved = result.bytes_removed_count;
+    pState->receiptRows.clear();
+    if (pState->receiptBits && pState->bitmapWidth > 0) {
+        for (uint64_t start : pState->receiptBits->receipt_starts()) {
+            pState->receiptRows.push_back((int)std::min<uint64_t>(start * 8 / (uint64_t)pState->bitmapWidth >> pState->zoomLevel, INT32_MAX));
+        }
+    }
+    if (relayout) {
+        pState->scrollX = 0;
+        pState->scrollY = 0;
+    }
 
 
     std::wstringstream ssStatus;
-     if (pState->currentBitmap) {
-         ssStatus << L"W:" << result.actual_width
-                  << L" H:" << result.actual_height
-                  << L" (" << (pState->msbFirst ? L"MSB" : L"LSB")
-                  << (pState->invertPolarity ? L", INV" : L"") << L")";
-         if (result.bytes_removed_count > 0) {
-             ssStatus << L" (" << result.bytes_removed_count << L" bytes removed)";
-         }
+     if (pState->bitmapHeight > 0) {
+         ssStatus << layout_status(pState);
          EnableWindow(pState->hBtnSavePng, TRUE);
+     } else if (pState->following) {
+         ssStatus << L"Following: waiting for a complete row...";
+         EnableWindow(pState->hBtnSavePng, FALSE);
      } else {
 
-         if (!result.error_message.empty()) {
-            ssStatus << L"Error: " << result.error_message;
+         if (!error.empty()) {
+            ssStatus << L"Error: " << error;
          } else {
              ssStatus << L"Load/Process Failed.";
          }
 
-          if (result.bytes_removed_count > 0) {
-              ssStatus << L" (" << result.bytes_removed_count << L" bytes removed)";
+          if (pState->bytesRemoved > 0) {
+              ssStatus << L" (" << pState->bytesRemoved << L" bytes removed)";
           }
           EnableWindow(pState->hBtnSavePng, FALSE);
 
@@ -1000,8 +1349,6 @@ void UpdateImage(AppState* pState) {
      SetWindowTextW(pState->hStatus, ssStatus.str().c_str());
 
 
-    pState->scrollX = 0;
-    pState->scrollY = 0;
     UpdateScrollbars(pState);
 
 
@@ -1011,6 +1358,82 @@ void UpdateImage(AppState* pState) {
     }
 }
 
+// Applies what the pipeline published; results of superseded generations are dropped
+void OnReceiptUpdates(AppState* pState) {
+    if (!pState->pipeline) return;
+    std::deque<ReceiptUpdate> updates;
+    {
+        std::lock_guard<std::mutex> lock(pState->updateMutex);
+        updates.swap(pState->updates);
+    }
+    for (ReceiptUpdate& update : updates) {
+        if (update.generation != pState->generation) continue;
+
+        switch (update.kind) {
+        case ReceiptUpdate::Kind::Decoded:
+            pState->receiptBits = update.bits;
+            pState->receiptBitsPath = pState->loadingPath;
+            pState->loadingPath.clear();
+            pState->bytesRemoved = (size_t)update.bits->removed;
+            pState->detectedWidth = update.detection.width;
+            pState->widthSource = update.detection.source;
+            log_receipt_bits(*update.bits, update.detection);
+
+            // Open at the raster header width, or the row period of the bit stream, unless
+            // the width was changed while the file was decoding
+            if (update.detection.width > 0 && pState->currentWidth == DEFAULT_WIDTH) {
+                pState->currentWidth = update.detection.width;
+                SetWindowTextW(pState->hEditWidth, std::to_wstring(update.detection.width).c_str());
+                SendMessage(pState->hSliderWidth, TBM_SETPOS, (WPARAM)TRUE, (LPARAM)update.detection.width);
+            }
+            ApplyLayout(pState);
+            if (pState->following) { // Show the end, where rows are added
+                pState->scrollY = INT_MAX;
+                UpdateScrollbars(pState);
+                if (pState->hCanvas) InvalidateRect(pState->hCanvas, NULL, FALSE);
+            }
+            break;
+
+        case ReceiptUpdate::Kind::Grown: {
+            // The followed capture gained rows: tiles of the rows it left unchanged stay
+            // cached, and a view that showed the end keeps showing it
+            int contentWidth = 0, contentHeight = 0;
+            get_content_size(pState, contentWidth, contentHeight);
+            bool atEnd = pState->scrollY + pState->canvasHeight >= contentHeight;
+            pState->receiptBits = update.bits;
+            pState->bytesRemoved = (size_t)update.bits->removed;
+            pState->tileCache.Extend(update.bits);
+            if (atEnd) pState->scrollY = INT_MAX; // UpdateScrollbars clamps it
+            ApplyLayout(pState);
+        } break;
+
+        case ReceiptUpdate::Kind::Failed: {
+            if (pState->following) { // The pipeline has stopped following
+                pState->following = false;
+                Button_SetCheck(pState->hChkFollow, BST_UNCHECKED);
+                if (pState->followTimer) { KillTimer(pState->hMainWnd, pState->followTimer); pState->followTimer = 0; }
+            }
+            pState->loadingPath.clear();
+            pState->detectedWidth = 0;
+            pState->widthSource = WidthSource::None;
+            std::wstring status = L"Error: " + std::wstring(update.error.begin(), update.error.end());
+            SetWindowTextW(pState->hStatus, status.c_str());
+            if (pState->hCanvas) InvalidateRect(pState->hCanvas, NULL, TRUE);
+            MessageBoxW(pState->hMainWnd, status.c_str(), L"Processing Error", MB_ICONWARNING | MB_OK);
+        } break;
+
+        case ReceiptUpdate::Kind::Tile: {
+            bool shown = update.tile.level == pState->zoomLevel;
+            RECT rcTile = { 0, update.tile.first_row - pState->scrollY, pState->canvasWidth,
+                            update.tile.first_row + update.tile.rows - pState->scrollY };
+            pState->tileCache.Insert(std::move(update.tile));
+            if (shown && pState->hCanvas) InvalidateRect(pState->hCanvas, &rcTile, FALSE);
+        } break;
+        }
+    }
+}
+
+
 void UpdateScrollbars(AppState* pState) {
      if (!pState || !pState->hCanvas) return;
 
@@ -1018,14 +1441,17 @@ void UpdateScrollbars(AppState* pState) {
      si.fMask = SIF_RANGE | SIF_PAGE | SIF_POS;
 
 
-     int imageWidth = (pState->currentBitmap) ? pState->currentBitmap->GetWidth() : 0;
-
      RECT canvasClientRect;
      GetClientRect(pState->hCanvas, &canvasClientRect);
      pState->canvasWidth = canvasClientRect.right;
 
-     if (pState->currentBitmap && imageWidth > pState->canvasWidth) {
+     int imageWidth = 0, imageHeight = 0;
+     get_content_size(pState, imageWidth, imageHeight);
+     bool hasImage = imageHeight > 0;
 
+     if (hasImage && imageWidth > pState->canvasWidth) {
+
+         pState->scrollX = std::min(pState->scrollX, imageWidth - pState->canvasWidth);
          si.nMin = 0;
          si.nMax = imageWidth - 1;
          si.nPage = pState->canvasWidth;
@@ -1041,11 +1467,11 @@ void UpdateScrollbars(AppState* pState) {
      SetScrollInfo(pState->hCanvas, SB_HORZ, &si, TRUE);
 
 
-      int imageHeight = (pState->currentBitmap) ? pState->currentBitmap->GetHeight() : 0;
       pState->canvasHeight = canvasClientRect.bottom;
 
-      if (pState->currentBitmap && imageHeight > pState->canvasHeight) {
+      if (hasImage && imageHeight > pState->canvasHeight) {
 
+         pState->scrollY = std::min(pState->scrollY, imageHeight - pState->canvasHeight);
          si.nMin = 0;
          si.nMax = imageHeight -1;
          si.nPage = pState->canvasHeight;
@@ -1102,26 +1528,48 @@ void OnPaintCanvas(HWND hWnd, AppState* pState) {
      graphicsMem.FillRectangle(&backgroundBrush, 0, 0, clientWidth, clientHeight);
 
 
-     if (pState->currentBitmap) {
-
-          Gdiplus::Rect destRect(0, 0, clientWidth, clientHeight);
+     if (pState->browsing) {
+          PaintThumbnailGrid(hdcMem, graphicsMem, pState, clientHeight);
 
-          Gdiplus::Rect srcRect(pState->scrollX, pState->scrollY,
-                                 clientWidth,
-                                 clientHeight);
-
-         graphicsMem.DrawImage(
-             pState->currentBitmap.get(),
-             destRect,
-             srcRect.X, srcRect.Y,
-             srcRect.Width, srcRect.Height,
-             Gdiplus::UnitPixel,
-             nullptr);
+     } else if (pState->bitmapHeight > 0) {
+          // Cached tiles of the zoom level are drawn and missing ones requested from the
+          // pipeline; until they arrive their rows show as blank paper. Full-size tiles are
+          // inverted by the raster operation if need be, zoomed-out 8-bit ones by the palette.
+          int level = pState->zoomLevel;
+          GrayBitmapInfo bmi;
+          init_gray_bitmap_info(bmi, pState->invertPolarity);
+          if (level == 0) {
+              bmi.bmiHeader.biBitCount = 32;
+              bmi.bmiHeader.biClrUsed = 0;
+          }
+          int firstRow = pState->scrollY;
+          int endRow = std::min(pState->scrollY + clientHeight, pState->tileCache.rows(level));
+          DWORD rop = pState->invertPolarity && level == 0 ? NOTSRCCOPY : SRCCOPY;
+          Gdiplus::SolidBrush paperBrush(pState->invertPolarity ? Gdiplus::Color(255, 0, 0, 0) : Gdiplus::Color(255, 255, 255, 255));
+          graphicsMem.FillRectangle(&paperBrush, -pState->scrollX, 0, ReceiptTileCache::LevelSize(pState->bitmapWidth, level),
+                                    std::max(endRow - firstRow, 0));
+          graphicsMem.Flush(Gdiplus::FlushIntentionSync); // The background goes down before the GDI blits
+          for (int index = firstRow / ReceiptTileCache::TILE_ROWS; index * ReceiptTileCache::TILE_ROWS < endRow; ++index) {
+              const ReceiptTileCache::Tile* tile = pState->tileCache.Find(index, level);
+              if (!tile) continue;
+              bmi.bmiHeader.biWidth = tile->width;
+              bmi.bmiHeader.biHeight = -tile->rows; // Top-down
+              const void* bits = level == 0 ? (const void*)tile->pixels.data() : (const void*)tile->gray.data();
+              StretchDIBits(hdcMem,
+                            -pState->scrollX, tile->first_row - pState->scrollY, tile->width, tile->rows,
+                            0, 0, tile->width, tile->rows,
+                            bits, reinterpret_cast<const BITMAPINFO*>(&bmi), DIB_RGB_COLORS, rop);
+          }
+          if (pState->pipeline) {
+              pState->pipeline->RenderTiles(pState->generation, pState->tileCache.Missing(firstRow, endRow, ReceiptTileCache::TILE_ROWS, level), level);
+          }
 
      } else {
 
          std::wstring placeholder = L"Select a file...";
-         if (!pState->currentFilePath.empty()) {
+         if (!pState->loadingPath.empty()) {
+             placeholder = L"Processing...";
+         } else if (!pState->currentFilePath.empty()) {
              placeholder = L"Failed to load/process image.";
          }
          Gdiplus::FontFamily fontFamily(L"Segoe UI");
@@ -1149,12 +1597,103 @@ void OnPaintCanvas(HWND hWnd, AppState* pState) {
 }
 
 
+// Draws the visible cells of the folder grid and moves the thumbnails they still lack to the
+// front of the generator's queue; until they arrive the cells show blank. Polarity is applied
+// through the palette, as the receipt view applies it when drawing.
+void PaintThumbnailGrid(HDC hdc, Gdiplus::Graphics& graphics, AppState* pState, int clientHeight) {
+    GrayBitmapInfo bmi;
+    init_gray_bitmap_info(bmi, pState->invertPolarity);
+
+    Gdiplus::FontFamily fontFamily(L"Segoe UI");
+    Gdiplus::Font font(&fontFamily, 8, Gdiplus::FontStyleRegular, Gdiplus::UnitPoint);
+    Gdiplus::SolidBrush textBrush(Gdiplus::Color(0, 0, 0));
+    Gdiplus::SolidBrush blankBrush(Gdiplus::Color(255, 224, 224, 224));
+    Gdiplus::StringFormat strFormat;
+    strFormat.SetAlignment(Gdiplus::StringAlignmentCenter);
+    strFormat.SetFormatFlags(Gdiplus::StringFormatFlagsNoWrap);
+    strFormat.SetTrimming(Gdiplus::StringTrimmingEllipsisCharacter);
+
+    int columns = grid_columns(pState);
+    size_t first = (size_t)(pState->scrollY / GRID_CELL_HEIGHT) * columns;
+    size_t end = std::min(pState->browseItems.size(), (size_t)((pState->scrollY + clientHeight) / GRID_CELL_HEIGHT + 1) * columns);
+    std::vector<std::filesystem::path> visible;
+    for (size_t i = first; i < end; ++i) {
+        BrowseItem& item = pState->browseItems[i];
+        RECT rcCell = grid_cell_rect(pState, i);
+        if (!item.thumbnail) {
+            graphics.FillRectangle(&blankBrush, rcCell.left + PADDING, rcCell.top + PADDING, THUMBNAIL_WIDTH, GRID_THUMB_HEIGHT);
+        }
+        if (item.state == BrowseItem::State::New || item.state == BrowseItem::State::Queued) {
+            item.state = BrowseItem::State::Urgent;
+            visible.push_back(item.path);
+        }
+        std::wstring label = item.path.filename().wstring();
+        if (item.state == BrowseItem::State::Failed) label = L"(no image) " + label;
+        Gdiplus::RectF rcLabel((Gdiplus::REAL)rcCell.left + PADDING / 2, (Gdiplus::REAL)rcCell.top + PADDING + GRID_THUMB_HEIGHT + 2,
+                               (Gdiplus::REAL)GRID_CELL_WIDTH - PADDING, (Gdiplus::REAL)GRID_LABEL_HEIGHT);
+        graphics.DrawString(label.c_str(), -1, &font, rcLabel, &strFormat, &textBrush);
+    }
+    graphics.Flush(Gdiplus::FlushIntentionSync); // The background goes down before the GDI blits
+
+    // DIB rows are DWORD aligned; thumbnails are packed
+    std::vector<BYTE> rows;
+    for (size_t i = first; i < end; ++i) {
+        const BrowseItem& item = pState->browseItems[i];
+        if (!item.thumbnail) continue;
+        const Thumbnail& t = *item.thumbnail;
+        int shown = std::min(t.height, GRID_THUMB_HEIGHT);
+        size_t stride = ((size_t)t.width + 3) & ~(size_t)3;
+        rows.assign(stride * shown, 0);
+        for (int y = 0; y < shown; ++y) std::memcpy(rows.data() + stride * y, t.pixels.data() + (size_t)t.width * y, t.width);
+        bmi.bmiHeader.biWidth = t.width;
+        bmi.bmiHeader.biHeight = -shown; // Top-down
+        RECT rcCell = grid_cell_rect(pState, i);
+        StretchDIBits(hdc,
+                      rcCell.left + PADDING + (THUMBNAIL_WIDTH - t.width) / 2, rcCell.top + PADDING, t.width, shown,
+                      0, 0, t.width, shown,
+                      rows.data(), reinterpret_cast<const BITMAPINFO*>(&bmi), DIB_RGB_COLORS, SRCCOPY);
+    }
+    if (pState->thumbnails) pState->thumbnails->Request(visible, true);
+}
+
+
+// Shows the receipt at 1 : 1 << level (the tile cache's zoom levels), keeping the spot under
+// (anchorX, anchorY) of the canvas where it is
+void ZoomCanvas(AppState* pState, int level, int anchorX, int anchorY) {
+    level = std::clamp(level, 0, ReceiptTileCache::MAX_LEVEL);
+    if (pState->browsing || pState->bitmapHeight == 0 || level == pState->zoomLevel) return;
+    int64_t x = ((int64_t)pState->scrollX + anchorX) << pState->zoomLevel;
+    int64_t y = ((int64_t)pState->scrollY + anchorY) << pState->zoomLevel;
+    pState->zoomLevel = level;
+    pState->scrollX = (int)std::max<int64_t>((x >> level) - anchorX, 0);
+    pState->scrollY = (int)std::max<int64_t>((y >> level) - anchorY, 0);
+    ApplyLayout(pState); // Same layout: updates the status, clamps the scroll position and repaints
+}
+
+
+// Scrolls the start of the next (step 1) or previous (step -1) receipt of the capture to
+// the top of the view; the cuts were found while decoding, so nothing is scanned again.
+// Stepping back from inside a receipt goes to its own start first.
+void StepReceipt(AppState* pState, int step) {
+    if (pState->browsing || pState->bitmapHeight == 0 || pState->receiptRows.size() < 2) return;
+    size_t current = current_receipt(pState);
+    size_t target = current;
+    if (step > 0) target = std::min(current + 1, pState->receiptRows.size() - 1);
+    else if (pState->scrollY == pState->receiptRows[current] && current > 0) target = current - 1;
+    pState->scrollY = pState->receiptRows[target];
+    ApplyLayout(pState);
+}
+
+
 void OnScrollCanvas(HWND hWnd, AppState* pState, int bar, WPARAM wParam) {
 
-     if (!pState || !pState->currentBitmap) return;
+     if (!pState) return;
+     int contentWidth = 0, contentHeight = 0;
+     get_content_size(pState, contentWidth, contentHeight);
+     if (contentHeight == 0) return;
 
      SCROLLINFO si = { sizeof(si) };
-     si.fMask = SIF_POS | SIF_RANGE | SIF_PAGE;
+     si.fMask = SIF_POS | SIF_RANGE | SIF_PAGE | SIF_TRACKPOS;
      GetScrollInfo(hWnd, bar, &si);
 
      int currentPos = si.nPos;
@@ -1180,7 +1719,7 @@ void OnScrollCanvas(HWND hWnd, AppState* pState, int bar, WPARAM wParam) {
              break;
          case SB_THUMBTRACK:
          case SB_THUMBPOSITION:
-             scrollAmount = HIWORD(wParam) - currentPos;
+             scrollAmount = si.nTrackPos - currentPos; // HIWORD(wParam) is 16-bit, too small for long rolls
              break;
          case SB_LEFT:
               scrollAmount = -currentPos;
@@ -1206,6 +1745,9 @@ void OnScrollCanvas(HWND hWnd, AppState* pState, int bar, WPARAM wParam) {
          si.fMask = SIF_POS;
          si.nPos = newPos;
          SetScrollInfo(hWnd, bar, &si, TRUE);
+         if (bar == SB_VERT && !pState->browsing && pState->receiptRows.size() > 1) {
+             SetWindowTextW(pState->hStatus, layout_status(pState).c_str()); // The receipt at the top may have changed
+         }
 
          ScrollWindowEx(hWnd,
                         (bar == SB_HORZ ? currentPos - newPos : 0),
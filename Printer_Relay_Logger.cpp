@@ -24,6 +24,11 @@
 #include <cstdio> // For sprintf_s
 #include <algorithm> // For std::replace, std::remove, std::isspace
 #include <sstream> // For string manipulation
+#include <memory> // For std::shared_ptr
+
+#include "Common/capture_format.h" // Raw/framed capture writer
+#include "Common/job_catalog.h" // Per-session job records
+#include "Common/receipt_split.h" // Receipt boundaries of the session
 
 // Link with Ws2_32.lib
 #pragma comment(lib, "Ws2_32.lib")
@@ -42,6 +47,9 @@ const std::string LOG_FILENAME_SUFFIX = ".log";
 const char* LOG_FILENAME_FORMAT = "%Y-%m-%d_%H"; // Format for strftime used in filename
 const int LOG_BACKUP_COUNT = 720; // Keep the last ~30 days (720 hours) of hourly log files
 const std::string DATA_DIRECTORY = "printer_data"; // Directory to save relayed data
+CaptureFormat g_capture_format = CaptureFormat::Raw; // "raw" (.bin, client->printer only) or "framed" (.cap, both directions with timing)
+bool g_pcapng_output = false; // Also write each session as a synthetic TCP flow to data_*.pcapng
+JobCatalogWriter g_job_catalog; // printer_data/catalog.jcl, one record per session
 
 // Log level - Simplified for this example (0=Info, 1=Debug)
 const int LOG_LEVEL = 0; // 0 = Info, 1 = Debug
@@ -111,6 +119,16 @@ bool ParseIniFile(const std::string& filename,
         } else if (key == "RelayPort") {
             relay_port = value;
             found_config = true;
+        } else if (key == "CaptureFormat") {
+            if (value == "framed") {
+                g_capture_format = CaptureFormat::Framed;
+            } else if (value == "raw") {
+                g_capture_format = CaptureFormat::Raw;
+            } else {
+                std::cerr << "[WARN] Unknown CaptureFormat '" << value << "' in INI file. Using raw." << std::endl;
+            }
+        } else if (key == "PcapngOutput") {
+            g_pcapng_output = (value == "1" || value == "true" || value == "yes");
         }
     }
 
@@ -201,7 +219,7 @@ std::string GenerateLogFilename(int hour) {
 }
 
 // Helper function to generate data filename
-std::string GenerateDataFilename(const std::string& log_prefix) {
+std::string GenerateDataFilename(const std::string& log_prefix, const std::string& extension = RAW_CAPTURE_EXTENSION) {
     std::string timestamp = GetTimestamp();
     // Sanitize timestamp for filename (replace :, . with _)
     std::replace(timestamp.begin(), timestamp.end(), ':', '_');
@@ -219,7 +237,7 @@ std::string GenerateDataFilename(const std::string& log_prefix) {
 
 
     std::filesystem::path dir_path = DATA_DIRECTORY;
-    std::filesystem::path file_path = dir_path / ("data_" + timestamp + "_" + client_info + ".bin");
+    std::filesystem::path file_path = dir_path / ("data_" + timestamp + "_" + client_info + extension);
     return file_path.string();
 }
 
@@ -333,58 +351,62 @@ void Log(int level, const std::string& message) {
 
 // --- Networking Logic ---
 
+// Totals of one pipe direction, read by HandleClientThread after the join for the job record
+struct PipeResult {
+    uint64_t total_bytes = 0;
+    uint32_t crc = 0; // CRC32C of everything received from the source
+    JobOutcome outcome = JobOutcome::Completed;
+    ReceiptSplitter receipts; // Client -> printer only: where the paper was cut
+};
+
 // Function executed by the pipe threads
-void PipeDataThread(SOCKET source_socket, SOCKET dest_socket, const std::string& source_desc, const std::string& dest_desc, const std::string& log_prefix) {
+// Both directions share one CaptureWriter; it decides which direction reaches the file.
+void PipeDataThread(SOCKET source_socket, SOCKET dest_socket, const std::string& source_desc, const std::string& dest_desc, const std::string& log_prefix,
+                    std::shared_ptr<CaptureWriter> capture, PipeResult* pipe_result) {
     char buffer[BUFFER_SIZE];
     int bytes_received;
     int bytes_sent;
-    int total_bytes = 0;
+    uint64_t total_bytes = 0;
+    uint32_t crc = 0;
+    JobOutcome outcome = JobOutcome::Completed;
     int result;
-    std::ofstream data_file;
-    std::string data_filename;
     bool is_client_to_relay = source_desc.rfind("Client ", 0) == 0 && dest_desc.rfind("Relay ", 0) == 0;
+    CaptureFrameKind direction = is_client_to_relay ? CaptureFrameKind::ClientToPrinter : CaptureFrameKind::PrinterToClient;
+    bool capture_ok = capture && capture->is_open();
 
     Log(0, log_prefix + "Starting pipe: " + source_desc + " -> " + dest_desc);
 
-    // If client -> relay, open data file
-    if (is_client_to_relay) {
-        data_filename = GenerateDataFilename(log_prefix);
-        data_file.open(data_filename, std::ios::binary | std::ios::app); // Append mode just in case, though should be new file
-        if (!data_file.is_open()) {
-            Log(99, log_prefix + "Failed to open data file for writing: " + data_filename);
-            // Continue piping even if file fails? Yes, core functionality is relaying.
-        } else {
-            Log(0, log_prefix + "Opened data file for recording: " + data_filename);
-        }
-    }
-
 
     while (!g_shutdown_requested) {
         bytes_received = recv(source_socket, buffer, sizeof(buffer), 0);
 
         if (bytes_received > 0) {
             total_bytes += bytes_received;
+            crc = Crc32cUpdate(crc, buffer, bytes_received);
             Log(0, log_prefix + "Relaying " + std::to_string(bytes_received) + " bytes from " + source_desc + " to " + dest_desc
                   + ". Snippet: [" + DataToHexSnippet(buffer, bytes_received) + "]");
             Log(1, log_prefix + "Data Hex: " + DataToHexSnippet(buffer, bytes_received, bytes_received)); // Full hex if debug
 
-            // Write received data to file if it's client->relay and file is open
-            if (is_client_to_relay && data_file.is_open()) {
-                data_file.write(buffer, bytes_received);
-                if (!data_file) { // Check for write errors
-                    Log(99, log_prefix + "Error writing to data file: " + data_filename);
-                    data_file.close(); // Close file on error
+            // Record received data (the writer closes the file itself on write errors)
+            if (is_client_to_relay && capture_ok) pipe_result->receipts.Feed(reinterpret_cast<const uint8_t*>(buffer), bytes_received);
+            if (capture_ok) {
+                capture_ok = capture->Write(direction, buffer, bytes_received);
+                if (!capture_ok) {
+                    outcome = WorseOutcome(outcome, JobOutcome::CaptureError);
+                    Log(99, log_prefix + "Error writing to data file: " + capture->filename());
                 }
             }
 
             bytes_sent = send(dest_socket, buffer, bytes_received, 0);
             if (bytes_sent == SOCKET_ERROR) {
                 Log(99, log_prefix + "send failed from " + source_desc + " to " + dest_desc + " with error: " + std::to_string(WSAGetLastError()));
+                outcome = WorseOutcome(outcome, JobOutcome::RelayError);
                 break;
             }
             if (bytes_sent != bytes_received) {
                  Log(99, log_prefix + "send did not send all bytes from " + source_desc + " to " + dest_desc + ". Sent: " + std::to_string(bytes_sent) + ", Expected: " + std::to_string(bytes_received));
                 // Potentially handle partial send here, but often break is okay for simple proxy
+                outcome = WorseOutcome(outcome, JobOutcome::RelayError);
                 break;
             }
              Log(1, log_prefix + "Wrote " + std::to_string(bytes_sent) + " bytes to " + dest_desc);
@@ -396,14 +418,18 @@ void PipeDataThread(SOCKET source_socket, SOCKET dest_socket, const std::string&
             int error_code = WSAGetLastError();
              if (error_code == WSAECONNRESET || error_code == WSAECONNABORTED || error_code == WSAESHUTDOWN) {
                  Log(0, log_prefix + "Connection reset/aborted by " + source_desc + " (Error: " + std::to_string(error_code) + ")");
+                 outcome = WorseOutcome(outcome, JobOutcome::Reset);
              } else if (error_code == WSAEINTR) { // Interrupted (maybe by closesocket on this thread's socket)
                   Log(0, log_prefix + "Recv interrupted on " + source_desc);
+                  outcome = WorseOutcome(outcome, JobOutcome::Interrupted);
              }
               else if (g_shutdown_requested) {
                   Log(0, log_prefix + "Recv stopped due to shutdown request on " + source_desc);
+                  outcome = WorseOutcome(outcome, JobOutcome::Interrupted);
               }
              else {
                  Log(99, log_prefix + "recv failed from " + source_desc + " with error: " + std::to_string(error_code));
+                 outcome = WorseOutcome(outcome, JobOutcome::RelayError);
              }
             break; // Error receiving data
         }
@@ -425,14 +451,42 @@ void PipeDataThread(SOCKET source_socket, SOCKET dest_socket, const std::string&
         }
     }
 
-    // Close data file if it was opened
-    if (data_file.is_open()) {
-        data_file.close();
-        Log(0, log_prefix + "Closed data file: " + data_filename);
+    if (g_shutdown_requested) {
+        outcome = WorseOutcome(outcome, JobOutcome::Interrupted);
     }
+    if (is_client_to_relay) pipe_result->receipts.Finish();
+    pipe_result->total_bytes = total_bytes;
+    pipe_result->crc = crc;
+    pipe_result->outcome = outcome;
+    Log(0, log_prefix + "Pipe finished (" + source_desc + " -> " + dest_desc + "). Total bytes: " + std::to_string(total_bytes));
+}
 
 
-    Log(0, log_prefix + "Pipe finished (" + source_desc + " -> " + dest_desc + "). Total bytes: " + std::to_string(total_bytes));
+// Appends the finished session to the job catalog
+void RecordJob(const std::string& log_prefix, JobRecord& job) {
+    job.end_unix_us = UnixTimeUs();
+    if (!g_job_catalog.is_open()) return;
+    if (g_job_catalog.Append(job) == 0) {
+        Log(99, log_prefix + "Failed to append job to catalog.");
+    } else {
+        Log(0, log_prefix + "Cataloged job " + std::to_string(job.job_id) + " (" + JobOutcomeName(job.outcome) + ").");
+    }
+}
+
+
+// Writes the receipt boundaries found while relaying next to the closed capture, so the
+// viewer and capture_tool need not scan it for them
+void RecordReceipts(const std::string& log_prefix, const std::string& data_filename, const ReceiptSplitter& receipts) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(data_filename, ec);
+    if (ec) return;
+    ReceiptIndex index = receipts.Index(size);
+    std::string error;
+    if (!WriteReceiptIndex(data_filename, index, error)) {
+        Log(99, log_prefix + "Failed to write receipt index: " + error);
+    } else {
+        Log(0, log_prefix + "Receipts in data file: " + std::to_string(index.receipts.size()));
+    }
 }
 
 
@@ -442,6 +496,10 @@ void HandleClientThread(SOCKET client_socket, std::string client_addr_str) {
     int result;
     struct addrinfo *relay_addr_result = nullptr, *ptr = nullptr, hints;
     std::string log_prefix = "[" + client_addr_str + "] ";
+    JobRecord job;
+    job.start_unix_us = UnixTimeUs();
+    job.client = client_addr_str;
+    job.upstream = g_relay_host + ":" + g_relay_port_str;
 
     Log(0, log_prefix + "Accepted connection.");
 
@@ -455,6 +513,8 @@ void HandleClientThread(SOCKET client_socket, std::string client_addr_str) {
     if (result != 0) {
         Log(99, log_prefix + "getaddrinfo failed for relay host " + g_relay_host + " with error: " + std::to_string(result));
         closesocket(client_socket);
+        job.outcome = JobOutcome::UpstreamUnavailable;
+        RecordJob(log_prefix, job);
         return;
     }
 
@@ -486,6 +546,8 @@ void HandleClientThread(SOCKET client_socket, std::string client_addr_str) {
     if (relay_socket == INVALID_SOCKET) {
         Log(99, log_prefix + "Unable to connect to relay server " + g_relay_host + ":" + g_relay_port_str); // Use variables
         closesocket(client_socket);
+        job.outcome = JobOutcome::UpstreamUnavailable;
+        RecordJob(log_prefix, job);
         return;
     }
 
@@ -495,18 +557,43 @@ void HandleClientThread(SOCKET client_socket, std::string client_addr_str) {
      std::string relay_desc = "Relay Unknown";
      if (getpeername(relay_socket, (sockaddr*)&relay_peer_addr, &peer_addr_len) == 0) {
          relay_desc = "Relay " + GetAddressString((sockaddr*)&relay_peer_addr);
+         job.upstream = GetAddressString((sockaddr*)&relay_peer_addr);
      }
 
 
     Log(0, log_prefix + "Successfully connected to " + relay_desc);
 
+    // --- Open Data File ---
+    auto capture = std::make_shared<CaptureWriter>();
+    std::string data_filename = GenerateDataFilename(log_prefix,
+        g_capture_format == CaptureFormat::Framed ? FRAMED_CAPTURE_EXTENSION : RAW_CAPTURE_EXTENSION);
+    if (!capture->Open(data_filename, g_capture_format)) {
+        Log(99, log_prefix + "Failed to open data file for writing: " + data_filename);
+        // Continue piping even if file fails? Yes, core functionality is relaying.
+    } else {
+        std::string upstream_addr_str = relay_desc.substr(relay_desc.find(' ') + 1);
+        capture->WriteSession(client_addr_str, upstream_addr_str);
+        job.capture = std::filesystem::path(data_filename).filename().string();
+        Log(0, log_prefix + "Opened data file for recording: " + data_filename);
+        if (g_pcapng_output) {
+            std::string pcapng_filename = std::filesystem::path(data_filename).replace_extension(PCAPNG_EXTENSION).string();
+            if (capture->OpenPcapng(pcapng_filename, client_addr_str, upstream_addr_str)) {
+                Log(0, log_prefix + "Opened pcapng output: " + pcapng_filename);
+            } else {
+                Log(99, log_prefix + "Failed to open pcapng output: " + pcapng_filename);
+            }
+        }
+    }
+
     // --- Start Piping Data ---
     std::string client_desc = "Client " + client_addr_str;
+    PipeResult to_printer;
+    PipeResult from_printer;
 
     try {
         // Create threads for bidirectional piping
-        std::thread client_to_relay_thread(PipeDataThread, client_socket, relay_socket, client_desc, relay_desc, log_prefix);
-        std::thread relay_to_client_thread(PipeDataThread, relay_socket, client_socket, relay_desc, client_desc, log_prefix);
+        std::thread client_to_relay_thread(PipeDataThread, client_socket, relay_socket, client_desc, relay_desc, log_prefix, capture, &to_printer);
+        std::thread relay_to_client_thread(PipeDataThread, relay_socket, client_socket, relay_desc, client_desc, log_prefix, capture, &from_printer);
 
         // Wait for both pipe threads to complete
         client_to_relay_thread.join();
@@ -516,12 +603,34 @@ void HandleClientThread(SOCKET client_socket, std::string client_addr_str) {
 
     } catch (const std::system_error& e) {
         Log(99, log_prefix + "System error creating/joining pipe threads: " + e.what());
+        to_printer.outcome = WorseOutcome(to_printer.outcome, JobOutcome::RelayError);
     } catch (const std::exception& e) {
          Log(99, log_prefix + "Exception creating/joining pipe threads: " + e.what());
+         to_printer.outcome = WorseOutcome(to_printer.outcome, JobOutcome::RelayError);
     }
 
 
     // --- Cleanup ---
+    // Close data file if it was opened (flushes the remaining buffered capture data)
+    bool capture_opened = capture->is_open();
+    if (capture->Close()) {
+        Log(0, log_prefix + "Closed data file: " + data_filename);
+    }
+
+    // --- Record Job ---
+    job.bytes_to_printer = to_printer.total_bytes;
+    job.bytes_from_printer = from_printer.total_bytes;
+    job.crc_to_printer = to_printer.crc;
+    job.crc_from_printer = from_printer.crc;
+    job.flags |= JOB_FLAG_CHECKSUMS;
+    job.outcome = WorseOutcome(to_printer.outcome, from_printer.outcome);
+    if (!capture_opened) {
+        job.outcome = WorseOutcome(job.outcome, JobOutcome::CaptureError); // Open failed or a write error closed it
+    } else {
+        RecordReceipts(log_prefix, data_filename, to_printer.receipts);
+    }
+    RecordJob(log_prefix, job);
+
     Log(0, log_prefix + "Closing connections.");
     if (relay_socket != INVALID_SOCKET) {
         closesocket(relay_socket);
@@ -604,6 +713,12 @@ int main(int argc, char* argv[]) {
           std::cerr << "Error accessing/creating data directory: " << e.what() << ". Attempting to proceed." << std::endl;
       }
 
+    // --- Open Job Catalog ---
+    std::string catalog_error;
+    if (!g_job_catalog.Open(std::filesystem::path(DATA_DIRECTORY) / JOB_CATALOG_FILENAME, catalog_error)) {
+        std::cerr << "[WARN] Job catalog disabled: " << catalog_error << std::endl;
+    }
+
 
     // Initial Log Startup Messages (using std::cout before full logging is setup)
     std::cout << "==================================================" << std::endl;
@@ -611,6 +726,8 @@ int main(int argc, char* argv[]) {
     std::cout << "Listening on: " << g_local_host << ":" << g_local_port_str << std::endl; // Use variables
     std::cout << "Relaying to: " << g_relay_host << ":" << g_relay_port_str << std::endl; // Use variables
     std::cout << "Logging to directory: " << LOG_DIRECTORY << std::endl;
+    std::cout << "Checksums: CRC32C (" << Crc32cImplementation() << ")" << std::endl;
+    std::cout << "Capture format: " << (g_capture_format == CaptureFormat::Framed ? "framed (both directions, timed)" : "raw") << std::endl;
     std::cout << "Log filename format: " << LOG_FILENAME_PREFIX << "<YYYY-MM-DD_HH>" << LOG_FILENAME_SUFFIX << std::endl;
     std::cout << "Keeping " << LOG_BACKUP_COUNT << " backup log files." << std::endl;
     std::cout << "==================================================" << std::endl;
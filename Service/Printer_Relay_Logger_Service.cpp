@@ -25,6 +25,11 @@
 #include <cstdio>
 #include <algorithm>
 #include <sstream>
+#include <memory>
+
+#include "../Common/capture_format.h"
+#include "../Common/job_catalog.h"
+#include "../Common/receipt_split.h"
 
 #pragma comment(lib, "Ws2_32.lib")
 #pragma comment(lib, "Advapi32.lib")
@@ -41,6 +46,9 @@ std::string g_relay_host;
 std::string g_relay_port_str = "9100";
 std::string g_log_directory_name = "printer_logs";
 std::string g_data_directory_name = "printer_data";
+CaptureFormat g_capture_format = CaptureFormat::Raw;
+bool g_pcapng_output = false;
+JobCatalogWriter g_job_catalog;
 const std::string LOG_FILENAME_PREFIX = "printer_log_";
 const std::string LOG_FILENAME_SUFFIX = ".log";
 const char* LOG_FILENAME_FORMAT = "%Y-%m-%d_%H";
@@ -121,6 +129,16 @@ bool ParseIniFile(const std::string& filename,
         } else if (key == "RelayPort") {
             relay_port = value;
             found_config = true;
+        } else if (key == "CaptureFormat") {
+            if (value == "framed") {
+                g_capture_format = CaptureFormat::Framed;
+            } else if (value == "raw") {
+                g_capture_format = CaptureFormat::Raw;
+            } else {
+                Log(99, "[WARN] Unknown CaptureFormat '" + value + "' in INI file. Using raw.");
+            }
+        } else if (key == "PcapngOutput") {
+            g_pcapng_output = (value == "1" || value == "true" || value == "yes");
         }
     }
 
@@ -209,7 +227,7 @@ std::string GenerateLogFilename(int hour) {
      return file_path.string();
 }
 
-std::string GenerateDataFilename(const std::string& log_prefix) {
+std::string GenerateDataFilename(const std::string& log_prefix, const std::string& extension = RAW_CAPTURE_EXTENSION) {
     std::string timestamp = GetTimestamp();
     std::replace(timestamp.begin(), timestamp.end(), ':', '_');
     std::replace(timestamp.begin(), timestamp.end(), '.', '_');
@@ -225,7 +243,7 @@ std::string GenerateDataFilename(const std::string& log_prefix) {
 
     std::filesystem::path dir_path = g_executable_dir;
     dir_path /= g_data_directory_name;
-    std::filesystem::path file_path = dir_path / ("data_" + timestamp + "_" + client_info + ".bin");
+    std::filesystem::path file_path = dir_path / ("data_" + timestamp + "_" + client_info + extension);
     return file_path.string();
 }
 
@@ -351,65 +369,63 @@ void ReportEventLog(WORD type, DWORD eventID, const std::string& message) {
     }
 }
 
-void PipeDataThread(SOCKET source_socket, SOCKET dest_socket, const std::string& source_desc, const std::string& dest_desc, const std::string& log_prefix) {
+// Totals of one pipe direction, read by HandleClientThread after the join for the job record
+struct PipeResult {
+    uint64_t total_bytes = 0;
+    uint32_t crc = 0; // CRC32C of everything received from the source
+    JobOutcome outcome = JobOutcome::Completed;
+    ReceiptSplitter receipts; // Client -> printer only: where the paper was cut
+};
+
+void PipeDataThread(SOCKET source_socket, SOCKET dest_socket, const std::string& source_desc, const std::string& dest_desc, const std::string& log_prefix,
+                    std::shared_ptr<CaptureWriter> capture, PipeResult* pipe_result) {
     char buffer[BUFFER_SIZE];
     int bytes_received;
     int bytes_sent;
-    int total_bytes = 0;
+    uint64_t total_bytes = 0;
+    uint32_t crc = 0;
+    JobOutcome outcome = JobOutcome::Completed;
     int result;
-    std::ofstream data_file;
-    std::string data_filename;
     bool is_client_to_relay = source_desc.rfind("Client ", 0) == 0 && dest_desc.rfind("Relay ", 0) == 0;
+    CaptureFrameKind direction = is_client_to_relay ? CaptureFrameKind::ClientToPrinter : CaptureFrameKind::PrinterToClient;
+    bool capture_ok = capture && capture->is_open();
 
     Log(0, log_prefix + "Starting pipe: " + source_desc + " -> " + dest_desc);
 
-    if (is_client_to_relay) {
-        std::filesystem::path data_dir_path = g_executable_dir;
-        data_dir_path /= g_data_directory_name;
-        try {
-            if (!std::filesystem::exists(data_dir_path)) {
-                std::filesystem::create_directories(data_dir_path);
-            }
-            data_filename = GenerateDataFilename(log_prefix);
-            data_file.open(data_filename, std::ios::binary | std::ios::app);
-            if (!data_file.is_open()) {
-                 Log(99, log_prefix + "Failed to open data file for writing: " + data_filename);
-                 ReportEventLog(EVENTLOG_WARNING_TYPE, 3001, log_prefix + "Failed to open data file: " + data_filename);
-            } else {
-                 Log(0, log_prefix + "Opened data file for recording: " + data_filename);
-            }
-        } catch (const std::exception& e) {
-             Log(99, log_prefix + "Error preparing data directory/file " + data_filename + ": " + e.what());
-             ReportEventLog(EVENTLOG_WARNING_TYPE, 3002, log_prefix + "Error preparing data file " + data_filename + ": " + e.what());
-        }
-
-    }
-
     while (!g_shutdown_requested) {
         bytes_received = recv(source_socket, buffer, sizeof(buffer), 0);
 
         if (bytes_received > 0) {
             total_bytes += bytes_received;
+            crc = Crc32cUpdate(crc, buffer, bytes_received);
             Log(0, log_prefix + "Relaying " + std::to_string(bytes_received) + " bytes from " + source_desc + " to " + dest_desc
                   + ". Snippet: [" + DataToHexSnippet(buffer, bytes_received) + "]");
             Log(1, log_prefix + "Data Hex: " + DataToHexSnippet(buffer, bytes_received, bytes_received));
 
-            if (is_client_to_relay && data_file.is_open()) {
-                data_file.write(buffer, bytes_received);
-                if (!data_file) {
-                    Log(99, log_prefix + "Error writing to data file: " + data_filename);
-                    ReportEventLog(EVENTLOG_WARNING_TYPE, 3003, log_prefix + "Error writing data file: " + data_filename);
-                    data_file.close();
+            if (is_client_to_relay && capture_ok) pipe_result->receipts.Feed(reinterpret_cast<const uint8_t*>(buffer), bytes_received);
+            if (capture_ok) {
+                capture_ok = capture->Write(direction, buffer, bytes_received);
+                if (!capture_ok) {
+                    outcome = WorseOutcome(outcome, JobOutcome::CaptureError);
+                    Log(99, log_prefix + "Error writing to data file: " + capture->filename());
+                    ReportEventLog(EVENTLOG_WARNING_TYPE, 3003, log_prefix + "Error writing data file: " + capture->filename());
+                }
+                std::string pcapng_error;
+                if (capture->TakePcapngError(pcapng_error)) {
+                    Log(99, log_prefix + pcapng_error);
+                    ReportEventLog(EVENTLOG_WARNING_TYPE, 3005, log_prefix + pcapng_error);
                 }
             }
 
             bytes_sent = send(dest_socket, buffer, bytes_received, 0);
             if (bytes_sent == SOCKET_ERROR) {
                 Log(99, log_prefix + "send failed from " + source_desc + " to " + dest_desc + " with error: " + std::to_string(WSAGetLastError()));
+                outcome = WorseOutcome(outcome, JobOutcome::RelayError);
                 break;
             }
             if (bytes_sent != bytes_received) {
                  Log(99, log_prefix + "send did not send all bytes from " + source_desc + " to " + dest_desc + ". Sent: " + std::to_string(bytes_sent) + ", Expected: " + std::to_string(bytes_received));
+                 outcome = WorseOutcome(outcome, JobOutcome::RelayError);
                 break;
             }
              Log(1, log_prefix + "Wrote " + std::to_string(bytes_sent) + " bytes to " + dest_desc);
@@ -421,12 +437,16 @@ void PipeDataThread(SOCKET source_socket, SOCKET dest_socket, const std::string&
             int error_code = WSAGetLastError();
              if (error_code == WSAECONNRESET || error_code == WSAECONNABORTED || error_code == WSAESHUTDOWN) {
                  Log(0, log_prefix + "Connection reset/aborted by " + source_desc + " (Error: " + std::to_string(error_code) + ")");
+                 outcome = WorseOutcome(outcome, JobOutcome::Reset);
              } else if (error_code == WSAEINTR) {
                   Log(0, log_prefix + "Recv interrupted on " + source_desc);
+                  outcome = WorseOutcome(outcome, JobOutcome::Interrupted);
              } else if (g_shutdown_requested) {
                   Log(0, log_prefix + "Recv stopped due to shutdown request on " + source_desc);
+                  outcome = WorseOutcome(outcome, JobOutcome::Interrupted);
              } else {
                  Log(99, log_prefix + "recv failed from " + source_desc + " with error: " + std::to_string(error_code));
+                 outcome = WorseOutcome(outcome, JobOutcome::RelayError);
              }
             break;
         }
@@ -444,19 +464,51 @@ void PipeDataThread(SOCKET source_socket, SOCKET dest_socket, const std::string&
         }
     }
 
-    if (data_file.is_open()) {
-        data_file.close();
-        Log(0, log_prefix + "Closed data file: " + data_filename);
+    if (g_shutdown_requested) {
+        outcome = WorseOutcome(outcome, JobOutcome::Interrupted);
     }
-
+    if (is_client_to_relay) pipe_result->receipts.Finish();
+    pipe_result->total_bytes = total_bytes;
+    pipe_result->crc = crc;
+    pipe_result->outcome = outcome;
     Log(0, log_prefix + "Pipe finished (" + source_desc + " -> " + dest_desc + "). Total bytes: " + std::to_string(total_bytes));
 }
 
+// Appends the finished session to the job catalog
+void RecordJob(const std::string& log_prefix, JobRecord& job) {
+    job.end_unix_us = UnixTimeUs();
+    if (!g_job_catalog.is_open()) return;
+    std::string error;
+    if (g_job_catalog.Append(job, error) == 0) {
+        Log(99, log_prefix + "Failed to append job to catalog: " + error);
+        ReportEventLog(EVENTLOG_WARNING_TYPE, 3004, log_prefix + "Failed to append job to catalog: " + error);
+    } else {
+        Log(0, log_prefix + "Cataloged job " + std::to_string(job.job_id) + " (" + JobOutcomeName(job.outcome) + ").");
+    }
+}
+
+// Writes the receipt boundaries found while relaying next to the closed capture
+void RecordReceipts(const std::string& log_prefix, const std::string& data_filename, const ReceiptSplitter& receipts) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(data_filename, ec);
+    if (ec) return;
+    ReceiptIndex index = receipts.Index(size);
+    std::string error;
+    if (!WriteReceiptIndex(data_filename, index, error)) {
+        Log(99, log_prefix + "Failed to write receipt index: " + error);
+    }
+}
+
+
 void HandleClientThread(SOCKET client_socket, std::string client_addr_str) {
     SOCKET relay_socket = INVALID_SOCKET;
     int result;
     struct addrinfo *relay_addr_result = nullptr, *ptr = nullptr, hints;
     std::string log_prefix = "[" + client_addr_str + "] ";
+    JobRecord job;
+    job.start_unix_us = UnixTimeUs();
+    job.client = client_addr_str;
+    job.upstream = g_relay_host + ":" + g_relay_port_str;
 
     Log(0, log_prefix + "Accepted connection.");
 
@@ -469,6 +521,8 @@ void HandleClientThread(SOCKET client_socket, std::string client_addr_str) {
     if (result != 0) {
         Log(99, log_prefix + "getaddrinfo failed for relay host " + g_relay_host + " with error: " + std::to_string(result));
         closesocket(client_socket);
+        job.outcome = JobOutcome::UpstreamUnavailable;
+        RecordJob(log_prefix, job);
         return;
     }
 
@@ -497,6 +551,8 @@ void HandleClientThread(SOCKET client_socket, std::string client_addr_str) {
     if (relay_socket == INVALID_SOCKET) {
         Log(99, log_prefix + "Unable to connect to relay server " + g_relay_host + ":" + g_relay_port_str);
         closesocket(client_socket);
+        job.outcome = JobOutcome::UpstreamUnavailable;
+        RecordJob(log_prefix, job);
         return;
     }
 
@@ -505,32 +561,98 @@ void HandleClientThread(SOCKET client_socket, std::string client_addr_str) {
      std::string relay_desc = "Relay Unknown";
      if (getpeername(relay_socket, (sockaddr*)&relay_peer_addr, &peer_addr_len) == 0) {
          relay_desc = "Relay " + GetAddressString((sockaddr*)&relay_peer_addr);
+         job.upstream = GetAddressString((sockaddr*)&relay_peer_addr);
      }
 
     Log(0, log_prefix + "Successfully connected to " + relay_desc);
 
+    auto capture = std::make_shared<CaptureWriter>();
+    std::string data_filename;
+    try {
+        std::filesystem::path data_dir_path = g_executable_dir;
+        data_dir_path /= g_data_directory_name;
+        if (!std::filesystem::exists(data_dir_path)) {
+            std::filesystem::create_directories(data_dir_path);
+        }
+        data_filename = GenerateDataFilename(log_prefix,
+            g_capture_format == CaptureFormat::Framed ? FRAMED_CAPTURE_EXTENSION : RAW_CAPTURE_EXTENSION);
+        if (!capture->Open(data_filename, g_capture_format)) {
+             Log(99, log_prefix + "Failed to open data file for writing: " + data_filename);
+             ReportEventLog(EVENTLOG_WARNING_TYPE, 3001, log_prefix + "Failed to open data file: " + data_filename);
+        } else {
+             std::string upstream_addr_str = relay_desc.substr(relay_desc.find(' ') + 1);
+             capture->WriteSession(client_addr_str, upstream_addr_str);
+             job.capture = std::filesystem::path(data_filename).filename().string();
+             Log(0, log_prefix + "Opened data file for recording: " + data_filename);
+             if (g_pcapng_output) {
+                 std::string pcapng_filename = std::filesystem::path(data_filename).replace_extension(PCAPNG_EXTENSION).string();
+                 if (capture->OpenPcapng(pcapng_filename, client_addr_str, upstream_addr_str)) {
+                     Log(0, log_prefix + "Opened pcapng output: " + pcapng_filename);
+                 } else {
+                     Log(99, log_prefix + "Failed to open pcapng output: " + pcapng_filename);
+                 }
+             }
+        }
+    } catch (const std::exception& e) {
+         Log(99, log_prefix + "Error preparing data directory/file " + data_filename + ": " + e.what());
+         ReportEventLog(EVENTLOG_WARNING_TYPE, 3002, log_prefix + "Error preparing data file " + data_filename + ": " + e.what());
+    }
+
     std::string client_desc = "Client " + client_addr_str;
+    PipeResult to_printer;
+    PipeResult from_printer;
     std::thread client_to_relay_thread;
     std::thread relay_to_client_thread;
 
+    // The pipe threads are joined (this handler thread is itself detached) so the shared
+    // capture is flushed and closed once both directions are done.
     try {
-        client_to_relay_thread = std::thread(PipeDataThread, client_socket, relay_socket, client_desc, relay_desc, log_prefix);
-        relay_to_client_thread = std::thread(PipeDataThread, relay_socket, client_socket, relay_desc, client_desc, log_prefix);
-        client_to_relay_thread.detach();
-        relay_to_client_thread.detach();
-        Log(1, log_prefix + "Pipe threads detached.");
-
+        client_to_relay_thread = std::thread(PipeDataThread, client_socket, relay_socket, client_desc, relay_desc, log_prefix, capture, &to_printer);
+        relay_to_client_thread = std::thread(PipeDataThread, relay_socket, client_socket, relay_desc, client_desc, log_prefix, capture, &from_printer);
     } catch (const std::system_error& e) {
         Log(99, log_prefix + "System error creating pipe threads: " + e.what());
         ReportEventLog(EVENTLOG_ERROR_TYPE, 4001, log_prefix + "System error creating pipe threads: " + std::string(e.what()));
-         if (relay_socket != INVALID_SOCKET) closesocket(relay_socket);
-         if (client_socket != INVALID_SOCKET) closesocket(client_socket);
+        shutdown(client_socket, SD_BOTH);
+        shutdown(relay_socket, SD_BOTH);
+        to_printer.outcome = JobOutcome::RelayError;
     } catch (const std::exception& e) {
          Log(99, log_prefix + "Exception creating pipe threads: " + e.what());
          ReportEventLog(EVENTLOG_ERROR_TYPE, 4002, log_prefix + "Exception creating pipe threads: " + std::string(e.what()));
-         if (relay_socket != INVALID_SOCKET) closesocket(relay_socket);
-         if (client_socket != INVALID_SOCKET) closesocket(client_socket);
+         shutdown(client_socket, SD_BOTH);
+         shutdown(relay_socket, SD_BOTH);
+         to_printer.outcome = JobOutcome::RelayError;
+    }
+
+    if (client_to_relay_thread.joinable()) client_to_relay_thread.join();
+    if (relay_to_client_thread.joinable()) relay_to_client_thread.join();
+    Log(1, log_prefix + "Pipe threads finished.");
+
+    bool capture_opened = capture->is_open();
+    if (capture->Close()) {
+        Log(0, log_prefix + "Closed data file: " + data_filename);
+    }
+    std::string pcapng_error;
+    if (capture->TakePcapngError(pcapng_error)) {
+        Log(99, log_prefix + pcapng_error);
+        ReportEventLog(EVENTLOG_WARNING_TYPE, 3005, log_prefix + pcapng_error);
     }
+
+    job.bytes_to_printer = to_printer.total_bytes;
+    job.bytes_from_printer = from_printer.total_bytes;
+    job.crc_to_printer = to_printer.crc;
+    job.crc_from_printer = from_printer.crc;
+    job.flags |= JOB_FLAG_CHECKSUMS;
+    job.outcome = WorseOutcome(to_printer.outcome, from_printer.outcome);
+    if (!capture_opened) {
+        job.outcome = WorseOutcome(job.outcome, JobOutcome::CaptureError);
+    } else {
+        RecordReceipts(log_prefix, data_filename, to_printer.receipts);
+    }
+    RecordJob(log_prefix, job);
+
+    closesocket(relay_socket);
+    closesocket(client_socket);
+    Log(0, log_prefix + "Connection handling finished.");
 }
 
 void ReportSvcStatus(DWORD dwCurrentState, DWORD dwWin32ExitCode, DWORD dwWaitHint) {
@@ -652,6 +774,7 @@ DWORD WINAPI ServiceWorkerThread(LPVOID lpParam) {
     Log(0, "  Relay: " + g_relay_host + ":" + g_relay_port_str);
     Log(0, "  Log Dir: " + (std::filesystem::path(g_executable_dir) / g_log_directory_name).string());
     Log(0, "  Data Dir: " + (std::filesystem::path(g_executable_dir) / g_data_directory_name).string());
+    Log(0, std::string("  Checksums: CRC32C (") + Crc32cImplementation() + ")");
 
 
      try {
@@ -670,6 +793,12 @@ DWORD WINAPI ServiceWorkerThread(LPVOID lpParam) {
          ReportEventLog(EVENTLOG_ERROR_TYPE, 5002, "Error creating directories: " + std::string(e.what()));
      }
 
+    std::string catalog_error;
+    if (!g_job_catalog.Open(std::filesystem::path(g_executable_dir) / g_data_directory_name / JOB_CATALOG_FILENAME, catalog_error)) {
+        Log(99, "Job catalog disabled: " + catalog_error);
+        ReportEventLog(EVENTLOG_WARNING_TYPE, 5008, "Job catalog disabled: " + catalog_error);
+    }
+
     struct addrinfo *listen_addr_result = nullptr, hints;
     ZeroMemory(&hints, sizeof(hints));
     hints.ai_family = AF_INET;